@@ -24,7 +24,7 @@ def BENCHMARK(name, pattern):
 
 BENCHMARK("sort_custom", "")
 BENCHMARK("sort", "")
-BENCHMARK("for", r"""499999500000\n""")
+BENCHMARK("for", r"""5e\+11\n""")
 
 BENCHMARK("binary_trees", """stretch tree of depth 13 check: -1
 8192 trees of depth 4 check: -8192
@@ -39,11 +39,15 @@ BENCHMARK("fib", r"""317811
 317811
 317811
 317811\n""")
+BENCHMARK("coroutine", r"""1.2e\+06\n""")
+BENCHMARK("state_machine", r"""1.2e\+06\n""")
+BENCHMARK("interpolation", r"""200000\n""")
+BENCHMARK("invariants", r"""1.80003e\+11\n""")
 BENCHMARK("lit_call", "")
 BENCHMARK("c_call", "")
 
 LANGUAGES = [
-    ("wally",          ["./build/release/Wally", ""],    ".wally"),
+    ("wally",          ["./build/release/Wally"],        ".wally"),
     ("python",         ["python2.7"],                    ".py"),
     ("lua",            ["lua"],                          ".lua"),
     ("luajit (-joff)", ["luajit", "-joff"],              ".lua"),
@@ -155,7 +159,8 @@ def run_benchmark_language(benchmark, language, benchmark_result):
     #         if ratio < 95:
     #             comparison = green(comparison)
     #    else:
-            comparison = "no baseline"
+    if language[0] == "wally":
+        comparison = "no baseline"
     else:
         # Hack: assumes wally gets to run first
         wally_score = benchmark_result["wally"]["score"]
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+
+# Measures what compiling through the IR costs over compiling straight from the syntax tree. Every generated
+# script is run with '--time-phases' once with the IR and once with '--no-ir', and the emit times are compared.
+
+from __future__ import print_function
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+WALLY = './build/release-mingw/Wally.exe' if sys.platform == 'win32' else './build/release/Wally'
+NUM_TRIALS = 5
+
+# Number of groups in each script, every function of a group is about 35 lines and is called once
+SIZES = [2, 8, 20]
+FUNCTIONS_PER_GROUP = 30
+
+PHASE_RE = re.compile(r'^(\S+)\s+(\d+\.\d+)\s', re.MULTILINE)
+
+
+# Loops and branches over plain variables, so every body goes through the IR instead of falling back
+def function_source(index):
+    return """    function f{0}(a, b)
+    {{
+        var x = a + {1};
+        var y = b * 2;
+        var i = 0;
+
+        while (i < 3)
+        {{
+            if (x > y)
+            {{
+                x = x - y;
+            }}
+            else
+            {{
+                y = y - x + {2};
+            }}
+
+            i = i + 1;
+        }}
+
+        var z = x;
+
+        for (var j = 0; j < y; j = j + 2)
+        {{
+            if (j == 4) continue;
+            if (z > 100) break;
+
+            z = z + j * (z > 0 ? 1 : 2);
+        }}
+
+        var label = "f{0}: " + z;
+        return x + y + z + (label == "" || z < 0 ? 1 : 0);
+    }}
+
+""".format(index, index % 7, index % 3 + 1)
+
+
+# Top-level declarations are constants of the script, so the functions are split into groups like in throughput.py
+def generate(groups):
+    lines = []
+
+    for group in range(groups):
+        lines.append('function group{0}()\n{{\n    var total = 0;\n\n'.format(group))
+
+        for i in range(FUNCTIONS_PER_GROUP):
+            lines.append(function_source(group * FUNCTIONS_PER_GROUP + i))
+
+        for i in range(FUNCTIONS_PER_GROUP):
+            index = group * FUNCTIONS_PER_GROUP + i
+            lines.append('    total = total + f{0}({1}, {2});\n'.format(index, index % 5, index % 3 + 1))
+
+        lines.append('    return total;\n}\n\n')
+
+    for group in range(groups):
+        lines.append('print(group{0}());\n'.format(group))
+
+    return ''.join(lines)
+
+
+def run_trial(path, extra_args):
+    args = [WALLY, '--time-phases'] + extra_args + [path]
+    proc = subprocess.Popen(args, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
+    out, err = proc.communicate()
+
+    if proc.returncode != 0:
+        print(err)
+        return None, None
+
+    phases = {}
+
+    for match in PHASE_RE.finditer(err):
+        phases[match.group(1)] = float(match.group(2))
+
+    # Bodies the VM compiles on their first call count as emitted too
+    return phases.get('emit', 0) + phases.get('lazy-emit', 0), out
+
+
+def best_emit(path, extra_args):
+    best = None
+    output = None
+
+    for _ in range(NUM_TRIALS):
+        emitted, output = run_trial(path, extra_args)
+        if emitted is None: sys.exit(1)
+
+        best = emitted if best is None else min(best, emitted)
+
+    return best, output
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare compile times with and without the IR")
+    parser.add_argument('--keep', action='store_true', help='Keep the generated scripts')
+    args = parser.parse_args()
+
+    directory = tempfile.mkdtemp()
+
+    print('{0:>10s} {1:>8s} {2:>12s} {3:>12s} {4:>12s}'.format(
+        'functions', 'lines', 'ir (ms)', 'no-ir (ms)', 'difference'))
+
+    for groups in SIZES:
+        functions = groups * FUNCTIONS_PER_GROUP
+        source = generate(groups)
+        path = os.path.join(directory, 'compile_ir_{0}.wally'.format(groups))
+
+        with open(path, 'w') as file:
+            file.write(source)
+
+        ir, ir_output = best_emit(path, [])
+        no_ir, no_ir_output = best_emit(path, ['--no-ir'])
+
+        if ir_output != no_ir_output:
+            print('Output differs between the IR and --no-ir for {0}'.format(path))
+            sys.exit(1)
+
+        print('{0:10d} {1:8d} {2:12.3f} {3:12.3f} {4:+11.1f}%'.format(
+            functions, source.count('\n') + 1, ir, no_ir, (ir - no_ir) / no_ir * 100))
+
+        if not args.keep: os.remove(path)
+
+    if not args.keep: os.rmdir(directory)
+
+
+main()
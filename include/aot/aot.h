@@ -0,0 +1,128 @@
+#ifndef WALLY_AOT_H
+#define WALLY_AOT_H
+
+#include "vm.h"
+#include "object.h"
+#include "memory.h"
+#include "garbage_collector.h"
+
+// Runtime used by C files generated with '--emit-c'.
+// Each opcode of the interpreter has a counterpart here, so a compiled script behaves exactly like
+// its interpreted version. Generated functions return false after a runtime error has been reported.
+
+#define AOT_PUSH(value)     (*vm.stackTop++ = (value))
+#define AOT_POP()           (*--vm.stackTop)
+#define AOT_PEEK(distance)  (vm.stackTop[-1 - (distance)])
+
+// Leaves the generated function after a runtime error. Functions with 'try' blocks redefine it to
+// look for their handler first.
+#define AOT_THROW() return false
+
+#define AOT_CHECK(call) \
+    do { if (!(call)) AOT_THROW(); } while (false)
+
+#define AOT_BINARY_OP(valueType, op, line) \
+    do { \
+        if (!IS_NUMBER(AOT_PEEK(0)) || !IS_NUMBER(AOT_PEEK(1))) \
+        { \
+            runtimeError(line, "Both operands must be numbers."); \
+            AOT_THROW(); \
+        } \
+        \
+        double b = AS_NUMBER(AOT_POP()); \
+        double a = AS_NUMBER(AOT_POP()); \
+        AOT_PUSH(valueType(a op b)); \
+    } while (false)
+
+// Operators of value.h like numberModulo, which take numbers and return one
+#define AOT_NUMBER_FUNCTION_OP(function, line) \
+    do { \
+        if (!IS_NUMBER(AOT_PEEK(0)) || !IS_NUMBER(AOT_PEEK(1))) \
+        { \
+            runtimeError(line, "Both operands must be numbers."); \
+            AOT_THROW(); \
+        } \
+        \
+        double b = AS_NUMBER(AOT_POP()); \
+        double a = AS_NUMBER(AOT_POP()); \
+        AOT_PUSH(NUMBER_VAL(function(a, b))); \
+    } while (false)
+
+// Both operands are known to be numbers
+#define AOT_NUMBER_OP(valueType, op) \
+    do { \
+        double b = AS_NUMBER(AOT_POP()); \
+        double a = AS_NUMBER(AOT_POP()); \
+        AOT_PUSH(valueType(a op b)); \
+    } while (false)
+
+static inline bool aotIsFalsey(Value value)
+{
+    return IS_NULL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+static inline bool aotNegate(uint16_t line)
+{
+    if (!IS_NUMBER(AOT_PEEK(0)))
+    {
+        runtimeError(line, "Operand must be a number.");
+        return false;
+    }
+
+    Value value = AOT_POP();
+    AOT_PUSH(NUMBER_VAL(-AS_NUMBER(value)));
+    return true;
+}
+
+static inline bool aotBitNot(uint16_t line)
+{
+    if (!IS_NUMBER(AOT_PEEK(0)))
+    {
+        runtimeError(line, "Operand must be a number.");
+        return false;
+    }
+
+    Value value = AOT_POP();
+    AOT_PUSH(NUMBER_VAL(numberBitNot(AS_NUMBER(value))));
+    return true;
+}
+
+// Program loading
+Value aotNumber(uint64_t bits);
+Value aotString(const char* chars, uint length);
+ObjFunction* aotNewFunction(const char* name, uint8_t arity, FunctionType type, CompiledFn compiled);
+void aotAddConstant(ObjFunction* function, Value value);
+int aotRun(ObjFunction* script);
+
+// Operations
+bool aotAdd(uint16_t line);
+bool aotDefineVariable(ObjString* name, uint16_t line);
+bool aotDefineArgument(ObjString* name, uint16_t line);
+bool aotGetVariable(ObjString* name, uint16_t line);
+bool aotSetVariable(ObjString* name, uint16_t line);
+bool aotUpdateVariable(ObjString* name, uint8_t op, uint16_t line);
+bool aotDefineFunction(uint16_t line);
+bool aotDefineClass(uint16_t line);
+void aotDefineMethod();
+bool aotInherit(uint16_t line);
+bool aotInvoke(ObjString* name, uint8_t argCount, uint16_t line);
+bool aotGetBase(ObjString* name, uint16_t line);
+bool aotGetProperty(ObjString* name, uint16_t line);
+bool aotSetProperty(ObjString* name, uint16_t line);
+bool aotUpdateProperty(ObjString* name, uint8_t op, uint16_t line);
+void aotScopeStart();
+void aotScopeEnd();
+void aotScopeOwn();
+bool aotCall(uint8_t argCount, uint16_t line);
+void aotCatch(ObjFunction* function, int frameCount, Environment* environment, uint8_t scopeDepth, Value* stackTop);
+void aotBuildList(uint8_t count);
+bool aotBuildString(uint8_t count, uint16_t line);
+bool aotSubscriptGet(uint16_t line);
+
+// 1 if the next item was pushed, 0 at the end and -1 on errors
+int aotForeachNext(uint16_t line);
+int aotForRange(bool isRangeSyntax, uint16_t line);
+void aotStepCached(Value* slot, Value step);
+bool aotSubscriptStore(uint16_t line);
+
+#endif //WALLY_AOT_H
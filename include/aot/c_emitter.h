@@ -0,0 +1,13 @@
+#ifndef WALLY_C_EMITTER_H
+#define WALLY_C_EMITTER_H
+
+#include <stdio.h>
+
+#include "object.h"
+
+// Translates the bytecode of a script and every function it contains into a C file which links
+// against the Wally runtime (built with -DBUILD_LIBRARY=1). Returns false if the script uses something
+// that can't be compiled ahead of time.
+bool emitC(ObjFunction* script, const char* sourceName, FILE* out);
+
+#endif //WALLY_C_EMITTER_H
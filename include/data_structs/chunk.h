@@ -28,16 +28,43 @@ typedef enum {
     OP_SUBTRACT,
     OP_MULTIPLY,
     OP_DIVIDE,
+    OP_MODULO,
+    OP_INT_DIVIDE,
+
+    // Bitwise operations, see numberBitAnd
+    OP_BIT_AND,
+    OP_BIT_OR,
+    OP_BIT_XOR,
+    OP_SHIFT_LEFT,
+    OP_SHIFT_RIGHT,
+    OP_BIT_NOT,
+
+    // Operations on operands whose types were inferred while compiling, they aren't checked
+    OP_NEGATE_NUMBER,
+    OP_ADD_NUMBERS,
+    OP_SUBTRACT_NUMBERS,
+    OP_MULTIPLY_NUMBERS,
+    OP_DIVIDE_NUMBERS,
+    OP_GREATER_NUMBERS,
+    OP_GREATER_EQUAL_NUMBERS,
+    OP_LESS_NUMBERS,
+    OP_LESS_EQUAL_NUMBERS,
+    OP_CONCATENATE,
+
+    // Specialized with a profile, the operands are still checked
+    OP_ADD_LIKELY_NUMBERS,
 
     // Variables
     OP_DEFINE_VARIABLE,
     OP_DEFINE_ARGUMENT,
     OP_GET_VARIABLE,
     OP_SET_VARIABLE,
+    OP_UPDATE_VARIABLE, // 'x op= y', the operator's opcode follows the name
 
     // Scope
     OP_SCOPE_START,
     OP_SCOPE_END,
+    OP_SCOPE_OWN,
 
     // Control flow
     OP_JUMP_IF_FALSE,
@@ -45,11 +72,41 @@ typedef enum {
     OP_JUMP,
     OP_LOOP,
 
+    // Control flow, popping the condition
+    OP_POP_JUMP_IF_FALSE,
+    OP_POP_JUMP_IF_TRUE,
+    OP_POP_LOOP_IF_TRUE,
+
+    // Switch, jumping to a case of one of the chunk's switch tables
+    OP_JUMP_TABLE,
+    OP_SWITCH_STRING,
+    OP_SWITCH_SEARCH,
+
+    // Loops
+    OP_FOREACH_NEXT,
+    OP_FOR_RANGE,
+
+    // Values computed once for a loop, kept in its hidden stack slots
+    OP_GET_CACHED,
+    OP_SET_CACHED,
+    OP_STEP_CACHED,
+
+    // Parameters and variables promoted to stack slots by the IR
+    OP_GET_LOCAL,
+    OP_SET_LOCAL,
+
     // Functions
     OP_CALL,
     OP_RETURN,
     OP_DEFINE_FUNCTION,
 
+    // Coroutines
+    OP_RESUME,
+    OP_YIELD,
+
+    // Strings
+    OP_BUILD_STRING,
+
     // List / Indexing
     OP_BUILD_LIST,
     OP_SUBSCRIPT_STORE,
@@ -59,6 +116,7 @@ typedef enum {
     OP_DEFINE_CLASS,
     OP_GET_PROPERTY,
     OP_SET_PROPERTY,
+    OP_UPDATE_PROPERTY, // Like OP_UPDATE_VARIABLE, leaves the value like OP_SET_PROPERTY
     OP_DEFINE_METHOD,
     OP_INVOKE,
     OP_INHERIT,
@@ -66,10 +124,42 @@ typedef enum {
 
     // Misc
     OP_POP,
-    OP_TERNARY,
+    OP_DUP,
     OP_SWITCH_EQUAL,
+    OP_PROFILE,
 } OpCode;
 
+// Protects the code in [start, end). Consulted only when a runtime error is raised,
+// so entering a 'try' block doesn't execute anything.
+typedef struct {
+    uint start;
+    uint end;
+    uint handler;
+
+    uint8_t scopeDepth; // Scopes opened inside the function at the 'try', the rest are closed when catching
+    uint8_t stackDepth; // Values kept on the stack by the loops and switches around the 'try'
+} ExceptionHandler;
+
+// No case matched, the switch instruction falls through
+#define NO_SWITCH_TARGET 0
+
+// OP_STEP_CACHED empties slots which reach this, integers past it aren't all exact
+#define MAX_EXACT_INTEGER 9007199254740992.0
+
+typedef struct {
+    Value key;   // NULL_VAL in unused slots of OP_JUMP_TABLE and OP_SWITCH_STRING tables
+    uint target;
+} SwitchCase;
+
+// Cases of a 'switch' whose values are all constants. How they are laid out depends on the instruction using it:
+// OP_JUMP_TABLE indexes them by the integer minus 'low', OP_SWITCH_STRING hashes the interned string,
+// with a power of two for count, and OP_SWITCH_SEARCH keeps them sorted for a binary search.
+typedef struct {
+    SwitchCase* cases;
+    uint count;
+    double low;
+} SwitchTable;
+
 typedef struct {
     uint codeCount;
     uint codeCapacity;
@@ -81,11 +171,29 @@ typedef struct {
     uint32_t* lines;
 
     ValueArray constants;
+
+    // Innermost handlers come first
+    uint handlerCount;
+    uint handlerCapacity;
+    ExceptionHandler* handlers;
+
+    uint switchCount;
+    uint switchCapacity;
+    SwitchTable* switches;
 } Chunk;
 
 void initChunk(Chunk* chunk);
 void writeChunk(Chunk* chunk, uint8_t byte, uint line);
 void freeChunk(Chunk* chunk);
 int addConstant(Chunk* chunk, Value value);
+void addExceptionHandler(Chunk* chunk, ExceptionHandler handler);
+uint addSwitchTable(Chunk* chunk, SwitchTable table);
+int compareSwitchKeys(Value a, Value b);
+
+// Offset of the matching case, or NO_SWITCH_TARGET
+uint jumpTableTarget(SwitchTable* table, Value value);
+uint stringSwitchTarget(SwitchTable* table, Value value);
+uint searchSwitchTarget(SwitchTable* table, Value value);
+int instructionLength(uint8_t instruction);
 
 #endif //WALLY_CHUNK_H
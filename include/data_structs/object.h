@@ -25,6 +25,7 @@
 #define IS_INSTANCE(value)     isObjType(value, OBJ_INSTANCE)
 #define IS_BOUND_METHOD(value) isObjType(value, OBJ_BOUND_METHOD)
 #define IS_LIST(value)         isObjType(value, OBJ_LIST)
+#define IS_COROUTINE(value)    isObjType(value, OBJ_COROUTINE)
 
 #define AS_STRING(value)        ((ObjString*)AS_OBJ(value))
 #define AS_CSTRING(value)       (((ObjString*)AS_OBJ(value))->chars)
@@ -34,8 +35,14 @@
 #define AS_INSTANCE(value)      ((ObjInstance*)AS_OBJ(value))
 #define AS_BOUND_METHOD(value)  ((ObjBoundMethod*)AS_OBJ(value))
 #define AS_LIST(value)          ((ObjWList*)AS_OBJ(value))
+#define AS_COROUTINE(value)     ((ObjCoroutine*)AS_OBJ(value))
+
+// Every coroutine gets its own stacks, allocated once when it is created
+#define COROUTINE_FRAMES_MAX 8
+#define COROUTINE_STACK_MAX (COROUTINE_FRAMES_MAX * UINT8_COUNT)
 
 typedef Value (*NativeFn)(uint8_t argCount, uint16_t line, const Value* args);
+typedef bool (*CompiledFn)();
 
 typedef enum {
     OBJ_CLASS,
@@ -45,6 +52,7 @@ typedef enum {
     OBJ_NATIVE,
     OBJ_BOUND_METHOD,
     OBJ_LIST,
+    OBJ_COROUTINE,
 } ObjType;
 
 struct Obj {
@@ -89,9 +97,11 @@ typedef struct ObjFunction {
 
     Environment* closure;
 
-    struct ObjFunction* calledFromFunction;
-    uint8_t* calledFromIp;
-    Environment* calledFromEnvironment;
+    // Body translated to C by '--emit-c', NULL when the function is interpreted
+    CompiledFn compiled;
+
+    // Set until the body is compiled on the first call, NULL afterwards
+    struct FunctionStmt* declaration;
 } ObjFunction;
 
 typedef struct {
@@ -113,6 +123,36 @@ typedef struct {
     Value* items;
 } ObjWList;
 
+typedef enum {
+    COROUTINE_CREATED,
+    COROUTINE_SUSPENDED,
+    COROUTINE_RUNNING,
+    COROUTINE_DONE,
+} CoroutineState;
+
+typedef struct ObjCoroutine {
+    Obj obj;
+
+    ObjFunction* function;
+    CoroutineState state;
+
+    Value* stack;
+    struct CallFrame* frames;
+
+    // Registers of whichever side isn't running. While the coroutine is suspended these are its own,
+    // while it runs they belong to whoever resumed it. Resuming and yielding both just swap them with the VM's.
+    Value* savedStack;
+    Value* savedStackTop;
+    struct CallFrame* savedFrames;
+    int savedFrameCount;
+    int savedFrameMax;
+    uint8_t* savedIp;
+    Environment* savedEnvironment;
+    ObjFunction* savedFunction;
+
+    struct ObjCoroutine* resumer;
+} ObjCoroutine;
+
 static inline bool isObjType(Value value, ObjType type)
 {
     return IS_OBJ(value) && AS_OBJ(value)->type == type;
@@ -125,11 +165,17 @@ static inline bool charsEqual(char* a, char* b, uint lengthA, uint lengthB)
 
 ObjString* copyString(const char* chars, uint length);
 ObjString* takeString(char* chars, uint length);
+uint32_t hashString(const char* key, uint length);
+ObjString* keepString(ObjString* string);
 void replaceIndexString(ObjString* string, uint index, char c);
 bool isValidStringIndex(ObjString* string, uint index);
 ObjString* getIndexString(ObjString* string, uint index);
 ObjString* addStrings(ObjString* a, ObjString* b);
 
+// The text of every value in one string, built in a single buffer. NULL if a value has no text.
+// Functions are replaced with their name, so the name stays reachable while the string is built.
+ObjString* joinValues(Value* values, uint count);
+
 void printObject(Value value);
 ObjString* objectToString(Value value);
 
@@ -138,6 +184,7 @@ ObjFunction* newFunction(ObjString* name, uint8_t arity, FunctionType type);
 ObjClass* newClass(ObjString* name);
 ObjInstance* newInstance(ObjClass* klass);
 ObjBoundMethod* newBoundMethod(ObjInstance* instance, ObjFunction* method);
+ObjCoroutine* newCoroutine(ObjFunction* function);
 
 ObjWList* newWList();
 void addWList(ObjWList* list, Value value);
@@ -35,6 +35,8 @@ uint8_t tableSetExistingEntry(Table* table, ObjString* key, Value value);
 uint8_t tableSet(Table* table, ObjString* key, Value value);
 
 bool tableGet(Table* table, ObjString* key, Value* value);
+// Where the value of an existing key is stored, NULL if there's none. Valid until the table grows.
+Value* tableGetSlot(Table* table, ObjString* key);
 bool tableDelete(Table* table, ObjString* key);
 
 ObjString* tableFindString(Table* table, const char* chars, uint length, uint32_t hash);
@@ -1,6 +1,8 @@
 #ifndef WALLY_VALUE_H
 #define WALLY_VALUE_H
 
+#include <math.h>
+
 #include "common.h"
 
 typedef struct Obj Obj;
@@ -103,6 +105,78 @@ void freeValueArray(ValueArray* array);
 void printValue(Value value);
 void printRawValue(Value value);
 bool valuesEqual(Value a, Value b);
+
+// Only bit-identical values are the same, 0 and -0 are equal but stay apart
+bool valuesIdentical(Value a, Value b);
+uint32_t hashValueBits(Value value);
 ObjString* valueToString(Value value);
 
+// Longest text of a number, including the terminator
+#define VALUE_TEXT_MAX UINT8_MAX
+
+// Writes the text of a number, boolean or null into text, which has room for VALUE_TEXT_MAX chars.
+// Returns its length.
+uint formatValue(Value value, char* text);
+
+// '%' and '~/' truncate like C does, on whole numbers a double holds exactly they're computed as integers.
+// The bitwise operators work on the numbers truncated to 64 bit integers.
+
+static inline bool isExactInteger(double number)
+{
+    return number >= -9007199254740992.0 && number <= 9007199254740992.0 && number == (double)(int64_t)number;
+}
+
+// NaN is 0, numbers out of range saturate
+static inline int64_t numberToInteger(double number)
+{
+    if (number != number) return 0;
+    if (number <= (double)INT64_MIN) return INT64_MIN;
+    if (number >= (double)INT64_MAX) return INT64_MAX;
+
+    return (int64_t)number;
+}
+
+static inline double numberModulo(double a, double b)
+{
+    if (isExactInteger(a) && isExactInteger(b) && b != 0) return (double)((int64_t)a % (int64_t)b);
+    return fmod(a, b);
+}
+
+static inline double numberIntDivide(double a, double b)
+{
+    if (isExactInteger(a) && isExactInteger(b) && b != 0) return (double)((int64_t)a / (int64_t)b);
+    return trunc(a / b);
+}
+
+static inline double numberBitAnd(double a, double b)
+{
+    return (double)(numberToInteger(a) & numberToInteger(b));
+}
+
+static inline double numberBitOr(double a, double b)
+{
+    return (double)(numberToInteger(a) | numberToInteger(b));
+}
+
+static inline double numberBitXor(double a, double b)
+{
+    return (double)(numberToInteger(a) ^ numberToInteger(b));
+}
+
+// Only the low 6 bits of the count are used
+static inline double numberShiftLeft(double a, double b)
+{
+    return (double)(int64_t)((uint64_t)numberToInteger(a) << (numberToInteger(b) & 63));
+}
+
+static inline double numberShiftRight(double a, double b)
+{
+    return (double)(numberToInteger(a) >> (numberToInteger(b) & 63));
+}
+
+static inline double numberBitNot(double a)
+{
+    return (double)~numberToInteger(a);
+}
+
 #endif //WALLY_VALUE_H
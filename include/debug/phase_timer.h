@@ -0,0 +1,18 @@
+#ifndef WALLY_PHASE_TIMER_H
+#define WALLY_PHASE_TIMER_H
+
+#include "common.h"
+
+// Set by '--time-phases', the phases are printed once the script is done
+extern bool timePhases;
+
+// Wall time, allocations and bytes allocated until the matching endPhase() are added to the phase of that name.
+// Phases can be nested, the outer one includes the inner one. Throughput is printed for phases covering the
+// whole source. Nothing is measured unless timePhases is set.
+void beginPhase(const char* name, bool coversSource);
+void endPhase();
+
+void setPhaseSource(uint lines, uint tokens);
+void printPhases();
+
+#endif //WALLY_PHASE_TIMER_H
@@ -0,0 +1,37 @@
+#ifndef WALLY_CHUNK_WRITER_H
+#define WALLY_CHUNK_WRITER_H
+
+#include "chunk.h"
+#include "scanner.h"
+
+// Writes the bytecode of the function being compiled, for the AST emitter and the IR lowering in ir_lowering.h
+
+Chunk* currentChunk();
+
+void emitByte(uint8_t byte, uint16_t line);
+void emitBytes(uint8_t byte1, uint8_t byte2, uint16_t line);
+
+// Each value is added to the chunk once
+uint8_t makeConstant(Value value, uint16_t line);
+void emitConstant(Value value, uint16_t line);
+
+// Returns the offset of the jump's operand for patchJump, which points it at the end of the chunk
+uint emitJump(uint8_t instruction, uint16_t line);
+void patchJump(uint offset, uint16_t line);
+
+// OP_LOOP or OP_POP_LOOP_IF_TRUE
+void emitLoop(uint8_t instruction, uint loopStart, uint16_t line);
+
+void emitReturn(uint16_t line);
+void emitProfile(uint site, uint16_t line);
+
+// Operands are on the stack, types are INFERRED_* bits
+void emitBinaryOp(TokenType op, uint8_t leftTypes, uint8_t rightTypes, uint site, uint16_t line);
+
+// The operand is on the stack, op is OP_UPDATE_VARIABLE or OP_UPDATE_PROPERTY
+void emitUpdate(uint8_t op, ObjString* name, TokenType operator, uint16_t line);
+
+// The function being compiled fails, the error is printed unless it's collected while compiling in parallel
+void emitterError(const char* message, uint16_t line);
+
+#endif //WALLY_CHUNK_WRITER_H
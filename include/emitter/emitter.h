@@ -16,13 +16,38 @@ typedef enum
     TYPE_SCRIPT
 } FunctionType;
 
+// Entry of the hash map from a constant to its index in the chunk, so each value is stored only once
+typedef struct
+{
+    Value value;
+    int index; // -1 if the slot is empty
+} ConstantSlot;
+
 typedef struct Compiler {
     ObjFunction* function;
 
+    ConstantSlot* constantSlots;
+    uint constantSlotCount;
+    uint constantSlotCapacity;
+
+    // Scopes opened so far in the function, recorded by exception handlers
+    uint8_t scopeDepth;
+
+    // Values kept on the stack by the loops and switches being compiled, recorded by exception handlers
+    uint8_t stackValues;
+
     struct Compiler* enclosing;
 } Compiler;
 
+// Cleared by '--emit-c', which needs every function compiled up front
+extern bool lazyCompilation;
+
+// Set by '--jobs'. With more than one thread, bodies of top-level functions and methods are compiled up front,
+// in parallel, once the rest of the script is.
+extern uint compileThreads;
+
 ObjFunction* emit(Node* statements);
+bool compileLazily(ObjFunction* function);
 void markCompilerRoots();
 
 #endif //WALLY_EMITTER_H
\ No newline at end of file
@@ -3,20 +3,32 @@
 
 #include "table.h"
 
+// Freed environments are kept for reuse, unless their table grew past this
+#define MAX_POOLED_ENVIRONMENTS 64
+#define MAX_POOLED_CAPACITY 32
+
 typedef struct Environment
 {
     Table* values;
     struct Environment* enclosing;
+
+    // Values only a variable of this environment refers to, freed with it instead of by the garbage collector.
+    // Linked through their 'next', they aren't in vm.objects.
+    Obj* owned;
 } Environment;
 
 Environment* newEnvironment();
+void environmentOwn(Environment* env, Obj* object);
 bool environmentDefine(Environment* env, ObjString* name, Value value, uint16_t line);
 bool environmentSet(Environment* env, ObjString* name, Value value, uint16_t line);
 bool environmentGet(Environment* env, ObjString* name, Value* result);
+// Where the innermost variable with that name is stored, NULL if there's none
+Value* environmentGetSlot(Environment* env, ObjString* name);
 
 void markEnvironment(Environment* env);
 void freeEnvironmentsRecursively(Environment* env);
 void freeEnvironment(Environment* env);
+void freeEnvironmentPool();
 void printVariables(Environment* env);
 
 #endif //WALLY_ENVIRONMENT_H
@@ -0,0 +1,181 @@
+#ifndef WALLY_IR_H
+#define WALLY_IR_H
+
+#include "list.h"
+
+// Index of an instruction in its function, an instruction which has a value is referred to by it
+typedef uint16_t IrValue;
+typedef uint16_t IrBlockIndex;
+
+#define IR_NO_VALUE UINT16_MAX
+#define IR_NO_BLOCK UINT16_MAX
+
+// Functions needing more are compiled straight from the AST
+#define IR_MAX_INSTRUCTIONS (UINT16_MAX - 1)
+#define IR_MAX_BLOCKS       (UINT16_MAX - 1)
+
+// Set by '--dump-ir', every function is printed after its IR is optimized
+extern bool irDumpEnabled;
+
+// Cleared by '--no-ir'
+extern bool irEnabled;
+
+typedef enum
+{
+    IR_CONSTANT,
+    IR_PARAMETER,       // Argument at 'index', the arguments are the frame's first slots
+    IR_PHI,             // One operand for every predecessor of the block, in the same order
+    IR_COPY,            // Value of a local's assignment or declaration, replaced by copy propagation
+    IR_GET_VARIABLE,    // Variables other than the function's own locals are looked up by name
+    IR_SET_VARIABLE,
+    IR_UPDATE_VARIABLE, // Applies the binary 'token' to the variable and the operand, see variableUpdate
+    IR_BINARY,
+    IR_UNARY,
+    IR_CALL,            // Arguments, then the callee
+    IR_INVOKE,          // Instance, then the arguments
+    IR_GET_PROPERTY,
+    IR_SET_PROPERTY,    // Instance and the value, which is also the result
+    IR_UPDATE_PROPERTY, // Instance and the operand, the result is the new value
+    IR_GET_BASE,
+    IR_SUBSCRIPT_GET,
+    IR_SUBSCRIPT_SET,   // List, index and the stored value
+    IR_BUILD_LIST,
+    IR_BUILD_STRING,
+} IrOp;
+
+typedef struct
+{
+    IrOp op;
+    uint16_t line;
+    IrBlockIndex block;
+
+    bool removed;
+    bool hasValue;
+
+    // INFERRED_* types the value may have
+    uint8_t types;
+
+    // In the order they're pushed
+    IrValue* operands;
+    uint16_t operandCount;
+    uint16_t operandCapacity;
+
+    Value constant;
+    ObjString* name;
+
+    // Operator of binary and unary instructions
+    TokenType token;
+
+    // Parameter index
+    uint16_t index;
+
+    // Recorded by OP_PROFILE if profiled, see profile.h
+    uint site;
+    bool profiled;
+} IrInstruction;
+
+typedef enum
+{
+    IR_UNTERMINATED,
+    IR_JUMP,
+    IR_BRANCH,      // To the first target if the value is truthy, to the second otherwise
+    IR_RETURN,      // Without a value it returns what a function returns when it reaches its end
+} IrTerminatorType;
+
+typedef struct
+{
+    IrTerminatorType type;
+    uint16_t line;
+
+    IrValue value;
+    IrBlockIndex targets[2];
+
+    uint site;
+    bool profiled;
+} IrTerminator;
+
+typedef struct
+{
+    IrValue* phis;
+    uint16_t phiCount;
+    uint16_t phiCapacity;
+
+    // Everything but the phis, in order
+    IrValue* instructions;
+    uint16_t instructionCount;
+    uint16_t instructionCapacity;
+
+    IrBlockIndex* predecessors;
+    uint16_t predecessorCount;
+    uint16_t predecessorCapacity;
+
+    IrTerminator terminator;
+    bool removed;
+} IrBlock;
+
+typedef struct
+{
+    ObjString* name;
+    uint16_t paramCount;
+
+    IrInstruction* instructions;
+    uint instructionCount;
+    uint instructionCapacity;
+
+    IrBlock* blocks;
+    uint blockCount;
+    uint blockCapacity;
+
+    // Order of the blocks in the chunk, starting with the entry
+    IrBlockIndex* layout;
+    uint layoutCount;
+    uint layoutCapacity;
+} IrFunction;
+
+IrFunction* newIrFunction(ObjString* name, uint16_t paramCount);
+void freeIrFunction(IrFunction* function);
+
+// IR_NO_BLOCK or IR_NO_VALUE once the function is too big
+IrBlockIndex irAddBlock(IrFunction* function);
+IrValue irAddInstruction(IrFunction* function, IrBlockIndex block, IrOp op, bool hasValue, uint16_t line);
+IrValue irAddPhi(IrFunction* function, IrBlockIndex block, uint16_t line);
+void irAddOperand(IrFunction* function, IrValue instruction, IrValue operand);
+
+// Appends the block to the layout
+void irPlaceBlock(IrFunction* function, IrBlockIndex block);
+
+// Terminators add the block to the predecessors of their targets
+void irJump(IrFunction* function, IrBlockIndex from, IrBlockIndex to, uint16_t line);
+void irBranch(IrFunction* function, IrBlockIndex from, IrValue condition, IrBlockIndex ifTrue, IrBlockIndex ifFalse,
+              uint16_t line);
+void irReturn(IrFunction* function, IrBlockIndex from, IrValue value, uint16_t line);
+
+// Drops one edge between the blocks, along with the operands its phis take from it
+void irRemoveEdge(IrFunction* function, IrBlockIndex from, IrBlockIndex to);
+
+// Puts an empty block on the edge to the terminator's target at 'target', laid out after 'from'.
+// IR_NO_BLOCK once the function is too big.
+IrBlockIndex irSplitEdge(IrFunction* function, IrBlockIndex from, int target);
+
+int irSuccessorCount(IrBlock* block);
+
+// Fills 'order' with the blocks reachable from the entry, each after the blocks dominating it. Returns how many.
+uint irReversePostorder(IrFunction* function, IrBlockIndex* order);
+
+// Index of 'predecessor' among the block's predecessors, the phis take their operand for it at that index
+int irPredecessorIndex(IrBlock* block, IrBlockIndex predecessor);
+
+static inline IrInstruction* irInstruction(IrFunction* function, IrValue value)
+{
+    return &function->instructions[value];
+}
+
+static inline IrBlock* irBlock(IrFunction* function, IrBlockIndex block)
+{
+    return &function->blocks[block];
+}
+
+// Prints the blocks in the order they're laid out in
+void irDump(IrFunction* function);
+
+#endif //WALLY_IR_H
@@ -0,0 +1,13 @@
+#ifndef WALLY_IR_BUILDER_H
+#define WALLY_IR_BUILDER_H
+
+#include "ir.h"
+
+// Builds the SSA form of a function's body. Parameters and variables the function declares become values,
+// everything else is still looked up by name.
+// Returns NULL for bodies the IR can't express, those which need their locals in an environment (nested
+// functions and classes, 'try', coroutines), loops kept by other passes ('foreach', ranges, cached expressions,
+// scope owned values), 'switch', and code the AST emitter reports as an error.
+IrFunction* buildIr(FunctionStmt* function, bool isInitializer);
+
+#endif //WALLY_IR_BUILDER_H
@@ -0,0 +1,11 @@
+#ifndef WALLY_IR_LOWERING_H
+#define WALLY_IR_LOWERING_H
+
+#include "ir.h"
+
+// Emits a function optimized by optimizeIr into the chunk being compiled, see chunk_writer.h. Its parameters and
+// the values the stack can't hold until they're used get stack slots.
+// Returns false before emitting anything if it needs too many.
+bool lowerIr(IrFunction* function, bool isInitializer, uint16_t line);
+
+#endif //WALLY_IR_LOWERING_H
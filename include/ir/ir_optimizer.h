@@ -0,0 +1,15 @@
+#ifndef WALLY_IR_OPTIMIZER_H
+#define WALLY_IR_OPTIMIZER_H
+
+#include "ir.h"
+
+// Runs the passes over a function built by buildIr: copy propagation, constant propagation folding the branches
+// it decides, type refinement, global value numbering and dead code elimination. Afterwards no edge goes from a
+// block with two successors to a block with phis, so the lowering can copy phi operands at the end of a jump.
+// Returns false if the function grew too big for that.
+bool optimizeIr(IrFunction* function);
+
+// Binary instructions are profiled like BinaryExpr, unless they compare for equality or work on numbers
+bool irProfilesOperands(IrFunction* function, IrInstruction* instruction);
+
+#endif //WALLY_IR_OPTIMIZER_H
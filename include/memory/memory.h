@@ -15,7 +15,28 @@
 
 #define FREE(type, pointer) reallocate(pointer, sizeof(type), 0)
 
+// Objects and bytes allocated by a thread compiling in parallel with others. The garbage collector doesn't run
+// on such a thread, its objects join the VM's once the thread is done, see mergeArena.
+typedef struct
+{
+    Obj* objects;
+    size_t bytesAllocated;
+
+    // Added to the VM's totals
+    size_t totalAllocations;
+    size_t totalBytesAllocated;
+} AllocationArena;
+
 void* reallocate(void* pointer, size_t oldSize, size_t newSize);
+void linkObject(Obj* object);
+
+void initArena(AllocationArena* arena);
+
+// Allocations of the calling thread go to the arena until it's called with NULL
+void useArena(AllocationArena* arena);
+bool usingArena();
+void mergeArena(AllocationArena* arena);
+
 void freeObjects();
 void freeObject(Obj* object);
 
@@ -19,7 +19,7 @@
 
 // -------------- DEBUG OPTIONS ------------------
 
-// #define DEBUG_TRACE_EXECUTION    // Print executed bytecode and value stack.
+// #define DEBUG_TRACE_EXECUTION    // Print executed bytecode and value stack. Same as running with --trace
 // #define DEBUG_PRINT_BYTECODE     // Print bytecode for each function (and the main script) generated by the emitter
 // #define DEBUG_PRINT_TOKENS       // Print tokens generated by the scanner and exit
 
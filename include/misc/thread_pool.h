@@ -0,0 +1,13 @@
+#ifndef WALLY_THREAD_POOL_H
+#define WALLY_THREAD_POOL_H
+
+#include "common.h"
+
+typedef void (*ParallelWork)(void* items, uint index);
+
+// Calls work for every index below count, on up to 'threads' threads counting the caller, and returns once
+// all calls are done. Which thread runs which index isn't defined, so each call may only write its own item.
+// Runs everything on the caller if no thread can be started.
+void runInParallel(ParallelWork work, void* items, uint count, uint threads);
+
+#endif //WALLY_THREAD_POOL_H
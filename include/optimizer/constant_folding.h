@@ -0,0 +1,15 @@
+#ifndef WALLY_CONSTANT_FOLDING_H
+#define WALLY_CONSTANT_FOLDING_H
+
+#include "list.h"
+
+// Rewrites the AST in place before it is emitted. Operations whose operands are all known are replaced
+// with their result and uses of 'const' declarations are replaced with the constant's value.
+// Returns false if an error was reported.
+bool foldConstants(Node* statements);
+
+// Results of operators applied to known values, false for those which could fail, which are left for the VM to report
+bool foldBinary(TokenType op, Value a, Value b, Value* result);
+bool foldUnary(TokenType op, Value value, Value* result);
+
+#endif //WALLY_CONSTANT_FOLDING_H
@@ -0,0 +1,10 @@
+#ifndef WALLY_ESCAPE_ANALYSIS_H
+#define WALLY_ESCAPE_ANALYSIS_H
+
+#include "list.h"
+
+// Marks declarations whose list or instance never outlives the scope, because nothing but the declared
+// variable refers to it. The emitter hands such values to the scope, which frees them when it ends.
+void findOwnedValues(Node* statements);
+
+#endif //WALLY_ESCAPE_ANALYSIS_H
@@ -0,0 +1,39 @@
+#ifndef WALLY_INLINER_H
+#define WALLY_INLINER_H
+
+#include "list.h"
+
+// Largest function body, in expression nodes, which is still copied into its call sites
+#define INLINE_MAX_SIZE 16
+
+// Cleared by '--no-inline'
+extern bool inliningEnabled;
+
+// A top-level function whose body is a single 'return' of an expression without side effects,
+// using nothing but its parameters. Its name is never used other than to call it.
+typedef struct
+{
+    FunctionStmt* declaration;
+
+    // Compiled before the rest of the script, so call sites placed before the declaration can check
+    // the name still refers to it
+    ObjFunction* function;
+} InlineCandidate;
+
+// Collects the candidates among the top-level statements, replacing the previous ones
+void findInlineCandidates(Node* statements);
+
+uint inlineCandidateCount();
+InlineCandidate* getInlineCandidateAt(uint index);
+
+// NULL if no candidate has this name
+InlineCandidate* getInlineCandidate(ObjString* name);
+
+// Returns the candidate's body with the call's arguments in place of its parameters,
+// or NULL if this call can't be inlined without changing the order of side effects
+Expr* inlineCall(InlineCandidate* candidate, CallExpr* call);
+
+void freeInlineCandidates();
+void markInlineCandidates();
+
+#endif //WALLY_INLINER_H
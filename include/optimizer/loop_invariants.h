@@ -0,0 +1,15 @@
+#ifndef WALLY_LOOP_INVARIANTS_H
+#define WALLY_LOOP_INVARIANTS_H
+
+#include "list.h"
+
+// Most values a single loop keeps in hidden slots
+#define MAX_LOOP_CACHES 32
+
+// Finds expressions in loops which evaluate to the same value on every iteration, and products of a
+// range's counter and a positive integer, which grow by that integer on every iteration. The emitter
+// computes them where the loop first reaches them and keeps the values in hidden stack slots, so they
+// fail or not exactly where they would have. Runs after type inference, which finds the ranges.
+void findLoopInvariants(Node* statements);
+
+#endif //WALLY_LOOP_INVARIANTS_H
@@ -0,0 +1,11 @@
+#ifndef WALLY_PEEPHOLE_H
+#define WALLY_PEEPHOLE_H
+
+#include "chunk.h"
+
+// Cleans up a finished chunk: threads jumps to jumps, drops unreachable code and pairs of instructions
+// which cancel out. Jump offsets, lines and exception handlers are moved along with the code.
+// Returns how many bytes were removed.
+uint optimizeChunk(Chunk* chunk);
+
+#endif //WALLY_PEEPHOLE_H
@@ -0,0 +1,46 @@
+#ifndef WALLY_PROFILE_H
+#define WALLY_PROFILE_H
+
+#include "common.h"
+#include "object.h"
+
+// Sites past this one can't be encoded in OP_PROFILE, they are never profiled
+#define MAX_PROFILED_SITE UINT16_MAX
+
+// What was seen at one site of the script, see the 'site' of BinaryExpr, DotExpr and IfStmt
+typedef struct
+{
+    // INFERRED_* bits of the operands of arithmetic and comparisons
+    uint8_t leftTypes;
+    uint8_t rightTypes;
+
+    // Conditions of 'if' statements
+    uint32_t truthy;
+    uint32_t falsy;
+
+    // Instances whose methods or properties were used, a site seeing more than one class keeps the first
+    ObjString* receiver;
+    ObjString* field;
+    uint32_t uses;
+} SiteFeedback;
+
+// Set by '--profile-out', the emitter puts OP_PROFILE before every instruction worth recording
+extern bool profiling;
+
+// Called by the VM for OP_PROFILE, next is the instruction being profiled
+void recordFeedback(uint site, uint8_t* next);
+
+// NULL if nothing was recorded or loaded for this site
+SiteFeedback* getSiteFeedback(uint site);
+
+// Uses of a method at every site that saw an instance of the class
+uint methodUses(ObjString* className, ObjString* method);
+
+// The source is used to tell whether a profile belongs to the script
+bool writeProfile(const char* path, const char* source);
+bool readProfile(const char* path, const char* source);
+
+void markProfile();
+void freeProfile();
+
+#endif //WALLY_PROFILE_H
@@ -0,0 +1,13 @@
+#ifndef WALLY_TREE_SHAKING_H
+#define WALLY_TREE_SHAKING_H
+
+#include "list.h"
+
+// Cleared by '--no-tree-shaking' and by the repl, where later lines may use what earlier ones declare
+extern bool treeShakingEnabled;
+
+// Removes declarations of functions, classes and methods which the script can never reach, starting from the
+// code which runs at the top level. Returns how many were removed.
+uint removeUnusedDeclarations(Node** statements);
+
+#endif //WALLY_TREE_SHAKING_H
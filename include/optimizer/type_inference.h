@@ -0,0 +1,13 @@
+#ifndef WALLY_TYPE_INFERENCE_H
+#define WALLY_TYPE_INFERENCE_H
+
+#include "list.h"
+
+// Fills in the inferred types of every expression, so the emitter can pick opcodes which don't check
+// their operands. Runs after constant folding.
+void inferTypes(Node* statements);
+
+// INFERRED_* bit of a value's type
+uint8_t valueTypes(Value value);
+
+#endif //WALLY_TYPE_INFERENCE_H
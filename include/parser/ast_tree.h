@@ -19,7 +19,10 @@ typedef enum {
     CALL_EXPRESSION,
     TERNARY_EXPRESSION,
     DOT_EXPRESSION,
-    BASE_EXPRESSION
+    BASE_EXPRESSION,
+    YIELD_EXPRESSION,
+    RESUME_EXPRESSION,
+    INTERPOLATION_EXPRESSION
 } ExprType;
 
 typedef enum {
@@ -28,6 +31,7 @@ typedef enum {
     IF_STATEMENT,
     WHILE_STATEMENT,
     FOR_STATEMENT,
+    FOREACH_STATEMENT,
     SWITCH_STATEMENT,
     VARIABLE_STATEMENT,
     CONTINUE_STATEMENT,
@@ -35,14 +39,29 @@ typedef enum {
     FUNCTION_STATEMENT,
     RETURN_STATEMENT,
     CLASS_STATEMENT,
+    TRY_STATEMENT,
 } StmtType;
 
 // ------------ EXPRESSIONS ------------
 
+// Types an expression may evaluate to, narrowed down by type inference
+#define INFERRED_NUMBER (1 << 0)
+#define INFERRED_STRING (1 << 1)
+#define INFERRED_BOOL   (1 << 2)
+#define INFERRED_NULL   (1 << 3)
+#define INFERRED_OTHER  (1 << 4)
+#define INFERRED_ANY    (INFERRED_NUMBER | INFERRED_STRING | INFERRED_BOOL | INFERRED_NULL | INFERRED_OTHER)
+
 typedef struct {
     ExprType type;
     uint16_t line;
     bool pop;
+
+    uint8_t inferredTypes;
+
+    // One more than the slot of the innermost loop keeping the value, 0 if it's computed every time.
+    // Set by loop_invariants.c.
+    uint8_t cacheSlot;
 } Expr;
 
 typedef struct
@@ -82,6 +101,9 @@ typedef struct
     Expr* left;
     TokenType op;
     Expr* right;
+
+    // Numbered in the order the parser creates them, keys the node's feedback in a profile
+    uint site;
 } BinaryExpr;
 
 typedef struct
@@ -140,6 +162,8 @@ typedef struct
 
     Node* args;
     uint8_t argCount;
+
+    uint site;
 } DotExpr;
 
 typedef struct
@@ -151,6 +175,33 @@ typedef struct
     Node* args;
 } CallExpr;
 
+typedef struct
+{
+    Expr expr;
+
+    // Null is yielded if there is no value
+    Expr* value;
+} YieldExpr;
+
+typedef struct
+{
+    Expr expr;
+
+    Expr* coroutine;
+
+    // Passed to the coroutine, null if there is no value
+    Expr* value;
+} ResumeExpr;
+
+typedef struct
+{
+    Expr expr;
+
+    // Text and the expressions between it, joined into a single string
+    Node* parts;
+    uint8_t partCount;
+} InterpolationExpr;
+
 // ------------ STATEMENTS ------------
 
 typedef struct Stmt {
@@ -183,6 +234,8 @@ typedef struct
     Expr* condition;
     Stmt* thenBranch;
     Stmt* elseBranch;
+
+    uint site;
 } IfStmt;
 
 typedef struct
@@ -191,12 +244,29 @@ typedef struct
 
     Expr* condition;
     Stmt* body;
+
+    // Hidden slots the emitter keeps on the stack for the loop, see cacheSlot of Expr
+    uint8_t cacheCount;
 } WhileStmt;
 
 typedef struct
 {
     Stmt stmt;
 
+    // Declared in the scope of the loop, set to the next item before every iteration
+    ObjString* name;
+    Expr* iterable;
+    Stmt* body;
+
+    uint8_t cacheCount;
+} ForeachStmt;
+
+typedef struct
+{
+    Stmt stmt;
+
+    Expr* value;
+
     Node* conditions;
     Node* caseBodies;
 
@@ -209,6 +279,12 @@ typedef struct
 
     ObjString* name;
     Expr* initializer;
+
+    // Uses of constants are replaced with the initializer's value, which has to be known while compiling
+    bool isConst;
+
+    // The initializer creates a list or an instance which nothing but this variable refers to, see escape_analysis.h
+    bool ownedByScope;
 } VariableStmt;
 
 typedef struct
@@ -219,9 +295,23 @@ typedef struct
     Expr* condition;
     Expr* increment;
     Stmt* body;
+
+    // Counts the declared variable up by one, from its initializer to the right of the '<' condition.
+    // Both bounds are evaluated once and the counter is kept apart from the variable.
+    // Set by the parser for 'for (i in start..end)' and by type inference for loops which count the same way.
+    bool isRange;
+
+    // Written as 'for (i in start..end)', other loops report bounds which aren't numbers like their comparison would
+    bool isRangeSyntax;
+
+    uint8_t cacheCount;
+
+    // Products of a range's counter and a positive integer among the cached expressions, the emitter
+    // adds the integer to their slots at the end of every iteration. The expressions aren't owned.
+    Node* inductions;
 } ForStmt;
 
-typedef struct
+typedef struct FunctionStmt
 {
     Stmt stmt;
 
@@ -250,6 +340,17 @@ typedef struct
     Expr* value;
 } ReturnStmt;
 
+typedef struct
+{
+    Stmt stmt;
+
+    Stmt* body;
+
+    // Name the error message is bound to inside the handler, NULL if it's not used.
+    ObjString* errorName;
+    Stmt* handler;
+} TryStmt;
+
 typedef struct
 {
     Stmt stmt;
@@ -264,6 +365,7 @@ typedef struct
 
 LiteralExpr* newLiteralExpr(Value value, uint16_t line);
 ListExpr* newListExpr(Node* expressions, uint16_t line);
+InterpolationExpr* newInterpolationExpr(Node* parts, uint8_t partCount, uint16_t line);
 SubscriptExpr* newSubscriptExpr(Expr* indexedValue, Expr* index, Expr* valueToStore, uint16_t line);
 BinaryExpr* newBinaryExpr(Expr* left, TokenType op, Expr* right, uint16_t line);
 LogicalExpr* newLogicalExpr(Expr* left, TokenType op, Expr* right, uint16_t line);
@@ -274,6 +376,22 @@ AssignExpr* newAssignExpr(ObjString* name, Expr* value, uint16_t line);
 CallExpr* newCallExpr(Expr* callee, uint8_t argCount, Node* args, uint16_t line);
 DotExpr* newDotExpr(Expr* instance, ObjString* fieldName, Expr* value, bool isCall, Node* args, uint8_t argCount, uint16_t line);
 BaseExpr* newBaseExpr(ObjString* methodName, uint16_t line);
+YieldExpr* newYieldExpr(Expr* value, uint16_t line);
+ResumeExpr* newResumeExpr(Expr* coroutine, Expr* value, uint16_t line);
+
+// ------------ COMPOUND ASSIGNMENTS ------------
+
+// The value of 'x = x op y', as written by 'x op= y' and 'x++', if the variable can be read once and updated in
+// place: 'op' is arithmetic and 'y' can't assign anything. NULL for other assignments.
+BinaryExpr* variableUpdate(AssignExpr* assignment);
+
+// The value of 'a.f = a.f op y', as written by 'a.f op= y' and 'a.f++', whose two sides share the instance
+// expression 'a'. Any operator and any 'y'. NULL for other assignments.
+BinaryExpr* propertyCompound(DotExpr* setter);
+
+// The same as variableUpdate for a property: one of propertyCompound's assignments whose 'op' is arithmetic and
+// whose 'y' can't assign anything
+BinaryExpr* propertyUpdate(DotExpr* setter);
 
 // ------------ STATEMENT CONSTRUCTORS ------------
 
@@ -282,10 +400,12 @@ BlockStmt* newBlockStmt(Node* statements, uint16_t line);
 IfStmt* newIfStmt(Expr* condition, Stmt* thenBranch, Stmt* elseBranch, uint16_t line);
 WhileStmt* newWhileStmt(Expr* condition, Stmt* body, uint16_t line);
 ForStmt* newForStmt(Stmt* declaration, Expr* condition, Expr* increment, Stmt* body, uint16_t line);
-SwitchStmt* newSwitchStmt(Node* caseConditions, Node* caseBodies, Stmt* defaultBranch, uint16_t line);
-VariableStmt* newVariableStmt(ObjString* name, Expr* initializer, uint16_t line);
+ForeachStmt* newForeachStmt(ObjString* name, Expr* iterable, Stmt* body, uint16_t line);
+SwitchStmt* newSwitchStmt(Expr* value, Node* caseConditions, Node* caseBodies, Stmt* defaultBranch, uint16_t line);
+VariableStmt* newVariableStmt(ObjString* name, Expr* initializer, bool isConst, uint16_t line);
 FunctionStmt* newFunctionStmt(ObjString* name, Node* body, ObjString** params, uint16_t paramCount, uint16_t line);
 ReturnStmt* newReturnStmt(Expr* value, uint16_t line);
 BreakStmt* newBreakStmt(uint16_t line);
 ContinueStmt* newContinueStmt(uint16_t line);
 ClassStmt* newClassStmt(ObjString* name, Expr* parent, Statements methods, uint16_t line);
+TryStmt* newTryStmt(Stmt* body, ObjString* errorName, Stmt* handler, uint16_t line);
@@ -20,7 +20,7 @@ typedef struct {
 /*
 The further we go, the biggest number we get
 PREC_NONE is 0
-and PREC_PRIMARY is 10
+and PREC_PRIMARY is 17
 */
 typedef enum {
     PREC_NONE,
@@ -30,9 +30,13 @@ typedef enum {
     PREC_AND,                 // and
     PREC_EQUALITY,            // == !=
     PREC_COMPARISON,          // < > <= >=
+    PREC_BIT_OR,              // |
+    PREC_BIT_XOR,             // ^
+    PREC_BIT_AND,             // &
+    PREC_SHIFT,               // << >>
     PREC_TERM,                // + -
-    PREC_FACTOR,              // * /
-    PREC_UNARY,               // ! -
+    PREC_FACTOR,              // * / % ~/
+    PREC_UNARY,               // ! - ~
     PREC_SUBSCRIPT,           // []
     PREC_CALL,                // . ()
     PREC_INCR_DECR,           // ++ --
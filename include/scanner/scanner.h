@@ -17,6 +17,7 @@ typedef enum {
     TOKEN_MINUS_E, // Used to distinguish from -= and -1
     TOKEN_SEMICOLON, TOKEN_SLASH, TOKEN_STAR,
     TOKEN_DOLLAR, TOKEN_PLUS_PLUS,
+    TOKEN_PERCENT, TOKEN_TILDE, TOKEN_CARET,
 
     // One or two character tokens.
     TOKEN_BANG, TOKEN_BANG_EQUAL,
@@ -24,7 +25,9 @@ typedef enum {
     TOKEN_GREATER, TOKEN_GREATER_EQUAL,
     TOKEN_LESS, TOKEN_LESS_EQUAL,
     TOKEN_AND, TOKEN_OR, TOKEN_COLON,
-    TOKEN_QUESTION_MARK,
+    TOKEN_QUESTION_MARK, TOKEN_DOT_DOT,
+    TOKEN_TILDE_SLASH, TOKEN_AMPERSAND, TOKEN_PIPE,
+    TOKEN_LESS_LESS, TOKEN_GREATER_GREATER,
 
     // Literals.
     TOKEN_IDENTIFIER, TOKEN_STRING, TOKEN_NUMBER,
@@ -35,7 +38,9 @@ typedef enum {
     TOKEN_RETURN, TOKEN_BASE, TOKEN_THIS,
     TOKEN_TRUE, TOKEN_VAR, TOKEN_WHILE, TOKEN_BREAK,
     TOKEN_CONTINUE, TOKEN_SWITCH, TOKEN_CASE,
-    TOKEN_DEFAULT,
+    TOKEN_DEFAULT, TOKEN_TRY, TOKEN_CATCH,
+    TOKEN_YIELD, TOKEN_RESUME, TOKEN_CONST,
+    TOKEN_FOREACH, TOKEN_IN,
 
     TOKEN_ERROR, TOKEN_EOF
 } TokenType;
@@ -54,6 +59,9 @@ typedef struct {
     uint line;
 
     TokenType returnNext;
+
+    // The next string follows '$', quotes inside its braces don't end it
+    bool afterDollar;
 } Scanner;
 
 extern Scanner scanner;
@@ -61,6 +69,9 @@ extern Scanner scanner;
 void initScanner(const char* source);
 Token scanToken();
 
+// Scans the whole source without parsing it, the scanner is left at its last line
+uint countTokens(const char* source);
+
 bool isDigit(char c);
 bool isAlpha(char c);
 
@@ -2,7 +2,12 @@
 #define WALLY_CORE_H
 
 #include "wally_list.h"
+#include "native_utils.h"
 
 void defineCore(Table* table);
 
+// What calling a core function, or a function of a module when moduleName isn't NULL, may do.
+// Looked up by name, modules don't exist before they're included.
+NativePurity nativePurity(ObjString* moduleName, ObjString* name);
+
 #endif //WALLY_CORE_H
@@ -6,7 +6,24 @@
 #define NATIVE_FUNCTION(name) static Value name##Native(uint8_t argCount, uint16_t line, const Value* args)
 #define CHECK_ARG_COUNT(name, expected) checkArgCount(name, line, expected, argCount)
 
+// What calling a native may do, the optimizer only moves or looks past calls it knows are harmless
+typedef enum {
+    NATIVE_PURE,    // Changes nothing, the result only depends on the arguments (and the items of a list passed)
+    NATIVE_EFFECTS, // Prints, reads input, files, the clock or the random state, but leaves the script's values alone
+    NATIVE_IMPURE,  // May change lists or define variables
+} NativePurity;
+
+typedef struct {
+    const char* name;
+    NativeFn function;
+    NativePurity purity;
+} NativeDefinition;
+
 void defineNativeFunction(Table* table, const char* name, NativeFn function);
+// The definitions end with one whose name is NULL
+void defineNativeFunctions(Table* table, const NativeDefinition* natives);
+// NATIVE_IMPURE for names which aren't defined
+NativePurity findNativePurity(const NativeDefinition* natives, ObjString* name);
 void nativeError(uint16_t line, const char* fooName, const char* format, ...);
 bool checkArgCount(const char* fooName, uint16_t line, uint8_t expected, uint8_t got);
 
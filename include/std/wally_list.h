@@ -2,6 +2,9 @@
 #define WALLY_LISTLIB_H
 
 #include "table.h"
+#include "native_utils.h"
+
+extern const NativeDefinition listNatives[];
 
 void defineList(Table* table);
 
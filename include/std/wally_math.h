@@ -1,6 +1,10 @@
 #ifndef WALLY_MATH_H
 #define WALLY_MATH_H
 
+#include "native_utils.h"
+
+extern const NativeDefinition mathNatives[];
+
 void defineMath(Table* table);
 
 #endif //WALLY_MATH_H
\ No newline at end of file
@@ -2,6 +2,9 @@
 #define WALLY_WALLY_OS_H
 
 #include "table.h"
+#include "native_utils.h"
+
+extern const NativeDefinition osNatives[];
 
 void defineOS(Table* table);
 
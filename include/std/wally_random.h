@@ -1,6 +1,10 @@
 #ifndef WALLY_WALLY_RANDOM_H
 #define WALLY_WALLY_RANDOM_H
 
+#include "native_utils.h"
+
+extern const NativeDefinition randomNatives[];
+
 void defineRandom(Table* table);
 
 #endif //WALLY_WALLY_RANDOM_H
@@ -13,6 +13,19 @@
 #define INTERPRET_RUNTIME_ERROR 70
 #define INTERPRET_COMPILE_ERROR 65
 
+#define ERROR_MESSAGE_MAX 256
+
+typedef struct CallFrame
+{
+    ObjFunction* function;
+    Environment* environment; // Created by the call, scopes opened inside the function enclose it
+    Value* slots; // The result of the call replaces everything from here to the top of the stack
+
+    // Caller state restored on return
+    uint8_t* returnIp;
+    Environment* returnEnvironment;
+} CallFrame;
+
 typedef struct
 {
     // -- Vm Runtime --
@@ -25,16 +38,37 @@ typedef struct
 
     uint8_t* ip; // Instruction pointer. Points towards the next instruction to be executed.
 
+    // Point either into the main arrays below or into the running coroutine's own ones,
+    // switching coroutines only swaps these (see ObjCoroutine)
+    CallFrame* frames;
+    int frameCount;
+    int frameMax;
+
+    ObjCoroutine* currentCoroutine; // NULL while the script itself is running
+
+    // -- Errors --
+    // Filled by runtimeError(), printed only if nothing catches it
+    char errorMessage[ERROR_MESSAGE_MAX];
+    uint16_t errorLine;
+
+    // -- Tracing --
+    bool trace; // Picks the instrumented dispatch loop, read once when the script starts
+    const char* traceFunction; // If not NULL, only instructions of this function are printed ("script" for top-level code)
+
     // -- Global strings --
 
     ObjString* thisString;
     ObjString* initString;
 
     // -- Vm Runtime Data --
-    Value stack[STACK_MAX];
+    Value* stack;
     Value* stackTop; // Points towards where the next pushed value will go, a.k.a. an empty place in the stack array.
 
+    Value mainStack[STACK_MAX];
+    CallFrame mainFrames[FRAMES_MAX];
+
     Table* strings;
+    Table* sourceStrings; // Referenced by the AST, which stays around for lazily compiled functions
     Obj* objects;
 
     // -- Garbage Collector --
@@ -44,6 +78,11 @@ typedef struct
 
     size_t bytesAllocated;
     size_t nextGC;
+
+    // Only ever grow, '--time-phases' reports how much they did in each phase. Growing a block counts its new
+    // bytes, but not as an allocation.
+    size_t totalAllocations;
+    size_t totalBytesAllocated;
 } VM;
 
 extern VM vm;
@@ -56,5 +95,9 @@ void freeVM();
 int interpret(const char* source);
 
 void runtimeError(uint16_t line, const char* format, ...);
+void reportRuntimeError();
+
+// Loops type inference turned into ranges fail like their first comparison would
+const char* rangeBoundsError(bool isRangeSyntax);
 
 #endif //WALLY_VM_H
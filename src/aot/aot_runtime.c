@@ -0,0 +1,732 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "aot.h"
+
+// region Loading
+
+Value aotNumber(uint64_t bits)
+{
+    // Numbers are written as their bit pattern, so the generated file reproduces them exactly
+    double number;
+    memcpy(&number, &bits, sizeof(double));
+
+    return NUMBER_VAL(number);
+}
+
+Value aotString(const char* chars, uint length)
+{
+    return OBJ_VAL(copyString(chars, length));
+}
+
+ObjFunction* aotNewFunction(const char* name, uint8_t arity, FunctionType type, CompiledFn compiled)
+{
+    ObjString* fooName = name == NULL ? NULL : copyString(name, strlen(name));
+
+    ObjFunction* function = newFunction(fooName, arity, type);
+    function->compiled = compiled;
+
+    return function;
+}
+
+void aotAddConstant(ObjFunction* function, Value value)
+{
+    addConstant(&function->chunk, value);
+}
+
+int aotRun(ObjFunction* script)
+{
+    // Keeps the script, and through its constants every other function, alive
+    AOT_PUSH(OBJ_VAL(script));
+
+    script->closure = NULL;
+    vm.currentFunction = script;
+    vm.currentEnvironment = newEnvironment();
+
+    gcStarted = true;
+
+    if (!script->compiled())
+    {
+        reportRuntimeError();
+        return INTERPRET_RUNTIME_ERROR;
+    }
+
+    freeVM();
+    return INTERPRET_OK;
+}
+
+// endregion
+
+// region Calls
+
+// Same calling convention as the interpreter. The C stack holds the return addresses, frames are
+// only pushed so the garbage collector sees the callers' environments.
+static bool callCompiled(ObjFunction* function, ObjInstance* thisValue, uint8_t argCount, uint16_t line)
+{
+    if (argCount != function->arity)
+    {
+        runtimeError(line, "Expected %d arguments but got %d.", function->arity, argCount);
+        return false;
+    }
+
+    if (vm.frameCount == vm.frameMax)
+    {
+        runtimeError(line, "Stack overflow.");
+        return false;
+    }
+
+    CallFrame* frame = &vm.frames[vm.frameCount++];
+    frame->function = function;
+    frame->slots = vm.stackTop - argCount;
+    frame->returnEnvironment = vm.currentEnvironment;
+
+    ObjFunction* callerFunction = vm.currentFunction;
+    vm.currentFunction = function;
+
+    if (thisValue != NULL)
+    {
+        AOT_PUSH(OBJ_VAL(thisValue));
+        vm.currentEnvironment = newEnvironment();
+        environmentDefine(vm.currentEnvironment, vm.thisString, OBJ_VAL(thisValue), line);
+        vm.stackTop--;
+    }
+    else
+    {
+        vm.currentEnvironment = newEnvironment();
+    }
+
+    vm.currentEnvironment->enclosing = function->closure;
+    frame->environment = vm.currentEnvironment;
+
+    if (!function->compiled())
+    {
+        return false;
+    }
+
+    // Initializers don't push anything, they always return the instance
+    Value result = function->type == TYPE_INITIALIZER ? OBJ_VAL(thisValue) : AOT_POP();
+
+    vm.currentEnvironment = frame->returnEnvironment;
+    freeEnvironment(frame->environment);
+    vm.currentFunction = callerFunction;
+
+    vm.stackTop = frame->slots;
+    AOT_PUSH(result);
+
+    vm.frameCount--;
+    return true;
+}
+
+// Frees the scopes opened on top of the environment, until depth of them are left
+static void closeScopes(Environment* environment, uint8_t depth)
+{
+    uint opened = 0;
+
+    for (Environment* env = vm.currentEnvironment; env != environment; env = env->enclosing)
+    {
+        opened++;
+    }
+
+    while (opened > depth)
+    {
+        Environment* old = vm.currentEnvironment;
+
+        vm.currentEnvironment = vm.currentEnvironment->enclosing;
+        freeEnvironment(old);
+        opened--;
+    }
+}
+
+// Called by the generated function whose handler covers the failed instruction. Callees which failed
+// have already returned from their C functions, but their frames and scopes are still open.
+void aotCatch(ObjFunction* function, int frameCount, Environment* environment, uint8_t scopeDepth, Value* stackTop)
+{
+    while (vm.frameCount > frameCount)
+    {
+        CallFrame* frame = &vm.frames[vm.frameCount - 1];
+
+        closeScopes(frame->environment, 0);
+        vm.currentEnvironment = frame->returnEnvironment;
+        freeEnvironment(frame->environment);
+
+        vm.frameCount--;
+    }
+
+    closeScopes(environment, scopeDepth);
+    vm.currentFunction = function;
+
+    vm.stackTop = stackTop;
+    AOT_PUSH(OBJ_VAL(copyString(vm.errorMessage, strlen(vm.errorMessage))));
+}
+
+static void callNative(Value callee, uint16_t line, uint8_t argCount)
+{
+    NativeFn native = AS_NATIVE(callee);
+    Value result = native(argCount, line, vm.stackTop - argCount);
+    vm.stackTop--;
+    AOT_PUSH(result);
+}
+
+bool aotCall(uint8_t argCount, uint16_t line)
+{
+    Value callee = AOT_POP();
+
+    if (IS_OBJ(callee))
+    {
+        switch (OBJ_TYPE(callee))
+        {
+            case OBJ_BOUND_METHOD:
+            {
+                ObjBoundMethod* bound = AS_BOUND_METHOD(callee);
+                return callCompiled(bound->method, bound->instance, argCount, line);
+            }
+
+            case OBJ_FUNCTION:
+                return callCompiled(AS_FUNCTION(callee), NULL, argCount, line);
+
+            case OBJ_CLASS:
+            {
+                ObjClass* klass = AS_CLASS(callee);
+                ObjInstance* instance = newInstance(klass);
+
+                Value initializer;
+                if (tableGet(klass->methods, vm.initString, &initializer))
+                {
+                    return callCompiled(AS_FUNCTION(initializer), instance, argCount, line);
+                }
+
+                if (argCount != 0)
+                {
+                    runtimeError(line, "Expected 0 arguments but got %d.", argCount);
+                    return false;
+                }
+
+                AOT_PUSH(OBJ_VAL(instance));
+                return true;
+            }
+
+            case OBJ_NATIVE:
+                callNative(callee, line, argCount);
+                return true;
+
+            default:
+                break; // Non-callable object type.
+        }
+    }
+
+    runtimeError(line, "Can only call functions and classes.");
+    return false;
+}
+
+bool aotInvoke(ObjString* name, uint8_t argCount, uint16_t line)
+{
+    Value receiver = AOT_PEEK(argCount);
+
+    if (!IS_INSTANCE(receiver))
+    {
+        runtimeError(line, "Only instances have methods.");
+        return false;
+    }
+
+    ObjInstance* instance = AS_INSTANCE(receiver);
+
+    Value method;
+    if (!tableGet(instance->klass->methods, name, &method))
+    {
+        runtimeError(line, "Undefined property '%s'.", name->chars);
+        return false;
+    }
+
+    if (IS_NATIVE(method))
+    {
+        callNative(method, line, argCount);
+        return true;
+    }
+
+    // The receiver is reachable through 'this' from now on
+    Value* args = vm.stackTop - argCount;
+    memmove(args - 1, args, sizeof(Value) * argCount);
+    vm.stackTop--;
+
+    return callCompiled(AS_FUNCTION(method), instance, argCount, line);
+}
+
+// endregion
+
+// region Operations
+
+bool aotAdd(uint16_t line)
+{
+    if (IS_STRING(AOT_PEEK(0)) || IS_STRING(AOT_PEEK(1)))
+    {
+        Value bValue = AOT_PEEK(0);
+        Value aValue = AOT_PEEK(1);
+
+        ObjString* b = IS_OBJ(bValue) ? objectToString(bValue) : valueToString(bValue);
+        ObjString* a = IS_OBJ(aValue) ? objectToString(aValue) : valueToString(aValue);
+
+        ObjString* result = addStrings(a, b);
+        vm.stackTop--;
+        vm.stackTop--;
+        AOT_PUSH(OBJ_VAL(result));
+    }
+    else if (IS_NUMBER(AOT_PEEK(0)) && IS_NUMBER(AOT_PEEK(1)))
+    {
+        double b = AS_NUMBER(AOT_POP());
+        double a = AS_NUMBER(AOT_POP());
+        AOT_PUSH(NUMBER_VAL(a + b));
+    }
+    else
+    {
+        runtimeError(line, "Operands must be either two numbers or two strings.");
+        return false;
+    }
+
+    return true;
+}
+
+// Values stay on the stack while they are stored, growing the table can collect garbage
+bool aotDefineVariable(ObjString* name, uint16_t line)
+{
+    bool defined = environmentDefine(vm.currentEnvironment, name, AOT_PEEK(0), line);
+    vm.stackTop--;
+
+    return defined;
+}
+
+bool aotDefineArgument(ObjString* name, uint16_t line)
+{
+    return aotDefineVariable(name, line);
+}
+
+bool aotGetVariable(ObjString* name, uint16_t line)
+{
+    Value value;
+
+    if (!environmentGet(vm.currentEnvironment, name, &value))
+    {
+        if (!environmentGet(vm.nativeEnvironment, name, &value))
+        {
+            runtimeError(line, "Tried to get value of '%s', but it doesn't exist.", name->chars);
+            return false;
+        }
+    }
+
+    AOT_PUSH(value);
+    return true;
+}
+
+bool aotSetVariable(ObjString* name, uint16_t line)
+{
+    bool set = environmentSet(vm.currentEnvironment, name, AOT_PEEK(0), line);
+    vm.stackTop--;
+
+    return set;
+}
+
+// Puts the current value under the operand and applies the operator like its opcode would
+static bool applyUpdate(uint8_t op, Value current, uint16_t line)
+{
+    Value operand = AOT_PEEK(0);
+    AOT_PUSH(operand);
+    vm.stackTop[-2] = current;
+
+    switch (op)
+    {
+        case OP_ADD:         return aotAdd(line);
+        case OP_SUBTRACT:    AOT_BINARY_OP(NUMBER_VAL, -, line);              return true;
+        case OP_MULTIPLY:    AOT_BINARY_OP(NUMBER_VAL, *, line);              return true;
+        case OP_DIVIDE:      AOT_BINARY_OP(NUMBER_VAL, /, line);              return true;
+        case OP_MODULO:      AOT_NUMBER_FUNCTION_OP(numberModulo, line);      return true;
+        case OP_INT_DIVIDE:  AOT_NUMBER_FUNCTION_OP(numberIntDivide, line);   return true;
+        case OP_BIT_AND:     AOT_NUMBER_FUNCTION_OP(numberBitAnd, line);      return true;
+        case OP_BIT_OR:      AOT_NUMBER_FUNCTION_OP(numberBitOr, line);       return true;
+        case OP_BIT_XOR:     AOT_NUMBER_FUNCTION_OP(numberBitXor, line);      return true;
+        case OP_SHIFT_LEFT:  AOT_NUMBER_FUNCTION_OP(numberShiftLeft, line);   return true;
+        case OP_SHIFT_RIGHT: AOT_NUMBER_FUNCTION_OP(numberShiftRight, line);  return true;
+
+        default:
+            runtimeError(line, "Unknown operator in compound assignment.");
+            return false;
+    }
+}
+
+bool aotUpdateVariable(ObjString* name, uint8_t op, uint16_t line)
+{
+    Value* variable = environmentGetSlot(vm.currentEnvironment, name);
+
+    if (variable == NULL)
+    {
+        runtimeError(line, "Tried to get value of '%s', but it doesn't exist.", name->chars);
+        return false;
+    }
+
+    if (!applyUpdate(op, *variable, line)) return false;
+
+    if (IS_FUNCTION(*variable))
+    {
+        runtimeError(line, "Changing value of functions is illegal.");
+        return false;
+    }
+
+    *variable = AOT_POP();
+    return true;
+}
+
+bool aotDefineFunction(uint16_t line)
+{
+    ObjFunction* function = AS_FUNCTION(AOT_POP());
+    function->closure = vm.currentEnvironment;
+
+    return environmentDefine(vm.currentEnvironment, function->name, OBJ_VAL(function), line);
+}
+
+bool aotDefineClass(uint16_t line)
+{
+    ObjClass* klass = AS_CLASS(AOT_PEEK(0));
+    return environmentDefine(vm.currentEnvironment, klass->name, OBJ_VAL(klass), line);
+}
+
+void aotDefineMethod()
+{
+    ObjFunction* method = AS_FUNCTION(AOT_POP());
+    ObjClass* klass = AS_CLASS(AOT_PEEK(0));
+
+    method->closure = vm.currentEnvironment;
+    tableSet(klass->methods, method->name, OBJ_VAL(method));
+}
+
+bool aotInherit(uint16_t line)
+{
+    Value base = AOT_PEEK(0);
+    ObjClass* child = AS_CLASS(AOT_PEEK(1));
+
+    if (!IS_CLASS(base))
+    {
+        runtimeError(line, "Superclass must be a class.");
+        return false;
+    }
+
+    ObjClass* parent = AS_CLASS(base);
+    tableAddAll(parent->methods, child->methods);
+    child->parent = (struct ObjClass*) parent;
+
+    vm.stackTop--; // Parent.
+    return true;
+}
+
+static bool bindMethod(ObjClass* klass, ObjInstance* instance, ObjString* name, uint16_t line)
+{
+    Value method;
+
+    if (!tableGet(klass->methods, name, &method))
+    {
+        runtimeError(line, "Undefined property '%s'.", name->chars);
+        return false;
+    }
+
+    AOT_PUSH(OBJ_VAL(newBoundMethod(instance, AS_FUNCTION(method))));
+    return true;
+}
+
+bool aotGetBase(ObjString* name, uint16_t line)
+{
+    if (charsEqual(name->chars, "init", name->length, 4))
+    {
+        runtimeError(line, "Cannot call base initializer.");
+        return false;
+    }
+
+    Value instanceV;
+
+    if (!environmentGet(vm.currentEnvironment, vm.thisString, &instanceV) || !IS_INSTANCE(instanceV))
+    {
+        runtimeError(line, "Cannot use 'base' outside of a method.");
+        return false;
+    }
+
+    ObjInstance* instance = AS_INSTANCE(instanceV);
+    ObjClass* base = (ObjClass*) instance->klass->parent;
+
+    if (base == NULL)
+    {
+        runtimeError(line, "Cannot use 'base' in a class that does not inherit from another.");
+        return false;
+    }
+
+    return bindMethod(base, instance, name, line);
+}
+
+bool aotGetProperty(ObjString* name, uint16_t line)
+{
+    if (!IS_INSTANCE(AOT_PEEK(0)))
+    {
+        runtimeError(line, "Only instances have properties.");
+        return false;
+    }
+
+    ObjInstance* instance = AS_INSTANCE(AOT_PEEK(0));
+    Value value;
+
+    if (!tableGet(instance->fields, name, &value))
+    {
+        return bindMethod(instance->klass, instance, name, line);
+    }
+
+    vm.stackTop--; // Instance.
+    AOT_PUSH(value);
+    return true;
+}
+
+bool aotSetProperty(ObjString* name, uint16_t line)
+{
+    Value initializer = AOT_POP();
+    Value instanceVal = AOT_POP();
+
+    if (!IS_INSTANCE(instanceVal))
+    {
+        runtimeError(line, "Only instances have fields.");
+        return false;
+    }
+
+    tableSet(AS_INSTANCE(instanceVal)->fields, name, initializer);
+    AOT_PUSH(initializer);
+    return true;
+}
+
+bool aotUpdateProperty(ObjString* name, uint8_t op, uint16_t line)
+{
+    if (!IS_INSTANCE(AOT_PEEK(1)))
+    {
+        runtimeError(line, "Only instances have properties.");
+        return false;
+    }
+
+    Value* field = tableGetSlot(AS_INSTANCE(AOT_PEEK(1))->fields, name);
+
+    if (field == NULL)
+    {
+        runtimeError(line, "Undefined property '%s'.", name->chars);
+        return false;
+    }
+
+    if (!applyUpdate(op, *field, line)) return false;
+
+    *field = AOT_PEEK(0);
+    vm.stackTop[-2] = vm.stackTop[-1];
+    vm.stackTop--;
+    return true;
+}
+
+void aotScopeStart()
+{
+    Environment* enclosing = vm.currentEnvironment;
+
+    vm.currentEnvironment = newEnvironment();
+    vm.currentEnvironment->enclosing = enclosing;
+}
+
+void aotScopeEnd()
+{
+    Environment* old = vm.currentEnvironment;
+
+    vm.currentEnvironment = vm.currentEnvironment->enclosing;
+    freeEnvironment(old);
+}
+
+void aotScopeOwn()
+{
+    if (IS_OBJ(AOT_PEEK(0))) environmentOwn(vm.currentEnvironment, AS_OBJ(AOT_PEEK(0)));
+}
+
+void aotBuildList(uint8_t count)
+{
+    ObjWList* list = newWList();
+    AOT_PUSH(OBJ_VAL(list));
+
+    for (int i = count; i > 0; i--)
+    {
+        addWList(list, AOT_PEEK(i));
+    }
+
+    vm.stackTop -= count + 1;
+    AOT_PUSH(OBJ_VAL(list));
+}
+
+bool aotBuildString(uint8_t count, uint16_t line)
+{
+    ObjString* string = joinValues(vm.stackTop - count, count);
+    if (string == NULL)
+    {
+        runtimeError(line, "Only strings, numbers, booleans, null and functions can be interpolated.");
+        return false;
+    }
+
+    vm.stackTop -= count;
+    AOT_PUSH(OBJ_VAL(string));
+    return true;
+}
+
+bool aotSubscriptGet(uint16_t line)
+{
+    Value indexVal = AOT_POP();
+    Value indexedValue = AOT_POP();
+
+    if (!IS_NUMBER(indexVal))
+    {
+        runtimeError(line, "Index must be a number.");
+        return false;
+    }
+
+    uint index = AS_NUMBER(indexVal);
+
+    if (IS_LIST(indexedValue))
+    {
+        ObjWList* list = AS_LIST(indexedValue);
+
+        if (!isValidWListIndex(list, index))
+        {
+            runtimeError(line, "'%d' is not a valid index of the indexed list.", index);
+            return false;
+        }
+
+        AOT_PUSH(getIndexWList(list, index));
+    }
+    else if (IS_STRING(indexedValue))
+    {
+        ObjString* string = AS_STRING(indexedValue);
+
+        if (!isValidStringIndex(string, index))
+        {
+            runtimeError(line, "'%d' is not a valid index of '%s'.", index, string->chars);
+            return false;
+        }
+
+        AOT_PUSH(OBJ_VAL(getIndexString(string, index)));
+    }
+    else
+    {
+        runtimeError(line, "Cannot index this value type.");
+        return false;
+    }
+
+    return true;
+}
+
+int aotForeachNext(uint16_t line)
+{
+    Value iterated = AOT_PEEK(1);
+    uint index = (uint)AS_NUMBER(AOT_PEEK(0));
+
+    if (IS_LIST(iterated))
+    {
+        ObjWList* list = AS_LIST(iterated);
+        if (index >= list->count) return 0;
+
+        vm.stackTop[-1] = NUMBER_VAL(index + 1);
+        AOT_PUSH(list->items[index]);
+        return 1;
+    }
+
+    if (IS_STRING(iterated))
+    {
+        ObjString* string = AS_STRING(iterated);
+        if (index >= string->length) return 0;
+
+        vm.stackTop[-1] = NUMBER_VAL(index + 1);
+        AOT_PUSH(OBJ_VAL(getIndexString(string, index)));
+        return 1;
+    }
+
+    runtimeError(line, "Only lists and strings can be iterated over.");
+    return -1;
+}
+
+int aotForRange(bool isRangeSyntax, uint16_t line)
+{
+    Value counter = AOT_PEEK(1);
+    Value limit = AOT_PEEK(0);
+
+    if (!IS_NUMBER(counter) || !IS_NUMBER(limit))
+    {
+        runtimeError(line, rangeBoundsError(isRangeSyntax));
+        return -1;
+    }
+
+    if (!(AS_NUMBER(counter) < AS_NUMBER(limit))) return 0;
+
+    vm.stackTop[-2] = NUMBER_VAL(AS_NUMBER(counter) + 1);
+    AOT_PUSH(counter);
+    return 1;
+}
+
+void aotStepCached(Value* slot, Value step)
+{
+    if (IS_NULL(*slot)) return;
+
+    double next = AS_NUMBER(*slot) + AS_NUMBER(step);
+    *slot = fabs(next) < MAX_EXACT_INTEGER ? NUMBER_VAL(next) : NULL_VAL;
+}
+
+bool aotSubscriptStore(uint16_t line)
+{
+    Value storedValue = AOT_POP();
+    Value indexVal = AOT_POP();
+
+    if (!IS_NUMBER(indexVal))
+    {
+        runtimeError(line, "Index must be a number.");
+        return false;
+    }
+
+    uint index = AS_NUMBER(indexVal);
+    Value indexedValue = AOT_POP();
+
+    if (IS_LIST(indexedValue))
+    {
+        ObjWList* list = AS_LIST(indexedValue);
+
+        if (!isValidWListIndex(list, index))
+        {
+            runtimeError(line, "'%d' is not a valid index of the indexed list.", index);
+            return false;
+        }
+
+        storeWList(list, storedValue, index);
+    }
+    else if (IS_STRING(indexedValue))
+    {
+        if (!IS_STRING(storedValue))
+        {
+            runtimeError(line, "String index can only store other strings.", index);
+            return false;
+        }
+
+        ObjString* string = AS_STRING(indexedValue);
+        char* c = AS_CSTRING(storedValue);
+
+        if (!isValidStringIndex(string, index))
+        {
+            runtimeError(line, "'%d' is not a valid index of '%s'.", index, string->chars);
+            return false;
+        }
+
+        if (strlen(c) > 1)
+        {
+            runtimeError(line, "Cannot replace a string index with a string longer than 1 ('%s').", c);
+            return false;
+        }
+
+        replaceIndexString(string, index, *c);
+    }
+    else
+    {
+        runtimeError(line, "Cannot index this value type.");
+        return false;
+    }
+
+    return true;
+}
+
+// endregion
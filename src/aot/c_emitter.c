@@ -0,0 +1,574 @@
+#include <string.h>
+
+#include "c_emitter.h"
+#include "array.h"
+#include "memory.h"
+
+// Every function is translated into a C function with one statement per instruction.
+// Jumps become gotos, so there is no dispatch left at runtime. Instructions which do more than
+// a few stack operations call into the runtime in aot_runtime.c.
+
+DECLARE_ARRAY(Functions, ObjFunction*)
+DEFINE_ARRAY_FUNCTIONS(Functions, functions, ObjFunction*)
+
+static Functions* functions;
+static FILE* out;
+static bool hadError;
+
+// region UTIL
+
+static void error(const char* message, uint8_t instruction)
+{
+    fprintf(stderr, "Emit C Error : %s (opcode %d).\n", message, instruction);
+    hadError = true;
+}
+
+static int functionIndex(ObjFunction* function)
+{
+    for (uint i = 0; i < functions->count; i++)
+    {
+        if (functions->values[i] == function) return (int)i;
+    }
+
+    return -1;
+}
+
+static void collectFunctions(ObjFunction* function)
+{
+    // Inlined functions are also constants of every chunk calling them
+    if (functionIndex(function) != -1) return;
+
+    functionsWrite(functions, function);
+
+    ValueArray* constants = &function->chunk.constants;
+
+    for (int i = 0; i < constants->count; i++)
+    {
+        if (IS_FUNCTION(constants->values[i]))
+        {
+            collectFunctions(AS_FUNCTION(constants->values[i]));
+        }
+    }
+}
+
+// The jump is in the last two bytes of the instruction, relative to its end
+static uint jumpTarget(Chunk* chunk, uint offset)
+{
+    uint end = offset + instructionLength(chunk->code[offset]);
+    uint16_t jump = (uint16_t)((chunk->code[end - 2] << 8) | chunk->code[end - 1]);
+
+    if (chunk->code[offset] == OP_LOOP || chunk->code[offset] == OP_POP_LOOP_IF_TRUE)
+    {
+        return end - jump;
+    }
+
+    return end + jump;
+}
+
+static void writeString(const char* chars, uint length)
+{
+    fputc('"', out);
+
+    for (uint i = 0; i < length; i++)
+    {
+        unsigned char c = chars[i];
+
+        if (c == '"' || c == '\\')
+        {
+            fprintf(out, "\\%c", c);
+        }
+        else if (c < ' ' || c > '~')
+        {
+            fprintf(out, "\\%03o", c);
+        }
+        else
+        {
+            fputc(c, out);
+        }
+    }
+
+    fputc('"', out);
+}
+
+static int constantIndex(Chunk* chunk, Value value)
+{
+    for (int i = 0; i < chunk->constants.count; i++)
+    {
+        if (valuesEqual(chunk->constants.values[i], value)) return i;
+    }
+
+    return -1;
+}
+
+static uint16_t readShort(Chunk* chunk, uint offset)
+{
+    return (uint16_t)((chunk->code[offset + 1] << 8) | chunk->code[offset + 2]);
+}
+
+// endregion
+
+// region FUNCTIONS
+
+// Dense integers become a C switch, which the C compiler turns into its own jump table
+static void writeJumpTable(SwitchTable* table)
+{
+    fprintf(out, "{ Value v = AOT_POP(); ");
+    fprintf(out, "if (IS_NUMBER(v) && AS_NUMBER(v) >= %.0f && AS_NUMBER(v) < %.0f && AS_NUMBER(v) == (int)AS_NUMBER(v)) ",
+            table->low, table->low + table->count);
+    fprintf(out, "switch ((int)AS_NUMBER(v)) {");
+
+    for (uint i = 0; i < table->count; i++)
+    {
+        if (table->cases[i].target == NO_SWITCH_TARGET) continue;
+        fprintf(out, " case %.0f: goto L%d;", table->low + i, table->cases[i].target);
+    }
+
+    fprintf(out, " default: break; } }");
+}
+
+// Strings are constants of the chunk, the switch tables of the compiler aren't carried over
+static void writeSwitchCases(Chunk* chunk, SwitchTable* table)
+{
+    fprintf(out, "{ Value v = AOT_POP();");
+
+    for (uint i = 0; i < table->count; i++)
+    {
+        SwitchCase* entry = &table->cases[i];
+        if (entry->target == NO_SWITCH_TARGET) continue;
+
+        Value key = entry->key;
+
+        if (IS_NUMBER(key))
+        {
+            double number = AS_NUMBER(key);
+            uint64_t bits;
+            memcpy(&bits, &number, sizeof(double));
+
+            fprintf(out, " if (IS_NUMBER(v) && AS_NUMBER(v) == AS_NUMBER(aotNumber(0x%016llxULL))) goto L%d;",
+                    (unsigned long long)bits, entry->target);
+        }
+        else if (IS_BOOL(key))
+        {
+            fprintf(out, " if (valuesEqual(v, BOOL_VAL(%s))) goto L%d;", AS_BOOL(key) ? "true" : "false", entry->target);
+        }
+        else if (IS_NULL(key))
+        {
+            fprintf(out, " if (IS_NULL(v)) goto L%d;", entry->target);
+        }
+        else
+        {
+            fprintf(out, " if (valuesEqual(v, k[%d])) goto L%d;", constantIndex(chunk, key), entry->target);
+        }
+    }
+
+    fprintf(out, " }");
+}
+
+static void writeInstruction(ObjFunction* function, uint offset)
+{
+    Chunk* chunk = &function->chunk;
+    uint8_t instruction = chunk->code[offset];
+    uint8_t operand = chunk->code[offset + 1];
+    uint line = chunk->lines[offset];
+
+    switch (instruction)
+    {
+        case OP_CONSTANT: fprintf(out, "AOT_PUSH(k[%d]);", operand); break;
+        case OP_NULL:     fprintf(out, "AOT_PUSH(NULL_VAL);");       break;
+        case OP_TRUE:     fprintf(out, "AOT_PUSH(BOOL_VAL(true));");  break;
+        case OP_FALSE:    fprintf(out, "AOT_PUSH(BOOL_VAL(false));"); break;
+        case OP_POP:      fprintf(out, "vm.stackTop--;");             break;
+        case OP_DUP:      fprintf(out, "{ Value v = AOT_PEEK(0); AOT_PUSH(v); }"); break;
+
+        case OP_NEGATE: fprintf(out, "AOT_CHECK(aotNegate(%d));", line);                  break;
+        case OP_NOT:    fprintf(out, "{ Value v = AOT_POP(); AOT_PUSH(BOOL_VAL(aotIsFalsey(v))); }"); break;
+
+        case OP_EQUAL:
+            fprintf(out, "{ Value b = AOT_POP(); Value a = AOT_POP(); AOT_PUSH(BOOL_VAL(valuesEqual(a, b))); }");
+            break;
+        case OP_NOT_EQUAL:
+            fprintf(out, "{ Value b = AOT_POP(); Value a = AOT_POP(); AOT_PUSH(BOOL_VAL(!valuesEqual(a, b))); }");
+            break;
+        case OP_SWITCH_EQUAL:
+            fprintf(out, "{ Value b = AOT_POP(); Value a = AOT_PEEK(0); AOT_PUSH(BOOL_VAL(valuesEqual(a, b))); }");
+            break;
+
+        case OP_GREATER:       fprintf(out, "AOT_BINARY_OP(BOOL_VAL, >, %d);", line);  break;
+        case OP_GREATER_EQUAL: fprintf(out, "AOT_BINARY_OP(BOOL_VAL, >=, %d);", line); break;
+        case OP_LESS:          fprintf(out, "AOT_BINARY_OP(BOOL_VAL, <, %d);", line);  break;
+        case OP_LESS_EQUAL:    fprintf(out, "AOT_BINARY_OP(BOOL_VAL, <=, %d);", line); break;
+
+        case OP_ADD:      fprintf(out, "AOT_CHECK(aotAdd(%d));", line);                 break;
+        case OP_SUBTRACT: fprintf(out, "AOT_BINARY_OP(NUMBER_VAL, -, %d);", line);     break;
+        case OP_MULTIPLY: fprintf(out, "AOT_BINARY_OP(NUMBER_VAL, *, %d);", line);     break;
+        case OP_DIVIDE:   fprintf(out, "AOT_BINARY_OP(NUMBER_VAL, /, %d);", line);     break;
+
+        case OP_MODULO:      fprintf(out, "AOT_NUMBER_FUNCTION_OP(numberModulo, %d);", line);     break;
+        case OP_INT_DIVIDE:  fprintf(out, "AOT_NUMBER_FUNCTION_OP(numberIntDivide, %d);", line);  break;
+        case OP_BIT_AND:     fprintf(out, "AOT_NUMBER_FUNCTION_OP(numberBitAnd, %d);", line);     break;
+        case OP_BIT_OR:      fprintf(out, "AOT_NUMBER_FUNCTION_OP(numberBitOr, %d);", line);      break;
+        case OP_BIT_XOR:     fprintf(out, "AOT_NUMBER_FUNCTION_OP(numberBitXor, %d);", line);     break;
+        case OP_SHIFT_LEFT:  fprintf(out, "AOT_NUMBER_FUNCTION_OP(numberShiftLeft, %d);", line);  break;
+        case OP_SHIFT_RIGHT: fprintf(out, "AOT_NUMBER_FUNCTION_OP(numberShiftRight, %d);", line); break;
+        case OP_BIT_NOT:     fprintf(out, "AOT_CHECK(aotBitNot(%d));", line);                     break;
+
+        case OP_NEGATE_NUMBER: fprintf(out, "{ Value v = AOT_POP(); AOT_PUSH(NUMBER_VAL(-AS_NUMBER(v))); }"); break;
+
+        case OP_ADD_NUMBERS:      fprintf(out, "AOT_NUMBER_OP(NUMBER_VAL, +);"); break;
+        case OP_SUBTRACT_NUMBERS: fprintf(out, "AOT_NUMBER_OP(NUMBER_VAL, -);"); break;
+        case OP_MULTIPLY_NUMBERS: fprintf(out, "AOT_NUMBER_OP(NUMBER_VAL, *);"); break;
+        case OP_DIVIDE_NUMBERS:   fprintf(out, "AOT_NUMBER_OP(NUMBER_VAL, /);"); break;
+
+        case OP_GREATER_NUMBERS:       fprintf(out, "AOT_NUMBER_OP(BOOL_VAL, >);");  break;
+        case OP_GREATER_EQUAL_NUMBERS: fprintf(out, "AOT_NUMBER_OP(BOOL_VAL, >=);"); break;
+        case OP_LESS_NUMBERS:          fprintf(out, "AOT_NUMBER_OP(BOOL_VAL, <);");  break;
+        case OP_LESS_EQUAL_NUMBERS:    fprintf(out, "AOT_NUMBER_OP(BOOL_VAL, <=);"); break;
+
+        // aotAdd() concatenates as soon as one operand is a string
+        case OP_CONCATENATE: fprintf(out, "AOT_CHECK(aotAdd(%d));", line); break;
+        case OP_ADD_LIKELY_NUMBERS: fprintf(out, "AOT_CHECK(aotAdd(%d));", line); break;
+
+        case OP_DEFINE_VARIABLE:
+            fprintf(out, "AOT_CHECK(aotDefineVariable(AS_STRING(k[%d]), %d));", operand, line);
+            break;
+        case OP_DEFINE_ARGUMENT:
+            fprintf(out, "AOT_CHECK(aotDefineArgument(AS_STRING(k[%d]), %d));", operand, line);
+            break;
+        case OP_GET_VARIABLE:
+            fprintf(out, "AOT_CHECK(aotGetVariable(AS_STRING(k[%d]), %d));", operand, line);
+            break;
+        case OP_SET_VARIABLE:
+            fprintf(out, "AOT_CHECK(aotSetVariable(AS_STRING(k[%d]), %d));", operand, line);
+            break;
+        case OP_UPDATE_VARIABLE:
+            fprintf(out, "AOT_CHECK(aotUpdateVariable(AS_STRING(k[%d]), %d, %d));", operand, chunk->code[offset + 2], line);
+            break;
+
+        case OP_SCOPE_START: fprintf(out, "aotScopeStart();"); break;
+        case OP_SCOPE_END:   fprintf(out, "aotScopeEnd();");   break;
+        case OP_SCOPE_OWN:   fprintf(out, "aotScopeOwn();");   break;
+
+        case OP_JUMP_IF_FALSE:
+            fprintf(out, "if (aotIsFalsey(AOT_PEEK(0))) goto L%d;", jumpTarget(chunk, offset));
+            break;
+        case OP_JUMP_IF_TRUE:
+            fprintf(out, "if (!aotIsFalsey(AOT_PEEK(0))) goto L%d;", jumpTarget(chunk, offset));
+            break;
+        case OP_JUMP:
+        case OP_LOOP:
+            fprintf(out, "goto L%d;", jumpTarget(chunk, offset));
+            break;
+        case OP_POP_JUMP_IF_FALSE:
+            fprintf(out, "if (aotIsFalsey(AOT_POP())) goto L%d;", jumpTarget(chunk, offset));
+            break;
+        case OP_POP_JUMP_IF_TRUE:
+        case OP_POP_LOOP_IF_TRUE:
+            fprintf(out, "if (!aotIsFalsey(AOT_POP())) goto L%d;", jumpTarget(chunk, offset));
+            break;
+
+        case OP_FOREACH_NEXT:
+            fprintf(out, "{ int next = aotForeachNext(%d); if (next < 0) AOT_THROW(); if (next == 0) goto L%d; }",
+                    line, jumpTarget(chunk, offset));
+            break;
+        case OP_FOR_RANGE:
+            fprintf(out, "{ int next = aotForRange(%s, %d); if (next < 0) AOT_THROW(); if (next == 0) goto L%d; }",
+                    operand ? "true" : "false", line, jumpTarget(chunk, offset));
+            break;
+
+        case OP_GET_CACHED:
+            fprintf(out, "if (!IS_NULL(slots[%d])) { AOT_PUSH(slots[%d]); goto L%d; }",
+                    operand, operand, jumpTarget(chunk, offset));
+            break;
+        case OP_SET_CACHED:
+            fprintf(out, "slots[%d] = AOT_PEEK(0);", operand);
+            break;
+        case OP_STEP_CACHED:
+            fprintf(out, "aotStepCached(&slots[%d], k[%d]);", operand, chunk->code[offset + 2]);
+            break;
+
+        case OP_GET_LOCAL:
+            fprintf(out, "AOT_PUSH(slots[%d]);", operand);
+            break;
+        case OP_SET_LOCAL:
+            fprintf(out, "slots[%d] = AOT_POP();", operand);
+            break;
+
+        case OP_JUMP_TABLE:
+            writeJumpTable(&chunk->switches[readShort(chunk, offset)]);
+            break;
+        case OP_SWITCH_STRING:
+        case OP_SWITCH_SEARCH:
+            writeSwitchCases(chunk, &chunk->switches[readShort(chunk, offset)]);
+            break;
+
+        case OP_CALL: fprintf(out, "AOT_CHECK(aotCall(%d, %d));", operand, line); break;
+
+        case OP_RETURN: fprintf(out, "return true;"); break;
+
+        case OP_DEFINE_FUNCTION: fprintf(out, "AOT_CHECK(aotDefineFunction(%d));", line); break;
+        case OP_BUILD_LIST:      fprintf(out, "aotBuildList(%d);", operand);   break;
+        case OP_BUILD_STRING:    fprintf(out, "AOT_CHECK(aotBuildString(%d, %d));", operand, line); break;
+
+        case OP_SUBSCRIPT_STORE: fprintf(out, "AOT_CHECK(aotSubscriptStore(%d));", line); break;
+        case OP_SUBSCRIPT_GET:   fprintf(out, "AOT_CHECK(aotSubscriptGet(%d));", line);   break;
+
+        case OP_DEFINE_CLASS:  fprintf(out, "AOT_CHECK(aotDefineClass(%d));", line); break;
+        case OP_DEFINE_METHOD: fprintf(out, "aotDefineMethod();");                  break;
+        case OP_INHERIT:       fprintf(out, "AOT_CHECK(aotInherit(%d));", line);    break;
+
+        case OP_GET_PROPERTY:
+            fprintf(out, "AOT_CHECK(aotGetProperty(AS_STRING(k[%d]), %d));", operand, line);
+            break;
+        case OP_SET_PROPERTY:
+            fprintf(out, "AOT_CHECK(aotSetProperty(AS_STRING(k[%d]), %d));", operand, line);
+            break;
+        case OP_UPDATE_PROPERTY:
+            fprintf(out, "AOT_CHECK(aotUpdateProperty(AS_STRING(k[%d]), %d, %d));", operand, chunk->code[offset + 2], line);
+            break;
+        case OP_GET_BASE:
+            fprintf(out, "AOT_CHECK(aotGetBase(AS_STRING(k[%d]), %d));", operand, line);
+            break;
+        case OP_INVOKE:
+            fprintf(out, "AOT_CHECK(aotInvoke(AS_STRING(k[%d]), %d, %d));", operand, chunk->code[offset + 2], line);
+            break;
+
+        default:
+            error("This instruction can't be compiled to C", instruction);
+    }
+}
+
+static void writeFunction(ObjFunction* function, int index)
+{
+    Chunk* chunk = &function->chunk;
+
+    // Errors inside 'try' blocks jump to the handlers at the end of the function
+    bool catches = chunk->handlerCount > 0;
+
+    // Only instructions which are jumped to get a label
+    bool* isTarget = ALLOCATE(bool, chunk->codeCount + 1);
+    memset(isTarget, 0, sizeof(bool) * (chunk->codeCount + 1));
+
+    bool usesSlots = false;
+
+    for (uint offset = 0; offset < chunk->codeCount; offset += instructionLength(chunk->code[offset]))
+    {
+        uint8_t instruction = chunk->code[offset];
+        if (instruction == OP_GET_CACHED || instruction == OP_GET_LOCAL || instruction == OP_SET_LOCAL)
+        {
+            usesSlots = true;
+        }
+
+        if (instruction == OP_JUMP || instruction == OP_JUMP_IF_FALSE ||
+            instruction == OP_JUMP_IF_TRUE || instruction == OP_LOOP ||
+            instruction == OP_POP_JUMP_IF_FALSE || instruction == OP_POP_JUMP_IF_TRUE ||
+            instruction == OP_POP_LOOP_IF_TRUE || instruction == OP_FOREACH_NEXT ||
+            instruction == OP_FOR_RANGE || instruction == OP_GET_CACHED)
+        {
+            isTarget[jumpTarget(chunk, offset)] = true;
+        }
+    }
+
+    for (uint i = 0; i < chunk->switchCount; i++)
+    {
+        SwitchTable* table = &chunk->switches[i];
+
+        for (uint j = 0; j < table->count; j++)
+        {
+            if (table->cases[j].target != NO_SWITCH_TARGET) isTarget[table->cases[j].target] = true;
+        }
+    }
+
+    for (uint i = 0; i < chunk->handlerCount; i++)
+    {
+        isTarget[chunk->handlers[i].handler] = true;
+    }
+
+    if (catches)
+    {
+        usesSlots = true;
+        fprintf(out, "#undef AOT_THROW\n#define AOT_THROW() goto fail\n\n");
+    }
+
+    fprintf(out, "// %s\n", function->name != NULL ? function->name->chars : "<script>");
+    fprintf(out, "static bool function%d()\n{\n", index);
+
+    if (chunk->constants.count > 0)
+    {
+        fprintf(out, "    Value* k = functions[%d]->chunk.constants.values;\n\n", index);
+    }
+
+    // The frame's slots start at the arguments, before anything defines them
+    if (usesSlots)
+    {
+        fprintf(out, "    Value* slots = vm.stackTop - %d;\n\n", function->arity);
+    }
+
+    // What to unwind to when catching, and which instruction failed
+    if (catches)
+    {
+        fprintf(out, "    int frameCount = vm.frameCount;\n");
+        fprintf(out, "    Environment* environment = vm.currentEnvironment;\n");
+        fprintf(out, "    uint at = 0;\n\n");
+    }
+
+    for (uint offset = 0; offset < chunk->codeCount; offset += instructionLength(chunk->code[offset]))
+    {
+        if (isTarget[offset]) fprintf(out, "L%d:\n", offset);
+
+        fprintf(out, "    ");
+        if (catches) fprintf(out, "at = %d; ", offset);
+        writeInstruction(function, offset);
+        fputc('\n', out);
+    }
+
+    // Innermost handlers come first, like the interpreter's catchError looks them up
+    if (catches)
+    {
+        fprintf(out, "fail:\n");
+
+        for (uint i = 0; i < chunk->handlerCount; i++)
+        {
+            ExceptionHandler* handler = &chunk->handlers[i];
+
+            fprintf(out, "    if (at >= %d && at < %d) { aotCatch(functions[%d], frameCount, environment, %d, slots + %d); goto L%d; }\n",
+                    handler->start, handler->end, index, handler->scopeDepth, handler->stackDepth, handler->handler);
+        }
+
+        fprintf(out, "    return false;\n");
+    }
+
+    fprintf(out, "}\n\n");
+
+    if (catches) fprintf(out, "#undef AOT_THROW\n#define AOT_THROW() return false\n\n");
+
+    FREE_ARRAY(bool, isTarget, chunk->codeCount + 1);
+}
+
+// endregion
+
+// region LOADING
+
+static void writeConstant(int index, Value value)
+{
+    fprintf(out, "    aotAddConstant(functions[%d], ", index);
+
+    if (IS_NUMBER(value))
+    {
+        double number = AS_NUMBER(value);
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(double));
+
+        fprintf(out, "aotNumber(0x%016llxULL)", (unsigned long long)bits);
+    }
+    else if (IS_BOOL(value))
+    {
+        fprintf(out, AS_BOOL(value) ? "BOOL_VAL(true)" : "BOOL_VAL(false)");
+    }
+    else if (IS_NULL(value))
+    {
+        fprintf(out, "NULL_VAL");
+    }
+    else if (IS_STRING(value))
+    {
+        ObjString* string = AS_STRING(value);
+
+        fprintf(out, "aotString(");
+        writeString(string->chars, string->length);
+        fprintf(out, ", %d)", string->length);
+    }
+    else if (IS_FUNCTION(value))
+    {
+        fprintf(out, "OBJ_VAL(functions[%d])", functionIndex(AS_FUNCTION(value)));
+    }
+    else if (IS_CLASS(value))
+    {
+        ObjString* name = AS_CLASS(value)->name;
+
+        fprintf(out, "OBJ_VAL(newClass(AS_STRING(aotString(");
+        writeString(name->chars, name->length);
+        fprintf(out, ", %d))))", name->length);
+    }
+    else
+    {
+        error("This constant can't be compiled to C", OP_CONSTANT);
+    }
+
+    fprintf(out, ");\n");
+}
+
+static void writeLoader()
+{
+    fprintf(out, "static void loadProgram()\n{\n");
+
+    for (uint i = 0; i < functions->count; i++)
+    {
+        ObjFunction* function = functions->values[i];
+
+        fprintf(out, "    functions[%d] = aotNewFunction(", i);
+
+        if (function->name == NULL)
+        {
+            fprintf(out, "NULL");
+        }
+        else
+        {
+            writeString(function->name->chars, function->name->length);
+        }
+
+        static const char* types[] = {
+            [TYPE_FUNCTION] = "TYPE_FUNCTION",
+            [TYPE_INITIALIZER] = "TYPE_INITIALIZER",
+            [TYPE_METHOD] = "TYPE_METHOD",
+            [TYPE_SCRIPT] = "TYPE_SCRIPT",
+        };
+
+        fprintf(out, ", %d, %s, function%d);\n", function->arity, types[function->type], i);
+    }
+
+    for (uint i = 0; i < functions->count; i++)
+    {
+        ValueArray* constants = &functions->values[i]->chunk.constants;
+
+        fputc('\n', out);
+        for (int j = 0; j < constants->count; j++)
+        {
+            writeConstant((int)i, constants->values[j]);
+        }
+    }
+
+    fprintf(out, "}\n\n");
+}
+
+// endregion
+
+bool emitC(ObjFunction* script, const char* sourceName, FILE* output)
+{
+    out = output;
+    hadError = false;
+
+    functions = initFunctions(functions);
+    collectFunctions(script);
+
+    fprintf(out, "// Generated by Wally from \"%s\" with '--emit-c'.\n", sourceName);
+    fprintf(out, "// Link against the Wally library (cmake -DBUILD_LIBRARY=1) and the math library.\n\n");
+    fprintf(out, "#include \"aot.h\"\n\n");
+
+    fprintf(out, "static ObjFunction* functions[%d];\n\n", functions->count);
+
+    for (uint i = 0; i < functions->count; i++)
+    {
+        writeFunction(functions->values[i], (int)i);
+    }
+
+    writeLoader();
+
+    fprintf(out, "int main()\n{\n");
+    fprintf(out, "    initVM();\n");
+    fprintf(out, "    loadProgram();\n\n");
+    fprintf(out, "    return aotRun(functions[0]);\n");
+    fprintf(out, "}\n");
+
+    freeFunctions(functions);
+
+    return !hadError;
+}
@@ -11,6 +11,14 @@ void initChunk(Chunk* chunk)
     chunk->code = NULL;
     chunk->lines = NULL;
 
+    chunk->handlerCount = 0;
+    chunk->handlerCapacity = 0;
+    chunk->handlers = NULL;
+
+    chunk->switchCount = 0;
+    chunk->switchCapacity = 0;
+    chunk->switches = NULL;
+
     initValueArray(&chunk->constants);
 }
 
@@ -41,7 +49,15 @@ void writeChunk(Chunk* chunk, uint8_t byte, uint line)
 void freeChunk(Chunk* chunk)
 {
     FREE_ARRAY(uint8_t, chunk->code, chunk->codeCapacity);
-    FREE_ARRAY(int, chunk->lines, chunk->codeCapacity);
+    FREE_ARRAY(uint32_t, chunk->lines, chunk->lineCapacity);
+    FREE_ARRAY(ExceptionHandler, chunk->handlers, chunk->handlerCapacity);
+
+    for (uint i = 0; i < chunk->switchCount; i++)
+    {
+        FREE_ARRAY(SwitchCase, chunk->switches[i].cases, chunk->switches[i].count);
+    }
+
+    FREE_ARRAY(SwitchTable, chunk->switches, chunk->switchCapacity);
 
     freeValueArray(&chunk->constants);
     initChunk(chunk);
@@ -49,8 +65,187 @@ void freeChunk(Chunk* chunk)
 
 int addConstant(Chunk* chunk, Value value)
 {
+    // Threads compiling in parallel never collect garbage, nor can they share the VM's stack
+    if (usingArena())
+    {
+        writeValueArray(&chunk->constants, value);
+        return chunk->constants.count - 1;
+    }
+
     push(value);
     writeValueArray(&chunk->constants, value);
     pop();
     return chunk->constants.count - 1;
-}
\ No newline at end of file
+}
+
+// Opcode plus operands
+int instructionLength(uint8_t instruction)
+{
+    switch (instruction)
+    {
+        case OP_CONSTANT:
+        case OP_DEFINE_VARIABLE:
+        case OP_DEFINE_ARGUMENT:
+        case OP_GET_VARIABLE:
+        case OP_SET_VARIABLE:
+        case OP_GET_PROPERTY:
+        case OP_SET_PROPERTY:
+        case OP_GET_BASE:
+        case OP_CALL:
+        case OP_BUILD_LIST:
+        case OP_BUILD_STRING:
+        case OP_SET_CACHED:
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+            return 2;
+
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+        case OP_JUMP:
+        case OP_LOOP:
+        case OP_POP_JUMP_IF_FALSE:
+        case OP_POP_JUMP_IF_TRUE:
+        case OP_POP_LOOP_IF_TRUE:
+        case OP_JUMP_TABLE:
+        case OP_SWITCH_STRING:
+        case OP_SWITCH_SEARCH:
+        case OP_FOREACH_NEXT:
+        case OP_INVOKE:
+        case OP_UPDATE_VARIABLE:
+        case OP_UPDATE_PROPERTY:
+        case OP_PROFILE:
+        case OP_STEP_CACHED:
+            return 3;
+
+        // The slot, or whether the loop was written as a range, comes before the jump
+        case OP_FOR_RANGE:
+        case OP_GET_CACHED:
+            return 4;
+
+        default:
+            return 1;
+    }
+}
+
+void addExceptionHandler(Chunk* chunk, ExceptionHandler handler)
+{
+    if (chunk->handlerCapacity < chunk->handlerCount + 1)
+    {
+        uint oldCapacity = chunk->handlerCapacity;
+        chunk->handlerCapacity = GROW_CAPACITY(oldCapacity);
+        chunk->handlers = GROW_ARRAY(ExceptionHandler, chunk->handlers, oldCapacity, chunk->handlerCapacity);
+    }
+
+    chunk->handlers[chunk->handlerCount] = handler;
+    chunk->handlerCount++;
+}
+
+// region Switch tables
+
+uint addSwitchTable(Chunk* chunk, SwitchTable table)
+{
+    if (chunk->switchCapacity < chunk->switchCount + 1)
+    {
+        uint oldCapacity = chunk->switchCapacity;
+        chunk->switchCapacity = GROW_CAPACITY(oldCapacity);
+        chunk->switches = GROW_ARRAY(SwitchTable, chunk->switches, oldCapacity, chunk->switchCapacity);
+    }
+
+    chunk->switches[chunk->switchCount] = table;
+    return chunk->switchCount++;
+}
+
+static int valueKind(Value value)
+{
+    if (IS_NULL(value))   return 0;
+    if (IS_BOOL(value))   return 1;
+    if (IS_NUMBER(value)) return 2;
+    return 3;
+}
+
+// Any order works as long as it's the same when sorting and searching, strings are interned so pointers do
+int compareSwitchKeys(Value a, Value b)
+{
+    int kindA = valueKind(a);
+    int kindB = valueKind(b);
+    if (kindA != kindB) return kindA - kindB;
+
+    switch (kindA)
+    {
+        case 1:
+            return (int)AS_BOOL(a) - (int)AS_BOOL(b);
+
+        case 2:
+        {
+            double numberA = AS_NUMBER(a);
+            double numberB = AS_NUMBER(b);
+            return numberA < numberB ? -1 : numberA > numberB;
+        }
+
+        case 3:
+        {
+            uintptr_t objA = (uintptr_t)AS_OBJ(a);
+            uintptr_t objB = (uintptr_t)AS_OBJ(b);
+            return objA < objB ? -1 : objA > objB;
+        }
+
+        default:
+            return 0;
+    }
+}
+
+uint jumpTableTarget(SwitchTable* table, Value value)
+{
+    if (!IS_NUMBER(value)) return NO_SWITCH_TARGET;
+
+    double number = AS_NUMBER(value);
+    if (!(number >= table->low && number < table->low + table->count)) return NO_SWITCH_TARGET;
+
+    // Fractions fall between the integers
+    uint index = (uint)(number - table->low);
+    if (table->low + index != number) return NO_SWITCH_TARGET;
+
+    return table->cases[index].target;
+}
+
+uint stringSwitchTarget(SwitchTable* table, Value value)
+{
+    if (!IS_STRING(value)) return NO_SWITCH_TARGET;
+
+    ObjString* string = AS_STRING(value);
+    uint index = string->hash & (table->count - 1);
+
+    for (;;)
+    {
+        SwitchCase* entry = &table->cases[index];
+
+        if (IS_NULL(entry->key)) return NO_SWITCH_TARGET;
+        if (AS_OBJ(entry->key) == (Obj*)string) return entry->target;
+
+        index = (index + 1) & (table->count - 1);
+    }
+}
+
+uint searchSwitchTarget(SwitchTable* table, Value value)
+{
+    // NaN is neither smaller nor greater than any key, and equal to none of them
+    if (IS_NUMBER(value) && AS_NUMBER(value) != AS_NUMBER(value)) return NO_SWITCH_TARGET;
+
+    uint low = 0;
+    uint high = table->count;
+
+    while (low < high)
+    {
+        uint middle = (low + high) / 2;
+        int order = compareSwitchKeys(table->cases[middle].key, value);
+
+        if (order == 0) return table->cases[middle].target;
+
+        if (order < 0) low = middle + 1;
+        else high = middle;
+    }
+
+    return NO_SWITCH_TARGET;
+}
+
+// endregion
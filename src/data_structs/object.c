@@ -15,8 +15,7 @@ static Obj* allocateObject(size_t size, ObjType type)
     object->type = type;
     object->isMarked = false;
 
-    object->next = vm.objects;
-    vm.objects = object;
+    linkObject(object);
 
     #ifdef DEBUG_LOG_GC
     printf("%p allocate %zu for %s\n", (void*)object, size, objectTypeToChar(type));
@@ -41,9 +40,8 @@ ObjFunction* newFunction(ObjString* name, uint8_t arity, FunctionType type)
     function->arity = arity;
     function->name = name;
     function->type = type;
-    function->calledFromFunction = NULL;
-    function->calledFromIp = NULL;
-    function->calledFromEnvironment = NULL;
+    function->compiled = NULL;
+    function->declaration = NULL;
 
     initChunk(&function->chunk);
 
@@ -69,6 +67,32 @@ ObjInstance* newInstance(ObjClass* klass)
     return instance;
 }
 
+ObjCoroutine* newCoroutine(ObjFunction* function)
+{
+    // Stacks first, a collection triggered by them can't see the coroutine yet
+    Value* stack = ALLOCATE(Value, COROUTINE_STACK_MAX);
+    CallFrame* frames = ALLOCATE(CallFrame, COROUTINE_FRAMES_MAX);
+
+    ObjCoroutine* coroutine = ALLOCATE_OBJ(ObjCoroutine, OBJ_COROUTINE);
+    coroutine->function = function;
+    coroutine->state = COROUTINE_CREATED;
+    coroutine->stack = stack;
+    coroutine->frames = frames;
+
+    coroutine->savedStack = stack;
+    coroutine->savedStackTop = stack;
+    coroutine->savedFrames = frames;
+    coroutine->savedFrameCount = 0;
+    coroutine->savedFrameMax = COROUTINE_FRAMES_MAX;
+    coroutine->savedIp = NULL;
+    coroutine->savedEnvironment = NULL;
+    coroutine->savedFunction = NULL;
+
+    coroutine->resumer = NULL;
+
+    return coroutine;
+}
+
 ObjNative* newNative(NativeFn function)
 {
     ObjNative* native = ALLOCATE_OBJ(ObjNative, OBJ_NATIVE);
@@ -123,12 +147,8 @@ void removeIndexWList(ObjWList* list, uint index)
 
 bool isValidWListIndex(ObjWList* list, uint index)
 {
-    if (index > list->count - 1)
-    {
-        return false;
-    }
-
-    return true;
+    // Not 'count - 1', which wraps around for an empty list
+    return index < list->count;
 }
 
 static ObjString* allocateString(char* chars, uint length, uint32_t hash)
@@ -147,7 +167,7 @@ static ObjString* allocateString(char* chars, uint length, uint32_t hash)
 }
 
 // FNV-1a hashing
-static uint32_t hashString(const char* key, uint length)
+uint32_t hashString(const char* key, uint length)
 {
     uint32_t hash = 2166136261u;
 
@@ -163,9 +183,28 @@ static uint32_t hashString(const char* key, uint length)
 ObjString* takeString(char* chars, uint length)
 {
     uint32_t hash = hashString(chars, length);
+
+    // Strings are compared by pointer, so a built string has to become the interned one if it exists
+    ObjString* interned = tableFindString(vm.strings, chars, length, hash);
+    if (interned != NULL)
+    {
+        FREE_ARRAY(char, chars, length + 1);
+        return interned;
+    }
+
     return allocateString(chars, length, hash);
 }
 
+// Function bodies are compiled when they are first called, so strings in the AST must outlive every collection
+ObjString* keepString(ObjString* string)
+{
+    push(OBJ_VAL(string));
+    tableSet(vm.sourceStrings, string, NULL_VAL);
+    pop();
+
+    return string;
+}
+
 ObjString* copyString(const char* chars, uint length)
 {
     // Generate hash
@@ -214,6 +253,60 @@ ObjString* addStrings(ObjString* a, ObjString* b)
     return takeString(chars, length);
 }
 
+ObjString* joinValues(Value* values, uint count)
+{
+    // Numbers get room for their longest text, the buffer is shrunk once they are written
+    uint capacity = 0;
+
+    for (uint i = 0; i < count; i++)
+    {
+        if (IS_FUNCTION(values[i]) || IS_NATIVE(values[i]))
+        {
+            values[i] = OBJ_VAL(objectToString(values[i]));
+        }
+
+        if (IS_STRING(values[i]))
+        {
+            capacity += AS_STRING(values[i])->length;
+        }
+        else if (IS_OBJ(values[i]))
+        {
+            return NULL;
+        }
+        else
+        {
+            capacity += VALUE_TEXT_MAX - 1;
+        }
+    }
+
+    char* chars = ALLOCATE(char, capacity + 1);
+    uint length = 0;
+
+    for (uint i = 0; i < count; i++)
+    {
+        if (IS_STRING(values[i]))
+        {
+            ObjString* string = AS_STRING(values[i]);
+
+            memcpy(chars + length, string->chars, string->length);
+            length += string->length;
+        }
+        else
+        {
+            length += formatValue(values[i], chars + length);
+        }
+    }
+
+    chars[length] = '\0';
+
+    if (length < capacity)
+    {
+        chars = reallocate(chars, capacity + 1, length + 1);
+    }
+
+    return takeString(chars, length);
+}
+
 static void printFunction(ObjFunction* function)
 {
     if (function->name == NULL)
@@ -270,6 +363,10 @@ void printObject(Value value)
         case OBJ_BOUND_METHOD:
             printFunction(AS_BOUND_METHOD(value)->method);
             break;
+
+        case OBJ_COROUTINE:
+            printf("<coroutine %s>", AS_COROUTINE(value)->function->name->chars);
+            break;
     }
 }
 
@@ -283,6 +380,7 @@ char* objectTypeToChar(ObjType type)
         case OBJ_CLASS: return "OBJ_CLASS";
         case OBJ_INSTANCE: return "OBJ_INSTANCE";
         case OBJ_BOUND_METHOD: return "OBJ_BOUND_METHOD";
+        case OBJ_COROUTINE: return "OBJ_COROUTINE";
 
         default: return "UNREACHABLE REACHED";
     }
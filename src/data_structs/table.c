@@ -20,7 +20,7 @@ void initTable(Table* table)
 void freeTable(Table* table)
 {
     FREE_ARRAY(Entry, table->entries, table->capacity);
-    FREE_ARRAY(Entry, table->keys, table->capacity);
+    FREE_ARRAY(ObjString*, table->keys, table->capacity);
     FREE(Table, table);
 }
 
@@ -90,7 +90,7 @@ static void adjustCapacity(Table* table, int capacity)
     }
 
     FREE_ARRAY(Entry, table->entries, table->capacity);
-    FREE_ARRAY(Entry, table->keys, table->capacity);
+    FREE_ARRAY(ObjString*, table->keys, table->capacity);
     table->entries = entries;
     table->keys = keys;
     table->capacity = capacity;
@@ -226,6 +226,16 @@ bool tableGet(Table* table, ObjString* key, Value* value)
     return true;
 }
 
+Value* tableGetSlot(Table* table, ObjString* key)
+{
+    if (table->count == 0) return NULL;
+
+    Entry* entry = findEntry(table->entries, table->capacity, key);
+    if (entry->key == NULL) return NULL;
+
+    return &entry->value;
+}
+
 bool tableDelete(Table* table, ObjString* key)
 {
     if (table->count == 0) return false;
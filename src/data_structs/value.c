@@ -72,6 +72,48 @@ bool valuesEqual(Value a, Value b)
     #endif
 }
 
+bool valuesIdentical(Value a, Value b)
+{
+    #ifdef NAN_BOXING
+    return a == b;
+    #else
+    if (a.type != b.type) return false;
+
+    switch (a.type)
+    {
+        case VAL_NUMBER: return memcmp(&a.as.number, &b.as.number, sizeof(double)) == 0;
+        case VAL_BOOL:   return a.as.boolean == b.as.boolean;
+        case VAL_OBJ:    return a.as.obj == b.as.obj;
+        default:         return true;
+    }
+    #endif
+}
+
+uint32_t hashValueBits(Value value)
+{
+    uint64_t bits;
+
+    #ifdef NAN_BOXING
+    bits = value;
+    #else
+    switch (value.type)
+    {
+        case VAL_NUMBER: memcpy(&bits, &value.as.number, sizeof(double)); break;
+        case VAL_BOOL:   bits = value.as.boolean; break;
+        case VAL_OBJ:    bits = (uint64_t)(uintptr_t)value.as.obj; break;
+        default:         bits = 0; break;
+    }
+    bits ^= value.type;
+    #endif
+
+    // Mixes the high bits in, pointers and small numbers differ only in a few of them
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+
+    return (uint32_t)bits;
+}
+
 void printRawValue(Value value)
 {
     #ifdef NAN_BOXING
@@ -192,96 +234,52 @@ void printValue(Value value)
     printf(COLOR_CLEAR);
 }
 
-// 1.100000 => 1.1
-void removeTrailingZeros(char* source)
+// 1.100000 => 1.1, 100.00000 => 100
+static void removeTrailingZeros(char* source)
 {
-    uint16_t length = strlen(source);
+    if (strchr(source, '.') == NULL) return;
+
+    int i = (int)strlen(source) - 1;
 
-    for(int i = length-1; i > 0; i--)
+    while (source[i] == '0')
     {
-        if(source[i] == '0' || source[i] == '.' )
-        {
-            source[i] = 0;
-        }
-        else
-        {
-            break;
-        }
+        source[i--] = 0;
     }
 
+    if (source[i] == '.') source[i] = 0;
 }
 
-ObjString* valueToString(Value value)
+uint formatValue(Value value, char* text)
 {
-    // todo true, false, null should be global constants instead of being allocated each time
-
-    #ifdef NAN_BOXING
-
     if (IS_BOOL(value))
     {
-        if (AS_BOOL(value))
-        {
-            return copyString("true", 4);
-        }
-        else
-        {
-            return copyString("false", 5);
-        }
-    }
-    else if (IS_NULL(value))
-    {
-        return copyString("null", 4);
+        const char* name = AS_BOOL(value) ? "true" : "false";
+        strcpy(text, name);
     }
     else if (IS_NUMBER(value))
     {
-        char output[UINT8_MAX];
-        snprintf(output, UINT8_MAX, "%.5lf", AS_NUMBER(value));
-        removeTrailingZeros(output);
-
-        return copyString(output, strlen(output));
+        snprintf(text, VALUE_TEXT_MAX, "%.5lf", AS_NUMBER(value));
+        removeTrailingZeros(text);
     }
-    else if (IS_OBJ(value))
+    else
     {
-        return objectToString(value);
+        strcpy(text, "null");
     }
 
-    #else
-
-    switch (value.type)
-    {
-        case VAL_BOOL:
-        {
-            if (AS_BOOL(value))
-            {
-                return copyString("true", 4);
-            }
-            else
-            {
-                return copyString("false", 5);
-            }
-        }
-
-        case VAL_NULL:
-        {
-            return copyString("null", 4);
-        }
-
-        case VAL_NUMBER:
-        {
-            char output[UINT8_MAX];
-            snprintf(output, UINT8_MAX, "%.5lf", AS_NUMBER(value));
-            removeTrailingZeros(output);
+    return strlen(text);
+}
 
-            return copyString(output, strlen(output));
-        }
+ObjString* valueToString(Value value)
+{
+    // todo true, false, null should be global constants instead of being allocated each time
 
-        default:
-        {
-            printf("Reached unreachable.");
-        }
+    if (IS_OBJ(value))
+    {
+        return objectToString(value);
     }
 
-    #endif
+    char text[VALUE_TEXT_MAX];
+    uint length = formatValue(value, text);
 
-    return NULL;
+    return copyString(text, length);
 }
@@ -12,6 +12,29 @@ void disassembleChunk(Chunk* chunk, const char* name)
         offset = disassembleInstruction(chunk, offset);
     }
 
+    for (uint i = 0; i < chunk->handlerCount; i++)
+    {
+        ExceptionHandler* handler = &chunk->handlers[i];
+
+        colorWrite(BOLD_PURPLE, "%-17s ", "TRY");
+        printf("%04d - %04d -> %d (scope depth %d)\n", handler->start, handler->end, handler->handler, handler->scopeDepth);
+    }
+
+    for (uint i = 0; i < chunk->switchCount; i++)
+    {
+        SwitchTable* table = &chunk->switches[i];
+
+        for (uint j = 0; j < table->count; j++)
+        {
+            if (table->cases[j].target == NO_SWITCH_TARGET) continue;
+
+            colorWrite(BOLD_PURPLE, "%-17s ", "SWITCH");
+            printf("%d '", i);
+            printValue(table->cases[j].key);
+            printf("' -> %d\n", table->cases[j].target);
+        }
+    }
+
     putchar('\n');
 }
 
@@ -33,6 +56,20 @@ static int invokeInstruction(const char* name, Chunk* chunk, int offset)
     return offset + 3;
 }
 
+// The name, then the opcode of the operator
+static int updateInstruction(const char* name, Chunk* chunk, int offset)
+{
+    uint8_t constant = chunk->code[offset + 1];
+    uint8_t op = chunk->code[offset + 2];
+
+    colorWrite(BLUE, "%-17s ", name);
+    printf("%d   '", constant);
+    printValue(chunk->constants.values[constant]);
+    printf("' op %d\n", op);
+
+    return offset + 3;
+}
+
 static int byteInstruction(const char* name, Chunk* chunk, int offset)
 {
     uint8_t slot = chunk->code[offset + 1];
@@ -42,6 +79,55 @@ static int byteInstruction(const char* name, Chunk* chunk, int offset)
     return offset + 2;
 }
 
+static int siteInstruction(const char* name, Chunk* chunk, int offset)
+{
+    uint16_t site = (uint16_t)((chunk->code[offset + 1] << 8) | chunk->code[offset + 2]);
+
+    colorWrite(CYAN, "%-16s ", name);
+    printf("site %d\n", site);
+    return offset + 3;
+}
+
+static int switchInstruction(const char* name, Chunk* chunk, int offset)
+{
+    uint16_t table = (uint16_t)((chunk->code[offset + 1] << 8) | chunk->code[offset + 2]);
+
+    colorWrite(BOLD_PURPLE, "%-17s ", name);
+    printf("table %d\n", table);
+    return offset + 3;
+}
+
+static int cachedInstruction(const char* name, Chunk* chunk, int offset)
+{
+    uint8_t slot = chunk->code[offset + 1];
+    uint16_t jump = (uint16_t)((chunk->code[offset + 2] << 8) | chunk->code[offset + 3]);
+
+    colorWrite(BOLD_PURPLE, "%-17s ", name);
+    printf("slot %d, %4d -> %d\n", slot, offset, offset + 4 + jump);
+    return offset + 4;
+}
+
+static int rangeInstruction(const char* name, Chunk* chunk, int offset)
+{
+    bool isRangeSyntax = chunk->code[offset + 1];
+    uint16_t jump = (uint16_t)((chunk->code[offset + 2] << 8) | chunk->code[offset + 3]);
+
+    colorWrite(BOLD_PURPLE, "%-17s ", name);
+    printf("%s, %4d -> %d\n", isRangeSyntax ? "range" : "counted", offset, offset + 4 + jump);
+    return offset + 4;
+}
+
+static int stepInstruction(const char* name, Chunk* chunk, int offset)
+{
+    uint8_t slot = chunk->code[offset + 1];
+    uint8_t constant = chunk->code[offset + 2];
+
+    colorWrite(CYAN, "%-16s slot %d by '", name, slot);
+    printValue(chunk->constants.values[constant]);
+    printf("'\n");
+    return offset + 3;
+}
+
 static int constantInstruction(const char* name, Chunk* chunk, int offset)
 {
     uint8_t constant = chunk->code[offset + 1];
@@ -97,6 +183,46 @@ int disassembleInstruction(Chunk* chunk, int offset)
             return simpleInstruction("OP_MULTIPLY", offset);
         case OP_DIVIDE:
             return simpleInstruction("OP_DIVIDE", offset);
+        case OP_MODULO:
+            return simpleInstruction("OP_MODULO", offset);
+        case OP_INT_DIVIDE:
+            return simpleInstruction("OP_INT_DIVIDE", offset);
+        case OP_BIT_AND:
+            return simpleInstruction("OP_BIT_AND", offset);
+        case OP_BIT_OR:
+            return simpleInstruction("OP_BIT_OR", offset);
+        case OP_BIT_XOR:
+            return simpleInstruction("OP_BIT_XOR", offset);
+        case OP_SHIFT_LEFT:
+            return simpleInstruction("OP_SHIFT_LEFT", offset);
+        case OP_SHIFT_RIGHT:
+            return simpleInstruction("OP_SHIFT_RIGHT", offset);
+        case OP_BIT_NOT:
+            return simpleInstruction("OP_BIT_NOT", offset);
+        case OP_NEGATE_NUMBER:
+            return simpleInstruction("OP_NEGATE_NUMBER", offset);
+        case OP_ADD_NUMBERS:
+            return simpleInstruction("OP_ADD_NUMBERS", offset);
+        case OP_SUBTRACT_NUMBERS:
+            return simpleInstruction("OP_SUBTRACT_NUMBERS", offset);
+        case OP_MULTIPLY_NUMBERS:
+            return simpleInstruction("OP_MULTIPLY_NUMBERS", offset);
+        case OP_DIVIDE_NUMBERS:
+            return simpleInstruction("OP_DIVIDE_NUMBERS", offset);
+        case OP_GREATER_NUMBERS:
+            return simpleInstruction("OP_GREATER_NUMBERS", offset);
+        case OP_GREATER_EQUAL_NUMBERS:
+            return simpleInstruction("OP_GREATER_EQUAL_NUMBERS", offset);
+        case OP_LESS_NUMBERS:
+            return simpleInstruction("OP_LESS_NUMBERS", offset);
+        case OP_LESS_EQUAL_NUMBERS:
+            return simpleInstruction("OP_LESS_EQUAL_NUMBERS", offset);
+        case OP_CONCATENATE:
+            return simpleInstruction("OP_CONCATENATE", offset);
+        case OP_ADD_LIKELY_NUMBERS:
+            return simpleInstruction("OP_ADD_LIKELY_NUMBERS", offset);
+        case OP_PROFILE:
+            return siteInstruction("OP_PROFILE", chunk, offset);
         case OP_NULL:
             return simpleInstruction("OP_NULL", offset);
         case OP_TRUE:
@@ -119,14 +245,20 @@ int disassembleInstruction(Chunk* chunk, int offset)
             return simpleInstruction("OP_LESS_EQUAL", offset);
         case OP_POP:
             return simpleInstruction("OP_POP", offset);
-        case OP_TERNARY:
-            return simpleInstruction("OP_TERNARY", offset);
+        case OP_DUP:
+            return simpleInstruction("OP_DUP", offset);
         case OP_SWITCH_EQUAL:
             return simpleInstruction("OP_SWITCH_EQUAL", offset);
+        case OP_RESUME:
+            return simpleInstruction("OP_RESUME", offset);
+        case OP_YIELD:
+            return simpleInstruction("OP_YIELD", offset);
         case OP_SCOPE_START:
             return simpleInstruction("OP_SCOPE_START", offset);
         case OP_SCOPE_END:
             return simpleInstruction("OP_SCOPE_END", offset);
+        case OP_SCOPE_OWN:
+            return simpleInstruction("OP_SCOPE_OWN", offset);
         case OP_DEFINE_FUNCTION:
             return simpleInstruction("OP_DEFINE_FUNCTION", offset);
         case OP_DEFINE_CLASS:
@@ -148,6 +280,26 @@ int disassembleInstruction(Chunk* chunk, int offset)
             return jumpInstruction("OP_JUMP_IF_TRUE", 1, chunk, offset);
         case OP_LOOP:
             return jumpInstruction("OP_LOOP", -1, chunk, offset);
+        case OP_POP_JUMP_IF_FALSE:
+            return jumpInstruction("OP_POP_JUMP_IF_FALSE", 1, chunk, offset);
+        case OP_POP_JUMP_IF_TRUE:
+            return jumpInstruction("OP_POP_JUMP_IF_TRUE", 1, chunk, offset);
+        case OP_POP_LOOP_IF_TRUE:
+            return jumpInstruction("OP_POP_LOOP_IF_TRUE", -1, chunk, offset);
+        case OP_FOREACH_NEXT:
+            return jumpInstruction("OP_FOREACH_NEXT", 1, chunk, offset);
+        case OP_FOR_RANGE:
+            return rangeInstruction("OP_FOR_RANGE", chunk, offset);
+        case OP_GET_CACHED:
+            return cachedInstruction("OP_GET_CACHED", chunk, offset);
+        case OP_STEP_CACHED:
+            return stepInstruction("OP_STEP_CACHED", chunk, offset);
+        case OP_JUMP_TABLE:
+            return switchInstruction("OP_JUMP_TABLE", chunk, offset);
+        case OP_SWITCH_STRING:
+            return switchInstruction("OP_SWITCH_STRING", chunk, offset);
+        case OP_SWITCH_SEARCH:
+            return switchInstruction("OP_SWITCH_SEARCH", chunk, offset);
 
         case OP_CONSTANT:
             return constantInstruction("OP_CONSTANT", chunk, offset);
@@ -159,6 +311,10 @@ int disassembleInstruction(Chunk* chunk, int offset)
             return constantInstruction("OP_GET_PROPERTY", chunk, offset);
         case OP_SET_PROPERTY:
             return constantInstruction("OP_SET_PROPERTY", chunk, offset);
+        case OP_UPDATE_VARIABLE:
+            return updateInstruction("OP_UPDATE_VARIABLE", chunk, offset);
+        case OP_UPDATE_PROPERTY:
+            return updateInstruction("OP_UPDATE_PROPERTY", chunk, offset);
         case OP_DEFINE_VARIABLE:
             return constantInstruction("OP_DEFINE_VARIABLE", chunk, offset);
         case OP_DEFINE_ARGUMENT:
@@ -173,6 +329,14 @@ int disassembleInstruction(Chunk* chunk, int offset)
             return byteInstruction("OP_CALL", chunk, offset);
         case OP_BUILD_LIST:
             return byteInstruction("OP_BUILD_LIST", chunk, offset);
+        case OP_BUILD_STRING:
+            return byteInstruction("OP_BUILD_STRING", chunk, offset);
+        case OP_SET_CACHED:
+            return byteInstruction("OP_SET_CACHED", chunk, offset);
+        case OP_GET_LOCAL:
+            return byteInstruction("OP_GET_LOCAL", chunk, offset);
+        case OP_SET_LOCAL:
+            return byteInstruction("OP_SET_LOCAL", chunk, offset);
 
         default:
             printf("Unknown opcode %d\n", instruction);
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "phase_timer.h"
+#include "vm.h"
+
+#define MAX_PHASES 8
+#define MAX_OPEN_PHASES 4
+
+typedef struct
+{
+    const char* name;
+    bool coversSource;
+
+    double seconds;
+    size_t allocations;
+    size_t bytes;
+} Phase;
+
+// Totals when the phase was entered
+typedef struct
+{
+    Phase* phase;
+
+    double start;
+    size_t allocations;
+    size_t bytes;
+} OpenPhase;
+
+bool timePhases = false;
+
+static Phase phases[MAX_PHASES];
+static uint phaseCount = 0;
+
+static OpenPhase openPhases[MAX_OPEN_PHASES];
+static uint openCount = 0;
+
+static uint sourceLines = 0;
+static uint sourceTokens = 0;
+
+static double now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static Phase* findPhase(const char* name, bool coversSource)
+{
+    for (uint i = 0; i < phaseCount; i++)
+    {
+        if (strcmp(phases[i].name, name) == 0) return &phases[i];
+    }
+
+    if (phaseCount == MAX_PHASES) return NULL;
+
+    Phase* phase = &phases[phaseCount++];
+    phase->name = name;
+    phase->coversSource = coversSource;
+    phase->seconds = 0;
+    phase->allocations = 0;
+    phase->bytes = 0;
+
+    return phase;
+}
+
+void beginPhase(const char* name, bool coversSource)
+{
+    if (!timePhases) return;
+
+    // Too deep phases are left out, their endPhase() still has to match
+    OpenPhase* entered = openCount < MAX_OPEN_PHASES ? &openPhases[openCount] : NULL;
+    openCount++;
+
+    if (entered == NULL) return;
+
+    entered->phase = findPhase(name, coversSource);
+    entered->allocations = vm.totalAllocations;
+    entered->bytes = vm.totalBytesAllocated;
+    entered->start = now();
+}
+
+void endPhase()
+{
+    if (!timePhases) return;
+
+    double end = now();
+
+    openCount--;
+    if (openCount >= MAX_OPEN_PHASES) return;
+
+    OpenPhase* left = &openPhases[openCount];
+    if (left->phase == NULL) return;
+
+    left->phase->seconds += end - left->start;
+    left->phase->allocations += vm.totalAllocations - left->allocations;
+    left->phase->bytes += vm.totalBytesAllocated - left->bytes;
+}
+
+void setPhaseSource(uint lines, uint tokens)
+{
+    sourceLines = lines;
+    sourceTokens = tokens;
+}
+
+void printPhases()
+{
+    fprintf(stderr, "%-12s %12s %12s %14s %12s %12s\n", "phase", "time (ms)", "allocations", "bytes", "lines/s",
+            "tokens/s");
+
+    for (uint i = 0; i < phaseCount; i++)
+    {
+        Phase* phase = &phases[i];
+
+        fprintf(stderr, "%-12s %12.3f %12zu %14zu", phase->name, phase->seconds * 1000, phase->allocations,
+                phase->bytes);
+
+        if (phase->coversSource && phase->seconds > 0)
+        {
+            fprintf(stderr, " %12.0f %12.0f", sourceLines / phase->seconds, sourceTokens / phase->seconds);
+        }
+
+        fprintf(stderr, "\n");
+    }
+}
@@ -10,11 +10,20 @@ char* tokenEnumToChar(TokenType type)
         case TOKEN_RIGHT_BRACE: return "TOKEN_RIGHT_BRACE";
         case TOKEN_COMMA: return "TOKEN_COMMA";
         case TOKEN_DOT: return "TOKEN_DOT";
+        case TOKEN_DOT_DOT: return "TOKEN_DOT_DOT";
         case TOKEN_MINUS: return "TOKEN_MINUS";
         case TOKEN_PLUS: return "TOKEN_PLUS";
         case TOKEN_SEMICOLON: return "TOKEN_SEMICOLON";
         case TOKEN_SLASH: return "TOKEN_SLASH";
         case TOKEN_STAR: return "TOKEN_STAR";
+        case TOKEN_PERCENT: return "TOKEN_PERCENT";
+        case TOKEN_TILDE: return "TOKEN_TILDE";
+        case TOKEN_TILDE_SLASH: return "TOKEN_TILDE_SLASH";
+        case TOKEN_CARET: return "TOKEN_CARET";
+        case TOKEN_AMPERSAND: return "TOKEN_AMPERSAND";
+        case TOKEN_PIPE: return "TOKEN_PIPE";
+        case TOKEN_LESS_LESS: return "TOKEN_LESS_LESS";
+        case TOKEN_GREATER_GREATER: return "TOKEN_GREATER_GREATER";
         case TOKEN_BANG: return "TOKEN_BANG";
         case TOKEN_BANG_EQUAL: return "TOKEN_BANG_EQUAL";
         case TOKEN_EQUAL: return "TOKEN_EQUAL";
@@ -30,6 +39,8 @@ char* tokenEnumToChar(TokenType type)
         case TOKEN_ELSE: return "TOKEN_ELSE";
         case TOKEN_FALSE: return "TOKEN_FALSE";
         case TOKEN_FOR: return "TOKEN_FOR";
+        case TOKEN_FOREACH: return "TOKEN_FOREACH";
+        case TOKEN_IN: return "TOKEN_IN";
         case TOKEN_FUNCTION: return "TOKEN_FUNCTION";
         case TOKEN_IF: return "TOKEN_IF";
         case TOKEN_NULL: return "TOKEN_NULL";
@@ -53,6 +64,11 @@ char* tokenEnumToChar(TokenType type)
         case TOKEN_CASE:    return "TOKEN_CASE";
         case TOKEN_DEFAULT: return "TOKEN_DEFAULT";
         case TOKEN_SWITCH:  return "TOKEN_SWITCH";
+        case TOKEN_TRY:     return "TOKEN_TRY";
+        case TOKEN_CATCH:   return "TOKEN_CATCH";
+        case TOKEN_YIELD:   return "TOKEN_YIELD";
+        case TOKEN_RESUME:  return "TOKEN_RESUME";
+        case TOKEN_CONST:   return "TOKEN_CONST";
         default: return "! PRINTED THE UNPRINTABLE !";
     }
 }
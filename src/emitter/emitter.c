@@ -1,71 +1,228 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "emitter.h"
 #include "chunk.h"
 #include "list.h"
 #include "garbage_collector.h"
 #include "array.h"
+#include "constant_folding.h"
+#include "peephole.h"
+#include "inliner.h"
+#include "type_inference.h"
+#include "profile.h"
+#include "escape_analysis.h"
+#include "loop_invariants.h"
+#include "tree_shaking.h"
+#include "ir_builder.h"
+#include "ir_optimizer.h"
+#include "ir_lowering.h"
+#include "chunk_writer.h"
+#include "vm.h"
+#include "memory.h"
+#include "thread_pool.h"
+#include "phase_timer.h"
 
 #ifdef DEBUG_PRINT_BYTECODE
 #include "disassembler.h"
 #endif
 
 static uint16_t compileStatement(Stmt* statement);
+static void compileExpression(Expr* expression);
 
-// TODO make it not global
-UInts* breaks;
-UInts* continues;
-uint loopDepth = 0;
+// Reported by a function body compiled in parallel, printed in the order of the bodies once all are done
+typedef struct
+{
+    const char* message;
+    uint16_t line;
+} EmitterError;
+
+// A body of a top-level function or method, put aside until the script is compiled
+typedef struct
+{
+    ObjFunction* function;
+    FunctionStmt* declaration;
+    uint16_t line;
+
+    AllocationArena arena;
+    EmitterError* errors;
+    uint errorCount;
+    uint errorCapacity;
+    bool hadError;
+} BodyJob;
+
+// State of one compilation, every thread compiling has its own
+typedef struct
+{
+    Compiler* current;
+
+    UInts* breaks;
+    UInts* continues;
+    uint loopDepth;
+
+    // Scopes opened inside the innermost loop are closed by 'break' and 'continue' before they jump out
+    int loopScopeDepth;
+
+    // Values of switches inside the innermost loop still on the stack, popped by 'break' and 'continue'
+    int loopSwitchValues;
+
+    // Stack slot, relative to the frame, of the innermost loop's first cached expression
+    int loopCacheBase;
 
-Compiler* current = NULL;
-bool hadError = false;
+    bool hadError;
+
+    // Collected instead of printed while compiling in parallel
+    EmitterError* errors;
+    uint errorCount;
+    uint errorCapacity;
+    bool collectErrors;
+
+    // Bodies of top-level functions and methods are put aside here while it's set, see compileJobs
+    BodyJob* jobs;
+    uint jobCount;
+    uint jobCapacity;
+    bool deferBodies;
+} Emitter;
+
+static _Thread_local Emitter* emitter = NULL;
+
+bool lazyCompilation = true;
+uint compileThreads = 1;
 
 // region ERROR
 
-static void error(const char* message, uint16_t line)
+static void printError(const char* message, uint16_t line)
 {
     fprintf(stderr, "[line %d] Emitter Error : %s\n", line, message);
-    hadError = true;
+}
+
+void emitterError(const char* message, uint16_t line)
+{
+    emitter->hadError = true;
+
+    if (!emitter->collectErrors)
+    {
+        printError(message, line);
+        return;
+    }
+
+    if (emitter->errorCount + 1 > emitter->errorCapacity)
+    {
+        uint oldCapacity = emitter->errorCapacity;
+        emitter->errorCapacity = GROW_CAPACITY(oldCapacity);
+        emitter->errors = GROW_ARRAY(EmitterError, emitter->errors, oldCapacity, emitter->errorCapacity);
+    }
+
+    emitter->errors[emitter->errorCount].message = message;
+    emitter->errors[emitter->errorCount].line = line;
+    emitter->errorCount++;
 }
 
 // endregion
 
 // region EMITTING BYTES
 
-static Chunk* currentChunk()
+// Declared in chunk_writer.h, ir_lowering.c emits through them as well
+
+Chunk* currentChunk()
 {
-    return &current->function->chunk;
+    return &emitter->current->function->chunk;
 }
 
-static void emitByte(uint8_t byte, uint16_t line)
+void emitByte(uint8_t byte, uint16_t line)
 {
     writeChunk(currentChunk(), byte, line);
 }
 
-static void emitBytes(uint8_t byte1, uint8_t byte2, uint16_t line)
+void emitBytes(uint8_t byte1, uint8_t byte2, uint16_t line)
 {
     emitByte(byte1, line);
     emitByte(byte2, line);
 }
 
-static uint8_t makeConstant(Value value, uint16_t line)
+static ConstantSlot* findConstantSlot(ConstantSlot* slots, uint capacity, Value value)
+{
+    uint32_t index = hashValueBits(value) & (capacity - 1);
+
+    for (;;)
+    {
+        ConstantSlot* slot = &slots[index];
+        if (slot->index == -1 || valuesIdentical(slot->value, value)) return slot;
+
+        index = (index + 1) & (capacity - 1);
+    }
+}
+
+static void growConstantSlots()
+{
+    uint capacity = GROW_CAPACITY(emitter->current->constantSlotCapacity);
+    ConstantSlot* slots = ALLOCATE(ConstantSlot, capacity);
+
+    for (uint i = 0; i < capacity; i++)
+    {
+        slots[i].index = -1;
+    }
+
+    for (uint i = 0; i < emitter->current->constantSlotCapacity; i++)
+    {
+        ConstantSlot* old = &emitter->current->constantSlots[i];
+        if (old->index == -1) continue;
+
+        *findConstantSlot(slots, capacity, old->value) = *old;
+    }
+
+    FREE_ARRAY(ConstantSlot, emitter->current->constantSlots, emitter->current->constantSlotCapacity);
+    emitter->current->constantSlots = slots;
+    emitter->current->constantSlotCapacity = capacity;
+}
+
+uint8_t makeConstant(Value value, uint16_t line)
 {
+    // Kept at most half full
+    if (emitter->current->constantSlotCount + 1 > emitter->current->constantSlotCapacity / 2)
+    {
+        growConstantSlots();
+    }
+
+    ConstantSlot* slot = findConstantSlot(emitter->current->constantSlots, emitter->current->constantSlotCapacity, value);
+    if (slot->index != -1) return (uint8_t)slot->index;
+
     int constant = addConstant(currentChunk(), value);
     if (constant > UINT8_MAX)
     {
-        error("Too many constants in one chunk.", line);
+        emitterError("Too many constants in one chunk.", line);
         return 0;
     }
 
+    slot->value = value;
+    slot->index = constant;
+    emitter->current->constantSlotCount++;
+
     return (uint8_t)constant;
 }
 
-static void emitConstant(Value value, uint16_t line)
+void emitConstant(Value value, uint16_t line)
 {
     emitBytes(OP_CONSTANT, makeConstant(value, line), line);
 }
 
-static uint emitJump(uint8_t instruction, uint16_t line)
+// The object isn't reachable from anywhere before it's a constant. Threads compiling in parallel never collect
+// garbage and can't use the VM's stack.
+static void emitNewObject(Obj* object, uint16_t line)
+{
+    if (usingArena())
+    {
+        emitConstant(OBJ_VAL(object), line);
+        return;
+    }
+
+    push(OBJ_VAL(object));
+    emitConstant(OBJ_VAL(object), line);
+    pop();
+}
+
+uint emitJump(uint8_t instruction, uint16_t line)
 {
     emitByte(instruction, line);
 
@@ -76,14 +233,14 @@ static uint emitJump(uint8_t instruction, uint16_t line)
     return currentChunk()->codeCount - 2;
 }
 
-static void patchJump(uint offset, uint16_t line)
+void patchJump(uint offset, uint16_t line)
 {
     // -2 to adjust for the bytecode for the jump offset itself
     uint jump = currentChunk()->codeCount - offset - 2;
 
     if (jump > UINT16_MAX)
     {
-        error("Too much code to jump over.", line);
+        emitterError("Too much code to jump over.", line);
     }
 
     currentChunk()->code[offset] = (jump >> 8) & 0xff;
@@ -96,229 +253,796 @@ static void patchLoopJumps(UInts* jumps, uint16_t line)
     {
         patchJump(jumps->values[i], line);
     }
-
-    freeUInts(jumps);
 }
 
-static void emitLoop(uint loopStart, uint16_t line)
+// OP_LOOP or OP_POP_LOOP_IF_TRUE
+void emitLoop(uint8_t instruction, uint loopStart, uint16_t line)
 {
-    emitByte(OP_LOOP, line);
+    emitByte(instruction, line);
 
     uint offset = currentChunk()->codeCount - loopStart + 2;
-    if (offset > UINT16_MAX) error("Loop body too large.", line);
+    if (offset > UINT16_MAX) emitterError("Loop body too large.", line);
 
     emitByte((offset >> 8) & 0xff, line);
     emitByte(offset & 0xff, line);
 }
 
-static void emitReturn(uint16_t line)
+void emitReturn(uint16_t line)
 {
     emitByte(OP_RETURN, line);
 }
 
-// endregion
-static void initCompiler(Compiler* compiler, ObjString* fooName, uint16_t fooArity, FunctionType type);
-static ObjFunction* endCompiler(bool emitNull, uint16_t line);
+// Only while recording a profile, sites that don't fit in the operand aren't recorded
+void emitProfile(uint site, uint16_t line)
+{
+    if (!profiling || site > MAX_PROFILED_SITE) return;
 
-static void compileExpression(Expr* expression)
+    emitByte(OP_PROFILE, line);
+    emitByte((site >> 8) & 0xff, line);
+    emitByte(site & 0xff, line);
+}
+
+static void emitScopeStart(uint16_t line)
+{
+    emitByte(OP_SCOPE_START, line);
+    emitter->current->scopeDepth++;
+}
+
+static void emitScopeEnd(uint16_t line)
+{
+    emitByte(OP_SCOPE_END, line);
+    emitter->current->scopeDepth--;
+}
+
+// Operands are on the stack, types are INFERRED_* bits
+void emitBinaryOp(TokenType op, uint8_t leftTypes, uint8_t rightTypes, uint site, uint16_t line)
 {
-    if(expression == NULL)
+    // Proven by type inference, the operands don't have to be checked
+    bool numbers = leftTypes == INFERRED_NUMBER && rightTypes == INFERRED_NUMBER;
+
+    if (!numbers && op != TOKEN_EQUAL_EQUAL && op != TOKEN_BANG_EQUAL)
     {
-        return;
+        emitProfile(site, line);
     }
 
-    uint16_t line = expression->line;
-
-    switch (expression->type)
+    switch (op)
     {
-        case LITERAL_EXPRESSION:
+        case TOKEN_PLUS:
         {
-            LiteralExpr* expr = (LiteralExpr*)expression;
-
-            #ifdef NAN_BOXING
-
-            Value value = expr->value;
+            SiteFeedback* feedback = getSiteFeedback(site);
 
-            if (IS_BOOL(value))
+            if (numbers)
             {
-                emitConstant(BOOL_VAL(AS_BOOL(value)), line);
+                emitByte(OP_ADD_NUMBERS, line);
             }
-            else if (IS_NULL(value))
+            else if (leftTypes == INFERRED_STRING || rightTypes == INFERRED_STRING)
             {
-                emitByte(OP_NULL, line);
+                emitByte(OP_CONCATENATE, line);
             }
-            else if (IS_NUMBER(value))
+            else if (feedback != NULL && feedback->leftTypes == INFERRED_NUMBER &&
+                     feedback->rightTypes == INFERRED_NUMBER)
             {
-                emitConstant(NUMBER_VAL(AS_NUMBER(value)), line);
+                emitByte(OP_ADD_LIKELY_NUMBERS, line);
             }
-            else if (IS_STRING(value))
+            else
             {
-                emitConstant(OBJ_VAL(AS_STRING(value)), line);
+                emitByte(OP_ADD, line);
             }
+            break;
+        }
+        case TOKEN_MINUS:
+        case TOKEN_MINUS_E:
+            emitByte(numbers ? OP_SUBTRACT_NUMBERS : OP_SUBTRACT, line);
+            break;
+        case TOKEN_SLASH:
+            emitByte(numbers ? OP_DIVIDE_NUMBERS : OP_DIVIDE, line);
+            break;
+        case TOKEN_STAR:
+            emitByte(numbers ? OP_MULTIPLY_NUMBERS : OP_MULTIPLY, line);
+            break;
+        case TOKEN_PERCENT:
+            emitByte(OP_MODULO, line);
+            break;
+        case TOKEN_TILDE_SLASH:
+            emitByte(OP_INT_DIVIDE, line);
+            break;
+        case TOKEN_AMPERSAND:
+            emitByte(OP_BIT_AND, line);
+            break;
+        case TOKEN_PIPE:
+            emitByte(OP_BIT_OR, line);
+            break;
+        case TOKEN_CARET:
+            emitByte(OP_BIT_XOR, line);
+            break;
+        case TOKEN_LESS_LESS:
+            emitByte(OP_SHIFT_LEFT, line);
+            break;
+        case TOKEN_GREATER_GREATER:
+            emitByte(OP_SHIFT_RIGHT, line);
+            break;
+        case TOKEN_EQUAL_EQUAL:
+            emitByte(OP_EQUAL, line);
+            break;
+        case TOKEN_BANG_EQUAL:
+            emitByte(OP_NOT_EQUAL, line);
+            break;
+        case TOKEN_GREATER_EQUAL:
+            emitByte(numbers ? OP_GREATER_EQUAL_NUMBERS : OP_GREATER_EQUAL, line);
+            break;
+        case TOKEN_LESS_EQUAL:
+            emitByte(numbers ? OP_LESS_EQUAL_NUMBERS : OP_LESS_EQUAL, line);
+            break;
+        case TOKEN_LESS:
+            emitByte(numbers ? OP_LESS_NUMBERS : OP_LESS, line);
+            break;
+        case TOKEN_GREATER:
+            emitByte(numbers ? OP_GREATER_NUMBERS : OP_GREATER, line);
+            break;
 
-            #else
+        default:
+            emitterError("Unknown operator in binary expression.", line);
+    }
+}
 
-            switch (expr->value.type)
-            {
-                case VAL_BOOL:
-                    emitConstant(BOOL_VAL(expr->value.as.boolean), line);
-                    break;
+// Checked opcode of an arithmetic operator, which OP_UPDATE_VARIABLE and OP_UPDATE_PROPERTY apply
+static uint8_t updateOpcode(TokenType op)
+{
+    switch (op)
+    {
+        case TOKEN_PLUS:            return OP_ADD;
+        case TOKEN_MINUS:
+        case TOKEN_MINUS_E:         return OP_SUBTRACT;
+        case TOKEN_STAR:            return OP_MULTIPLY;
+        case TOKEN_SLASH:           return OP_DIVIDE;
+        case TOKEN_PERCENT:         return OP_MODULO;
+        case TOKEN_TILDE_SLASH:     return OP_INT_DIVIDE;
+        case TOKEN_AMPERSAND:       return OP_BIT_AND;
+        case TOKEN_PIPE:            return OP_BIT_OR;
+        case TOKEN_CARET:           return OP_BIT_XOR;
+        case TOKEN_LESS_LESS:       return OP_SHIFT_LEFT;
+        case TOKEN_GREATER_GREATER: return OP_SHIFT_RIGHT;
+
+        default:
+            return OP_ADD;
+    }
+}
 
-                case VAL_NULL:
-                    emitByte(OP_NULL, line);
-                    break;
+// The operand is on the stack
+void emitUpdate(uint8_t op, ObjString* name, TokenType operator, uint16_t line)
+{
+    emitBytes(op, makeConstant(OBJ_VAL(name), line), line);
+    emitByte(updateOpcode(operator), line);
+}
 
-                case VAL_NUMBER:
-                    emitConstant(NUMBER_VAL(expr->value.as.number), line);
-                    break;
+// Blocks which don't declare anything get no environment of their own, nested blocks get their own scope
+static bool declaresNames(Node* statements)
+{
+    for (Node* node = statements; node != NULL; node = node->next)
+    {
+        switch (node->value.as.statement->type)
+        {
+            case VARIABLE_STATEMENT:
+            case FUNCTION_STATEMENT:
+            case CLASS_STATEMENT:
+                return true;
 
-                case VAL_OBJ:
-                    emitConstant(OBJ_VAL(expr->value.as.obj), line);
-                    break;
-            }
+            default:
+                break;
+        }
+    }
 
-            #endif
+    return false;
+}
 
-            break;
-        }
+// endregion
 
-        case BINARY_EXPRESSION:
-        {
-            BinaryExpr* expr = (BinaryExpr*)expression;
+// region LOOPS
 
-            compileExpression(expr->left);
-            compileExpression(expr->right);
+// Constant folding leaves literal conditions, like the one of 'while (true)', these need no test
+static bool isAlwaysTrue(Expr* condition)
+{
+    if (condition == NULL) return true;
+    if (condition->type != LITERAL_EXPRESSION) return false;
 
-            switch (expr->op)
-            {
-                case TOKEN_PLUS:
-                    emitByte(OP_ADD, line);
-                    break;
-                case TOKEN_MINUS:
-                case TOKEN_MINUS_E:
-                    emitByte(OP_SUBTRACT, line);
-                    break;
-                case TOKEN_SLASH:
-                    emitByte(OP_DIVIDE, line);
-                    break;
-                case TOKEN_STAR:
-                    emitByte(OP_MULTIPLY, line);
-                    break;
-                case TOKEN_EQUAL_EQUAL:
-                    emitByte(OP_EQUAL, line);
-                    break;
-                case TOKEN_BANG_EQUAL:
-                    emitByte(OP_NOT_EQUAL, line);
-                    break;
-                case TOKEN_GREATER_EQUAL:
-                    emitByte(OP_GREATER_EQUAL, line);
-                    break;
-                case TOKEN_LESS_EQUAL:
-                    emitByte(OP_LESS_EQUAL, line);
-                    break;
-                case TOKEN_LESS:
-                    emitByte(OP_LESS, line);
-                    break;
-                case TOKEN_GREATER:
-                    emitByte(OP_GREATER, line);
-                    break;
+    Value value = ((LiteralExpr*)condition)->value;
+    return !IS_NULL(value) && !(IS_BOOL(value) && !AS_BOOL(value));
+}
 
-                default:
-                    error("Unknown operator in binary expression.", line);
-            }
+typedef struct
+{
+    UInts* breaks;
+    UInts* continues;
+    int scopeDepth;
+    int switchValues;
+    int cacheBase;
+} Loop;
+
+static void beginLoop(Loop* loop, int cacheBase)
+{
+    loop->breaks = emitter->breaks;
+    loop->continues = emitter->continues;
+    loop->scopeDepth = emitter->loopScopeDepth;
+    loop->switchValues = emitter->loopSwitchValues;
+    loop->cacheBase = emitter->loopCacheBase;
+
+    emitter->breaks = initUInts(NULL);
+    emitter->continues = initUInts(NULL);
+    emitter->loopScopeDepth = emitter->current->scopeDepth;
+    emitter->loopSwitchValues = 0;
+    emitter->loopCacheBase = cacheBase;
+    emitter->loopDepth++;
+}
 
-            break;
-        }
+static void endLoop(Loop* loop)
+{
+    freeUInts(emitter->breaks);
+    freeUInts(emitter->continues);
+    FREE(UInts, emitter->breaks);
+    FREE(UInts, emitter->continues);
+
+    emitter->breaks = loop->breaks;
+    emitter->continues = loop->continues;
+    emitter->loopScopeDepth = loop->scopeDepth;
+    emitter->loopSwitchValues = loop->switchValues;
+    emitter->loopCacheBase = loop->cacheBase;
+    emitter->loopDepth--;
+}
 
-        case UNARY_EXPRESSION:
-        {
-            UnaryExpr* expr = (UnaryExpr*)expression;
+// Empty slots for the loop's cached expressions, below anything else the loop keeps on the stack.
+// Returns the first one.
+static int emitLoopCaches(uint8_t count, uint16_t line)
+{
+    int base = emitter->current->stackValues;
 
-            compileExpression(expr->target);
+    for (uint i = 0; i < count; i++)
+    {
+        emitByte(OP_NULL, line);
+    }
 
-            switch (expr->op)
-            {
-                case TOKEN_MINUS:
-                    emitByte(OP_NEGATE, line);
-                    break;
+    emitter->current->stackValues += count;
+    return base;
+}
 
-                case TOKEN_BANG:
-                    emitByte(OP_NOT, line);
-                    break;
+static void popLoopCaches(uint8_t count, uint16_t line)
+{
+    for (uint i = 0; i < count; i++)
+    {
+        emitByte(OP_POP, line);
+    }
 
-                default:
-                    error("Unrecognized operand in unary expression.", line);
-            }
-            break;
-        }
+    emitter->current->stackValues -= count;
+}
 
-        case TERNARY_EXPRESSION:
-        {
-            TernaryExpr* expr = (TernaryExpr*)expression;
+// Products of the counter grow by the same step every iteration, the slots of those computed so far follow it
+static void emitInductionSteps(Node* inductions, uint16_t line)
+{
+    for (Node* node = inductions; node != NULL; node = node->next)
+    {
+        BinaryExpr* product = (BinaryExpr*)AS_EXPRESSION(node);
+        Expr* step = product->left->type == LITERAL_EXPRESSION ? product->left : product->right;
 
-            compileExpression(expr->condition);
-            compileExpression(expr->thenBranch);
-            compileExpression(expr->elseBranch);
+        emitBytes(OP_STEP_CACHED, emitter->loopCacheBase + product->expr.cacheSlot - 1, line);
+        emitByte(makeConstant(((LiteralExpr*)step)->value, line), line);
+    }
+}
 
-            emitByte(OP_TERNARY, line);
-            break;
-        }
+// The jump leaves blocks the emitter is still inside of, so their scopes are ended without changing scopeDepth
+static void emitLoopExit(UInts* jumps, uint16_t line)
+{
+    for (int i = 0; i < emitter->loopSwitchValues; i++)
+    {
+        emitByte(OP_POP, line);
+    }
 
-        case VAR_EXPRESSION:
-        {
-            VarExpr* expr = (VarExpr*)expression;
+    for (int depth = emitter->current->scopeDepth; depth > emitter->loopScopeDepth; depth--)
+    {
+        emitByte(OP_SCOPE_END, line);
+    }
 
-            emitBytes(OP_GET_VARIABLE, makeConstant(OBJ_VAL(expr->name), line), line);
+    uintsWrite(jumps, emitJump(OP_JUMP, line));
+}
 
-            break;
-        }
+// The counter and the limit stay on the stack during the loop, OP_FOR_RANGE sets the variable from the counter
+static void compileRangeLoop(ForStmt* stmt, uint16_t line)
+{
+    VariableStmt* declaration = (VariableStmt*)stmt->declaration;
+    uint8_t name = makeConstant(OBJ_VAL(declaration->name), line);
 
-        case ASSIGN_EXPRESSION:
-        {
-            AssignExpr* expr = (AssignExpr*)expression;
+    emitScopeStart(line);
+    int cacheBase = emitLoopCaches(stmt->cacheCount, line);
+    compileExpression(declaration->initializer);
+    compileExpression(((BinaryExpr*)stmt->condition)->right);
 
-            compileExpression(expr->value);
+    emitByte(OP_NULL, line);
+    emitBytes(OP_DEFINE_VARIABLE, name, line);
 
-            emitBytes(OP_SET_VARIABLE, makeConstant(OBJ_VAL(expr->name), line), line);
+    Loop loop;
+    beginLoop(&loop, cacheBase);
 
-            break;
-        }
+    // The statement's line is after the body, bounds errors belong to the header
+    uint16_t headerLine = stmt->condition->line;
 
-        case DOT_EXPRESSION:
-        {
-            DotExpr* expr = (DotExpr*)expression;
+    uint loopStart = currentChunk()->codeCount;
+    emitBytes(OP_FOR_RANGE, stmt->isRangeSyntax, headerLine);
+    emitBytes(0xff, 0xff, headerLine);
+    uint exitJump = currentChunk()->codeCount - 2;
+    emitBytes(OP_SET_VARIABLE, name, line);
 
-            compileExpression(expr->instance);
+    emitter->current->stackValues += 2;
+    compileStatement(stmt->body);
+    emitter->current->stackValues -= 2;
 
-            if(expr->isCall) // Call to a method
-            {
-                Node* node = expr->args;
+    patchLoopJumps(emitter->continues, line);
+    emitInductionSteps(stmt->inductions, line);
+    emitLoop(OP_LOOP, loopStart, line);
 
-                while(node != NULL)
-                {
-                    compileExpression(node->value.as.expression);
-                    node = node->next;
-                }
+    patchJump(exitJump, line);
+    patchLoopJumps(emitter->breaks, line);
+    endLoop(&loop);
 
-                emitBytes(OP_INVOKE, makeConstant(OBJ_VAL(expr->fieldName), line), line);
-                emitByte(expr->argCount, line);
-            }
-            else if (expr->value != NULL) // Setter
-            {
-                compileExpression(expr->value);
-                emitBytes(OP_SET_PROPERTY, makeConstant(OBJ_VAL(expr->fieldName), line), line);
-            }
-            else // Getter
-            {
-                emitBytes(OP_GET_PROPERTY, makeConstant(OBJ_VAL(expr->fieldName), line), line);
-            }
+    emitByte(OP_POP, line);
+    emitByte(OP_POP, line);
+    popLoopCaches(stmt->cacheCount, line);
+    emitScopeEnd(line);
+}
 
-            break;
-        }
+// endregion
 
-        case BASE_EXPRESSION:
-        {
-            BaseExpr* expr = (BaseExpr*)expression;
+// region SWITCH
+
+// Integer cases spread over more than this, or less than half dense, are searched instead
+#define MAX_JUMP_TABLE_SIZE 1024
+
+// Every case whose value matches runs, in order, and then the default branch always runs.
+// Only used when some case values aren't known while compiling.
+static void compileSwitchChain(SwitchStmt* stmt, uint16_t line)
+{
+    compileExpression(stmt->value);
+
+    Node* body = stmt->caseBodies;
+
+    for (Node* node = stmt->conditions; node != NULL; node = node->next, body = body->next)
+    {
+        compileExpression(AS_EXPRESSION(node));
+        emitByte(OP_SWITCH_EQUAL, line);
+        uint skipJump = emitJump(OP_POP_JUMP_IF_FALSE, line);
+
+        // The value stays on the stack for the next case
+        emitter->loopSwitchValues++;
+        emitter->current->stackValues++;
+        compileStatement(AS_STATEMENT(body));
+        emitter->current->stackValues--;
+        emitter->loopSwitchValues--;
+
+        patchJump(skipJump, line);
+    }
+
+    emitByte(OP_POP, line);
+    compileStatement(stmt->defaultBranch);
+}
+
+static int compareCases(const void* a, const void* b)
+{
+    return compareSwitchKeys(((SwitchCase*)a)->key, ((SwitchCase*)b)->key);
+}
+
+static bool isSmallInteger(Value value)
+{
+    if (!IS_NUMBER(value)) return false;
+
+    double number = AS_NUMBER(value);
+    return number >= INT32_MIN && number <= INT32_MAX && number == (int32_t)number;
+}
+
+// Lays out the distinct case values for the switch instruction, slots[i] is where the i-th one ended up
+static SwitchTable buildSwitchTable(uint8_t instruction, Value* keys, uint keyCount, uint* slots)
+{
+    SwitchTable table;
+    table.low = 0;
+
+    switch (instruction)
+    {
+        case OP_JUMP_TABLE:
+        {
+            double high = AS_NUMBER(keys[0]);
+            table.low = high;
+
+            for (uint i = 1; i < keyCount; i++)
+            {
+                if (AS_NUMBER(keys[i]) < table.low) table.low = AS_NUMBER(keys[i]);
+                if (AS_NUMBER(keys[i]) > high) high = AS_NUMBER(keys[i]);
+            }
+
+            table.count = (uint)(high - table.low) + 1;
+            break;
+        }
+
+        case OP_SWITCH_STRING:
+            // At most half full
+            table.count = 4;
+            while (table.count < keyCount * 2) table.count *= 2;
+            break;
+
+        default:
+            table.count = keyCount;
+            break;
+    }
+
+    table.cases = ALLOCATE(SwitchCase, table.count);
+
+    for (uint i = 0; i < table.count; i++)
+    {
+        table.cases[i].key = NULL_VAL;
+        table.cases[i].target = NO_SWITCH_TARGET;
+    }
+
+    for (uint i = 0; i < keyCount; i++)
+    {
+        switch (instruction)
+        {
+            case OP_JUMP_TABLE:
+                slots[i] = (uint)(AS_NUMBER(keys[i]) - table.low);
+                break;
+
+            case OP_SWITCH_STRING:
+            {
+                uint slot = AS_STRING(keys[i])->hash & (table.count - 1);
+                while (!IS_NULL(table.cases[slot].key)) slot = (slot + 1) & (table.count - 1);
+
+                slots[i] = slot;
+                break;
+            }
+
+            default:
+                // Remembers which key it is while sorting
+                table.cases[i].target = i;
+                break;
+        }
+
+        if (instruction != OP_SWITCH_SEARCH) table.cases[slots[i]].key = keys[i];
+        else table.cases[i].key = keys[i];
+    }
+
+    if (instruction == OP_SWITCH_SEARCH)
+    {
+        qsort(table.cases, table.count, sizeof(SwitchCase), compareCases);
+
+        for (uint i = 0; i < table.count; i++)
+        {
+            slots[table.cases[i].target] = i;
+            table.cases[i].target = NO_SWITCH_TARGET;
+        }
+    }
+
+    return table;
+}
+
+// All case values are constants: one instruction finds the first case of the value, the cases with the same value
+// are compiled one after the other, and all of them continue at the default branch.
+static void compileSwitchTable(SwitchStmt* stmt, uint16_t line)
+{
+    uint caseCount = listGetLength(stmt->conditions);
+
+    // Distinct values in the order they first appear, and which of them each case has
+    Value* keys = ALLOCATE(Value, caseCount);
+    int* caseKeys = ALLOCATE(int, caseCount);
+    uint keyCount = 0;
+
+    bool allIntegers = true;
+    bool allStrings = true;
+
+    uint i = 0;
+    for (Node* node = stmt->conditions; node != NULL; node = node->next, i++)
+    {
+        Value value = ((LiteralExpr*)AS_EXPRESSION(node))->value;
+        caseKeys[i] = -1;
+
+        // NaN equals nothing, such a case never runs
+        if (IS_NUMBER(value) && AS_NUMBER(value) != AS_NUMBER(value)) continue;
+
+        for (uint key = 0; key < keyCount; key++)
+        {
+            if (compareSwitchKeys(keys[key], value) == 0) caseKeys[i] = (int)key;
+        }
+
+        if (caseKeys[i] != -1) continue;
+
+        caseKeys[i] = (int)keyCount;
+        keys[keyCount++] = value;
+
+        allIntegers = allIntegers && isSmallInteger(value);
+        allStrings = allStrings && IS_STRING(value);
+
+        // The table only refers to strings, the constants keep them alive
+        if (IS_STRING(value)) makeConstant(value, line);
+    }
+
+    uint8_t instruction = OP_SWITCH_SEARCH;
+
+    if (keyCount > 0 && allIntegers)
+    {
+        double low = AS_NUMBER(keys[0]);
+        double high = low;
+
+        for (uint key = 1; key < keyCount; key++)
+        {
+            if (AS_NUMBER(keys[key]) < low) low = AS_NUMBER(keys[key]);
+            if (AS_NUMBER(keys[key]) > high) high = AS_NUMBER(keys[key]);
+        }
+
+        double size = high - low + 1;
+        if (size <= MAX_JUMP_TABLE_SIZE && size <= keyCount * 2) instruction = OP_JUMP_TABLE;
+    }
+    else if (keyCount > 0 && allStrings)
+    {
+        instruction = OP_SWITCH_STRING;
+    }
+
+    uint* slots = ALLOCATE(uint, keyCount);
+    uint table = addSwitchTable(currentChunk(), buildSwitchTable(instruction, keys, keyCount, slots));
+
+    if (table > UINT16_MAX) emitterError("Too many switch statements in one function.", line);
+
+    compileExpression(stmt->value);
+    emitByte(instruction, line);
+    emitByte((table >> 8) & 0xff, line);
+    emitByte(table & 0xff, line);
+
+    uint* jumps = ALLOCATE(uint, keyCount + 1);
+    jumps[keyCount] = emitJump(OP_JUMP, line);
+
+    for (uint key = 0; key < keyCount; key++)
+    {
+        // Bodies can add tables of their own, which moves the array
+        currentChunk()->switches[table].cases[slots[key]].target = currentChunk()->codeCount;
+
+        Node* body = stmt->caseBodies;
+
+        for (i = 0; i < caseCount; i++, body = body->next)
+        {
+            if (caseKeys[i] == (int)key) compileStatement(AS_STATEMENT(body));
+        }
+
+        jumps[key] = emitJump(OP_JUMP, line);
+    }
+
+    for (uint key = 0; key <= keyCount; key++)
+    {
+        patchJump(jumps[key], line);
+    }
+
+    compileStatement(stmt->defaultBranch);
+
+    FREE_ARRAY(uint, jumps, keyCount + 1);
+    FREE_ARRAY(uint, slots, keyCount);
+    FREE_ARRAY(int, caseKeys, caseCount);
+    FREE_ARRAY(Value, keys, caseCount);
+}
+
+static void compileSwitch(SwitchStmt* stmt, uint16_t line)
+{
+    if (stmt->conditions == NULL)
+    {
+        compileSwitchChain(stmt, line);
+        return;
+    }
+
+    for (Node* node = stmt->conditions; node != NULL; node = node->next)
+    {
+        if (AS_EXPRESSION(node)->type != LITERAL_EXPRESSION)
+        {
+            compileSwitchChain(stmt, line);
+            return;
+        }
+    }
+
+    compileSwitchTable(stmt, line);
+}
+
+// endregion
+static void initCompiler(Compiler* compiler, ObjFunction* function);
+static ObjFunction* endCompiler(bool emitNull, uint16_t line);
+
+static void compileUncachedExpression(Expr* expression)
+{
+    uint16_t line = expression->line;
+
+    switch (expression->type)
+    {
+        case LITERAL_EXPRESSION:
+        {
+            LiteralExpr* expr = (LiteralExpr*)expression;
+
+            #ifdef NAN_BOXING
+
+            Value value = expr->value;
+
+            if (IS_BOOL(value))
+            {
+                emitConstant(BOOL_VAL(AS_BOOL(value)), line);
+            }
+            else if (IS_NULL(value))
+            {
+                emitByte(OP_NULL, line);
+            }
+            else if (IS_NUMBER(value))
+            {
+                emitConstant(NUMBER_VAL(AS_NUMBER(value)), line);
+            }
+            else if (IS_STRING(value))
+            {
+                emitConstant(OBJ_VAL(AS_STRING(value)), line);
+            }
+
+            #else
+
+            switch (expr->value.type)
+            {
+                case VAL_BOOL:
+                    emitConstant(BOOL_VAL(expr->value.as.boolean), line);
+                    break;
+
+                case VAL_NULL:
+                    emitByte(OP_NULL, line);
+                    break;
+
+                case VAL_NUMBER:
+                    emitConstant(NUMBER_VAL(expr->value.as.number), line);
+                    break;
+
+                case VAL_OBJ:
+                    emitConstant(OBJ_VAL(expr->value.as.obj), line);
+                    break;
+            }
+
+            #endif
+
+            break;
+        }
+
+        case BINARY_EXPRESSION:
+        {
+            BinaryExpr* expr = (BinaryExpr*)expression;
+
+            compileExpression(expr->left);
+            compileExpression(expr->right);
+
+            emitBinaryOp(expr->op, expr->left->inferredTypes, expr->right->inferredTypes, expr->site, line);
+            break;
+        }
+
+        case UNARY_EXPRESSION:
+        {
+            UnaryExpr* expr = (UnaryExpr*)expression;
+
+            compileExpression(expr->target);
+
+            switch (expr->op)
+            {
+                case TOKEN_MINUS:
+                    emitByte(expr->target->inferredTypes == INFERRED_NUMBER ? OP_NEGATE_NUMBER : OP_NEGATE, line);
+                    break;
+
+                case TOKEN_BANG:
+                    emitByte(OP_NOT, line);
+                    break;
+
+                case TOKEN_TILDE:
+                    emitByte(OP_BIT_NOT, line);
+                    break;
+
+                default:
+                    emitterError("Unrecognized operand in unary expression.", line);
+            }
+            break;
+        }
+
+        case TERNARY_EXPRESSION:
+        {
+            TernaryExpr* expr = (TernaryExpr*)expression;
+
+            // Only the chosen branch is evaluated
+            compileExpression(expr->condition);
+            uint elseJump = emitJump(OP_POP_JUMP_IF_FALSE, line);
+
+            compileExpression(expr->thenBranch);
+            uint endJump = emitJump(OP_JUMP, line);
+
+            patchJump(elseJump, line);
+            compileExpression(expr->elseBranch);
+
+            patchJump(endJump, line);
+            break;
+        }
+
+        case VAR_EXPRESSION:
+        {
+            VarExpr* expr = (VarExpr*)expression;
+
+            emitBytes(OP_GET_VARIABLE, makeConstant(OBJ_VAL(expr->name), line), line);
+
+            break;
+        }
+
+        case ASSIGN_EXPRESSION:
+        {
+            AssignExpr* expr = (AssignExpr*)expression;
+            BinaryExpr* update = variableUpdate(expr);
+
+            if (update != NULL)
+            {
+                compileExpression(update->right);
+                emitUpdate(OP_UPDATE_VARIABLE, expr->name, update->op, line);
+                break;
+            }
+
+            compileExpression(expr->value);
+
+            emitBytes(OP_SET_VARIABLE, makeConstant(OBJ_VAL(expr->name), line), line);
+
+            break;
+        }
+
+        case DOT_EXPRESSION:
+        {
+            DotExpr* expr = (DotExpr*)expression;
+
+            compileExpression(expr->instance);
+
+            if(expr->isCall) // Call to a method
+            {
+                Node* node = expr->args;
+
+                while(node != NULL)
+                {
+                    compileExpression(node->value.as.expression);
+                    node = node->next;
+                }
+
+                emitProfile(expr->site, line);
+                emitBytes(OP_INVOKE, makeConstant(OBJ_VAL(expr->fieldName), line), line);
+                emitByte(expr->argCount, line);
+            }
+            else if (propertyUpdate(expr) != NULL) // Compound assignment, the instance is evaluated once
+            {
+                BinaryExpr* update = propertyUpdate(expr);
+
+                compileExpression(update->right);
+                emitUpdate(OP_UPDATE_PROPERTY, expr->fieldName, update->op, line);
+            }
+            else if (propertyCompound(expr) != NULL) // Any other 'y', the field is read before it's evaluated
+            {
+                BinaryExpr* compound = propertyCompound(expr);
+                DotExpr* getter = (DotExpr*)compound->left;
+
+                emitByte(OP_DUP, line);
+                emitProfile(getter->site, line);
+                emitBytes(OP_GET_PROPERTY, makeConstant(OBJ_VAL(expr->fieldName), line), line);
+
+                compileExpression(compound->right);
+                emitBinaryOp(compound->op, compound->left->inferredTypes, compound->right->inferredTypes,
+                             compound->site, line);
+
+                emitBytes(OP_SET_PROPERTY, makeConstant(OBJ_VAL(expr->fieldName), line), line);
+            }
+            else if (expr->value != NULL) // Setter
+            {
+                compileExpression(expr->value);
+                emitBytes(OP_SET_PROPERTY, makeConstant(OBJ_VAL(expr->fieldName), line), line);
+            }
+            else // Getter
+            {
+                emitProfile(expr->site, line);
+                emitBytes(OP_GET_PROPERTY, makeConstant(OBJ_VAL(expr->fieldName), line), line);
+            }
+
+            break;
+        }
+
+        case BASE_EXPRESSION:
+        {
+            BaseExpr* expr = (BaseExpr*)expression;
 
             emitBytes(OP_GET_BASE, makeConstant(OBJ_VAL(expr->methodName), line), line);
             break;
@@ -328,6 +1052,31 @@ static void compileExpression(Expr* expression)
         {
             CallExpr* expr = (CallExpr*)expression;
 
+            InlineCandidate* candidate = NULL;
+            Expr* inlined = NULL;
+            uint slowPath = 0;
+            uint end = 0;
+
+            if (expr->callee->type == VAR_EXPRESSION)
+            {
+                candidate = getInlineCandidate(((VarExpr*)expr->callee)->name);
+            }
+
+            if (candidate != NULL && (inlined = inlineCall(candidate, expr)) != NULL)
+            {
+                // Something else of the same name may be in scope here, then it has to be called instead
+                emitBytes(OP_GET_VARIABLE, makeConstant(OBJ_VAL(candidate->declaration->name), line), line);
+                emitConstant(OBJ_VAL(candidate->function), line);
+                emitByte(OP_EQUAL, line);
+
+                slowPath = emitJump(OP_POP_JUMP_IF_FALSE, line);
+
+                compileExpression(inlined);
+
+                end = emitJump(OP_JUMP, line);
+                patchJump(slowPath, line);
+            }
+
             Node* node = expr->args;
 
             while(node != NULL)
@@ -339,6 +1088,49 @@ static void compileExpression(Expr* expression)
             compileExpression(expr->callee);
             emitBytes(OP_CALL, expr->argCount, line);
 
+            if (inlined != NULL) patchJump(end, line);
+
+            break;
+        }
+
+        case YIELD_EXPRESSION:
+        {
+            YieldExpr* expr = (YieldExpr*)expression;
+
+            if(emitter->current->function->type == TYPE_SCRIPT)
+            {
+                emitterError("Can't yield from top-level code.", line);
+            }
+
+            if(expr->value == NULL)
+            {
+                emitByte(OP_NULL, line);
+            }
+            else
+            {
+                compileExpression(expr->value);
+            }
+
+            emitByte(OP_YIELD, line);
+            break;
+        }
+
+        case RESUME_EXPRESSION:
+        {
+            ResumeExpr* expr = (ResumeExpr*)expression;
+
+            compileExpression(expr->coroutine);
+
+            if(expr->value == NULL)
+            {
+                emitByte(OP_NULL, line);
+            }
+            else
+            {
+                compileExpression(expr->value);
+            }
+
+            emitByte(OP_RESUME, line);
             break;
         }
 
@@ -356,139 +1148,517 @@ static void compileExpression(Expr* expression)
                     emitByte(OP_POP, line);
                     compileExpression(expr->right);
 
-                    patchJump(endJump, line);
-                    break;
-                }
+                    patchJump(endJump, line);
+                    break;
+                }
+
+                case TOKEN_OR:
+                {
+                    compileExpression(expr->left);
+                    uint endJump = emitJump(OP_JUMP_IF_TRUE, line);
+
+                    emitByte(OP_POP, line);
+                    compileExpression(expr->right);
+
+                    patchJump(endJump, line);
+                    break;
+                }
+
+                default:
+                    printf("Reached unreachable");
+            }
+
+            break;
+        }
+
+        case LIST_EXPRESSION:
+        {
+            ListExpr* expr = (ListExpr*)expression;
+
+            Node* processed = expr->expressions;
+            uint8_t count = 0;
+
+            while(processed != NULL)
+            {
+                compileExpression(AS_EXPRESSION(processed));
+                count++;
+
+                processed = processed->next;
+            }
+
+            emitBytes(OP_BUILD_LIST, count, line);
+
+            break;
+        }
+
+        case INTERPOLATION_EXPRESSION:
+        {
+            InterpolationExpr* expr = (InterpolationExpr*)expression;
+
+            for (Node* node = expr->parts; node != NULL; node = node->next)
+            {
+                compileExpression(AS_EXPRESSION(node));
+            }
+
+            emitBytes(OP_BUILD_STRING, expr->partCount, line);
+            break;
+        }
+
+        case SUBSCRIPT_EXPRESSION:
+        {
+            SubscriptExpr* expr = (SubscriptExpr*)expression;
+
+            compileExpression(expr->list);
+
+            // Get
+            if(expr->value == NULL)
+            {
+                compileExpression(expr->index);
+                emitByte(OP_SUBSCRIPT_GET, line);
+            }
+            // Set
+            else
+            {
+                compileExpression(expr->index);
+                compileExpression(expr->value);
+                emitByte(OP_SUBSCRIPT_STORE, line);
+            }
+
+            break;
+        }
+    }
+}
+
+// Computed where the loop first reaches it, after that its slot holds the value
+static void compileCachedExpression(Expr* expression)
+{
+    uint16_t line = expression->line;
+    uint8_t slot = emitter->loopCacheBase + expression->cacheSlot - 1;
+
+    // Jumps over the code computing it, to where it would've left the value
+    emitBytes(OP_GET_CACHED, slot, line);
+    emitBytes(0xff, 0xff, line);
+    uint skip = currentChunk()->codeCount - 2;
+
+    compileUncachedExpression(expression);
+    emitBytes(OP_SET_CACHED, slot, line);
+
+    patchJump(skip, line);
+}
+
+static void compileExpression(Expr* expression)
+{
+    if (expression == NULL) return;
+
+    if (expression->cacheSlot != 0)
+    {
+        compileCachedExpression(expression);
+        return;
+    }
+
+    compileUncachedExpression(expression);
+}
+
+static void compileExpressionStatement(ExpressionStmt* statement)
+{
+    Expr* expr = statement->expr;
+    compileExpression(statement->expr);
+
+    if(expr->pop)
+    {
+        emitByte(OP_POP, 0);
+    }
+}
+
+static void compileVariable(ObjString* name, Expr* initializer, bool ownedByScope, uint16_t line)
+{
+    if(initializer == NULL)
+    {
+        emitByte(OP_NULL, line);
+    }
+    else
+    {
+        compileExpression(initializer);
+    }
+
+    if(ownedByScope)
+    {
+        emitByte(OP_SCOPE_OWN, line);
+    }
+
+    emitBytes(OP_DEFINE_VARIABLE, makeConstant(OBJ_VAL(name), line), line);
+}
+
+static FunctionType functionType(FunctionStmt* stmt, bool isMethod)
+{
+    if (isMethod && stmt->name->length == 4 && memcmp(stmt->name->chars, "init", 4) == 0)
+    {
+        return TYPE_INITIALIZER;
+    }
+
+    return isMethod ? TYPE_METHOD : TYPE_FUNCTION;
+}
+
+// False with nothing emitted if the AST emitter has to compile it
+static bool compileIr(FunctionStmt* stmt, uint16_t line)
+{
+    bool isInitializer = emitter->current->function->type == TYPE_INITIALIZER;
+
+    IrFunction* function = buildIr(stmt, isInitializer);
+    bool lowered = function != NULL && optimizeIr(function);
+
+    if (lowered && irDumpEnabled) irDump(function);
+
+    lowered = lowered && lowerIr(function, isInitializer, line);
+    if (function != NULL) freeIrFunction(function);
+
+    if (!lowered && irDumpEnabled) printf("== %s: compiled from the syntax tree ==\n\n", stmt->name->chars);
+
+    return lowered;
+}
+
+static void compileFunctionBody(ObjFunction* function, FunctionStmt* stmt, uint16_t line)
+{
+    Compiler compiler;
+    initCompiler(&compiler, function);
+
+    // Loops around the declaration can't be left from inside of the function
+    uint enclosingLoopDepth = emitter->loopDepth;
+    emitter->loopDepth = 0;
+
+    if (irEnabled && compileIr(stmt, line))
+    {
+        emitter->loopDepth = enclosingLoopDepth;
+        endCompiler(true, line);
+        return;
+    }
+
+    // Params
+    ObjString** params = stmt->params;
+    int paramCount = stmt->paramCount - 1;
+
+    while (paramCount >= 0)
+    {
+        emitBytes(OP_DEFINE_ARGUMENT, makeConstant(OBJ_VAL(params[paramCount]), line), line);
+        paramCount--;
+    }
+
+    // Body
+    Node* body = stmt->body;
+
+    while (body != NULL)
+    {
+        compileStatement(AS_STATEMENT(body));
+        body = body->next;
+    }
+
+    emitter->loopDepth = enclosingLoopDepth;
+    endCompiler(true, line);
+}
+
+// region PARALLEL COMPILATION
+
+static void initEmitter(Emitter* state)
+{
+    state->current = NULL;
+
+    state->breaks = NULL;
+    state->continues = NULL;
+    state->loopDepth = 0;
+    state->loopScopeDepth = 0;
+    state->loopSwitchValues = 0;
+    state->loopCacheBase = 0;
+
+    state->hadError = false;
+
+    state->errors = NULL;
+    state->errorCount = 0;
+    state->errorCapacity = 0;
+    state->collectErrors = false;
+
+    state->jobs = NULL;
+    state->jobCount = 0;
+    state->jobCapacity = 0;
+    state->deferBodies = false;
+}
+
+// Bodies declared by the script itself depend on nothing the emitter has to track
+static bool isDeferred()
+{
+    return emitter->deferBodies && emitter->current->function->type == TYPE_SCRIPT;
+}
+
+static void addJob(ObjFunction* function, FunctionStmt* declaration, uint16_t line)
+{
+    if (emitter->jobCount + 1 > emitter->jobCapacity)
+    {
+        uint oldCapacity = emitter->jobCapacity;
+        emitter->jobCapacity = GROW_CAPACITY(oldCapacity);
+        emitter->jobs = GROW_ARRAY(BodyJob, emitter->jobs, oldCapacity, emitter->jobCapacity);
+    }
+
+    BodyJob* job = &emitter->jobs[emitter->jobCount++];
+
+    job->function = function;
+    job->declaration = declaration;
+    job->line = line;
+
+    initArena(&job->arena);
+    job->errors = NULL;
+    job->errorCount = 0;
+    job->errorCapacity = 0;
+    job->hadError = false;
+}
+
+// Runs on any thread of the pool, with an emitter and arena of its own
+static void compileJob(void* items, uint index)
+{
+    BodyJob* job = &((BodyJob*)items)[index];
+    Emitter* enclosing = emitter;
+
+    Emitter state;
+    initEmitter(&state);
+    state.collectErrors = true;
+
+    emitter = &state;
+    useArena(&job->arena);
+
+    compileFunctionBody(job->function, job->declaration, job->line);
+
+    useArena(NULL);
+    emitter = enclosing;
+
+    job->errors = state.errors;
+    job->errorCount = state.errorCount;
+    job->errorCapacity = state.errorCapacity;
+    job->hadError = state.hadError;
+}
+
+// The garbage collector doesn't run until the arenas are merged, which happens in the order the bodies were
+// declared, as do their errors. The functions are constants of the script by then, so they're reachable.
+static void compileJobs()
+{
+    runInParallel(compileJob, emitter->jobs, emitter->jobCount, compileThreads);
+
+    for (uint i = 0; i < emitter->jobCount; i++)
+    {
+        BodyJob* job = &emitter->jobs[i];
+
+        mergeArena(&job->arena);
+
+        for (uint j = 0; j < job->errorCount; j++)
+        {
+            printError(job->errors[j].message, job->errors[j].line);
+        }
+
+        if (job->hadError) emitter->hadError = true;
+        FREE_ARRAY(EmitterError, job->errors, job->errorCapacity);
+    }
+
+    FREE_ARRAY(BodyJob, emitter->jobs, emitter->jobCapacity);
+
+    emitter->jobs = NULL;
+    emitter->jobCount = 0;
+    emitter->jobCapacity = 0;
+}
+
+// endregion
+
+// region VALIDATION
+
+static void validateStatements(Node* statements, FunctionType type, uint loopDepth);
+
+// Whether a return, break or continue is allowed where it is, reports it if it isn't
+static bool checkPlacement(Stmt* statement, FunctionType type, uint loopDepth)
+{
+    uint16_t line = statement->line;
+
+    switch (statement->type)
+    {
+        case RETURN_STATEMENT:
+            if (type == TYPE_SCRIPT)
+            {
+                emitterError("Can't return from top-level code.", line);
+                return false;
+            }
+
+            if (type == TYPE_INITIALIZER)
+            {
+                emitterError("Can't return custom values from initializer. It always returns the instance of your class.", line);
+                return false;
+            }
 
-                case TOKEN_OR:
-                {
-                    compileExpression(expr->left);
-                    uint endJump = emitJump(OP_JUMP_IF_TRUE, line);
+            return true;
 
-                    emitByte(OP_POP, line);
-                    compileExpression(expr->right);
+        case CONTINUE_STATEMENT:
+            if (loopDepth == 0)
+            {
+                emitterError("Can't 'continue' from top-level code.", line);
+                return false;
+            }
 
-                    patchJump(endJump, line);
-                    break;
-                }
+            return true;
 
-                default:
-                    printf("Reached unreachable");
+        case BREAK_STATEMENT:
+            if (loopDepth == 0)
+            {
+                emitterError("Can't break from top-level code.", line);
+                return false;
             }
 
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+// Reports the mistakes compileStatement would, for the whole script before anything is emitted. Bodies compiled on
+// their first call, or removed by tree shaking, are never seen by the emitter otherwise. Only the bytecode's limits,
+// like the number of constants in a chunk, are left for compileLazily to find.
+static void validateStatement(Stmt* statement, FunctionType type, uint loopDepth)
+{
+    if (statement == NULL) return;
+
+    switch (statement->type)
+    {
+        case BLOCK_STATEMENT:
+            validateStatements(((BlockStmt*)statement)->statements, type, loopDepth);
             break;
-        }
 
-        case LIST_EXPRESSION:
+        case IF_STATEMENT:
         {
-            ListExpr* expr = (ListExpr*)expression;
+            IfStmt* stmt = (IfStmt*)statement;
 
-            Node* processed = expr->expressions;
-            uint8_t count = 0;
+            validateStatement(stmt->thenBranch, type, loopDepth);
+            validateStatement(stmt->elseBranch, type, loopDepth);
+            break;
+        }
 
-            while(processed != NULL)
-            {
-                compileExpression(AS_EXPRESSION(processed));
-                count++;
+        case WHILE_STATEMENT:
+            validateStatement(((WhileStmt*)statement)->body, type, loopDepth + 1);
+            break;
 
-                processed = processed->next;
-            }
+        case FOR_STATEMENT:
+            validateStatement(((ForStmt*)statement)->body, type, loopDepth + 1);
+            break;
 
-            emitBytes(OP_BUILD_LIST, count, line);
+        case FOREACH_STATEMENT:
+            validateStatement(((ForeachStmt*)statement)->body, type, loopDepth + 1);
+            break;
+
+        case SWITCH_STATEMENT:
+        {
+            SwitchStmt* stmt = (SwitchStmt*)statement;
 
+            validateStatements(stmt->caseBodies, type, loopDepth);
+            validateStatement(stmt->defaultBranch, type, loopDepth);
             break;
         }
 
-        case SUBSCRIPT_EXPRESSION:
+        case TRY_STATEMENT:
         {
-            SubscriptExpr* expr = (SubscriptExpr*)expression;
+            TryStmt* stmt = (TryStmt*)statement;
 
-            compileExpression(expr->list);
+            validateStatement(stmt->body, type, loopDepth);
+            validateStatement(stmt->handler, type, loopDepth);
+            break;
+        }
 
-            // Get
-            if(expr->value == NULL)
-            {
-                compileExpression(expr->index);
-                emitByte(OP_SUBSCRIPT_GET, line);
-            }
-            // Set
-            else
+        // Loops around the declaration can't be left from inside of the function
+        case FUNCTION_STATEMENT:
+            validateStatements(((FunctionStmt*)statement)->body, TYPE_FUNCTION, 0);
+            break;
+
+        case CLASS_STATEMENT:
+        {
+            ClassStmt* stmt = (ClassStmt*)statement;
+
+            for (uint i = 0; i < stmt->methods.count; i++)
             {
-                compileExpression(expr->index);
-                compileExpression(expr->value);
-                emitByte(OP_SUBSCRIPT_STORE, line);
+                FunctionStmt* method = (FunctionStmt*)stmt->methods.values[i];
+                validateStatements(method->body, functionType(method, true), 0);
             }
 
             break;
         }
-    }
-}
 
-static void compileExpressionStatement(ExpressionStmt* statement)
-{
-    Expr* expr = statement->expr;
-    compileExpression(statement->expr);
+        case RETURN_STATEMENT:
+        case CONTINUE_STATEMENT:
+        case BREAK_STATEMENT:
+            checkPlacement(statement, type, loopDepth);
+            break;
 
-    if(expr->pop)
-    {
-        emitByte(OP_POP, 0);
+        default:
+            break;
     }
 }
 
-static void compileVariable(ObjString* name, Expr* initializer, uint16_t line)
+static void validateStatements(Node* statements, FunctionType type, uint loopDepth)
 {
-    if(initializer == NULL)
-    {
-        emitByte(OP_NULL, line);
-    }
-    else
+    for (Node* node = statements; node != NULL; node = node->next)
     {
-        compileExpression(initializer);
+        validateStatement(AS_STATEMENT(node), type, loopDepth);
     }
-
-    emitBytes(OP_DEFINE_VARIABLE, makeConstant(OBJ_VAL(name), line), line);
 }
 
+// endregion
+
 static void compileFunction(FunctionStmt* stmt, bool isMethod, uint16_t line)
 {
-    Compiler compiler;
+    ObjFunction* function = NULL;
+    InlineCandidate* candidate = isMethod ? NULL : getInlineCandidate(stmt->name);
 
-    FunctionType type = isMethod ? TYPE_METHOD : TYPE_FUNCTION;
-
-    if (isMethod && stmt->name->length == 4 && memcmp(stmt->name->chars, "init", 4) == 0)
+    if (candidate != NULL && candidate->declaration == stmt)
     {
-        type = TYPE_INITIALIZER;
+        function = candidate->function;
     }
+    else
+    {
+        function = newFunction(stmt->name, stmt->paramCount, functionType(stmt, isMethod));
 
-    initCompiler(&compiler,
-             stmt->name,
-              stmt->paramCount,
-                          type);
+        if (isDeferred())
+        {
+            addJob(function, stmt, line);
+        }
+        else if (lazyCompilation)
+        {
+            // The VM compiles it on the first call
+            function->declaration = stmt;
+        }
+        else
+        {
+            compileFunctionBody(function, stmt, line);
+        }
+    }
 
-    // Params
-    ObjString** params = stmt->params;
-    int paramCount = stmt->paramCount - 1;
+    // Function definition data
+    emitNewObject((Obj*)function, line);
 
-    while (paramCount >= 0)
-    {
-        emitBytes(OP_DEFINE_ARGUMENT, makeConstant(OBJ_VAL(params[paramCount]), line), line);
-        paramCount--;
-    }
+    emitByte(isMethod ? OP_DEFINE_METHOD : OP_DEFINE_FUNCTION, line);
+}
 
-    // Body
-    Node* body = stmt->body;
+// Methods used most by the profiled run are defined first, they keep their own slots of the method table when
+// names collide
+static void orderMethods(ClassStmt* stmt)
+{
+    Stmt** methods = stmt->methods.values;
 
-    while (body != NULL)
+    for (uint i = 1; i < stmt->methods.count; i++)
     {
-        compileStatement(AS_STATEMENT(body));
-        body = body->next;
-    }
+        Stmt* method = methods[i];
+        uint uses = methodUses(stmt->name, ((FunctionStmt*)method)->name);
 
-    ObjFunction* function = endCompiler(true, line);
+        // Stable, a method declared twice keeps its last declaration
+        uint j = i;
+        while (j > 0 && methodUses(stmt->name, ((FunctionStmt*)methods[j - 1])->name) < uses)
+        {
+            methods[j] = methods[j - 1];
+            j--;
+        }
 
-    // Function definition data
-    emitConstant(OBJ_VAL(function), line);
-    emitByte(isMethod ? OP_DEFINE_METHOD : OP_DEFINE_FUNCTION, line);
+        methods[j] = method;
+    }
 }
 
 static uint16_t compileStatement(Stmt* statement)
@@ -512,8 +1682,9 @@ static uint16_t compileStatement(Stmt* statement)
         {
             BlockStmt* stmt = (BlockStmt*)statement;
             Node* toExecute = stmt->statements;
+            bool hasScope = declaresNames(toExecute);
 
-            emitByte(OP_SCOPE_START, line);
+            if (hasScope) emitScopeStart(line);
 
             int length = listGetLength(toExecute);
 
@@ -522,7 +1693,7 @@ static uint16_t compileStatement(Stmt* statement)
                 compileStatement(listGet(toExecute, i, line).as.statement);
             }
 
-            emitByte(OP_SCOPE_END, line);
+            if (hasScope) emitScopeEnd(line);
 
             break;
         }
@@ -532,19 +1703,31 @@ static uint16_t compileStatement(Stmt* statement)
             IfStmt* stmt = (IfStmt*) statement;
 
             compileExpression(stmt->condition);
+            emitProfile(stmt->site, line);
 
-            uint thenJump = emitJump(OP_JUMP_IF_FALSE, line);
-            emitByte(OP_POP, line);
+            // The branch which mostly ran goes last, it's the one that doesn't end with a jump over the other
+            SiteFeedback* feedback = getSiteFeedback(stmt->site);
+            bool thenIsHot = feedback != NULL && feedback->truthy > feedback->falsy;
 
-            compileStatement(stmt->thenBranch);
+            Stmt* first = thenIsHot ? stmt->elseBranch : stmt->thenBranch;
+            Stmt* second = thenIsHot ? stmt->thenBranch : stmt->elseBranch;
 
-            uint elseJump = emitJump(OP_JUMP, line);
-            patchJump(thenJump, line);
-            emitByte(OP_POP, line);
+            uint secondJump = emitJump(thenIsHot ? OP_POP_JUMP_IF_TRUE : OP_POP_JUMP_IF_FALSE, line);
 
-            compileStatement(stmt->elseBranch);
+            compileStatement(first);
 
-            patchJump(elseJump, line);
+            if (second == NULL)
+            {
+                patchJump(secondJump, line);
+                break;
+            }
+
+            uint endJump = emitJump(OP_JUMP, line);
+            patchJump(secondJump, line);
+
+            compileStatement(second);
+
+            patchJump(endJump, line);
 
             break;
         }
@@ -553,7 +1736,7 @@ static uint16_t compileStatement(Stmt* statement)
         {
             VariableStmt* stmt = (VariableStmt*) statement;
 
-            compileVariable(stmt->name, stmt->initializer, line);
+            compileVariable(stmt->name, stmt->initializer, stmt->ownedByScope, line);
 
             break;
         }
@@ -562,22 +1745,31 @@ static uint16_t compileStatement(Stmt* statement)
         {
             WhileStmt* stmt = (WhileStmt*) statement;
 
-            uint loopStart = currentChunk()->codeCount;
-            loopDepth++;
+            Loop loop;
+            beginLoop(&loop, emitLoopCaches(stmt->cacheCount, line));
 
-            compileExpression(stmt->condition);
-            uint exitJump = emitJump(OP_JUMP_IF_FALSE, line);
-            emitByte(OP_POP, line);
+            // The condition is tested at the bottom, where it jumps back to the body, the first test is jumped to
+            bool alwaysTrue = isAlwaysTrue(stmt->condition);
+            uint conditionJump = alwaysTrue ? 0 : emitJump(OP_JUMP, line);
+            uint loopStart = currentChunk()->codeCount;
 
             compileStatement(stmt->body);
+            patchLoopJumps(emitter->continues, line);
 
-            patchLoopJumps(continues, line);
-            emitLoop(loopStart, line);
-            patchJump(exitJump, line);
-            patchLoopJumps(breaks, line);
+            if (alwaysTrue)
+            {
+                emitLoop(OP_LOOP, loopStart, line);
+            }
+            else
+            {
+                patchJump(conditionJump, line);
+                compileExpression(stmt->condition);
+                emitLoop(OP_POP_LOOP_IF_TRUE, loopStart, line);
+            }
 
-            emitByte(OP_POP, line);
-            loopDepth--;
+            patchLoopJumps(emitter->breaks, line);
+            endLoop(&loop);
+            popLoopCaches(stmt->cacheCount, line);
             break;
         }
 
@@ -585,49 +1777,87 @@ static uint16_t compileStatement(Stmt* statement)
         {
             ForStmt* stmt = (ForStmt*) statement;
 
-            emitByte(OP_SCOPE_START, line);
-            loopDepth++;
+            if (stmt->isRange)
+            {
+                compileRangeLoop(stmt, line);
+                break;
+            }
+
+            // Only a declared loop variable needs a scope around the loop
+            bool hasScope = stmt->declaration != NULL && stmt->declaration->type == VARIABLE_STATEMENT;
+            if (hasScope) emitScopeStart(line);
 
             // Declaration/Initializer
             compileStatement(stmt->declaration);
 
-            // Start the loop before condition
+            Loop loop;
+            beginLoop(&loop, emitLoopCaches(stmt->cacheCount, line));
+
+            // Laid out like 'while', with the condition at the bottom
+            bool alwaysTrue = isAlwaysTrue(stmt->condition);
+            uint conditionJump = alwaysTrue ? 0 : emitJump(OP_JUMP, line);
             uint loopStart = currentChunk()->codeCount;
-            int exitJump = -1;
 
-            // Condition
-            if(stmt->condition == NULL)
+            compileStatement(stmt->body);
+            patchLoopJumps(emitter->continues, line);
+
+            compileExpression(stmt->increment);
+
+            if (alwaysTrue)
             {
-                emitConstant(BOOL_VAL(true), line);
+                emitLoop(OP_LOOP, loopStart, line);
             }
             else
             {
+                patchJump(conditionJump, line);
                 compileExpression(stmt->condition);
+                emitLoop(OP_POP_LOOP_IF_TRUE, loopStart, line);
             }
 
-            // Jump out of the loop if the condition is false.
-            exitJump = emitJump(OP_JUMP_IF_FALSE, line);
-            emitByte(OP_POP, line); // Pop Condition
+            patchLoopJumps(emitter->breaks, line);
+            endLoop(&loop);
+            popLoopCaches(stmt->cacheCount, line);
 
-            compileStatement(stmt->body);
-            patchLoopJumps(continues, line);
+            if (hasScope) emitScopeEnd(line);
+            break;
+        }
 
-            compileExpression(stmt->increment);
+        case FOREACH_STATEMENT:
+        {
+            ForeachStmt* stmt = (ForeachStmt*) statement;
+            uint8_t name = makeConstant(OBJ_VAL(stmt->name), line);
 
-            emitLoop(loopStart, line);
+            // The iterated value and the index of the next item stay on the stack during the loop
+            emitScopeStart(line);
+            int cacheBase = emitLoopCaches(stmt->cacheCount, line);
+            compileExpression(stmt->iterable);
+            emitConstant(NUMBER_VAL(0), line);
 
-            patchLoopJumps(breaks, line);
-            emitByte(OP_SCOPE_END, line);
+            emitByte(OP_NULL, line);
+            emitBytes(OP_DEFINE_VARIABLE, name, line);
 
-            // Jump out of the loop
-            if (exitJump != -1)
-            {
-                patchJump(exitJump, line);
-                emitByte(OP_SCOPE_END, line);
-                emitByte(OP_POP, line);
-            }
+            Loop loop;
+            beginLoop(&loop, cacheBase);
+
+            uint loopStart = currentChunk()->codeCount;
+            uint exitJump = emitJump(OP_FOREACH_NEXT, line);
+            emitBytes(OP_SET_VARIABLE, name, line);
 
-            loopDepth--;
+            emitter->current->stackValues += 2;
+            compileStatement(stmt->body);
+            emitter->current->stackValues -= 2;
+            patchLoopJumps(emitter->continues, line);
+            emitLoop(OP_LOOP, loopStart, line);
+
+            // Breaks leave the stack as it is when the items run out
+            patchJump(exitJump, line);
+            patchLoopJumps(emitter->breaks, line);
+            endLoop(&loop);
+
+            emitByte(OP_POP, line);
+            emitByte(OP_POP, line);
+            popLoopCaches(stmt->cacheCount, line);
+            emitScopeEnd(line);
             break;
         }
 
@@ -643,7 +1873,10 @@ static uint16_t compileStatement(Stmt* statement)
         {
             ClassStmt* stmt = (ClassStmt*) statement;
 
-            emitConstant(OBJ_VAL(newClass(stmt->name)), line);
+            ObjClass* klass = newClass(stmt->name);
+            emitNewObject((Obj*)klass, line);
+
+            orderMethods(stmt);
 
             for(uint i = 0; i < stmt->methods.count; i++)
             {
@@ -669,15 +1902,7 @@ static uint16_t compileStatement(Stmt* statement)
 
         case RETURN_STATEMENT:
         {
-            if (current->function->type == TYPE_SCRIPT)
-            {
-                error("Can't return from top-level code.", line);
-            }
-
-            if (current->function->type == TYPE_INITIALIZER)
-            {
-                error("Can't return custom values from initializer. It always returns the instance of your class.", line);
-            }
+            if (!checkPlacement(statement, emitter->current->function->type, emitter->loopDepth)) break;
 
             ReturnStmt* stmt = (ReturnStmt*) statement;
 
@@ -696,25 +1921,58 @@ static uint16_t compileStatement(Stmt* statement)
         }
 
         case CONTINUE_STATEMENT:
-            if (loopDepth == 0)
-            {
-                error("Can't 'continue' from top-level code.", line);
-            }
+            if (!checkPlacement(statement, emitter->current->function->type, emitter->loopDepth)) break;
 
-            uintsWrite(continues, emitJump(OP_JUMP, statement->line));
+            emitLoopExit(emitter->continues, line);
             break;
 
         case BREAK_STATEMENT:
-            if (loopDepth == 0)
-            {
-                error("Can't break from top-level code.", line);
-            }
+            if (!checkPlacement(statement, emitter->current->function->type, emitter->loopDepth)) break;
 
-            uintsWrite(breaks, emitJump(OP_JUMP, statement->line));
+            emitLoopExit(emitter->breaks, line);
             break;
 
         case SWITCH_STATEMENT:
+            compileSwitch((SwitchStmt*) statement, line);
+            break;
+
+        case TRY_STATEMENT:
+        {
+            TryStmt* stmt = (TryStmt*) statement;
+
+            // Nothing is emitted for entering the block, only the table entry knows about it
+            ExceptionHandler handler;
+            handler.start = currentChunk()->codeCount;
+            handler.scopeDepth = emitter->current->scopeDepth;
+            handler.stackDepth = emitter->current->stackValues;
+
+            compileStatement(stmt->body);
+
+            handler.end = currentChunk()->codeCount;
+            uint skipJump = emitJump(OP_JUMP, line);
+
+            // The VM jumps here with the error message on top of the stack
+            handler.handler = currentChunk()->codeCount;
+            emitScopeStart(line);
+
+            if(stmt->errorName != NULL)
+            {
+                emitBytes(OP_DEFINE_VARIABLE, makeConstant(OBJ_VAL(stmt->errorName), line), line);
+            }
+            else
+            {
+                emitByte(OP_POP, line);
+            }
+
+            compileStatement(stmt->handler);
+            emitScopeEnd(line);
+
+            patchJump(skipJump, line);
+
+            // Added after the nested ones, so the innermost handler is always found first
+            addExceptionHandler(currentChunk(), handler);
             break;
+        }
 
     }
 
@@ -724,58 +1982,110 @@ static uint16_t compileStatement(Stmt* statement)
 
 // region MAIN
 
-static void initEmitter()
-{
-    continues = initUInts(continues);
-    breaks = initUInts(breaks);
-}
-
-static void initCompiler(Compiler* compiler, ObjString* fooName, uint16_t fooArity, FunctionType type)
+static void initCompiler(Compiler* compiler, ObjFunction* function)
 {
-    compiler->enclosing = (struct Compiler*) current;
-    compiler->function = NULL;
+    compiler->enclosing = (struct Compiler*) emitter->current;
+    compiler->function = function;
+    compiler->scopeDepth = 0;
+    compiler->stackValues = 0;
 
-    current = compiler;
+    compiler->constantSlots = NULL;
+    compiler->constantSlotCount = 0;
+    compiler->constantSlotCapacity = 0;
 
-    compiler->function = newFunction(fooName, fooArity, type);
-//    compiler->function->arity = functionArity;
-//
-//    if(functionName != NULL)
-//    {
-//        current->function->name = copyString(functionName->chars,
-//                                             functionName->length);
-//    }
+    emitter->current = compiler;
 }
 
 static ObjFunction* endCompiler(bool emitNull, uint16_t line)
 {
     // We emit null if user didn't return anything else via the return statement
-    if(current->function->type != TYPE_INITIALIZER && emitNull)
+    if(emitter->current->function->type != TYPE_INITIALIZER && emitNull)
     {
         emitByte(OP_NULL, line);
     }
 
     emitReturn(line);
-    ObjFunction* function = current->function;
+    ObjFunction* function = emitter->current->function;
+
+    __attribute__((unused)) uint saved = optimizeChunk(currentChunk());
 
     #ifdef DEBUG_PRINT_BYTECODE
-    if (!hadError)
+    if (!emitter->hadError)
     {
+        printf("Peephole optimizer saved %u bytes in %s\n", saved, function->name != NULL
+                                                                 ? function->name->chars : "<script>");
         disassembleChunk(currentChunk(), function->name != NULL
                                          ? function->name->chars : "<script>");
     }
     #endif
 
-    current = (Compiler*) current->enclosing;
+    FREE_ARRAY(ConstantSlot, emitter->current->constantSlots, emitter->current->constantSlotCapacity);
+
+    emitter->current = (Compiler*) emitter->current->enclosing;
     return function;
 }
 
 ObjFunction* emit(Node* statements)
 {
-    initEmitter();
+    if (!foldConstants(statements)) return NULL;
+
+    Emitter* enclosing = emitter;
+    Emitter state;
+    initEmitter(&state);
+    emitter = &state;
+
+    validateStatements(statements, TYPE_SCRIPT, 0);
+
+    if (state.hadError)
+    {
+        emitter = enclosing;
+        return NULL;
+    }
+
+    // Dumps have to come out in order
+    #ifndef DEBUG_PRINT_BYTECODE
+    state.deferBodies = compileThreads > 1 && !irDumpEnabled;
+    #endif
+
+    if (treeShakingEnabled)
+    {
+        __attribute__((unused)) uint removed = removeUnusedDeclarations(&statements);
+
+        #ifdef DEBUG_PRINT_BYTECODE
+        printf("Tree shaking removed %u unused declarations\n", removed);
+        #endif
+    }
+
+    inferTypes(statements);
+    findOwnedValues(statements);
+    findLoopInvariants(statements);
 
     Compiler compiler;
-    initCompiler(&compiler, NULL, 0, TYPE_SCRIPT);
+    initCompiler(&compiler, newFunction(NULL, 0, TYPE_SCRIPT));
+
+    if (inliningEnabled)
+    {
+        findInlineCandidates(statements);
+
+        for (uint i = 0; i < inlineCandidateCount(); i++)
+        {
+            InlineCandidate* candidate = getInlineCandidateAt(i);
+            if (candidate == NULL) continue;
+
+            FunctionStmt* declaration = candidate->declaration;
+
+            candidate->function = newFunction(declaration->name, declaration->paramCount, TYPE_FUNCTION);
+
+            if (isDeferred())
+            {
+                addJob(candidate->function, declaration, declaration->stmt.line);
+            }
+            else
+            {
+                compileFunctionBody(candidate->function, declaration, declaration->stmt.line);
+            }
+        }
+    }
 
     Node* stmt = statements;
     Node* root = stmt;
@@ -787,19 +2097,51 @@ ObjFunction* emit(Node* statements)
         stmt = stmt->next;
     }
 
+    compileJobs();
     freeList(root);
 
     ObjFunction* function = endCompiler(false, lastLine);
-    return hadError ? NULL : function;
+    emitter = enclosing;
+
+    return state.hadError ? NULL : function;
+}
+
+bool compileLazily(ObjFunction* function)
+{
+    FunctionStmt* declaration = function->declaration;
+
+    Emitter* enclosing = emitter;
+    Emitter state;
+    initEmitter(&state);
+    emitter = &state;
+
+    // Part of the run phase too
+    beginPhase("lazy-emit", false);
+    compileFunctionBody(function, declaration, declaration->stmt.line);
+    endPhase();
+
+    emitter = enclosing;
+
+    if (state.hadError)
+    {
+        // Stays uncompiled, so every call reports the errors
+        freeChunk(&function->chunk);
+        return false;
+    }
+
+    function->declaration = NULL;
+    return true;
 }
 
 void markCompilerRoots()
 {
-    Compiler* compiler = current;
+    Compiler* compiler = emitter != NULL ? emitter->current : NULL;
 
     while (compiler != NULL)
     {
         markObject((Obj*)compiler->function);
         compiler = (Compiler *) compiler->enclosing;
     }
+
+    markInlineCandidates();
 }
\ No newline at end of file
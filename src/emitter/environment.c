@@ -4,9 +4,24 @@
 #include "vm.h"
 #include "environment.h"
 #include "memory.h"
+#include "garbage_collector.h"
+
+// Linked through 'enclosing'
+static Environment* pool = NULL;
+static uint pooledCount = 0;
 
 Environment* newEnvironment()
 {
+    if (pool != NULL)
+    {
+        Environment* reused = pool;
+        pool = pool->enclosing;
+        pooledCount--;
+
+        reused->enclosing = NULL;
+        return reused;
+    }
+
     Environment* newEnv = reallocate(NULL, 0, sizeof(Environment));
 
     Table* values = ALLOCATE_TABLE();
@@ -14,10 +29,32 @@ Environment* newEnvironment()
     newEnv->values = values;
 
     newEnv->enclosing = NULL;
+    newEnv->owned = NULL;
 
     return newEnv;
 }
 
+// The object was allocated moments ago, it's close to the start of the list
+void environmentOwn(Environment* env, Obj* object)
+{
+    Obj* previous = NULL;
+    Obj* current = vm.objects;
+
+    while (current != NULL && current != object)
+    {
+        previous = current;
+        current = current->next;
+    }
+
+    if (current == NULL) return;
+
+    if (previous != NULL) previous->next = object->next;
+    else vm.objects = object->next;
+
+    object->next = env->owned;
+    env->owned = object;
+}
+
 bool environmentDefine(Environment* env, ObjString* name, Value value, uint16_t line)
 {
     uint8_t success = tableDefineEntry(env->values, name, value);
@@ -73,6 +110,17 @@ bool environmentGet(Environment* env, ObjString* name, Value* result)
     return true;
 }
 
+Value* environmentGetSlot(Environment* env, ObjString* name)
+{
+    for (; env != NULL; env = env->enclosing)
+    {
+        Value* slot = tableGetSlot(env->values, name);
+        if (slot != NULL) return slot;
+    }
+
+    return NULL;
+}
+
 void printVariables(Environment* env)
 {
      while(env != NULL)
@@ -99,28 +147,86 @@ void markEnvironment(Environment* env)
 {
     markTable(env->values);
 
+    // Sweeping doesn't see owned values, so their mark from the previous collection is still set
+    for (Obj* object = env->owned; object != NULL; object = object->next)
+    {
+        object->isMarked = false;
+        markObject(object);
+    }
+
     if(env->enclosing != NULL)
     {
         markEnvironment(env->enclosing);
     }
 }
 
-void freeEnvironmentsRecursively(Environment* env)
+static void freeOwned(Environment* env)
 {
-    if(env->enclosing != NULL)
+    Obj* object = env->owned;
+
+    while (object != NULL)
     {
-        freeEnvironmentsRecursively(env->enclosing);
+        Obj* next = object->next;
+        freeObject(object);
+        object = next;
     }
 
+    env->owned = NULL;
+}
 
+static void destroyEnvironment(Environment* env)
+{
+    freeOwned(env);
     freeTable(env->values);
     FREE(Environment, env);
 }
 
+void freeEnvironmentsRecursively(Environment* env)
+{
+    if(env->enclosing != NULL)
+    {
+        freeEnvironmentsRecursively(env->enclosing);
+    }
+
+    destroyEnvironment(env);
+}
+
 void freeEnvironment(Environment* env)
 {
-    freeTable(env->values);
-    FREE(Environment, env);
+    if (pooledCount >= MAX_POOLED_ENVIRONMENTS || env->values->capacity > MAX_POOLED_CAPACITY)
+    {
+        destroyEnvironment(env);
+        return;
+    }
+
+    freeOwned(env);
+
+    // Emptied without freeing the entries, the next scope will most likely need as many
+    Table* values = env->values;
+
+    for (int i = 0; i < values->capacity; i++)
+    {
+        values->entries[i].key = NULL;
+        values->entries[i].value = NULL_VAL;
+    }
+
+    values->count = 0;
+
+    env->enclosing = pool;
+    pool = env;
+    pooledCount++;
+}
+
+void freeEnvironmentPool()
+{
+    while (pool != NULL)
+    {
+        Environment* next = pool->enclosing;
+        destroyEnvironment(pool);
+        pool = next;
+    }
+
+    pooledCount = 0;
 }
 
 
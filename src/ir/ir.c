@@ -0,0 +1,566 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ir.h"
+#include "memory.h"
+
+bool irDumpEnabled = false;
+bool irEnabled = true;
+
+// region Construction
+
+IrFunction* newIrFunction(ObjString* name, uint16_t paramCount)
+{
+    IrFunction* function = ALLOCATE(IrFunction, 1);
+
+    function->name = name;
+    function->paramCount = paramCount;
+
+    function->instructions = NULL;
+    function->instructionCount = 0;
+    function->instructionCapacity = 0;
+
+    function->blocks = NULL;
+    function->blockCount = 0;
+    function->blockCapacity = 0;
+
+    function->layout = NULL;
+    function->layoutCount = 0;
+    function->layoutCapacity = 0;
+
+    return function;
+}
+
+void freeIrFunction(IrFunction* function)
+{
+    for (uint i = 0; i < function->instructionCount; i++)
+    {
+        IrInstruction* instruction = &function->instructions[i];
+        FREE_ARRAY(IrValue, instruction->operands, instruction->operandCapacity);
+    }
+
+    for (uint i = 0; i < function->blockCount; i++)
+    {
+        IrBlock* block = &function->blocks[i];
+
+        FREE_ARRAY(IrValue, block->phis, block->phiCapacity);
+        FREE_ARRAY(IrValue, block->instructions, block->instructionCapacity);
+        FREE_ARRAY(IrBlockIndex, block->predecessors, block->predecessorCapacity);
+    }
+
+    FREE_ARRAY(IrInstruction, function->instructions, function->instructionCapacity);
+    FREE_ARRAY(IrBlock, function->blocks, function->blockCapacity);
+    FREE_ARRAY(IrBlockIndex, function->layout, function->layoutCapacity);
+    FREE(IrFunction, function);
+}
+
+IrBlockIndex irAddBlock(IrFunction* function)
+{
+    if (function->blockCount >= IR_MAX_BLOCKS) return IR_NO_BLOCK;
+
+    if (function->blockCapacity < function->blockCount + 1)
+    {
+        uint oldCapacity = function->blockCapacity;
+        function->blockCapacity = GROW_CAPACITY(oldCapacity);
+        function->blocks = GROW_ARRAY(IrBlock, function->blocks, oldCapacity, function->blockCapacity);
+    }
+
+    IrBlock* block = &function->blocks[function->blockCount];
+
+    block->phis = NULL;
+    block->phiCount = 0;
+    block->phiCapacity = 0;
+
+    block->instructions = NULL;
+    block->instructionCount = 0;
+    block->instructionCapacity = 0;
+
+    block->predecessors = NULL;
+    block->predecessorCount = 0;
+    block->predecessorCapacity = 0;
+
+    block->terminator.type = IR_UNTERMINATED;
+    block->terminator.line = 0;
+    block->terminator.value = IR_NO_VALUE;
+    block->terminator.targets[0] = IR_NO_BLOCK;
+    block->terminator.targets[1] = IR_NO_BLOCK;
+    block->terminator.site = 0;
+    block->terminator.profiled = false;
+
+    block->removed = false;
+
+    return (IrBlockIndex)function->blockCount++;
+}
+
+static IrValue newInstruction(IrFunction* function, IrBlockIndex block, IrOp op, bool hasValue, uint16_t line)
+{
+    if (function->instructionCount >= IR_MAX_INSTRUCTIONS) return IR_NO_VALUE;
+
+    if (function->instructionCapacity < function->instructionCount + 1)
+    {
+        uint oldCapacity = function->instructionCapacity;
+        function->instructionCapacity = GROW_CAPACITY(oldCapacity);
+        function->instructions = GROW_ARRAY(IrInstruction, function->instructions, oldCapacity,
+                                            function->instructionCapacity);
+    }
+
+    IrInstruction* instruction = &function->instructions[function->instructionCount];
+
+    instruction->op = op;
+    instruction->line = line;
+    instruction->block = block;
+
+    instruction->removed = false;
+    instruction->hasValue = hasValue;
+    instruction->types = INFERRED_ANY;
+
+    instruction->operands = NULL;
+    instruction->operandCount = 0;
+    instruction->operandCapacity = 0;
+
+    instruction->constant = NULL_VAL;
+    instruction->name = NULL;
+    instruction->token = 0;
+    instruction->index = 0;
+
+    instruction->site = 0;
+    instruction->profiled = false;
+
+    return (IrValue)function->instructionCount++;
+}
+
+static void appendValue(IrValue** values, uint16_t* count, uint16_t* capacity, IrValue value)
+{
+    if (*capacity < *count + 1)
+    {
+        uint16_t oldCapacity = *capacity;
+        *capacity = GROW_CAPACITY(oldCapacity);
+        *values = GROW_ARRAY(IrValue, *values, oldCapacity, *capacity);
+    }
+
+    (*values)[(*count)++] = value;
+}
+
+IrValue irAddInstruction(IrFunction* function, IrBlockIndex block, IrOp op, bool hasValue, uint16_t line)
+{
+    IrValue value = newInstruction(function, block, op, hasValue, line);
+    if (value == IR_NO_VALUE) return IR_NO_VALUE;
+
+    IrBlock* added = irBlock(function, block);
+    appendValue(&added->instructions, &added->instructionCount, &added->instructionCapacity, value);
+
+    return value;
+}
+
+IrValue irAddPhi(IrFunction* function, IrBlockIndex block, uint16_t line)
+{
+    IrValue value = newInstruction(function, block, IR_PHI, true, line);
+    if (value == IR_NO_VALUE) return IR_NO_VALUE;
+
+    // Narrowed down by the operands once they're known
+    irInstruction(function, value)->types = 0;
+
+    IrBlock* added = irBlock(function, block);
+    appendValue(&added->phis, &added->phiCount, &added->phiCapacity, value);
+
+    return value;
+}
+
+void irAddOperand(IrFunction* function, IrValue instruction, IrValue operand)
+{
+    IrInstruction* added = irInstruction(function, instruction);
+    appendValue(&added->operands, &added->operandCount, &added->operandCapacity, operand);
+}
+
+void irPlaceBlock(IrFunction* function, IrBlockIndex block)
+{
+    if (function->layoutCapacity < function->layoutCount + 1)
+    {
+        uint oldCapacity = function->layoutCapacity;
+        function->layoutCapacity = GROW_CAPACITY(oldCapacity);
+        function->layout = GROW_ARRAY(IrBlockIndex, function->layout, oldCapacity, function->layoutCapacity);
+    }
+
+    function->layout[function->layoutCount++] = block;
+}
+
+// endregion
+
+// region Edges
+
+static void addPredecessor(IrFunction* function, IrBlockIndex block, IrBlockIndex predecessor)
+{
+    IrBlock* target = irBlock(function, block);
+
+    if (target->predecessorCapacity < target->predecessorCount + 1)
+    {
+        uint16_t oldCapacity = target->predecessorCapacity;
+        target->predecessorCapacity = GROW_CAPACITY(oldCapacity);
+        target->predecessors = GROW_ARRAY(IrBlockIndex, target->predecessors, oldCapacity, target->predecessorCapacity);
+    }
+
+    target->predecessors[target->predecessorCount++] = predecessor;
+}
+
+void irJump(IrFunction* function, IrBlockIndex from, IrBlockIndex to, uint16_t line)
+{
+    IrTerminator* terminator = &irBlock(function, from)->terminator;
+
+    terminator->type = IR_JUMP;
+    terminator->line = line;
+    terminator->targets[0] = to;
+
+    addPredecessor(function, to, from);
+}
+
+void irBranch(IrFunction* function, IrBlockIndex from, IrValue condition, IrBlockIndex ifTrue, IrBlockIndex ifFalse,
+              uint16_t line)
+{
+    IrTerminator* terminator = &irBlock(function, from)->terminator;
+
+    terminator->type = IR_BRANCH;
+    terminator->line = line;
+    terminator->value = condition;
+    terminator->targets[0] = ifTrue;
+    terminator->targets[1] = ifFalse;
+
+    addPredecessor(function, ifTrue, from);
+    addPredecessor(function, ifFalse, from);
+}
+
+void irReturn(IrFunction* function, IrBlockIndex from, IrValue value, uint16_t line)
+{
+    IrTerminator* terminator = &irBlock(function, from)->terminator;
+
+    terminator->type = IR_RETURN;
+    terminator->line = line;
+    terminator->value = value;
+}
+
+int irPredecessorIndex(IrBlock* block, IrBlockIndex predecessor)
+{
+    for (int i = 0; i < block->predecessorCount; i++)
+    {
+        if (block->predecessors[i] == predecessor) return i;
+    }
+
+    return -1;
+}
+
+void irRemoveEdge(IrFunction* function, IrBlockIndex from, IrBlockIndex to)
+{
+    IrBlock* target = irBlock(function, to);
+
+    int index = irPredecessorIndex(target, from);
+    if (index == -1) return;
+
+    for (int i = index; i < target->predecessorCount - 1; i++)
+    {
+        target->predecessors[i] = target->predecessors[i + 1];
+    }
+
+    target->predecessorCount--;
+
+    for (uint16_t i = 0; i < target->phiCount; i++)
+    {
+        IrInstruction* phi = irInstruction(function, target->phis[i]);
+
+        for (int j = index; j < phi->operandCount - 1; j++)
+        {
+            phi->operands[j] = phi->operands[j + 1];
+        }
+
+        phi->operandCount--;
+    }
+}
+
+IrBlockIndex irSplitEdge(IrFunction* function, IrBlockIndex from, int target)
+{
+    IrBlockIndex to = irBlock(function, from)->terminator.targets[target];
+    uint16_t line = irBlock(function, from)->terminator.line;
+
+    IrBlockIndex split = irAddBlock(function);
+    if (split == IR_NO_BLOCK) return IR_NO_BLOCK;
+
+    // Takes the place of 'from', the phis keep their operands
+    IrBlock* successor = irBlock(function, to);
+    successor->predecessors[irPredecessorIndex(successor, from)] = split;
+
+    addPredecessor(function, split, from);
+
+    IrTerminator* terminator = &irBlock(function, split)->terminator;
+    terminator->type = IR_JUMP;
+    terminator->line = line;
+    terminator->targets[0] = to;
+
+    irBlock(function, from)->terminator.targets[target] = split;
+
+    irPlaceBlock(function, split);
+
+    uint position = function->layoutCount - 1;
+    while (position > 0 && function->layout[position - 1] != from)
+    {
+        function->layout[position] = function->layout[position - 1];
+        position--;
+    }
+
+    function->layout[position] = split;
+    return split;
+}
+
+int irSuccessorCount(IrBlock* block)
+{
+    switch (block->terminator.type)
+    {
+        case IR_JUMP:   return 1;
+        case IR_BRANCH: return 2;
+        default:        return 0;
+    }
+}
+
+uint irReversePostorder(IrFunction* function, IrBlockIndex* order)
+{
+    uint blockCount = function->blockCount;
+
+    bool* visited = ALLOCATE(bool, blockCount);
+    IrBlockIndex* stack = ALLOCATE(IrBlockIndex, blockCount);
+    int* nextSuccessor = ALLOCATE(int, blockCount);
+    uint stackCount = 0;
+
+    memset(visited, 0, sizeof(bool) * blockCount);
+
+    // Filled from the back as the blocks are finished
+    uint filled = 0;
+    IrBlockIndex* postorder = ALLOCATE(IrBlockIndex, blockCount);
+
+    visited[0] = true;
+    nextSuccessor[0] = 0;
+    stack[stackCount++] = 0;
+
+    while (stackCount > 0)
+    {
+        IrBlockIndex index = stack[stackCount - 1];
+        IrBlock* block = irBlock(function, index);
+
+        if (nextSuccessor[index] < irSuccessorCount(block))
+        {
+            IrBlockIndex successor = block->terminator.targets[nextSuccessor[index]++];
+            if (visited[successor]) continue;
+
+            visited[successor] = true;
+            nextSuccessor[successor] = 0;
+            stack[stackCount++] = successor;
+            continue;
+        }
+
+        postorder[filled++] = index;
+        stackCount--;
+    }
+
+    for (uint i = 0; i < filled; i++)
+    {
+        order[i] = postorder[filled - 1 - i];
+    }
+
+    FREE_ARRAY(bool, visited, blockCount);
+    FREE_ARRAY(IrBlockIndex, stack, blockCount);
+    FREE_ARRAY(int, nextSuccessor, blockCount);
+    FREE_ARRAY(IrBlockIndex, postorder, blockCount);
+
+    return filled;
+}
+
+// endregion
+
+// region Dump
+
+static const char* opName(IrOp op)
+{
+    switch (op)
+    {
+        case IR_CONSTANT:      return "const";
+        case IR_PARAMETER:     return "param";
+        case IR_PHI:           return "phi";
+        case IR_COPY:          return "copy";
+        case IR_GET_VARIABLE:  return "get";
+        case IR_SET_VARIABLE:  return "set";
+        case IR_UPDATE_VARIABLE: return "update";
+        case IR_BINARY:        return "binary";
+        case IR_UNARY:         return "unary";
+        case IR_CALL:          return "call";
+        case IR_INVOKE:        return "invoke";
+        case IR_GET_PROPERTY:  return "get_property";
+        case IR_SET_PROPERTY:  return "set_property";
+        case IR_UPDATE_PROPERTY: return "update_property";
+        case IR_GET_BASE:      return "get_base";
+        case IR_SUBSCRIPT_GET: return "subscript_get";
+        case IR_SUBSCRIPT_SET: return "subscript_set";
+        case IR_BUILD_LIST:    return "build_list";
+        case IR_BUILD_STRING:  return "build_string";
+    }
+
+    return "?";
+}
+
+static const char* tokenName(TokenType token)
+{
+    switch (token)
+    {
+        case TOKEN_PLUS:          return "+";
+        case TOKEN_MINUS:
+        case TOKEN_MINUS_E:       return "-";
+        case TOKEN_STAR:          return "*";
+        case TOKEN_SLASH:         return "/";
+        case TOKEN_PERCENT:       return "%";
+        case TOKEN_TILDE_SLASH:   return "~/";
+        case TOKEN_AMPERSAND:     return "&";
+        case TOKEN_PIPE:          return "|";
+        case TOKEN_CARET:         return "^";
+        case TOKEN_LESS_LESS:     return "<<";
+        case TOKEN_GREATER_GREATER: return ">>";
+        case TOKEN_EQUAL_EQUAL:   return "==";
+        case TOKEN_BANG_EQUAL:    return "!=";
+        case TOKEN_GREATER:       return ">";
+        case TOKEN_GREATER_EQUAL: return ">=";
+        case TOKEN_LESS:          return "<";
+        case TOKEN_LESS_EQUAL:    return "<=";
+        case TOKEN_BANG:          return "!";
+        case TOKEN_TILDE:         return "~";
+
+        default:
+            return "?";
+    }
+}
+
+static void dumpTypes(uint8_t types)
+{
+    if (types == INFERRED_ANY) return;
+
+    static const char* names[] = { "number", "string", "bool", "null", "other" };
+    bool first = true;
+
+    printf("  : ");
+
+    for (int i = 0; i < 5; i++)
+    {
+        if (!(types & (1 << i))) continue;
+
+        printf(first ? "%s" : "|%s", names[i]);
+        first = false;
+    }
+}
+
+static void dumpInstruction(IrFunction* function, IrValue value)
+{
+    IrInstruction* instruction = irInstruction(function, value);
+
+    printf("    ");
+    if (instruction->hasValue) printf("v%d = ", value);
+
+    printf("%s", opName(instruction->op));
+
+    switch (instruction->op)
+    {
+        case IR_CONSTANT:
+            printf(" ");
+            printValue(instruction->constant);
+            break;
+
+        case IR_PARAMETER:
+            printf(" %d", instruction->index);
+            break;
+
+        case IR_BINARY:
+        case IR_UNARY:
+        case IR_UPDATE_VARIABLE:
+        case IR_UPDATE_PROPERTY:
+            printf(" %s", tokenName(instruction->token));
+            break;
+
+        default:
+            break;
+    }
+
+    if (instruction->name != NULL) printf(" '%s'", instruction->name->chars);
+
+    for (uint16_t i = 0; i < instruction->operandCount; i++)
+    {
+        printf(" v%d", instruction->operands[i]);
+    }
+
+    if (instruction->hasValue) dumpTypes(instruction->types);
+    printf("\n");
+}
+
+void irDump(IrFunction* function)
+{
+    printf("== %s (%d params) ==\n", function->name != NULL ? function->name->chars : "<script>",
+           function->paramCount);
+
+    for (uint i = 0; i < function->layoutCount; i++)
+    {
+        IrBlockIndex index = function->layout[i];
+        IrBlock* block = irBlock(function, index);
+
+        if (block->removed) continue;
+
+        printf("b%d:", index);
+
+        if (block->predecessorCount > 0)
+        {
+            printf(" <-");
+
+            for (uint16_t j = 0; j < block->predecessorCount; j++)
+            {
+                printf(" b%d", block->predecessors[j]);
+            }
+        }
+
+        printf("\n");
+
+        for (uint16_t j = 0; j < block->phiCount; j++)
+        {
+            if (!irInstruction(function, block->phis[j])->removed) dumpInstruction(function, block->phis[j]);
+        }
+
+        for (uint16_t j = 0; j < block->instructionCount; j++)
+        {
+            if (!irInstruction(function, block->instructions[j])->removed)
+            {
+                dumpInstruction(function, block->instructions[j]);
+            }
+        }
+
+        IrTerminator* terminator = &block->terminator;
+
+        switch (terminator->type)
+        {
+            case IR_UNTERMINATED:
+                printf("    <unterminated>\n");
+                break;
+
+            case IR_JUMP:
+                printf("    jump b%d\n", terminator->targets[0]);
+                break;
+
+            case IR_BRANCH:
+                printf("    branch v%d b%d b%d\n", terminator->value, terminator->targets[0], terminator->targets[1]);
+                break;
+
+            case IR_RETURN:
+                if (terminator->value == IR_NO_VALUE)
+                {
+                    printf("    return\n");
+                }
+                else
+                {
+                    printf("    return v%d\n", terminator->value);
+                }
+                break;
+        }
+    }
+
+    printf("\n");
+}
+
+// endregion
@@ -0,0 +1,1168 @@
+#include <string.h>
+
+#include "ir_builder.h"
+#include "memory.h"
+#include "inliner.h"
+#include "profile.h"
+#include "type_inference.h"
+
+// SSA is built while walking the AST, as in Braun et al., "Simple and Efficient Construction of Static Single
+// Assignment Form". Every local is a variable number, each block knows the value a variable has where the block
+// ends. A block whose predecessors aren't all known yet isn't sealed, variables read in it get a phi which is
+// completed once it is.
+//
+// Locals are resolved the way the VM finds them in its environments: a name declared in a block refers to
+// an outer variable until the declaration runs, and the variable is gone when the block ends.
+
+typedef struct
+{
+    ObjString* name;
+    uint16_t variable;
+    int depth;
+} Local;
+
+typedef struct
+{
+    uint16_t variable;
+    IrValue phi;
+} IncompletePhi;
+
+typedef struct
+{
+    // Value of every variable where the block ends, IR_NO_VALUE until it's read or written
+    IrValue* definitions;
+    uint16_t definitionCapacity;
+
+    IncompletePhi* incomplete;
+    uint incompleteCount;
+    uint incompleteCapacity;
+
+    bool sealed;
+} BlockState;
+
+typedef struct LoopTargets
+{
+    IrBlockIndex continueTarget;
+    IrBlockIndex breakTarget;
+    struct LoopTargets* enclosing;
+} LoopTargets;
+
+typedef struct
+{
+    IrFunction* function;
+    bool isInitializer;
+
+    // Something the IR can't express was found, the function is compiled from the AST
+    bool failed;
+
+    BlockState* states;
+    uint stateCapacity;
+
+    Local* locals;
+    uint localCount;
+    uint localCapacity;
+    int depth;
+    uint16_t variableCount;
+
+    // Block instructions are added to
+    IrBlockIndex block;
+
+    // Innermost loop, NULL outside of loops
+    LoopTargets* loop;
+} Builder;
+
+static void buildStatement(Builder* builder, Stmt* statement);
+static IrValue buildExpression(Builder* builder, Expr* expression);
+
+// region Blocks
+
+static IrBlockIndex newBlock(Builder* builder)
+{
+    IrBlockIndex block = irAddBlock(builder->function);
+
+    if (block == IR_NO_BLOCK)
+    {
+        builder->failed = true;
+        return 0;
+    }
+
+    if (builder->stateCapacity < builder->function->blockCount)
+    {
+        uint oldCapacity = builder->stateCapacity;
+        builder->stateCapacity = GROW_CAPACITY(oldCapacity);
+        builder->states = GROW_ARRAY(BlockState, builder->states, oldCapacity, builder->stateCapacity);
+    }
+
+    BlockState* state = &builder->states[block];
+
+    state->definitions = NULL;
+    state->definitionCapacity = 0;
+
+    state->incomplete = NULL;
+    state->incompleteCount = 0;
+    state->incompleteCapacity = 0;
+
+    state->sealed = false;
+
+    return block;
+}
+
+// Blocks are laid out in the order they're started in
+static void startBlock(Builder* builder, IrBlockIndex block)
+{
+    builder->block = block;
+    irPlaceBlock(builder->function, block);
+}
+
+static bool isTerminated(Builder* builder)
+{
+    return irBlock(builder->function, builder->block)->terminator.type != IR_UNTERMINATED;
+}
+
+// Code after 'return', 'break' or 'continue' goes into a block which nothing jumps to
+static void startUnreachable(Builder* builder)
+{
+    IrBlockIndex block = newBlock(builder);
+    builder->states[block].sealed = true;
+
+    startBlock(builder, block);
+}
+
+static void jumpTo(Builder* builder, IrBlockIndex target, uint16_t line)
+{
+    if (!isTerminated(builder)) irJump(builder->function, builder->block, target, line);
+}
+
+// Moves the blocks laid out in [from, middle) after the ones in [middle, end)
+static void rotateLayout(IrFunction* function, uint from, uint middle)
+{
+    uint count = middle - from;
+    if (count == 0 || middle == function->layoutCount) return;
+
+    IrBlockIndex* moved = ALLOCATE(IrBlockIndex, count);
+    memcpy(moved, &function->layout[from], sizeof(IrBlockIndex) * count);
+
+    memmove(&function->layout[from], &function->layout[middle],
+            sizeof(IrBlockIndex) * (function->layoutCount - middle));
+    memcpy(&function->layout[function->layoutCount - count], moved, sizeof(IrBlockIndex) * count);
+
+    FREE_ARRAY(IrBlockIndex, moved, count);
+}
+
+// endregion
+
+// region Instructions
+
+static IrValue addInstruction(Builder* builder, IrOp op, bool hasValue, uint8_t types, uint16_t line)
+{
+    IrValue value = irAddInstruction(builder->function, builder->block, op, hasValue, line);
+
+    if (value == IR_NO_VALUE)
+    {
+        builder->failed = true;
+        return IR_NO_VALUE;
+    }
+
+    irInstruction(builder->function, value)->types = types == 0 ? INFERRED_ANY : types;
+    return value;
+}
+
+// Constants are kept in the entry block, the lowering loads them where they're used
+static IrValue buildConstant(Builder* builder, Value value, uint16_t line)
+{
+    IrValue constant = irAddInstruction(builder->function, 0, IR_CONSTANT, true, line);
+
+    if (constant == IR_NO_VALUE)
+    {
+        builder->failed = true;
+        return IR_NO_VALUE;
+    }
+
+    IrInstruction* instruction = irInstruction(builder->function, constant);
+    instruction->constant = value;
+    instruction->types = valueTypes(value);
+
+    return constant;
+}
+
+static void addOperand(Builder* builder, IrValue instruction, IrValue operand)
+{
+    if (instruction == IR_NO_VALUE) return;
+    irAddOperand(builder->function, instruction, operand);
+}
+
+static void setName(Builder* builder, IrValue instruction, ObjString* name)
+{
+    if (instruction != IR_NO_VALUE) irInstruction(builder->function, instruction)->name = name;
+}
+
+static void setSite(Builder* builder, IrValue instruction, uint site, bool profiled)
+{
+    if (instruction == IR_NO_VALUE) return;
+
+    irInstruction(builder->function, instruction)->site = site;
+    irInstruction(builder->function, instruction)->profiled = profiled;
+}
+
+// endregion
+
+// region Variables
+
+static void writeVariable(Builder* builder, uint16_t variable, IrBlockIndex block, IrValue value)
+{
+    BlockState* state = &builder->states[block];
+
+    if (variable >= state->definitionCapacity)
+    {
+        uint16_t oldCapacity = state->definitionCapacity;
+        uint16_t capacity = GROW_CAPACITY(oldCapacity);
+        if (capacity <= variable) capacity = variable + 1;
+
+        state->definitions = GROW_ARRAY(IrValue, state->definitions, oldCapacity, capacity);
+        state->definitionCapacity = capacity;
+
+        for (uint16_t i = oldCapacity; i < capacity; i++)
+        {
+            state->definitions[i] = IR_NO_VALUE;
+        }
+    }
+
+    state->definitions[variable] = value;
+}
+
+static IrValue readVariable(Builder* builder, uint16_t variable, IrBlockIndex block);
+
+static void addPhiOperands(Builder* builder, uint16_t variable, IrValue phi, IrBlockIndex block)
+{
+    // Reading may add phis to the blocks, which moves their arrays, but not predecessors
+    for (uint16_t i = 0; i < irBlock(builder->function, block)->predecessorCount; i++)
+    {
+        IrBlockIndex predecessor = irBlock(builder->function, block)->predecessors[i];
+        irAddOperand(builder->function, phi, readVariable(builder, variable, predecessor));
+    }
+}
+
+static IrValue addPhi(Builder* builder, IrBlockIndex block)
+{
+    IrValue phi = irAddPhi(builder->function, block, 0);
+    if (phi == IR_NO_VALUE) builder->failed = true;
+
+    return phi;
+}
+
+static IrValue readVariable(Builder* builder, uint16_t variable, IrBlockIndex block)
+{
+    BlockState* state = &builder->states[block];
+
+    if (variable < state->definitionCapacity && state->definitions[variable] != IR_NO_VALUE)
+    {
+        return state->definitions[variable];
+    }
+
+    if (builder->failed) return IR_NO_VALUE;
+
+    IrBlock* target = irBlock(builder->function, block);
+    IrValue value;
+
+    if (!state->sealed)
+    {
+        value = addPhi(builder, block);
+
+        if (state->incompleteCapacity < state->incompleteCount + 1)
+        {
+            uint oldCapacity = state->incompleteCapacity;
+            state->incompleteCapacity = GROW_CAPACITY(oldCapacity);
+            state->incomplete = GROW_ARRAY(IncompletePhi, state->incomplete, oldCapacity, state->incompleteCapacity);
+        }
+
+        state->incomplete[state->incompleteCount++] = (IncompletePhi){ variable, value };
+    }
+    else if (target->predecessorCount == 0)
+    {
+        // Only in code nothing reaches
+        value = buildConstant(builder, NULL_VAL, 0);
+    }
+    else if (target->predecessorCount == 1)
+    {
+        value = readVariable(builder, variable, target->predecessors[0]);
+    }
+    else
+    {
+        // Written before the operands are read, loops reading it again find the phi
+        value = addPhi(builder, block);
+        if (value == IR_NO_VALUE) return IR_NO_VALUE;
+
+        writeVariable(builder, variable, block, value);
+        addPhiOperands(builder, variable, value, block);
+    }
+
+    writeVariable(builder, variable, block, value);
+    return value;
+}
+
+// All of the block's predecessors are known
+static void sealBlock(Builder* builder, IrBlockIndex block)
+{
+    BlockState* state = &builder->states[block];
+
+    for (uint i = 0; i < state->incompleteCount && !builder->failed; i++)
+    {
+        IncompletePhi incomplete = state->incomplete[i];
+        addPhiOperands(builder, incomplete.variable, incomplete.phi, block);
+    }
+
+    FREE_ARRAY(IncompletePhi, state->incomplete, state->incompleteCapacity);
+    state->incomplete = NULL;
+    state->incompleteCount = 0;
+    state->incompleteCapacity = 0;
+
+    state->sealed = true;
+}
+
+static Local* resolveLocal(Builder* builder, ObjString* name)
+{
+    for (int i = (int)builder->localCount - 1; i >= 0; i--)
+    {
+        if (builder->locals[i].name == name) return &builder->locals[i];
+    }
+
+    return NULL;
+}
+
+static void declareLocal(Builder* builder, ObjString* name, IrValue value)
+{
+    // The VM reports names declared twice in one scope
+    for (int i = (int)builder->localCount - 1; i >= 0 && builder->locals[i].depth == builder->depth; i--)
+    {
+        if (builder->locals[i].name == name)
+        {
+            builder->failed = true;
+            return;
+        }
+    }
+
+    if (builder->variableCount == UINT16_MAX)
+    {
+        builder->failed = true;
+        return;
+    }
+
+    if (builder->localCapacity < builder->localCount + 1)
+    {
+        uint oldCapacity = builder->localCapacity;
+        builder->localCapacity = GROW_CAPACITY(oldCapacity);
+        builder->locals = GROW_ARRAY(Local, builder->locals, oldCapacity, builder->localCapacity);
+    }
+
+    Local* local = &builder->locals[builder->localCount++];
+    local->name = name;
+    local->variable = builder->variableCount++;
+    local->depth = builder->depth;
+
+    writeVariable(builder, local->variable, builder->block, value);
+}
+
+// Declarations and assignments are copies, named after the variable until copy propagation removes them
+static void assignLocal(Builder* builder, Local* local, IrValue value, uint16_t line)
+{
+    IrValue copy = addInstruction(builder, IR_COPY, true, 0, line);
+    addOperand(builder, copy, value);
+    setName(builder, copy, local->name);
+
+    writeVariable(builder, local->variable, builder->block, copy);
+}
+
+static void beginScope(Builder* builder)
+{
+    builder->depth++;
+}
+
+static void endScope(Builder* builder)
+{
+    builder->depth--;
+
+    while (builder->localCount > 0 && builder->locals[builder->localCount - 1].depth > builder->depth)
+    {
+        builder->localCount--;
+    }
+}
+
+// endregion
+
+// region Expressions
+
+static IrValue buildValue(Builder* builder, Expr* expression)
+{
+    IrValue value = buildExpression(builder, expression);
+
+    // Assignments and stores leave nothing on the stack, the AST emitter would lose track of it
+    if (value == IR_NO_VALUE) builder->failed = true;
+
+    return value;
+}
+
+// The operands are built before the instruction is added, so they're put aside first
+static IrValue buildWithOperands(Builder* builder, IrOp op, bool hasValue, uint8_t types, IrValue* operands,
+                                 uint count, uint16_t line)
+{
+    IrValue value = addInstruction(builder, op, hasValue, types, line);
+
+    for (uint i = 0; i < count; i++)
+    {
+        addOperand(builder, value, operands[i]);
+    }
+
+    return value;
+}
+
+static IrValue buildList(Builder* builder, IrOp op, uint8_t types, Expr* first, Node* rest, uint16_t line)
+{
+    uint count = listGetLength(rest) + (first != NULL ? 1 : 0);
+    IrValue* operands = ALLOCATE(IrValue, count + 1);
+    uint i = 0;
+
+    if (first != NULL) operands[i++] = buildValue(builder, first);
+
+    for (Node* node = rest; node != NULL && !builder->failed; node = node->next)
+    {
+        operands[i++] = buildValue(builder, AS_EXPRESSION(node));
+    }
+
+    IrValue value = buildWithOperands(builder, op, true, types, operands, i, line);
+
+    FREE_ARRAY(IrValue, operands, count + 1);
+    return value;
+}
+
+static void buildCondition(Builder* builder, Expr* condition, IrBlockIndex ifTrue, IrBlockIndex ifFalse);
+
+// 'and' and 'or' whose value is used, the result is whichever side decided it
+static IrValue buildLogical(Builder* builder, LogicalExpr* expr, uint16_t line)
+{
+    IrBlockIndex right = newBlock(builder);
+    IrBlockIndex end = newBlock(builder);
+
+    IrValue left = buildValue(builder, expr->left);
+    IrBlockIndex leftEnd = builder->block;
+
+    if (expr->op == TOKEN_AND)
+    {
+        irBranch(builder->function, leftEnd, left, right, end, line);
+    }
+    else
+    {
+        irBranch(builder->function, leftEnd, left, end, right, line);
+    }
+
+    sealBlock(builder, right);
+    startBlock(builder, right);
+
+    IrValue rightValue = buildValue(builder, expr->right);
+    jumpTo(builder, end, line);
+
+    sealBlock(builder, end);
+    startBlock(builder, end);
+
+    // The left side's block comes first among the predecessors
+    IrValue phi = addPhi(builder, end);
+    addOperand(builder, phi, left);
+    addOperand(builder, phi, rightValue);
+
+    return phi;
+}
+
+static IrValue buildTernary(Builder* builder, TernaryExpr* expr, uint16_t line)
+{
+    IrBlockIndex thenBlock = newBlock(builder);
+    IrBlockIndex elseBlock = newBlock(builder);
+    IrBlockIndex end = newBlock(builder);
+
+    buildCondition(builder, expr->condition, thenBlock, elseBlock);
+    sealBlock(builder, thenBlock);
+    sealBlock(builder, elseBlock);
+
+    startBlock(builder, thenBlock);
+    IrValue thenValue = buildValue(builder, expr->thenBranch);
+    jumpTo(builder, end, line);
+
+    startBlock(builder, elseBlock);
+    IrValue elseValue = buildValue(builder, expr->elseBranch);
+    jumpTo(builder, end, line);
+
+    sealBlock(builder, end);
+    startBlock(builder, end);
+
+    IrValue phi = addPhi(builder, end);
+    addOperand(builder, phi, thenValue);
+    addOperand(builder, phi, elseValue);
+
+    return phi;
+}
+
+// Arguments, then the callee, like the AST emitter
+static IrValue buildPlainCall(Builder* builder, CallExpr* expr, uint16_t line)
+{
+    IrValue* args = ALLOCATE(IrValue, expr->argCount + 1);
+    uint count = 0;
+
+    for (Node* node = expr->args; node != NULL && !builder->failed; node = node->next)
+    {
+        args[count++] = buildValue(builder, AS_EXPRESSION(node));
+    }
+
+    args[count++] = buildValue(builder, expr->callee);
+
+    IrValue call = buildWithOperands(builder, IR_CALL, true, ((Expr*)expr)->inferredTypes, args, count, line);
+
+    FREE_ARRAY(IrValue, args, expr->argCount + 1);
+    return call;
+}
+
+// Checks the name still refers to the candidate, like the AST emitter does, and calls whatever it is otherwise
+static IrValue buildInlinedCall(Builder* builder, CallExpr* expr, InlineCandidate* candidate, Expr* inlined,
+                                uint16_t line)
+{
+    IrValue current = addInstruction(builder, IR_GET_VARIABLE, true, INFERRED_ANY, line);
+    setName(builder, current, candidate->declaration->name);
+
+    IrValue guard[2] = { current, buildConstant(builder, OBJ_VAL(candidate->function), line) };
+    IrValue same = buildWithOperands(builder, IR_BINARY, true, INFERRED_BOOL, guard, 2, line);
+    if (same != IR_NO_VALUE) irInstruction(builder->function, same)->token = TOKEN_EQUAL_EQUAL;
+
+    IrBlockIndex fast = newBlock(builder);
+    IrBlockIndex slow = newBlock(builder);
+    IrBlockIndex end = newBlock(builder);
+
+    irBranch(builder->function, builder->block, same, fast, slow, line);
+    sealBlock(builder, fast);
+    sealBlock(builder, slow);
+
+    startBlock(builder, fast);
+    IrValue fastValue = buildValue(builder, inlined);
+    jumpTo(builder, end, line);
+
+    startBlock(builder, slow);
+    IrValue call = buildPlainCall(builder, expr, line);
+    jumpTo(builder, end, line);
+
+    sealBlock(builder, end);
+    startBlock(builder, end);
+
+    IrValue phi = addPhi(builder, end);
+    addOperand(builder, phi, fastValue);
+    addOperand(builder, phi, call);
+
+    return phi;
+}
+
+static IrValue buildCall(Builder* builder, CallExpr* expr, uint16_t line)
+{
+    if (expr->callee->type == VAR_EXPRESSION && resolveLocal(builder, ((VarExpr*)expr->callee)->name) == NULL)
+    {
+        InlineCandidate* candidate = getInlineCandidate(((VarExpr*)expr->callee)->name);
+        Expr* inlined = candidate != NULL ? inlineCall(candidate, expr) : NULL;
+
+        if (inlined != NULL) return buildInlinedCall(builder, expr, candidate, inlined, line);
+    }
+
+    return buildPlainCall(builder, expr, line);
+}
+
+// The value of one of propertyCompound's assignments, its field is read from the instance before 'y' is evaluated
+static IrValue buildPropertyCompound(Builder* builder, BinaryExpr* compound, IrValue instance, uint16_t line)
+{
+    DotExpr* getter = (DotExpr*)compound->left;
+
+    IrValue operands[2];
+    operands[0] = buildWithOperands(builder, IR_GET_PROPERTY, true, compound->left->inferredTypes, &instance, 1, line);
+    setName(builder, operands[0], getter->fieldName);
+    setSite(builder, operands[0], getter->site, true);
+
+    operands[1] = buildValue(builder, compound->right);
+
+    IrValue binary = buildWithOperands(builder, IR_BINARY, true, ((Expr*)compound)->inferredTypes, operands, 2, line);
+    if (binary == IR_NO_VALUE) return IR_NO_VALUE;
+
+    irInstruction(builder->function, binary)->token = compound->op;
+    setSite(builder, binary, compound->site, true);
+
+    return binary;
+}
+
+static IrValue buildDot(Builder* builder, DotExpr* expr, uint16_t line)
+{
+    uint8_t types = ((Expr*)expr)->inferredTypes;
+
+    if (expr->isCall)
+    {
+        IrValue invoke = buildList(builder, IR_INVOKE, types, expr->instance, expr->args, line);
+        setName(builder, invoke, expr->fieldName);
+        setSite(builder, invoke, expr->site, true);
+
+        return invoke;
+    }
+
+    IrValue operands[2];
+    operands[0] = buildValue(builder, expr->instance);
+
+    BinaryExpr* update = propertyUpdate(expr);
+
+    if (update != NULL)
+    {
+        operands[1] = buildValue(builder, update->right);
+
+        IrValue set = buildWithOperands(builder, IR_UPDATE_PROPERTY, true, types, operands, 2, line);
+        setName(builder, set, expr->fieldName);
+        irInstruction(builder->function, set)->token = update->op;
+
+        return set;
+    }
+
+    if (expr->value != NULL)
+    {
+        // Any other compound assignment still evaluates the instance once
+        BinaryExpr* compound = propertyCompound(expr);
+        operands[1] = compound != NULL ? buildPropertyCompound(builder, compound, operands[0], line)
+                                       : buildValue(builder, expr->value);
+
+        IrValue set = buildWithOperands(builder, IR_SET_PROPERTY, true, types, operands, 2, line);
+        setName(builder, set, expr->fieldName);
+
+        return set;
+    }
+
+    IrValue get = buildWithOperands(builder, IR_GET_PROPERTY, true, types, operands, 1, line);
+    setName(builder, get, expr->fieldName);
+    setSite(builder, get, expr->site, true);
+
+    return get;
+}
+
+static IrValue buildExpression(Builder* builder, Expr* expression)
+{
+    if (builder->failed) return IR_NO_VALUE;
+
+    // Cached by the loop, see loop_invariants.h
+    if (expression->cacheSlot != 0)
+    {
+        builder->failed = true;
+        return IR_NO_VALUE;
+    }
+
+    uint16_t line = expression->line;
+    uint8_t types = expression->inferredTypes;
+
+    switch (expression->type)
+    {
+        case LITERAL_EXPRESSION:
+            return buildConstant(builder, ((LiteralExpr*)expression)->value, line);
+
+        case BINARY_EXPRESSION:
+        {
+            BinaryExpr* expr = (BinaryExpr*)expression;
+
+            IrValue operands[2];
+            operands[0] = buildValue(builder, expr->left);
+            operands[1] = buildValue(builder, expr->right);
+
+            IrValue binary = buildWithOperands(builder, IR_BINARY, true, types, operands, 2, line);
+            if (binary == IR_NO_VALUE) return IR_NO_VALUE;
+
+            irInstruction(builder->function, binary)->token = expr->op;
+            setSite(builder, binary, expr->site, true);
+
+            return binary;
+        }
+
+        case UNARY_EXPRESSION:
+        {
+            UnaryExpr* expr = (UnaryExpr*)expression;
+
+            IrValue target = buildValue(builder, expr->target);
+            IrValue unary = buildWithOperands(builder, IR_UNARY, true, types, &target, 1, line);
+            if (unary == IR_NO_VALUE) return IR_NO_VALUE;
+
+            irInstruction(builder->function, unary)->token = expr->op;
+            return unary;
+        }
+
+        case TERNARY_EXPRESSION:
+            return buildTernary(builder, (TernaryExpr*)expression, line);
+
+        case LOGICAL_EXPRESSION:
+            return buildLogical(builder, (LogicalExpr*)expression, line);
+
+        case VAR_EXPRESSION:
+        {
+            VarExpr* expr = (VarExpr*)expression;
+            Local* local = resolveLocal(builder, expr->name);
+
+            if (local != NULL) return readVariable(builder, local->variable, builder->block);
+
+            IrValue get = addInstruction(builder, IR_GET_VARIABLE, true, types, line);
+            setName(builder, get, expr->name);
+
+            return get;
+        }
+
+        case ASSIGN_EXPRESSION:
+        {
+            AssignExpr* expr = (AssignExpr*)expression;
+            Local* local = resolveLocal(builder, expr->name);
+            BinaryExpr* update = variableUpdate(expr);
+
+            if (local == NULL && update != NULL)
+            {
+                IrValue operand = buildValue(builder, update->right);
+                IrValue set = buildWithOperands(builder, IR_UPDATE_VARIABLE, false, types, &operand, 1, line);
+                setName(builder, set, expr->name);
+                irInstruction(builder->function, set)->token = update->op;
+
+                return IR_NO_VALUE;
+            }
+
+            IrValue value = buildValue(builder, expr->value);
+
+            if (local != NULL)
+            {
+                assignLocal(builder, local, value, line);
+            }
+            else
+            {
+                IrValue set = buildWithOperands(builder, IR_SET_VARIABLE, false, types, &value, 1, line);
+                setName(builder, set, expr->name);
+            }
+
+            return IR_NO_VALUE;
+        }
+
+        case DOT_EXPRESSION:
+            return buildDot(builder, (DotExpr*)expression, line);
+
+        case BASE_EXPRESSION:
+        {
+            IrValue base = addInstruction(builder, IR_GET_BASE, true, types, line);
+            setName(builder, base, ((BaseExpr*)expression)->methodName);
+
+            return base;
+        }
+
+        case CALL_EXPRESSION:
+            return buildCall(builder, (CallExpr*)expression, line);
+
+        case LIST_EXPRESSION:
+            return buildList(builder, IR_BUILD_LIST, types, NULL, ((ListExpr*)expression)->expressions, line);
+
+        case INTERPOLATION_EXPRESSION:
+            return buildList(builder, IR_BUILD_STRING, types, NULL, ((InterpolationExpr*)expression)->parts, line);
+
+        case SUBSCRIPT_EXPRESSION:
+        {
+            SubscriptExpr* expr = (SubscriptExpr*)expression;
+
+            IrValue operands[3];
+            operands[0] = buildValue(builder, expr->list);
+            operands[1] = buildValue(builder, expr->index);
+
+            if (expr->value == NULL)
+            {
+                return buildWithOperands(builder, IR_SUBSCRIPT_GET, true, types, operands, 2, line);
+            }
+
+            operands[2] = buildValue(builder, expr->value);
+            buildWithOperands(builder, IR_SUBSCRIPT_SET, false, types, operands, 3, line);
+
+            return IR_NO_VALUE;
+        }
+
+        // A suspended coroutine keeps its frame, not the values of this one
+        case YIELD_EXPRESSION:
+        case RESUME_EXPRESSION:
+            builder->failed = true;
+            return IR_NO_VALUE;
+    }
+
+    return IR_NO_VALUE;
+}
+
+// endregion
+
+// region Conditions
+
+static bool isAlwaysTrue(Expr* condition)
+{
+    if (condition == NULL) return true;
+    if (condition->type != LITERAL_EXPRESSION) return false;
+
+    Value value = ((LiteralExpr*)condition)->value;
+    return !IS_NULL(value) && !(IS_BOOL(value) && !AS_BOOL(value));
+}
+
+// Jumps to one of the blocks, 'and', 'or' and '!' only decide where to go, their values aren't built
+static void buildCondition(Builder* builder, Expr* condition, IrBlockIndex ifTrue, IrBlockIndex ifFalse)
+{
+    if (builder->failed) return;
+
+    uint16_t line = condition->line;
+
+    if (condition->cacheSlot == 0 && condition->type == LOGICAL_EXPRESSION)
+    {
+        LogicalExpr* expr = (LogicalExpr*)condition;
+        IrBlockIndex right = newBlock(builder);
+
+        if (expr->op == TOKEN_AND)
+        {
+            buildCondition(builder, expr->left, right, ifFalse);
+        }
+        else
+        {
+            buildCondition(builder, expr->left, ifTrue, right);
+        }
+
+        sealBlock(builder, right);
+        startBlock(builder, right);
+
+        buildCondition(builder, expr->right, ifTrue, ifFalse);
+        return;
+    }
+
+    if (condition->cacheSlot == 0 && condition->type == UNARY_EXPRESSION &&
+        ((UnaryExpr*)condition)->op == TOKEN_BANG)
+    {
+        buildCondition(builder, ((UnaryExpr*)condition)->target, ifFalse, ifTrue);
+        return;
+    }
+
+    IrValue value = buildValue(builder, condition);
+    if (builder->failed) return;
+
+    irBranch(builder->function, builder->block, value, ifTrue, ifFalse, line);
+}
+
+// endregion
+
+// region Statements
+
+static void buildStatements(Builder* builder, Node* statements)
+{
+    for (Node* node = statements; node != NULL && !builder->failed; node = node->next)
+    {
+        buildStatement(builder, AS_STATEMENT(node));
+    }
+}
+
+// A declaration which is the whole body of an 'if' or a loop is made in the enclosing scope
+static void buildBody(Builder* builder, Stmt* body)
+{
+    if (body != NULL && body->type == VARIABLE_STATEMENT)
+    {
+        builder->failed = true;
+        return;
+    }
+
+    buildStatement(builder, body);
+}
+
+static void buildIf(Builder* builder, IfStmt* stmt, uint16_t line)
+{
+    IrBlockIndex thenBlock = newBlock(builder);
+    IrBlockIndex end = newBlock(builder);
+    IrBlockIndex elseBlock = stmt->elseBranch != NULL ? newBlock(builder) : end;
+
+    if (profiling)
+    {
+        // Recorded for the whole condition
+        IrValue condition = buildValue(builder, stmt->condition);
+        if (builder->failed) return;
+
+        irBranch(builder->function, builder->block, condition, thenBlock, elseBlock, line);
+
+        IrTerminator* terminator = &irBlock(builder->function, builder->block)->terminator;
+        terminator->site = stmt->site;
+        terminator->profiled = true;
+    }
+    else
+    {
+        buildCondition(builder, stmt->condition, thenBlock, elseBlock);
+    }
+
+    sealBlock(builder, thenBlock);
+    if (elseBlock != end) sealBlock(builder, elseBlock);
+
+    // The branch which mostly ran goes last, like in the AST emitter
+    SiteFeedback* feedback = getSiteFeedback(stmt->site);
+    bool thenIsHot = feedback != NULL && feedback->truthy > feedback->falsy;
+
+    if (thenIsHot && elseBlock != end)
+    {
+        startBlock(builder, elseBlock);
+        buildBody(builder, stmt->elseBranch);
+        jumpTo(builder, end, line);
+
+        startBlock(builder, thenBlock);
+        buildBody(builder, stmt->thenBranch);
+        jumpTo(builder, end, line);
+    }
+    else
+    {
+        startBlock(builder, thenBlock);
+        buildBody(builder, stmt->thenBranch);
+        jumpTo(builder, end, line);
+
+        if (elseBlock != end)
+        {
+            startBlock(builder, elseBlock);
+            buildBody(builder, stmt->elseBranch);
+            jumpTo(builder, end, line);
+        }
+    }
+
+    sealBlock(builder, end);
+    startBlock(builder, end);
+}
+
+// The condition is laid out after the body, where it jumps back to the body, like in the AST emitter.
+// 'increment' is NULL for 'while' loops.
+static void buildLoop(Builder* builder, Expr* condition, Stmt* body, Expr* increment, uint16_t line)
+{
+    IrFunction* function = builder->function;
+    bool alwaysTrue = isAlwaysTrue(condition);
+
+    // Conditions which are always true aren't tested, the body jumps straight back to its start
+    IrBlockIndex start = newBlock(builder);
+    IrBlockIndex test = alwaysTrue ? start : newBlock(builder);
+    IrBlockIndex step = increment != NULL ? newBlock(builder) : test;
+    IrBlockIndex exit = newBlock(builder);
+
+    jumpTo(builder, test, line);
+
+    uint testStart = function->layoutCount;
+
+    if (!alwaysTrue)
+    {
+        startBlock(builder, test);
+        buildCondition(builder, condition, start, exit);
+        sealBlock(builder, start);
+    }
+
+    uint bodyStart = function->layoutCount;
+
+    LoopTargets loop;
+    loop.continueTarget = step;
+    loop.breakTarget = exit;
+    loop.enclosing = builder->loop;
+    builder->loop = &loop;
+
+    startBlock(builder, start);
+    buildBody(builder, body);
+
+    if (increment != NULL)
+    {
+        jumpTo(builder, step, line);
+        sealBlock(builder, step);
+        startBlock(builder, step);
+
+        buildExpression(builder, increment);
+    }
+
+    jumpTo(builder, test, line);
+    builder->loop = loop.enclosing;
+
+    sealBlock(builder, test);
+    rotateLayout(function, testStart, bodyStart);
+
+    sealBlock(builder, exit);
+    startBlock(builder, exit);
+}
+
+static void buildStatement(Builder* builder, Stmt* statement)
+{
+    if (statement == NULL || builder->failed) return;
+
+    if (isTerminated(builder)) startUnreachable(builder);
+
+    uint16_t line = statement->line;
+
+    switch (statement->type)
+    {
+        case EXPRESSION_STATEMENT:
+            buildExpression(builder, ((ExpressionStmt*)statement)->expr);
+            break;
+
+        case BLOCK_STATEMENT:
+            beginScope(builder);
+            buildStatements(builder, ((BlockStmt*)statement)->statements);
+            endScope(builder);
+            break;
+
+        case IF_STATEMENT:
+            buildIf(builder, (IfStmt*)statement, line);
+            break;
+
+        case VARIABLE_STATEMENT:
+        {
+            VariableStmt* stmt = (VariableStmt*)statement;
+
+            // Freed when its scope ends, see escape_analysis.h
+            if (stmt->ownedByScope)
+            {
+                builder->failed = true;
+                break;
+            }
+
+            IrValue value = stmt->initializer == NULL ? buildConstant(builder, NULL_VAL, line)
+                                                      : buildValue(builder, stmt->initializer);
+
+            IrValue copy = addInstruction(builder, IR_COPY, true, 0, line);
+            addOperand(builder, copy, value);
+            setName(builder, copy, stmt->name);
+
+            declareLocal(builder, stmt->name, copy);
+            break;
+        }
+
+        case WHILE_STATEMENT:
+        {
+            WhileStmt* stmt = (WhileStmt*)statement;
+
+            if (stmt->cacheCount > 0)
+            {
+                builder->failed = true;
+                break;
+            }
+
+            buildLoop(builder, stmt->condition, stmt->body, NULL, line);
+            break;
+        }
+
+        case FOR_STATEMENT:
+        {
+            ForStmt* stmt = (ForStmt*)statement;
+
+            // Counted by OP_FOR_RANGE, or caching expressions in hidden slots
+            if (stmt->isRange || stmt->cacheCount > 0)
+            {
+                builder->failed = true;
+                break;
+            }
+
+            beginScope(builder);
+            buildStatement(builder, stmt->declaration);
+
+            buildLoop(builder, stmt->condition, stmt->body, stmt->increment, line);
+            endScope(builder);
+            break;
+        }
+
+        case RETURN_STATEMENT:
+        {
+            ReturnStmt* stmt = (ReturnStmt*)statement;
+
+            // Reported by the AST emitter
+            if (builder->isInitializer)
+            {
+                builder->failed = true;
+                break;
+            }
+
+            IrValue value = stmt->value == NULL ? buildConstant(builder, NULL_VAL, line)
+                                                : buildValue(builder, stmt->value);
+
+            irReturn(builder->function, builder->block, value, line);
+            break;
+        }
+
+        case CONTINUE_STATEMENT:
+        case BREAK_STATEMENT:
+        {
+            if (builder->loop == NULL)
+            {
+                builder->failed = true;
+                break;
+            }
+
+            IrBlockIndex target = statement->type == BREAK_STATEMENT ? builder->loop->breakTarget
+                                                                     : builder->loop->continueTarget;
+            jumpTo(builder, target, line);
+            break;
+        }
+
+        case FOREACH_STATEMENT:
+        case SWITCH_STATEMENT:
+        case FUNCTION_STATEMENT:
+        case CLASS_STATEMENT:
+        case TRY_STATEMENT:
+            builder->failed = true;
+            break;
+    }
+}
+
+// endregion
+
+static void freeBuilder(Builder* builder)
+{
+    for (uint i = 0; i < builder->function->blockCount; i++)
+    {
+        BlockState* state = &builder->states[i];
+
+        FREE_ARRAY(IrValue, state->definitions, state->definitionCapacity);
+        FREE_ARRAY(IncompletePhi, state->incomplete, state->incompleteCapacity);
+    }
+
+    FREE_ARRAY(BlockState, builder->states, builder->stateCapacity);
+    FREE_ARRAY(Local, builder->locals, builder->localCapacity);
+}
+
+IrFunction* buildIr(FunctionStmt* function, bool isInitializer)
+{
+    Builder builder;
+
+    builder.function = newIrFunction(function->name, function->paramCount);
+    builder.isInitializer = isInitializer;
+    builder.failed = false;
+
+    builder.states = NULL;
+    builder.stateCapacity = 0;
+
+    builder.locals = NULL;
+    builder.localCount = 0;
+    builder.localCapacity = 0;
+    builder.depth = 0;
+    builder.variableCount = 0;
+
+    builder.loop = NULL;
+
+    IrBlockIndex entry = newBlock(&builder);
+    builder.states[entry].sealed = true;
+    startBlock(&builder, entry);
+
+    // The arguments are left in the frame's first slots
+    for (uint16_t i = 0; i < function->paramCount && !builder.failed; i++)
+    {
+        IrValue param = addInstruction(&builder, IR_PARAMETER, true, INFERRED_ANY, function->stmt.line);
+        if (param == IR_NO_VALUE) break;
+
+        irInstruction(builder.function, param)->index = i;
+        setName(&builder, param, function->params[i]);
+
+        declareLocal(&builder, function->params[i], param);
+    }
+
+    buildStatements(&builder, function->body);
+
+    if (!builder.failed && !isTerminated(&builder))
+    {
+        irReturn(builder.function, builder.block, IR_NO_VALUE, function->stmt.line);
+    }
+
+    IrFunction* built = builder.function;
+    freeBuilder(&builder);
+
+    if (builder.failed)
+    {
+        freeIrFunction(built);
+        return NULL;
+    }
+
+    return built;
+}
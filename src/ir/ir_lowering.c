@@ -0,0 +1,858 @@
+#include <string.h>
+
+#include "ir_lowering.h"
+#include "chunk_writer.h"
+#include "memory.h"
+
+// Arguments and values kept for later uses, functions needing more are compiled from the AST
+#define IR_MAX_SLOTS 64
+
+#define NO_SLOT (-1)
+
+typedef struct
+{
+    IrValue* values;
+    uint count;
+    uint capacity;
+} ValueList;
+
+typedef struct
+{
+    IrFunction* function;
+    bool isInitializer;
+
+    // By instruction
+    uint* uses;
+    uint* useStarts;          // Where its blocks start in 'useBlocks', one more for the end
+    bool* inlined;            // Left on the stack by its operands for the only instruction using it
+    int* slots;
+    int slotCount;
+
+    // Blocks of every use, phi operands are used at the end of the predecessor
+    IrBlockIndex* useBlocks;
+    uint useCount;
+
+    // Live instructions of the block in order, then the order the block would compute them in
+    IrValue* expected;
+    IrValue* computed;
+    uint computedCount;
+
+    // By block
+    uint* starts;
+    bool* emitted;
+    ValueList* liveIn;
+    ValueList* liveOut;
+
+    // Jumps to blocks which haven't been emitted yet
+    uint* pendingOffsets;
+    IrBlockIndex* pendingTargets;
+    uint pendingCount;
+    uint pendingCapacity;
+} Lowering;
+
+static bool isLoaded(IrInstruction* instruction)
+{
+    return instruction->op == IR_CONSTANT || instruction->op == IR_PARAMETER || instruction->op == IR_PHI;
+}
+
+static bool isLive(IrFunction* function, IrValue value)
+{
+    return value != IR_NO_VALUE && !irInstruction(function, value)->removed;
+}
+
+// Next block emitted after the one at 'position' in the layout
+static IrBlockIndex nextBlock(IrFunction* function, uint position)
+{
+    for (uint i = position + 1; i < function->layoutCount; i++)
+    {
+        if (!irBlock(function, function->layout[i])->removed) return function->layout[i];
+    }
+
+    return IR_NO_BLOCK;
+}
+
+// Counts the use without 'cursors', then stores its block at the value's cursor
+static void addUse(Lowering* lowering, IrValue value, IrBlockIndex block, uint* cursors)
+{
+    if (cursors == NULL)
+    {
+        lowering->uses[value]++;
+    }
+    else
+    {
+        lowering->useBlocks[cursors[value]++] = block;
+    }
+}
+
+static void visitUses(Lowering* lowering, uint* cursors)
+{
+    IrFunction* function = lowering->function;
+
+    for (uint i = 0; i < function->instructionCount; i++)
+    {
+        IrInstruction* instruction = &function->instructions[i];
+        if (instruction->removed) continue;
+
+        for (uint16_t j = 0; j < instruction->operandCount; j++)
+        {
+            IrBlockIndex block = instruction->block;
+            if (instruction->op == IR_PHI) block = irBlock(function, block)->predecessors[j];
+
+            addUse(lowering, instruction->operands[j], block, cursors);
+        }
+    }
+
+    for (uint i = 0; i < function->blockCount; i++)
+    {
+        IrTerminator* terminator = &function->blocks[i].terminator;
+        if (function->blocks[i].removed || terminator->value == IR_NO_VALUE) continue;
+
+        addUse(lowering, terminator->value, (IrBlockIndex)i, cursors);
+    }
+}
+
+static void countUses(Lowering* lowering)
+{
+    uint count = lowering->function->instructionCount;
+    visitUses(lowering, NULL);
+
+    uint* cursors = ALLOCATE(uint, count);
+    lowering->useStarts = ALLOCATE(uint, count + 1);
+    lowering->useCount = 0;
+
+    for (uint i = 0; i < count; i++)
+    {
+        lowering->useStarts[i] = lowering->useCount;
+        cursors[i] = lowering->useCount;
+        lowering->useCount += lowering->uses[i];
+    }
+
+    lowering->useStarts[count] = lowering->useCount;
+    lowering->useBlocks = ALLOCATE(IrBlockIndex, lowering->useCount);
+
+    visitUses(lowering, cursors);
+    FREE_ARRAY(uint, cursors, count);
+}
+
+// Phis whose operand comes from 'block', which jumps to their block
+static IrBlock* jumpedPhis(IrFunction* function, IrBlock* block, int* predecessor)
+{
+    if (block->terminator.type != IR_JUMP) return NULL;
+
+    IrBlock* target = irBlock(function, block->terminator.targets[0]);
+    *predecessor = irPredecessorIndex(target, (IrBlockIndex)(block - function->blocks));
+
+    return target;
+}
+
+static void computeValue(Lowering* lowering, IrValue value)
+{
+    IrInstruction* instruction = irInstruction(lowering->function, value);
+
+    for (uint16_t i = 0; i < instruction->operandCount; i++)
+    {
+        if (lowering->inlined[instruction->operands[i]]) computeValue(lowering, instruction->operands[i]);
+    }
+
+    lowering->computed[lowering->computedCount++] = value;
+}
+
+// Order the block computes its instructions in when each inlined one waits for its use
+static void computeBlock(Lowering* lowering, IrBlock* block)
+{
+    IrFunction* function = lowering->function;
+    lowering->computedCount = 0;
+
+    for (uint16_t i = 0; i < block->instructionCount; i++)
+    {
+        IrValue value = block->instructions[i];
+        if (!isLive(function, value) || lowering->inlined[value] || isLoaded(irInstruction(function, value))) continue;
+
+        computeValue(lowering, value);
+    }
+
+    int predecessor;
+    IrBlock* target = jumpedPhis(function, block, &predecessor);
+
+    for (uint16_t i = 0; target != NULL && i < target->phiCount; i++)
+    {
+        IrInstruction* phi = irInstruction(function, target->phis[i]);
+        if (phi->removed) continue;
+
+        IrValue operand = phi->operands[predecessor];
+        if (lowering->inlined[operand]) computeValue(lowering, operand);
+    }
+
+    IrValue value = block->terminator.value;
+    if (value != IR_NO_VALUE && lowering->inlined[value]) computeValue(lowering, value);
+}
+
+// Values used once, right where the block would leave them on the stack, are never stored. Inlining one
+// which would then run after something it ran before is undone, until the order is the same.
+static void stackifyBlock(Lowering* lowering, IrBlock* block)
+{
+    IrFunction* function = lowering->function;
+    IrBlockIndex index = (IrBlockIndex)(block - function->blocks);
+    uint expectedCount = 0;
+
+    for (uint16_t i = 0; i < block->instructionCount; i++)
+    {
+        IrValue value = block->instructions[i];
+        IrInstruction* instruction = irInstruction(function, value);
+
+        if (!isLive(function, value) || isLoaded(instruction)) continue;
+
+        lowering->expected[expectedCount++] = value;
+        lowering->inlined[value] = instruction->hasValue && lowering->uses[value] == 1 &&
+                                   lowering->useBlocks[lowering->useStarts[value]] == index;
+    }
+
+    for (;;)
+    {
+        computeBlock(lowering, block);
+
+        uint i = 0;
+        while (i < lowering->computedCount && lowering->computed[i] == lowering->expected[i]) i++;
+
+        if (i == expectedCount) return;
+
+        // Used by nothing which is computed in this block
+        lowering->inlined[lowering->expected[i]] = false;
+    }
+}
+
+static void appendValue(ValueList* list, IrValue value)
+{
+    if (list->capacity < list->count + 1)
+    {
+        uint oldCapacity = list->capacity;
+        list->capacity = GROW_CAPACITY(oldCapacity);
+        list->values = GROW_ARRAY(IrValue, list->values, oldCapacity, list->capacity);
+    }
+
+    list->values[list->count++] = value;
+}
+
+// Constants are loaded where they're used, the stack holds inlined values
+static bool needsSlot(Lowering* lowering, IrValue value)
+{
+    IrInstruction* instruction = irInstruction(lowering->function, value);
+    if (instruction->removed || lowering->inlined[value] || instruction->op == IR_CONSTANT) return false;
+
+    return instruction->op == IR_PHI || lowering->uses[value] > 0;
+}
+
+// Walks back from the blocks using the value to the one defining it, a use in that block comes after the definition
+static void findLiveBlocks(Lowering* lowering, IrValue value, uint* inStamps, uint* outStamps, IrBlockIndex* worklist)
+{
+    IrFunction* function = lowering->function;
+    IrBlockIndex definition = irInstruction(function, value)->block;
+    uint stamp = value + 1;
+    uint worklistCount = 0;
+
+    for (uint i = lowering->useStarts[value]; i < lowering->useStarts[value + 1]; i++)
+    {
+        IrBlockIndex block = lowering->useBlocks[i];
+        if (block == definition || inStamps[block] == stamp) continue;
+
+        inStamps[block] = stamp;
+        appendValue(&lowering->liveIn[block], value);
+        worklist[worklistCount++] = block;
+    }
+
+    while (worklistCount > 0)
+    {
+        IrBlock* block = irBlock(function, worklist[--worklistCount]);
+
+        for (uint16_t i = 0; i < block->predecessorCount; i++)
+        {
+            IrBlockIndex predecessor = block->predecessors[i];
+
+            if (outStamps[predecessor] != stamp)
+            {
+                outStamps[predecessor] = stamp;
+                appendValue(&lowering->liveOut[predecessor], value);
+            }
+
+            if (predecessor == definition || inStamps[predecessor] == stamp) continue;
+
+            inStamps[predecessor] = stamp;
+            appendValue(&lowering->liveIn[predecessor], value);
+            worklist[worklistCount++] = predecessor;
+        }
+    }
+}
+
+static void findLiveness(Lowering* lowering)
+{
+    IrFunction* function = lowering->function;
+
+    uint* inStamps = ALLOCATE(uint, function->blockCount);
+    uint* outStamps = ALLOCATE(uint, function->blockCount);
+    IrBlockIndex* worklist = ALLOCATE(IrBlockIndex, function->blockCount);
+
+    memset(inStamps, 0, sizeof(uint) * function->blockCount);
+    memset(outStamps, 0, sizeof(uint) * function->blockCount);
+
+    for (uint i = 0; i < function->instructionCount; i++)
+    {
+        if (needsSlot(lowering, (IrValue)i)) findLiveBlocks(lowering, (IrValue)i, inStamps, outStamps, worklist);
+    }
+
+    FREE_ARRAY(uint, inStamps, function->blockCount);
+    FREE_ARRAY(uint, outStamps, function->blockCount);
+    FREE_ARRAY(IrBlockIndex, worklist, function->blockCount);
+}
+
+// Stores 'position' for the values loaded by the instruction and those inlined into it
+static void markUses(Lowering* lowering, IrValue value, uint* lastUses, uint position)
+{
+    IrInstruction* instruction = irInstruction(lowering->function, value);
+
+    for (uint16_t i = 0; i < instruction->operandCount; i++)
+    {
+        IrValue operand = instruction->operands[i];
+
+        if (lowering->inlined[operand])
+        {
+            markUses(lowering, operand, lastUses, position);
+        }
+        else
+        {
+            lastUses[operand] = position;
+        }
+    }
+}
+
+
+// Frees the slots of loaded values last used at 'position' which don't outlive the block
+static void releaseUses(Lowering* lowering, IrValue value, uint* lastUses, uint position, uint* outMarks,
+                        uint outMark, bool* occupied)
+{
+    IrInstruction* instruction = irInstruction(lowering->function, value);
+
+    for (uint16_t i = 0; i < instruction->operandCount; i++)
+    {
+        IrValue operand = instruction->operands[i];
+
+        if (lowering->inlined[operand])
+        {
+            releaseUses(lowering, operand, lastUses, position, outMarks, outMark, occupied);
+        }
+        else if (lowering->slots[operand] != NO_SLOT && lastUses[operand] == position && outMarks[operand] != outMark)
+        {
+            occupied[lowering->slots[operand]] = false;
+        }
+    }
+}
+
+static int occupySlot(Lowering* lowering, bool* occupied)
+{
+    int slot = 0;
+    while (occupied[slot]) slot++;
+
+    occupied[slot] = true;
+    if (slot + 1 > lowering->slotCount) lowering->slotCount = slot + 1;
+
+    return slot;
+}
+
+static bool isRoot(Lowering* lowering, IrValue value)
+{
+    IrFunction* function = lowering->function;
+    return isLive(function, value) && !lowering->inlined[value] && !isLoaded(irInstruction(function, value));
+}
+
+// Values which are never live at the same time share a slot. Blocks are colored after those dominating them, so
+// the values live into one already have theirs. Parameters keep the slot their argument is in.
+static bool assignSlots(Lowering* lowering)
+{
+    IrFunction* function = lowering->function;
+    uint count = function->instructionCount;
+
+    findLiveness(lowering);
+
+    IrBlockIndex* order = ALLOCATE(IrBlockIndex, function->blockCount);
+    uint orderCount = irReversePostorder(function, order);
+
+    uint* lastUses = ALLOCATE(uint, count);
+    uint* outMarks = ALLOCATE(uint, count);
+    bool* occupied = ALLOCATE(bool, function->paramCount + count + 1);
+
+    memset(lastUses, 0, sizeof(uint) * count);
+    memset(outMarks, 0, sizeof(uint) * count);
+    memset(occupied, 0, sizeof(bool) * (function->paramCount + count + 1));
+
+    lowering->slotCount = function->paramCount;
+    for (uint i = 0; i < count; i++) lowering->slots[i] = NO_SLOT;
+
+    uint position = 0;
+
+    for (uint i = 0; i < orderCount; i++)
+    {
+        IrBlockIndex index = order[i];
+        IrBlock* block = irBlock(function, index);
+        uint outMark = index + 1;
+
+        for (uint j = 0; j < lowering->liveIn[index].count; j++)
+        {
+            occupied[lowering->slots[lowering->liveIn[index].values[j]]] = true;
+        }
+
+        for (uint j = 0; j < lowering->liveOut[index].count; j++)
+        {
+            outMarks[lowering->liveOut[index].values[j]] = outMark;
+        }
+
+        for (uint16_t j = 0; j < block->instructionCount; j++)
+        {
+            IrValue value = block->instructions[j];
+            IrInstruction* instruction = irInstruction(function, value);
+            if (!needsSlot(lowering, value)) continue;
+
+            if (instruction->op == IR_PARAMETER)
+            {
+                lowering->slots[value] = instruction->index;
+                occupied[instruction->index] = true;
+            }
+        }
+
+        for (uint16_t j = 0; j < block->phiCount; j++)
+        {
+            if (needsSlot(lowering, block->phis[j])) lowering->slots[block->phis[j]] = occupySlot(lowering, occupied);
+        }
+
+        // Positions of the instructions, the terminator and the phi copies before it come last
+        uint start = position;
+
+        for (uint16_t j = 0; j < block->instructionCount; j++)
+        {
+            if (isRoot(lowering, block->instructions[j])) markUses(lowering, block->instructions[j], lastUses, ++position);
+        }
+
+        position++;
+
+        int predecessor;
+        IrBlock* target = jumpedPhis(function, block, &predecessor);
+
+        for (uint16_t j = 0; target != NULL && j < target->phiCount; j++)
+        {
+            IrInstruction* phi = irInstruction(function, target->phis[j]);
+            if (phi->removed) continue;
+
+            IrValue operand = phi->operands[predecessor];
+
+            if (lowering->inlined[operand])
+            {
+                markUses(lowering, operand, lastUses, position);
+            }
+            else
+            {
+                lastUses[operand] = position;
+            }
+        }
+
+        IrValue terminatorValue = block->terminator.value;
+
+        if (terminatorValue != IR_NO_VALUE && lowering->inlined[terminatorValue])
+        {
+            markUses(lowering, terminatorValue, lastUses, position);
+        }
+        else if (terminatorValue != IR_NO_VALUE)
+        {
+            lastUses[terminatorValue] = position;
+        }
+
+        for (uint16_t j = 0; j < block->instructionCount; j++)
+        {
+            IrValue value = block->instructions[j];
+            if (!isRoot(lowering, value)) continue;
+
+            releaseUses(lowering, value, lastUses, ++start, outMarks, outMark, occupied);
+            if (needsSlot(lowering, value)) lowering->slots[value] = occupySlot(lowering, occupied);
+        }
+
+        memset(occupied, 0, sizeof(bool) * lowering->slotCount);
+    }
+
+    FREE_ARRAY(IrBlockIndex, order, function->blockCount);
+    FREE_ARRAY(uint, lastUses, count);
+    FREE_ARRAY(uint, outMarks, count);
+    FREE_ARRAY(bool, occupied, function->paramCount + count + 1);
+
+    return lowering->slotCount <= IR_MAX_SLOTS;
+}
+
+static void emitValue(Lowering* lowering, IrValue value);
+
+// Loads get the line of what uses them, constants are shared by the whole function
+static void emitOperand(Lowering* lowering, IrValue value, uint16_t line)
+{
+    IrInstruction* instruction = irInstruction(lowering->function, value);
+
+    if (lowering->inlined[value])
+    {
+        emitValue(lowering, value);
+    }
+    else if (instruction->op == IR_CONSTANT)
+    {
+        if (IS_NULL(instruction->constant))
+        {
+            emitByte(OP_NULL, line);
+        }
+        else
+        {
+            emitConstant(instruction->constant, line);
+        }
+    }
+    else
+    {
+        emitBytes(OP_GET_LOCAL, (uint8_t)lowering->slots[value], line);
+    }
+}
+
+static void emitNamed(uint8_t op, IrInstruction* instruction)
+{
+    emitBytes(op, makeConstant(OBJ_VAL(instruction->name), instruction->line), instruction->line);
+}
+
+static void emitValue(Lowering* lowering, IrValue value)
+{
+    IrFunction* function = lowering->function;
+    IrInstruction* instruction = irInstruction(function, value);
+    uint16_t line = instruction->line;
+
+    for (uint16_t i = 0; i < instruction->operandCount; i++)
+    {
+        emitOperand(lowering, instruction->operands[i], line);
+    }
+
+    switch (instruction->op)
+    {
+        case IR_GET_VARIABLE: emitNamed(OP_GET_VARIABLE, instruction); break;
+        case IR_SET_VARIABLE: emitNamed(OP_SET_VARIABLE, instruction); break;
+        case IR_SET_PROPERTY: emitNamed(OP_SET_PROPERTY, instruction); break;
+        case IR_GET_BASE:     emitNamed(OP_GET_BASE, instruction);     break;
+
+        case IR_UPDATE_VARIABLE:
+        case IR_UPDATE_PROPERTY:
+            emitUpdate(instruction->op == IR_UPDATE_VARIABLE ? OP_UPDATE_VARIABLE : OP_UPDATE_PROPERTY,
+                       instruction->name, instruction->token, line);
+            break;
+
+        case IR_BINARY:
+            emitBinaryOp(instruction->token, irInstruction(function, instruction->operands[0])->types,
+                         irInstruction(function, instruction->operands[1])->types, instruction->site, line);
+            break;
+
+        case IR_UNARY:
+            if (instruction->token == TOKEN_BANG)
+            {
+                emitByte(OP_NOT, line);
+            }
+            else if (instruction->token == TOKEN_TILDE)
+            {
+                emitByte(OP_BIT_NOT, line);
+            }
+            else
+            {
+                bool number = irInstruction(function, instruction->operands[0])->types == INFERRED_NUMBER;
+                emitByte(number ? OP_NEGATE_NUMBER : OP_NEGATE, line);
+            }
+            break;
+
+        case IR_CALL:
+            emitBytes(OP_CALL, instruction->operandCount - 1, line);
+            break;
+
+        case IR_INVOKE:
+            emitProfile(instruction->site, line);
+            emitNamed(OP_INVOKE, instruction);
+            emitByte(instruction->operandCount - 1, line);
+            break;
+
+        case IR_GET_PROPERTY:
+            emitProfile(instruction->site, line);
+            emitNamed(OP_GET_PROPERTY, instruction);
+            break;
+
+        case IR_SUBSCRIPT_GET: emitByte(OP_SUBSCRIPT_GET, line);   break;
+        case IR_SUBSCRIPT_SET: emitByte(OP_SUBSCRIPT_STORE, line); break;
+
+        case IR_BUILD_LIST:   emitBytes(OP_BUILD_LIST, instruction->operandCount, line);   break;
+        case IR_BUILD_STRING: emitBytes(OP_BUILD_STRING, instruction->operandCount, line); break;
+
+        default:
+            emitterError("Unexpected instruction in the IR.", line);
+    }
+}
+
+// Forward jumps are patched once their target is emitted
+static void emitJumpTo(Lowering* lowering, uint8_t forward, uint8_t backward, IrBlockIndex target, uint16_t line)
+{
+    if (lowering->emitted[target])
+    {
+        emitLoop(backward, lowering->starts[target], line);
+        return;
+    }
+
+    if (lowering->pendingCapacity < lowering->pendingCount + 1)
+    {
+        uint oldCapacity = lowering->pendingCapacity;
+        lowering->pendingCapacity = GROW_CAPACITY(oldCapacity);
+        lowering->pendingOffsets = GROW_ARRAY(uint, lowering->pendingOffsets, oldCapacity, lowering->pendingCapacity);
+        lowering->pendingTargets = GROW_ARRAY(IrBlockIndex, lowering->pendingTargets, oldCapacity,
+                                              lowering->pendingCapacity);
+    }
+
+    lowering->pendingOffsets[lowering->pendingCount] = emitJump(forward, line);
+    lowering->pendingTargets[lowering->pendingCount] = target;
+    lowering->pendingCount++;
+}
+
+// Jumps there if the value on the stack is falsy, there's no backward jump for that
+static void emitJumpIfFalse(Lowering* lowering, IrBlockIndex target, uint16_t line)
+{
+    if (!lowering->emitted[target])
+    {
+        emitJumpTo(lowering, OP_POP_JUMP_IF_FALSE, OP_LOOP, target, line);
+        return;
+    }
+
+    uint skip = emitJump(OP_POP_JUMP_IF_TRUE, line);
+    emitLoop(OP_LOOP, lowering->starts[target], line);
+    patchJump(skip, line);
+}
+
+// All operands are pushed before any phi is stored, a phi may be the operand of another
+static void emitPhiCopies(Lowering* lowering, IrBlock* block)
+{
+    IrFunction* function = lowering->function;
+
+    int predecessor;
+    IrBlock* target = jumpedPhis(function, block, &predecessor);
+    if (target == NULL) return;
+
+    for (uint16_t i = 0; i < target->phiCount; i++)
+    {
+        IrInstruction* phi = irInstruction(function, target->phis[i]);
+        if (phi->removed || phi->operands[predecessor] == target->phis[i]) continue;
+
+        emitOperand(lowering, phi->operands[predecessor], block->terminator.line);
+    }
+
+    for (int i = target->phiCount - 1; i >= 0; i--)
+    {
+        IrInstruction* phi = irInstruction(function, target->phis[i]);
+        if (phi->removed || phi->operands[predecessor] == target->phis[i]) continue;
+
+        emitBytes(OP_SET_LOCAL, (uint8_t)lowering->slots[target->phis[i]], block->terminator.line);
+    }
+}
+
+static void emitTerminator(Lowering* lowering, IrBlock* block, IrBlockIndex next)
+{
+    IrTerminator* terminator = &block->terminator;
+    uint16_t line = terminator->line;
+
+    switch (terminator->type)
+    {
+        case IR_JUMP:
+            emitPhiCopies(lowering, block);
+            if (terminator->targets[0] != next) emitJumpTo(lowering, OP_JUMP, OP_LOOP, terminator->targets[0], line);
+            break;
+
+        case IR_BRANCH:
+        {
+            IrBlockIndex ifTrue = terminator->targets[0];
+            IrBlockIndex ifFalse = terminator->targets[1];
+
+            emitOperand(lowering, terminator->value, line);
+            if (terminator->profiled) emitProfile(terminator->site, line);
+
+            if (ifFalse == next)
+            {
+                emitJumpTo(lowering, OP_POP_JUMP_IF_TRUE, OP_POP_LOOP_IF_TRUE, ifTrue, line);
+                break;
+            }
+
+            emitJumpIfFalse(lowering, ifFalse, line);
+            if (ifTrue != next) emitJumpTo(lowering, OP_JUMP, OP_LOOP, ifTrue, line);
+            break;
+        }
+
+        case IR_RETURN:
+            if (terminator->value != IR_NO_VALUE)
+            {
+                emitOperand(lowering, terminator->value, line);
+            }
+            else if (next == IR_NO_BLOCK)
+            {
+                // Left to endCompiler
+                break;
+            }
+            else if (!lowering->isInitializer)
+            {
+                emitByte(OP_NULL, line);
+            }
+
+            emitReturn(line);
+            break;
+
+        case IR_UNTERMINATED:
+            break;
+    }
+}
+
+static void emitBlock(Lowering* lowering, IrBlockIndex index, IrBlockIndex next)
+{
+    IrFunction* function = lowering->function;
+    IrBlock* block = irBlock(function, index);
+
+    lowering->starts[index] = currentChunk()->codeCount;
+    lowering->emitted[index] = true;
+
+    for (uint i = 0; i < lowering->pendingCount; i++)
+    {
+        if (lowering->pendingTargets[i] != index) continue;
+
+        patchJump(lowering->pendingOffsets[i], block->terminator.line);
+
+        lowering->pendingCount--;
+        lowering->pendingOffsets[i] = lowering->pendingOffsets[lowering->pendingCount];
+        lowering->pendingTargets[i] = lowering->pendingTargets[lowering->pendingCount];
+        i--;
+    }
+
+    for (uint16_t i = 0; i < block->instructionCount; i++)
+    {
+        IrValue value = block->instructions[i];
+        IrInstruction* instruction = irInstruction(function, value);
+
+        if (!isLive(function, value) || lowering->inlined[value] || isLoaded(instruction)) continue;
+
+        emitValue(lowering, value);
+        if (!instruction->hasValue) continue;
+
+        if (lowering->slots[value] != NO_SLOT)
+        {
+            emitBytes(OP_SET_LOCAL, (uint8_t)lowering->slots[value], instruction->line);
+        }
+        else
+        {
+            emitByte(OP_POP, instruction->line);
+        }
+    }
+
+    emitTerminator(lowering, block, next);
+}
+
+// Phis are only copied at the end of jumps
+static bool branchesToPhis(IrFunction* function)
+{
+    for (uint i = 0; i < function->blockCount; i++)
+    {
+        IrBlock* block = &function->blocks[i];
+        if (block->removed || block->terminator.type != IR_BRANCH) continue;
+
+        for (int j = 0; j < 2; j++)
+        {
+            IrBlock* target = irBlock(function, block->terminator.targets[j]);
+
+            for (uint16_t k = 0; k < target->phiCount; k++)
+            {
+                if (!irInstruction(function, target->phis[k])->removed) return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static void freeLowering(Lowering* lowering)
+{
+    IrFunction* function = lowering->function;
+
+    FREE_ARRAY(uint, lowering->uses, function->instructionCount);
+    FREE_ARRAY(uint, lowering->useStarts, function->instructionCount + 1);
+    FREE_ARRAY(IrBlockIndex, lowering->useBlocks, lowering->useCount);
+    FREE_ARRAY(bool, lowering->inlined, function->instructionCount);
+    FREE_ARRAY(int, lowering->slots, function->instructionCount);
+    FREE_ARRAY(IrValue, lowering->expected, function->instructionCount);
+    FREE_ARRAY(IrValue, lowering->computed, function->instructionCount);
+
+    FREE_ARRAY(uint, lowering->starts, function->blockCount);
+    FREE_ARRAY(bool, lowering->emitted, function->blockCount);
+
+    for (uint i = 0; i < function->blockCount; i++)
+    {
+        FREE_ARRAY(IrValue, lowering->liveIn[i].values, lowering->liveIn[i].capacity);
+        FREE_ARRAY(IrValue, lowering->liveOut[i].values, lowering->liveOut[i].capacity);
+    }
+
+    FREE_ARRAY(ValueList, lowering->liveIn, function->blockCount);
+    FREE_ARRAY(ValueList, lowering->liveOut, function->blockCount);
+
+    FREE_ARRAY(uint, lowering->pendingOffsets, lowering->pendingCapacity);
+    FREE_ARRAY(IrBlockIndex, lowering->pendingTargets, lowering->pendingCapacity);
+}
+
+bool lowerIr(IrFunction* function, bool isInitializer, uint16_t line)
+{
+    if (branchesToPhis(function)) return false;
+
+    Lowering lowering;
+    lowering.function = function;
+    lowering.isInitializer = isInitializer;
+
+    uint count = function->instructionCount;
+
+    lowering.uses = ALLOCATE(uint, count);
+    lowering.inlined = ALLOCATE(bool, count);
+    lowering.slots = ALLOCATE(int, count);
+    lowering.expected = ALLOCATE(IrValue, count);
+    lowering.computed = ALLOCATE(IrValue, count);
+    lowering.computedCount = 0;
+
+    lowering.starts = ALLOCATE(uint, function->blockCount);
+    lowering.emitted = ALLOCATE(bool, function->blockCount);
+    lowering.liveIn = ALLOCATE(ValueList, function->blockCount);
+    lowering.liveOut = ALLOCATE(ValueList, function->blockCount);
+
+    lowering.pendingOffsets = NULL;
+    lowering.pendingTargets = NULL;
+    lowering.pendingCount = 0;
+    lowering.pendingCapacity = 0;
+
+    memset(lowering.uses, 0, sizeof(uint) * count);
+    memset(lowering.inlined, 0, sizeof(bool) * count);
+    memset(lowering.emitted, 0, sizeof(bool) * function->blockCount);
+    memset(lowering.liveIn, 0, sizeof(ValueList) * function->blockCount);
+    memset(lowering.liveOut, 0, sizeof(ValueList) * function->blockCount);
+
+    countUses(&lowering);
+
+    for (uint i = 0; i < function->layoutCount; i++)
+    {
+        IrBlock* block = irBlock(function, function->layout[i]);
+        if (!block->removed) stackifyBlock(&lowering, block);
+    }
+
+    if (!assignSlots(&lowering))
+    {
+        freeLowering(&lowering);
+        return false;
+    }
+
+    // Slots of the values, after the arguments
+    for (int i = function->paramCount; i < lowering.slotCount; i++) emitByte(OP_NULL, line);
+
+    for (uint i = 0; i < function->layoutCount; i++)
+    {
+        IrBlockIndex index = function->layout[i];
+        if (!irBlock(function, index)->removed) emitBlock(&lowering, index, nextBlock(function, i));
+    }
+
+    freeLowering(&lowering);
+    return true;
+}
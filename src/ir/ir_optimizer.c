@@ -0,0 +1,788 @@
+#include <string.h>
+
+#include "ir_optimizer.h"
+#include "memory.h"
+#include "constant_folding.h"
+#include "profile.h"
+#include "type_inference.h"
+
+// Values which are replaced by others are forwarded to them, then every operand is rewritten at once
+typedef struct
+{
+    IrValue* to;
+    uint count;
+} Forwarding;
+
+// Types whose values only equal each other when they're the same, strings can be changed in place
+#define COMPARABLE_TYPES (INFERRED_NUMBER | INFERRED_BOOL | INFERRED_NULL)
+
+static bool isFalsey(Value value)
+{
+    return IS_NULL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+static uint8_t operandTypes(IrFunction* function, IrInstruction* instruction, int index)
+{
+    return irInstruction(function, instruction->operands[index])->types;
+}
+
+bool irProfilesOperands(IrFunction* function, IrInstruction* instruction)
+{
+    if (instruction->op != IR_BINARY) return false;
+    if (instruction->token == TOKEN_EQUAL_EQUAL || instruction->token == TOKEN_BANG_EQUAL) return false;
+
+    return operandTypes(function, instruction, 0) != INFERRED_NUMBER ||
+           operandTypes(function, instruction, 1) != INFERRED_NUMBER;
+}
+
+// region Forwarding
+
+static void initForwarding(Forwarding* forwarding, IrFunction* function)
+{
+    forwarding->count = function->instructionCount;
+    forwarding->to = ALLOCATE(IrValue, forwarding->count);
+
+    for (uint i = 0; i < forwarding->count; i++)
+    {
+        forwarding->to[i] = (IrValue)i;
+    }
+}
+
+static void freeForwarding(Forwarding* forwarding)
+{
+    FREE_ARRAY(IrValue, forwarding->to, forwarding->count);
+}
+
+static IrValue resolve(Forwarding* forwarding, IrValue value)
+{
+    if (value == IR_NO_VALUE || value >= forwarding->count) return value;
+
+    while (forwarding->to[value] != value)
+    {
+        value = forwarding->to[value];
+    }
+
+    return value;
+}
+
+static void forward(IrFunction* function, Forwarding* forwarding, IrValue from, IrValue to)
+{
+    forwarding->to[from] = to;
+    irInstruction(function, from)->removed = true;
+}
+
+static void applyForwarding(IrFunction* function, Forwarding* forwarding)
+{
+    for (uint i = 0; i < function->instructionCount; i++)
+    {
+        IrInstruction* instruction = &function->instructions[i];
+        if (instruction->removed) continue;
+
+        for (uint16_t j = 0; j < instruction->operandCount; j++)
+        {
+            instruction->operands[j] = resolve(forwarding, instruction->operands[j]);
+        }
+    }
+
+    for (uint i = 0; i < function->blockCount; i++)
+    {
+        IrTerminator* terminator = &function->blocks[i].terminator;
+        terminator->value = resolve(forwarding, terminator->value);
+    }
+}
+
+// endregion
+
+// region Control flow
+
+static void removeBlock(IrFunction* function, IrBlockIndex index)
+{
+    IrBlock* block = irBlock(function, index);
+    block->removed = true;
+
+    for (uint16_t i = 0; i < block->phiCount; i++)
+    {
+        irInstruction(function, block->phis[i])->removed = true;
+    }
+
+    for (uint16_t i = 0; i < block->instructionCount; i++)
+    {
+        irInstruction(function, block->instructions[i])->removed = true;
+    }
+
+    IrTerminator* terminator = &block->terminator;
+
+    if (terminator->type == IR_JUMP || terminator->type == IR_BRANCH)
+    {
+        irRemoveEdge(function, index, terminator->targets[0]);
+    }
+
+    if (terminator->type == IR_BRANCH)
+    {
+        irRemoveEdge(function, index, terminator->targets[1]);
+    }
+}
+
+// Also drops the operands the phis of the reachable blocks take from them
+static bool removeUnreachableBlocks(IrFunction* function)
+{
+    bool* reached = ALLOCATE(bool, function->blockCount);
+    IrBlockIndex* stack = ALLOCATE(IrBlockIndex, function->blockCount);
+    uint stackCount = 0;
+
+    memset(reached, 0, sizeof(bool) * function->blockCount);
+
+    reached[0] = true;
+    stack[stackCount++] = 0;
+
+    while (stackCount > 0)
+    {
+        IrBlock* block = irBlock(function, stack[--stackCount]);
+
+        for (int i = 0; i < irSuccessorCount(block); i++)
+        {
+            IrBlockIndex successor = block->terminator.targets[i];
+            if (reached[successor]) continue;
+
+            reached[successor] = true;
+            stack[stackCount++] = successor;
+        }
+    }
+
+    bool changed = false;
+
+    for (uint i = 0; i < function->blockCount; i++)
+    {
+        if (reached[i] || function->blocks[i].removed) continue;
+
+        removeBlock(function, (IrBlockIndex)i);
+        changed = true;
+    }
+
+    FREE_ARRAY(bool, reached, function->blockCount);
+    FREE_ARRAY(IrBlockIndex, stack, function->blockCount);
+
+    return changed;
+}
+
+static void replaceBranch(IrFunction* function, IrBlockIndex index, int taken)
+{
+    IrTerminator* terminator = &irBlock(function, index)->terminator;
+    IrBlockIndex target = terminator->targets[taken];
+
+    // Both edges may lead to the same block, then either of them goes
+    irRemoveEdge(function, index, terminator->targets[1 - taken]);
+
+    terminator->type = IR_JUMP;
+    terminator->value = IR_NO_VALUE;
+    terminator->targets[0] = target;
+    terminator->targets[1] = IR_NO_BLOCK;
+}
+
+// endregion
+
+// region Copy propagation
+
+// Copies are their operand, and so are phis whose operands are that value or the phi itself
+static bool propagateCopies(IrFunction* function)
+{
+    Forwarding forwarding;
+    initForwarding(&forwarding, function);
+
+    bool changed = false;
+
+    for (uint i = 0; i < function->instructionCount; i++)
+    {
+        IrInstruction* instruction = &function->instructions[i];
+        if (instruction->removed || instruction->op != IR_COPY) continue;
+
+        forward(function, &forwarding, (IrValue)i, instruction->operands[0]);
+        changed = true;
+    }
+
+    // Removing one phi may leave another with a single value
+    bool removedPhi = true;
+
+    while (removedPhi)
+    {
+        removedPhi = false;
+
+        for (uint i = 0; i < function->blockCount; i++)
+        {
+            IrBlock* block = &function->blocks[i];
+            if (block->removed) continue;
+
+            for (uint16_t j = 0; j < block->phiCount; j++)
+            {
+                IrValue phi = block->phis[j];
+                IrInstruction* instruction = irInstruction(function, phi);
+                if (instruction->removed) continue;
+
+                IrValue same = IR_NO_VALUE;
+                bool trivial = true;
+
+                for (uint16_t k = 0; k < instruction->operandCount; k++)
+                {
+                    IrValue operand = resolve(&forwarding, instruction->operands[k]);
+                    if (operand == phi || operand == same) continue;
+
+                    if (same != IR_NO_VALUE)
+                    {
+                        trivial = false;
+                        break;
+                    }
+
+                    same = operand;
+                }
+
+                if (!trivial || same == IR_NO_VALUE) continue;
+
+                forward(function, &forwarding, phi, same);
+                removedPhi = true;
+                changed = true;
+            }
+        }
+    }
+
+    applyForwarding(function, &forwarding);
+    freeForwarding(&forwarding);
+
+    return changed;
+}
+
+// endregion
+
+// region Constant propagation
+
+static void becomeConstant(IrInstruction* instruction, Value value)
+{
+    instruction->op = IR_CONSTANT;
+    instruction->operandCount = 0;
+    instruction->constant = value;
+    instruction->types = valueTypes(value);
+}
+
+static bool isConstant(IrFunction* function, IrValue value)
+{
+    return irInstruction(function, value)->op == IR_CONSTANT;
+}
+
+// Operators whose operands are known are folded, and so are branches on known conditions
+static bool propagateConstants(IrFunction* function)
+{
+    bool changed = false;
+
+    for (uint i = 0; i < function->instructionCount; i++)
+    {
+        IrInstruction* instruction = &function->instructions[i];
+        if (instruction->removed) continue;
+
+        Value result;
+
+        if (instruction->op == IR_BINARY && isConstant(function, instruction->operands[0]) &&
+            isConstant(function, instruction->operands[1]) &&
+            foldBinary(instruction->token, irInstruction(function, instruction->operands[0])->constant,
+                       irInstruction(function, instruction->operands[1])->constant, &result))
+        {
+            // Folding strings may allocate, the instructions move
+            becomeConstant(&function->instructions[i], result);
+            changed = true;
+        }
+        else if (instruction->op == IR_UNARY && isConstant(function, instruction->operands[0]) &&
+                 foldUnary(instruction->token, irInstruction(function, instruction->operands[0])->constant, &result))
+        {
+            becomeConstant(instruction, result);
+            changed = true;
+        }
+    }
+
+    for (uint i = 0; i < function->blockCount; i++)
+    {
+        IrBlock* block = &function->blocks[i];
+        IrTerminator* terminator = &block->terminator;
+
+        if (block->removed || terminator->type != IR_BRANCH) continue;
+
+        if (terminator->targets[0] == terminator->targets[1])
+        {
+            replaceBranch(function, (IrBlockIndex)i, 0);
+            changed = true;
+        }
+        else if (isConstant(function, terminator->value))
+        {
+            replaceBranch(function, (IrBlockIndex)i, isFalsey(irInstruction(function, terminator->value)->constant));
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+// endregion
+
+// region Types
+
+// Values of arithmetic are numbers, or strings for '+' with a string, the VM reports anything else
+static uint8_t binaryTypes(TokenType op, uint8_t left, uint8_t right)
+{
+    switch (op)
+    {
+        case TOKEN_EQUAL_EQUAL:
+        case TOKEN_BANG_EQUAL:
+        case TOKEN_GREATER:
+        case TOKEN_GREATER_EQUAL:
+        case TOKEN_LESS:
+        case TOKEN_LESS_EQUAL:
+            return INFERRED_BOOL;
+
+        case TOKEN_PLUS:
+        {
+            uint8_t types = 0;
+
+            if ((left & INFERRED_NUMBER) && (right & INFERRED_NUMBER)) types |= INFERRED_NUMBER;
+            if (left != 0 && right != 0 && ((left | right) & INFERRED_STRING)) types |= INFERRED_STRING;
+
+            return types;
+        }
+
+        case TOKEN_MINUS:
+        case TOKEN_MINUS_E:
+        case TOKEN_STAR:
+        case TOKEN_SLASH:
+        case TOKEN_PERCENT:
+        case TOKEN_TILDE_SLASH:
+        case TOKEN_AMPERSAND:
+        case TOKEN_PIPE:
+        case TOKEN_CARET:
+        case TOKEN_LESS_LESS:
+        case TOKEN_GREATER_GREATER:
+            return INFERRED_NUMBER;
+
+        default:
+            return INFERRED_ANY;
+    }
+}
+
+static uint8_t transferTypes(IrFunction* function, IrInstruction* instruction)
+{
+    switch (instruction->op)
+    {
+        case IR_PHI:
+        {
+            uint8_t types = 0;
+
+            for (uint16_t i = 0; i < instruction->operandCount; i++)
+            {
+                types |= operandTypes(function, instruction, i);
+            }
+
+            return types;
+        }
+
+        case IR_COPY:
+            return operandTypes(function, instruction, 0);
+
+        case IR_BINARY:
+            return binaryTypes(instruction->token, operandTypes(function, instruction, 0),
+                               operandTypes(function, instruction, 1));
+
+        case IR_UNARY:
+            return instruction->token == TOKEN_BANG ? INFERRED_BOOL : INFERRED_NUMBER;
+
+        default:
+            return instruction->types;
+    }
+}
+
+static bool isRefined(IrOp op)
+{
+    return op == IR_PHI || op == IR_COPY || op == IR_BINARY || op == IR_UNARY;
+}
+
+// Like type_inference.c, but a variable's type is the type of the value it has at that point. Starts with no types
+// for phis and operators and adds the ones which flow into them, the AST's types stay an upper bound.
+static void refineTypes(IrFunction* function)
+{
+    uint8_t* bounds = ALLOCATE(uint8_t, function->instructionCount);
+
+    for (uint i = 0; i < function->instructionCount; i++)
+    {
+        IrInstruction* instruction = &function->instructions[i];
+        bounds[i] = instruction->types;
+
+        if (instruction->op == IR_PHI || instruction->op == IR_COPY) bounds[i] = INFERRED_ANY;
+        if (!instruction->removed && isRefined(instruction->op)) instruction->types = 0;
+    }
+
+    bool changed = true;
+
+    while (changed)
+    {
+        changed = false;
+
+        for (uint i = 0; i < function->instructionCount; i++)
+        {
+            IrInstruction* instruction = &function->instructions[i];
+            if (instruction->removed || !isRefined(instruction->op)) continue;
+
+            uint8_t types = (transferTypes(function, instruction) | instruction->types) & bounds[i];
+
+            if (types != instruction->types)
+            {
+                instruction->types = types;
+                changed = true;
+            }
+        }
+    }
+
+    // Nothing flows into values of code which never finishes, like loops with no way in
+    for (uint i = 0; i < function->instructionCount; i++)
+    {
+        if (function->instructions[i].types == 0) function->instructions[i].types = INFERRED_ANY;
+    }
+
+    FREE_ARRAY(uint8_t, bounds, function->instructionCount);
+}
+
+// endregion
+
+// region Dominators
+
+typedef struct
+{
+    IrBlockIndex* order;   // Reachable blocks in reverse postorder
+    uint count;
+
+    uint* position;        // In 'order', by block
+    IrBlockIndex* idom;
+} Dominators;
+
+static void orderBlocks(IrFunction* function, Dominators* dominators)
+{
+    dominators->order = ALLOCATE(IrBlockIndex, function->blockCount);
+    dominators->position = ALLOCATE(uint, function->blockCount);
+    dominators->count = irReversePostorder(function, dominators->order);
+
+    for (uint i = 0; i < dominators->count; i++)
+    {
+        dominators->position[dominators->order[i]] = i;
+    }
+}
+
+static IrBlockIndex intersect(Dominators* dominators, IrBlockIndex a, IrBlockIndex b)
+{
+    while (a != b)
+    {
+        while (dominators->position[a] > dominators->position[b]) a = dominators->idom[a];
+        while (dominators->position[b] > dominators->position[a]) b = dominators->idom[b];
+    }
+
+    return a;
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+static void findDominators(IrFunction* function, Dominators* dominators)
+{
+    orderBlocks(function, dominators);
+
+    dominators->idom = ALLOCATE(IrBlockIndex, function->blockCount);
+
+    for (uint i = 0; i < function->blockCount; i++)
+    {
+        dominators->idom[i] = IR_NO_BLOCK;
+    }
+
+    dominators->idom[0] = 0;
+
+    bool changed = true;
+
+    while (changed)
+    {
+        changed = false;
+
+        for (uint i = 1; i < dominators->count; i++)
+        {
+            IrBlockIndex index = dominators->order[i];
+            IrBlock* block = irBlock(function, index);
+            IrBlockIndex idom = IR_NO_BLOCK;
+
+            for (uint16_t j = 0; j < block->predecessorCount; j++)
+            {
+                IrBlockIndex predecessor = block->predecessors[j];
+                if (dominators->idom[predecessor] == IR_NO_BLOCK) continue;
+
+                idom = idom == IR_NO_BLOCK ? predecessor : intersect(dominators, predecessor, idom);
+            }
+
+            if (idom != dominators->idom[index])
+            {
+                dominators->idom[index] = idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+static bool dominates(Dominators* dominators, IrBlockIndex a, IrBlockIndex b)
+{
+    for (;;)
+    {
+        if (a == b) return true;
+        if (b == 0) return false;
+
+        b = dominators->idom[b];
+    }
+}
+
+static void freeDominators(IrFunction* function, Dominators* dominators)
+{
+    FREE_ARRAY(IrBlockIndex, dominators->order, function->blockCount);
+    FREE_ARRAY(uint, dominators->position, function->blockCount);
+    FREE_ARRAY(IrBlockIndex, dominators->idom, function->blockCount);
+}
+
+// endregion
+
+// region Value numbering
+
+static bool isNumbered(IrFunction* function, IrInstruction* instruction)
+{
+    if (instruction->op == IR_CONSTANT) return true;
+    if (instruction->op != IR_BINARY && instruction->op != IR_UNARY) return false;
+
+    // Each site records its own feedback
+    if (profiling && irProfilesOperands(function, instruction)) return false;
+
+    for (uint16_t i = 0; i < instruction->operandCount; i++)
+    {
+        if (operandTypes(function, instruction, i) & ~COMPARABLE_TYPES) return false;
+    }
+
+    return true;
+}
+
+static uint32_t hashInstruction(IrInstruction* instruction)
+{
+    if (instruction->op == IR_CONSTANT) return hashValueBits(instruction->constant);
+
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ instruction->op) * 16777619;
+    hash = (hash ^ instruction->token) * 16777619;
+
+    for (uint16_t i = 0; i < instruction->operandCount; i++)
+    {
+        hash = (hash ^ instruction->operands[i]) * 16777619;
+    }
+
+    return hash;
+}
+
+static bool sameInstruction(IrInstruction* a, IrInstruction* b)
+{
+    if (a->op != b->op) return false;
+    if (a->op == IR_CONSTANT) return valuesIdentical(a->constant, b->constant);
+
+    if (a->token != b->token || a->operandCount != b->operandCount) return false;
+
+    return memcmp(a->operands, b->operands, sizeof(IrValue) * a->operandCount) == 0;
+}
+
+// An operator computed again with the same operands is the value the first one computed, if that one always runs
+// first. Only operators on numbers, booleans and null are numbered, they don't create anything. Constants are loaded
+// where they're used, any of them can stand for the others.
+static void numberValues(IrFunction* function)
+{
+    Dominators dominators;
+    findDominators(function, &dominators);
+
+    Forwarding forwarding;
+    initForwarding(&forwarding, function);
+
+    uint capacity = 16;
+    while (capacity < function->instructionCount * 2) capacity *= 2;
+
+    IrValue* table = ALLOCATE(IrValue, capacity);
+
+    for (uint i = 0; i < capacity; i++)
+    {
+        table[i] = IR_NO_VALUE;
+    }
+
+    for (uint i = 0; i < dominators.count; i++)
+    {
+        IrBlock* block = irBlock(function, dominators.order[i]);
+
+        for (uint16_t j = 0; j < block->instructionCount; j++)
+        {
+            IrValue value = block->instructions[j];
+            IrInstruction* instruction = irInstruction(function, value);
+
+            if (instruction->removed) continue;
+
+            for (uint16_t k = 0; k < instruction->operandCount; k++)
+            {
+                instruction->operands[k] = resolve(&forwarding, instruction->operands[k]);
+            }
+
+            if (!isNumbered(function, instruction)) continue;
+
+            uint index = hashInstruction(instruction) & (capacity - 1);
+            bool found = false;
+
+            for (; table[index] != IR_NO_VALUE; index = (index + 1) & (capacity - 1))
+            {
+                IrInstruction* numbered = irInstruction(function, table[index]);
+                if (!sameInstruction(numbered, instruction)) continue;
+
+                if (instruction->op == IR_CONSTANT || dominates(&dominators, numbered->block, instruction->block))
+                {
+                    forward(function, &forwarding, value, table[index]);
+                    found = true;
+                    break;
+                }
+            }
+
+            if (!found) table[index] = value;
+        }
+    }
+
+    applyForwarding(function, &forwarding);
+
+    FREE_ARRAY(IrValue, table, capacity);
+    freeForwarding(&forwarding);
+    freeDominators(function, &dominators);
+}
+
+// endregion
+
+// region Dead code
+
+static bool hasEffects(IrFunction* function, IrInstruction* instruction)
+{
+    switch (instruction->op)
+    {
+        case IR_CONSTANT:
+        case IR_PARAMETER:
+        case IR_PHI:
+        case IR_COPY:
+        case IR_BUILD_LIST:
+            return false;
+
+        case IR_BINARY:
+            if (profiling && irProfilesOperands(function, instruction)) return true;
+            if (instruction->token == TOKEN_EQUAL_EQUAL || instruction->token == TOKEN_BANG_EQUAL) return false;
+
+            return operandTypes(function, instruction, 0) != INFERRED_NUMBER ||
+                   operandTypes(function, instruction, 1) != INFERRED_NUMBER;
+
+        case IR_UNARY:
+            return instruction->token != TOKEN_BANG && operandTypes(function, instruction, 0) != INFERRED_NUMBER;
+
+        // Calls, errors the VM reports, and lookups of names which might not be defined
+        default:
+            return true;
+    }
+}
+
+// Keeps what has effects, what decides where the code goes and what's returned, and what those use
+static void eliminateDeadCode(IrFunction* function)
+{
+    bool* live = ALLOCATE(bool, function->instructionCount);
+    IrValue* worklist = ALLOCATE(IrValue, function->instructionCount);
+    uint worklistCount = 0;
+
+    memset(live, 0, sizeof(bool) * function->instructionCount);
+
+    for (uint i = 0; i < function->instructionCount; i++)
+    {
+        IrInstruction* instruction = &function->instructions[i];
+        if (instruction->removed || !hasEffects(function, instruction)) continue;
+
+        live[i] = true;
+        worklist[worklistCount++] = (IrValue)i;
+    }
+
+    for (uint i = 0; i < function->blockCount; i++)
+    {
+        IrValue value = function->blocks[i].terminator.value;
+        if (function->blocks[i].removed || value == IR_NO_VALUE || live[value]) continue;
+
+        live[value] = true;
+        worklist[worklistCount++] = value;
+    }
+
+    while (worklistCount > 0)
+    {
+        IrInstruction* instruction = irInstruction(function, worklist[--worklistCount]);
+
+        for (uint16_t i = 0; i < instruction->operandCount; i++)
+        {
+            IrValue operand = instruction->operands[i];
+            if (live[operand]) continue;
+
+            live[operand] = true;
+            worklist[worklistCount++] = operand;
+        }
+    }
+
+    for (uint i = 0; i < function->instructionCount; i++)
+    {
+        if (!live[i]) function->instructions[i].removed = true;
+    }
+
+    FREE_ARRAY(bool, live, function->instructionCount);
+    FREE_ARRAY(IrValue, worklist, function->instructionCount);
+}
+
+// endregion
+
+static bool hasPhis(IrFunction* function, IrBlock* block)
+{
+    for (uint16_t i = 0; i < block->phiCount; i++)
+    {
+        if (!irInstruction(function, block->phis[i])->removed) return true;
+    }
+
+    return false;
+}
+
+// Phi operands are copied at the end of the predecessor, which a block branching elsewhere too can't do
+static bool splitCriticalEdges(IrFunction* function)
+{
+    uint blockCount = function->blockCount;
+
+    for (uint i = 0; i < blockCount; i++)
+    {
+        if (function->blocks[i].removed || function->blocks[i].terminator.type != IR_BRANCH) continue;
+
+        for (int target = 0; target < 2; target++)
+        {
+            IrBlock* successor = irBlock(function, function->blocks[i].terminator.targets[target]);
+            if (successor->predecessorCount < 2 || !hasPhis(function, successor)) continue;
+
+            if (irSplitEdge(function, (IrBlockIndex)i, target) == IR_NO_BLOCK) return false;
+        }
+    }
+
+    return true;
+}
+
+bool optimizeIr(IrFunction* function)
+{
+    removeUnreachableBlocks(function);
+
+    bool changed = true;
+
+    while (changed)
+    {
+        changed = propagateCopies(function);
+        changed |= propagateConstants(function);
+        changed |= removeUnreachableBlocks(function);
+    }
+
+    refineTypes(function);
+    numberValues(function);
+    eliminateDeadCode(function);
+
+    return splitCriticalEdges(function);
+}
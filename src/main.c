@@ -3,6 +3,18 @@
 #include <string.h>
 
 #include "vm.h"
+#include "parser.h"
+#include "emitter.h"
+#include "c_emitter.h"
+#include "inliner.h"
+#include "profile.h"
+#include "tree_shaking.h"
+#include "ir.h"
+#include "phase_timer.h"
+
+// Set by '--profile-out' and '--profile-in'
+static const char* profileOut = NULL;
+static const char* profileIn = NULL;
 
 static char* readFile(const char* path)
 {
@@ -46,7 +58,16 @@ static void runFile(const char* path)
     return;
     #endif
 
+    if (profileIn != NULL) readProfile(profileIn, source);
+
     int result = interpret(source);
+    if (timePhases) printPhases();
+
+    if (profileOut != NULL && !writeProfile(profileOut, source))
+    {
+        fprintf(stderr, "Could not write profile \"%s\".\n", profileOut);
+    }
+
     free(source);
 
     if(result == 0) freeVM();
@@ -54,10 +75,50 @@ static void runFile(const char* path)
     exit(result);
 }
 
+static void emitCFile(const char* path)
+{
+    char* source = readFile(path);
+
+    Node* statements = compile(source);
+    if (statements == NULL) exit(INTERPRET_COMPILE_ERROR);
+
+    // Generated C can't compile anything at runtime, nor record a profile
+    lazyCompilation = false;
+    profiling = false;
+
+    ObjFunction* function = emit(statements);
+    if (function == NULL) exit(INTERPRET_COMPILE_ERROR);
+
+    bool success = emitC(function, path, stdout);
+    free(source);
+
+    exit(success ? INTERPRET_OK : INTERPRET_COMPILE_ERROR);
+}
+
+static void dumpIrFile(const char* path)
+{
+    char* source = readFile(path);
+
+    Node* statements = compile(source);
+    if (statements == NULL) exit(INTERPRET_COMPILE_ERROR);
+
+    // Every function is printed as it's compiled, the script doesn't run
+    lazyCompilation = false;
+    irDumpEnabled = true;
+
+    ObjFunction* function = emit(statements);
+    free(source);
+
+    exit(function != NULL ? INTERPRET_OK : INTERPRET_COMPILE_ERROR);
+}
+
 static void repl()
 {
     char line[1024];
 
+    // Every line is compiled on its own
+    treeShakingEnabled = false;
+
     for (;;)
     {
         printf("> ");
@@ -76,8 +137,59 @@ static void repl()
     freeVM();
 }
 
+// Options which can be combined with any of the modes below are removed from argv
+static int parseOptions(int argc, const char* argv[])
+{
+    int remaining = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--no-inline") == 0)
+        {
+            inliningEnabled = false;
+        }
+        else if (strcmp(argv[i], "--no-ir") == 0)
+        {
+            irEnabled = false;
+        }
+        else if (strcmp(argv[i], "--no-tree-shaking") == 0)
+        {
+            treeShakingEnabled = false;
+        }
+        else if (strcmp(argv[i], "--time-phases") == 0)
+        {
+            timePhases = true;
+        }
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+        {
+            int threads = atoi(argv[++i]);
+            compileThreads = threads > 0 ? threads : 1;
+        }
+        else if (strcmp(argv[i], "--profile-out") == 0 && i + 1 < argc)
+        {
+            profileOut = argv[++i];
+            profiling = true;
+        }
+        else if (strcmp(argv[i], "--profile-in") == 0 && i + 1 < argc)
+        {
+            profileIn = argv[++i];
+        }
+        else
+        {
+            argv[remaining++] = argv[i];
+        }
+    }
+
+    return remaining;
+}
+
 int runWally(int argc, const char* argv[])
 {
+    argc = parseOptions(argc, argv);
+
+    // After the options, so '--time-phases' covers initializing too
+    initVM();
+
     switch(argc)
     {
         case 1:
@@ -97,6 +209,18 @@ int runWally(int argc, const char* argv[])
                 printf("Commandline arguments:\n");
                 printf("    --help                - Display this message\n");
                 printf("    --interpret \"code\"    - Run \"code\" string\n");
+                printf("    --emit-c [path]       - Translate Wally script to C and print it\n");
+                printf("    --dump-ir [path]      - Print the optimized IR of every function of Wally script\n");
+                printf("    --trace [path]        - Run Wally script, printing each executed instruction and the stack\n");
+                printf("    --trace [fn] [path]   - Same as above, but only inside function fn (\"script\" for top-level code)\n");
+                printf("    --no-inline           - Don't inline calls to small functions, can be combined with the above\n");
+                printf("    --no-tree-shaking     - Keep functions, classes and methods nothing uses, can be combined too\n");
+                printf("    --no-ir               - Compile functions straight from the syntax tree, can be combined too\n");
+                printf("    --jobs [n]            - Compile top-level functions and methods on n threads before running\n");
+                printf("    --time-phases         - Print time, allocations and bytes spent initializing, scanning, parsing,\n");
+                printf("                            emitting and running a script\n");
+                printf("    --profile-out [file]  - Record types and branches seen while running a script into file\n");
+                printf("    --profile-in [file]   - Compile a script using a profile recorded for it\n");
                 printf("    [path to file]        - Run Wally script\n");
                 printf("    [none]                - Run interactive repl\n");
             }
@@ -112,11 +236,41 @@ int runWally(int argc, const char* argv[])
             if(strcmp(argv[1], "--interpret") == 0)
             {
                 int result = interpret(argv[2]);
+                if (timePhases) printPhases();
 
                 if(result == 0) freeVM();
 
                 exit(result);
             }
+            else if(strcmp(argv[1], "--emit-c") == 0)
+            {
+                emitCFile(argv[2]);
+            }
+            else if(strcmp(argv[1], "--dump-ir") == 0)
+            {
+                dumpIrFile(argv[2]);
+            }
+            else if(strcmp(argv[1], "--trace") == 0)
+            {
+                vm.trace = true;
+                runFile(argv[2]);
+            }
+            else
+            {
+                fprintf(stderr, "Usage: Wally [path to file]\n");
+                exit(64);
+            }
+            break;
+        }
+
+        case 4:
+        {
+            if(strcmp(argv[1], "--trace") == 0)
+            {
+                vm.trace = true;
+                vm.traceFunction = argv[2];
+                runFile(argv[3]);
+            }
             else
             {
                 fprintf(stderr, "Usage: Wally [path to file]\n");
@@ -138,7 +292,6 @@ int runWally(int argc, const char* argv[])
 #ifndef LIBRARY
 int main(int argc, const char* argv[])
 {
-    initVM();
     return runWally(argc, argv);
 }
 #endif
@@ -9,6 +9,7 @@
 #include "memory.h"
 #include "colors.h"
 #include "emitter.h"
+#include "profile.h"
 #include "value.h"
 
 // This is a Mark-Sweep garbage collector.
@@ -85,11 +86,25 @@ static void markRoots()
         markEnvironment(vm.currentEnvironment);
     }
 
+    // Callers' environments aren't reachable from the one currently executing
+    for (int i = 0; i < vm.frameCount; i++)
+    {
+        markObject((Obj*)vm.frames[i].function);
+
+        if(vm.frames[i].returnEnvironment != NULL)
+        {
+            markEnvironment(vm.frames[i].returnEnvironment);
+        }
+    }
+
     markObject((Obj*)vm.currentFunction);
+    markObject((Obj*)vm.currentCoroutine);
     markObject((Obj*)vm.initString);
     markObject((Obj*)vm.thisString);
 
     markEnvironment(vm.nativeEnvironment);
+    markTable(vm.sourceStrings);
+    markProfile();
 
     markCompilerRoots();
 }
@@ -131,17 +146,53 @@ static void blackenObject(Obj* object)
             break;
         }
 
+        case OBJ_LIST:
+        {
+            ObjWList* list = (ObjWList*)object;
+
+            for (uint i = 0; i < list->count; i++)
+            {
+                markValue(list->items[i]);
+            }
+            break;
+        }
+
         case OBJ_FUNCTION:
         {
             ObjFunction* function = (ObjFunction*)object;
             markObject((Obj*)function->name);
             markArray(&function->chunk.constants);
+            break;
+        }
+
+        case OBJ_COROUTINE:
+        {
+            ObjCoroutine* coroutine = (ObjCoroutine*)object;
+            markObject((Obj*)coroutine->function);
+
+            // Either the suspended coroutine's registers or the ones of whoever resumed it
+            for (Value* slot = coroutine->savedStack; slot < coroutine->savedStackTop; slot++)
+            {
+                markValue(*slot);
+            }
+
+            for (int i = 0; i < coroutine->savedFrameCount; i++)
+            {
+                markObject((Obj*)coroutine->savedFrames[i].function);
+
+                if(coroutine->savedFrames[i].returnEnvironment != NULL)
+                {
+                    markEnvironment(coroutine->savedFrames[i].returnEnvironment);
+                }
+            }
 
-            if(function->calledFromFunction != NULL)
+            if(coroutine->savedEnvironment != NULL)
             {
-                markObject((Obj*)function->calledFromFunction);
+                markEnvironment(coroutine->savedEnvironment);
             }
 
+            markObject((Obj*)coroutine->savedFunction);
+            markObject((Obj*)coroutine->resumer);
             break;
         }
     }
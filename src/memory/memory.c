@@ -6,11 +6,15 @@
 #include "vm.h"
 #include "emitter.h"
 #include "garbage_collector.h"
+#include "phase_timer.h"
 
 #ifdef DEBUG_LOG_ALLOCATION
 #include "allocation_logger.h"
 #endif
 
+// Set on threads compiling in parallel, see useArena
+static _Thread_local AllocationArena* arena = NULL;
+
 // oldSize      newSize                 Operation
 // 0 	        Non‑zero 	            Allocate new block.
 // Non‑zero 	0 	                    Free allocation.
@@ -18,19 +22,41 @@
 // Non‑zero 	Larger than oldSize 	Grow existing allocation.
 void* reallocate(void* pointer, size_t oldSize, size_t newSize)
 {
-    vm.bytesAllocated += newSize - oldSize;
-
-    #ifdef DEBUG_STRESS_GC
-    if (newSize > oldSize)
+    if (arena != NULL)
     {
-        collectGarbage();
+        // The collector can't see the objects of other threads, it runs once they're merged
+        arena->bytesAllocated += newSize - oldSize;
+
+        // Only '--time-phases' reads the totals
+        if (timePhases && newSize > oldSize)
+        {
+            arena->totalAllocations += oldSize == 0;
+            arena->totalBytesAllocated += newSize - oldSize;
+        }
     }
-    #else
-    if (vm.bytesAllocated > vm.nextGC)
+    else
     {
-        collectGarbage();
+        vm.bytesAllocated += newSize - oldSize;
+
+        if (timePhases && newSize > oldSize)
+        {
+            vm.totalAllocations += oldSize == 0;
+            vm.totalBytesAllocated += newSize - oldSize;
+        }
+
+        #ifdef DEBUG_STRESS_GC
+        if (newSize > oldSize)
+        {
+            collectGarbage();
+        }
+        #else
+        // Never while freeing, callers free structures which are still reachable from the roots
+        if (newSize > oldSize && vm.bytesAllocated > vm.nextGC)
+        {
+            collectGarbage();
+        }
+        #endif
     }
-    #endif
 
 
     if (newSize == 0)
@@ -59,6 +85,53 @@ void* reallocate(void* pointer, size_t oldSize, size_t newSize)
 }
 
 
+void linkObject(Obj* object)
+{
+    Obj** objects = arena != NULL ? &arena->objects : &vm.objects;
+
+    object->next = *objects;
+    *objects = object;
+}
+
+void initArena(AllocationArena* initialized)
+{
+    initialized->objects = NULL;
+    initialized->bytesAllocated = 0;
+    initialized->totalAllocations = 0;
+    initialized->totalBytesAllocated = 0;
+}
+
+void useArena(AllocationArena* newArena)
+{
+    arena = newArena;
+}
+
+bool usingArena()
+{
+    return arena != NULL;
+}
+
+// Called after the thread which used it is done, the objects are put in front of the VM's
+void mergeArena(AllocationArena* merged)
+{
+    vm.bytesAllocated += merged->bytesAllocated;
+    vm.totalAllocations += merged->totalAllocations;
+    vm.totalBytesAllocated += merged->totalBytesAllocated;
+
+    merged->bytesAllocated = 0;
+    merged->totalAllocations = 0;
+    merged->totalBytesAllocated = 0;
+
+    if (merged->objects == NULL) return;
+
+    Obj* last = merged->objects;
+    while (last->next != NULL) last = last->next;
+
+    last->next = vm.objects;
+    vm.objects = merged->objects;
+    merged->objects = NULL;
+}
+
 void freeObject(Obj* object)
 {
     #ifdef DEBUG_LOG_GC
@@ -113,6 +186,37 @@ void freeObject(Obj* object)
         case OBJ_NATIVE:
             FREE(ObjNative, object);
             break;
+
+        case OBJ_COROUTINE:
+        {
+            ObjCoroutine* coroutine = (ObjCoroutine*)object;
+
+            // Running coroutines are always reachable, so the saved registers are the coroutine's own
+            if(coroutine->state == COROUTINE_SUSPENDED)
+            {
+                Environment* env = coroutine->savedEnvironment;
+
+                for(int i = coroutine->savedFrameCount - 1; i >= 0; i--)
+                {
+                    CallFrame* frame = &coroutine->frames[i];
+
+                    while(env != frame->environment)
+                    {
+                        Environment* old = env;
+                        env = env->enclosing;
+                        freeEnvironment(old);
+                    }
+
+                    freeEnvironment(frame->environment);
+                    env = frame->returnEnvironment;
+                }
+            }
+
+            FREE_ARRAY(Value, coroutine->stack, COROUTINE_STACK_MAX);
+            FREE_ARRAY(CallFrame, coroutine->frames, COROUTINE_FRAMES_MAX);
+            FREE(ObjCoroutine, object);
+            break;
+        }
     }
 }
 
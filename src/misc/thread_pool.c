@@ -0,0 +1,59 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "thread_pool.h"
+
+typedef struct
+{
+    ParallelWork work;
+    void* items;
+    uint count;
+
+    atomic_uint next;
+} Pool;
+
+// Takes the next index until none are left
+static void* runWorker(void* argument)
+{
+    Pool* pool = (Pool*)argument;
+
+    for (uint index = atomic_fetch_add(&pool->next, 1); index < pool->count;
+         index = atomic_fetch_add(&pool->next, 1))
+    {
+        pool->work(pool->items, index);
+    }
+
+    return NULL;
+}
+
+void runInParallel(ParallelWork work, void* items, uint count, uint threads)
+{
+    if (count == 0) return;
+
+    Pool pool;
+    pool.work = work;
+    pool.items = items;
+    pool.count = count;
+    atomic_init(&pool.next, 0);
+
+    // The caller is one of the threads
+    uint helperCount = (threads > count ? count : threads) - 1;
+    pthread_t* helpers = helperCount > 0 ? malloc(sizeof(pthread_t) * helperCount) : NULL;
+    uint started = 0;
+
+    while (helpers != NULL && started < helperCount &&
+           pthread_create(&helpers[started], NULL, runWorker, &pool) == 0)
+    {
+        started++;
+    }
+
+    runWorker(&pool);
+
+    for (uint i = 0; i < started; i++)
+    {
+        pthread_join(helpers[i], NULL);
+    }
+
+    free(helpers);
+}
@@ -0,0 +1,664 @@
+#include <stdio.h>
+
+#include "constant_folding.h"
+#include "memory.h"
+#include "object.h"
+#include "table.h"
+
+// Names are looked up the same way the VM does it, innermost scope first.
+// Every name declared in a block is known from the start of the block, so a constant is never inlined
+// into code which could see another variable of the same name at runtime (e.g. a function declared before it).
+
+typedef struct
+{
+    ObjString* name;
+
+    bool isConst;
+    Value value;
+} Symbol;
+
+typedef struct Scope
+{
+    uint count;
+    uint capacity;
+    Symbol* symbols;
+
+    // Name to its symbol's index, created by the first declaration
+    Table* indices;
+
+    struct Scope* enclosing;
+} Scope;
+
+static Scope* scope = NULL;
+static bool hadError = false;
+
+static Stmt* foldStatement(Stmt* statement);
+
+// region Error
+
+static void error(const char* message, const char* name, uint16_t line)
+{
+    fprintf(stderr, "[line %d] Emitter Error : ", line);
+    fprintf(stderr, message, name);
+    fputs("\n", stderr);
+    hadError = true;
+}
+
+// endregion
+
+// region Scopes
+
+static void beginScope(Scope* newScope)
+{
+    newScope->count = 0;
+    newScope->capacity = 0;
+    newScope->symbols = NULL;
+    newScope->indices = NULL;
+
+    newScope->enclosing = scope;
+    scope = newScope;
+}
+
+static void endScope()
+{
+    FREE_ARRAY(Symbol, scope->symbols, scope->capacity);
+    if (scope->indices != NULL) freeTable(scope->indices);
+
+    scope = scope->enclosing;
+}
+
+static Symbol* findSymbol(Scope* in, ObjString* name)
+{
+    Value index;
+    if (in->indices == NULL || !tableGet(in->indices, name, &index)) return NULL;
+
+    return &in->symbols[(uint)AS_NUMBER(index)];
+}
+
+static void declare(ObjString* name, bool isConst, Value value)
+{
+    Symbol* symbol = findSymbol(scope, name);
+
+    if (symbol == NULL)
+    {
+        if (scope->capacity < scope->count + 1)
+        {
+            uint oldCapacity = scope->capacity;
+            scope->capacity = GROW_CAPACITY(oldCapacity);
+            scope->symbols = GROW_ARRAY(Symbol, scope->symbols, oldCapacity, scope->capacity);
+        }
+
+        if (scope->indices == NULL)
+        {
+            scope->indices = ALLOCATE_TABLE();
+            initTable(scope->indices);
+        }
+
+        tableSet(scope->indices, name, NUMBER_VAL(scope->count));
+
+        symbol = &scope->symbols[scope->count++];
+        symbol->name = name;
+    }
+
+    symbol->isConst = isConst;
+    symbol->value = value;
+}
+
+static Symbol* lookup(ObjString* name)
+{
+    for (Scope* current = scope; current != NULL; current = current->enclosing)
+    {
+        Symbol* symbol = findSymbol(current, name);
+        if (symbol != NULL) return symbol;
+    }
+
+    return NULL;
+}
+
+// Constants are known only once their declaration is reached
+static void declareAll(Node* statements)
+{
+    for (Node* node = statements; node != NULL; node = node->next)
+    {
+        Stmt* statement = AS_STATEMENT(node);
+        if (statement == NULL) continue;
+
+        switch (statement->type)
+        {
+            case VARIABLE_STATEMENT:
+                declare(((VariableStmt*)statement)->name, false, NULL_VAL);
+                break;
+
+            case FUNCTION_STATEMENT:
+                declare(((FunctionStmt*)statement)->name, false, NULL_VAL);
+                break;
+
+            case CLASS_STATEMENT:
+                declare(((ClassStmt*)statement)->name, false, NULL_VAL);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+// endregion
+
+// region Expressions
+
+static bool isFalsey(Value value)
+{
+    return IS_NULL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+static bool isLiteral(Expr* expr)
+{
+    return expr != NULL && expr->type == LITERAL_EXPRESSION;
+}
+
+static Value literalValue(Expr* expr)
+{
+    return ((LiteralExpr*)expr)->value;
+}
+
+// Only folds what can't fail, everything else is left for the VM to report
+bool foldBinary(TokenType op, Value a, Value b, Value* result)
+{
+    switch (op)
+    {
+        case TOKEN_EQUAL_EQUAL: *result = BOOL_VAL(valuesEqual(a, b));  return true;
+        case TOKEN_BANG_EQUAL:  *result = BOOL_VAL(!valuesEqual(a, b)); return true;
+
+        case TOKEN_PLUS:
+        {
+            if (IS_STRING(a) || IS_STRING(b))
+            {
+                *result = OBJ_VAL(keepString(addStrings(valueToString(a), valueToString(b))));
+                return true;
+            }
+
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    if (!IS_NUMBER(a) || !IS_NUMBER(b)) return false;
+
+    double x = AS_NUMBER(a);
+    double y = AS_NUMBER(b);
+
+    switch (op)
+    {
+        case TOKEN_PLUS:          *result = NUMBER_VAL(x + y); return true;
+        case TOKEN_MINUS:
+        case TOKEN_MINUS_E:       *result = NUMBER_VAL(x - y); return true;
+        case TOKEN_STAR:          *result = NUMBER_VAL(x * y); return true;
+        case TOKEN_SLASH:         *result = NUMBER_VAL(x / y); return true;
+        case TOKEN_PERCENT:       *result = NUMBER_VAL(numberModulo(x, y));     return true;
+        case TOKEN_TILDE_SLASH:   *result = NUMBER_VAL(numberIntDivide(x, y));  return true;
+        case TOKEN_AMPERSAND:     *result = NUMBER_VAL(numberBitAnd(x, y));     return true;
+        case TOKEN_PIPE:          *result = NUMBER_VAL(numberBitOr(x, y));      return true;
+        case TOKEN_CARET:         *result = NUMBER_VAL(numberBitXor(x, y));     return true;
+        case TOKEN_LESS_LESS:     *result = NUMBER_VAL(numberShiftLeft(x, y));  return true;
+        case TOKEN_GREATER_GREATER: *result = NUMBER_VAL(numberShiftRight(x, y)); return true;
+        case TOKEN_GREATER:       *result = BOOL_VAL(x > y);   return true;
+        case TOKEN_GREATER_EQUAL: *result = BOOL_VAL(x >= y);  return true;
+        case TOKEN_LESS:          *result = BOOL_VAL(x < y);   return true;
+        case TOKEN_LESS_EQUAL:    *result = BOOL_VAL(x <= y);  return true;
+
+        default:
+            return false;
+    }
+}
+
+bool foldUnary(TokenType op, Value value, Value* result)
+{
+    if (op == TOKEN_BANG)
+    {
+        *result = BOOL_VAL(isFalsey(value));
+        return true;
+    }
+
+    if (op == TOKEN_MINUS && IS_NUMBER(value))
+    {
+        *result = NUMBER_VAL(-AS_NUMBER(value));
+        return true;
+    }
+
+    if (op == TOKEN_TILDE && IS_NUMBER(value))
+    {
+        *result = NUMBER_VAL(numberBitNot(AS_NUMBER(value)));
+        return true;
+    }
+
+    return false;
+}
+
+static Expr* foldExpression(Expr* expression);
+
+static void foldExpressions(Node* expressions)
+{
+    for (Node* node = expressions; node != NULL; node = node->next)
+    {
+        AS_EXPRESSION(node) = foldExpression(AS_EXPRESSION(node));
+    }
+}
+
+// An expression can only be replaced with one which leaves its result on the stack the same way
+static Expr* replaceWith(Expr* expression, Expr* replacement)
+{
+    return replacement->pop == expression->pop ? replacement : expression;
+}
+
+static Expr* foldExpression(Expr* expression)
+{
+    if (expression == NULL) return NULL;
+
+    uint16_t line = expression->line;
+
+    switch (expression->type)
+    {
+        case LITERAL_EXPRESSION:
+        case BASE_EXPRESSION:
+            break;
+
+        case BINARY_EXPRESSION:
+        {
+            BinaryExpr* expr = (BinaryExpr*)expression;
+
+            expr->left = foldExpression(expr->left);
+            expr->right = foldExpression(expr->right);
+
+            Value result;
+            if (isLiteral(expr->left) && isLiteral(expr->right) &&
+                foldBinary(expr->op, literalValue(expr->left), literalValue(expr->right), &result))
+            {
+                return (Expr*)newLiteralExpr(result, line);
+            }
+
+            break;
+        }
+
+        case UNARY_EXPRESSION:
+        {
+            UnaryExpr* expr = (UnaryExpr*)expression;
+
+            expr->target = foldExpression(expr->target);
+            if (!isLiteral(expr->target)) break;
+
+            Value result;
+            if (foldUnary(expr->op, literalValue(expr->target), &result))
+            {
+                return (Expr*)newLiteralExpr(result, line);
+            }
+
+            break;
+        }
+
+        case LOGICAL_EXPRESSION:
+        {
+            LogicalExpr* expr = (LogicalExpr*)expression;
+
+            expr->left = foldExpression(expr->left);
+            expr->right = foldExpression(expr->right);
+
+            if (!isLiteral(expr->left)) break;
+
+            // 'and' stops at a falsey value, 'or' at a truthy one, otherwise the result is the right side
+            bool falsey = isFalsey(literalValue(expr->left));
+            bool stops = expr->op == TOKEN_AND ? falsey : !falsey;
+
+            return replaceWith(expression, stops ? expr->left : expr->right);
+        }
+
+        case TERNARY_EXPRESSION:
+        {
+            TernaryExpr* expr = (TernaryExpr*)expression;
+
+            expr->condition = foldExpression(expr->condition);
+            expr->thenBranch = foldExpression(expr->thenBranch);
+            expr->elseBranch = foldExpression(expr->elseBranch);
+
+            if (!isLiteral(expr->condition)) break;
+
+            return replaceWith(expression, isFalsey(literalValue(expr->condition)) ? expr->elseBranch : expr->thenBranch);
+        }
+
+        case VAR_EXPRESSION:
+        {
+            VarExpr* expr = (VarExpr*)expression;
+            Symbol* symbol = lookup(expr->name);
+
+            if (symbol != NULL && symbol->isConst)
+            {
+                return (Expr*)newLiteralExpr(symbol->value, line);
+            }
+
+            break;
+        }
+
+        case ASSIGN_EXPRESSION:
+        {
+            AssignExpr* expr = (AssignExpr*)expression;
+            Symbol* symbol = lookup(expr->name);
+
+            if (symbol != NULL && symbol->isConst)
+            {
+                error("Cannot assign to constant '%s'.", expr->name->chars, line);
+            }
+
+            expr->value = foldExpression(expr->value);
+            break;
+        }
+
+        case DOT_EXPRESSION:
+        {
+            DotExpr* expr = (DotExpr*)expression;
+
+            expr->instance = foldExpression(expr->instance);
+            expr->value = foldExpression(expr->value);
+            foldExpressions(expr->args);
+            break;
+        }
+
+        case CALL_EXPRESSION:
+        {
+            CallExpr* expr = (CallExpr*)expression;
+
+            expr->callee = foldExpression(expr->callee);
+            foldExpressions(expr->args);
+            break;
+        }
+
+        case LIST_EXPRESSION:
+        {
+            foldExpressions(((ListExpr*)expression)->expressions);
+            break;
+        }
+
+        case INTERPOLATION_EXPRESSION:
+        {
+            InterpolationExpr* expr = (InterpolationExpr*)expression;
+            foldExpressions(expr->parts);
+
+            // Neighbouring parts known while compiling are joined into one string
+            for (Node* node = expr->parts; node != NULL; node = node->next)
+            {
+                while (isLiteral(AS_EXPRESSION(node)) && node->next != NULL && isLiteral(AS_EXPRESSION(node->next)))
+                {
+                    Node* next = node->next;
+                    Value joined = OBJ_VAL(keepString(addStrings(valueToString(literalValue(AS_EXPRESSION(node))),
+                                                                 valueToString(literalValue(AS_EXPRESSION(next))))));
+
+                    AS_EXPRESSION(node) = (Expr*)newLiteralExpr(joined, line);
+                    node->next = next->next;
+                    FREE(Node, next);
+                    expr->partCount--;
+                }
+            }
+
+            if (expr->partCount == 0)
+            {
+                return replaceWith(expression, (Expr*)newLiteralExpr(OBJ_VAL(keepString(copyString("", 0))), line));
+            }
+
+            if (expr->partCount == 1 && isLiteral(AS_EXPRESSION(expr->parts)))
+            {
+                Value text = OBJ_VAL(keepString(valueToString(literalValue(AS_EXPRESSION(expr->parts)))));
+                return replaceWith(expression, (Expr*)newLiteralExpr(text, line));
+            }
+
+            break;
+        }
+
+        case SUBSCRIPT_EXPRESSION:
+        {
+            SubscriptExpr* expr = (SubscriptExpr*)expression;
+
+            expr->list = foldExpression(expr->list);
+            expr->index = foldExpression(expr->index);
+            expr->value = foldExpression(expr->value);
+            break;
+        }
+
+        case YIELD_EXPRESSION:
+        {
+            YieldExpr* expr = (YieldExpr*)expression;
+
+            expr->value = foldExpression(expr->value);
+            break;
+        }
+
+        case RESUME_EXPRESSION:
+        {
+            ResumeExpr* expr = (ResumeExpr*)expression;
+
+            expr->coroutine = foldExpression(expr->coroutine);
+            expr->value = foldExpression(expr->value);
+            break;
+        }
+    }
+
+    return expression;
+}
+
+// endregion
+
+// region Statements
+
+static void foldStatements(Node* statements)
+{
+    for (Node* node = statements; node != NULL; node = node->next)
+    {
+        AS_STATEMENT(node) = foldStatement(AS_STATEMENT(node));
+    }
+}
+
+static void foldFunction(FunctionStmt* stmt)
+{
+    Scope functionScope;
+    beginScope(&functionScope);
+
+    for (uint i = 0; i < stmt->paramCount; i++)
+    {
+        declare(stmt->params[i], false, NULL_VAL);
+    }
+
+    declareAll(stmt->body);
+    foldStatements(stmt->body);
+
+    endScope();
+}
+
+static Stmt* foldStatement(Stmt* statement)
+{
+    if (statement == NULL) return NULL;
+
+    uint16_t line = statement->line;
+
+    switch (statement->type)
+    {
+        case EXPRESSION_STATEMENT:
+        {
+            ExpressionStmt* stmt = (ExpressionStmt*)statement;
+
+            stmt->expr = foldExpression(stmt->expr);
+            break;
+        }
+
+        case BLOCK_STATEMENT:
+        {
+            BlockStmt* stmt = (BlockStmt*)statement;
+
+            Scope blockScope;
+            beginScope(&blockScope);
+
+            declareAll(stmt->statements);
+            foldStatements(stmt->statements);
+
+            endScope();
+            break;
+        }
+
+        case IF_STATEMENT:
+        {
+            IfStmt* stmt = (IfStmt*)statement;
+
+            stmt->condition = foldExpression(stmt->condition);
+            stmt->thenBranch = foldStatement(stmt->thenBranch);
+            stmt->elseBranch = foldStatement(stmt->elseBranch);
+            break;
+        }
+
+        case WHILE_STATEMENT:
+        {
+            WhileStmt* stmt = (WhileStmt*)statement;
+
+            stmt->condition = foldExpression(stmt->condition);
+            stmt->body = foldStatement(stmt->body);
+            break;
+        }
+
+        case FOR_STATEMENT:
+        {
+            ForStmt* stmt = (ForStmt*)statement;
+
+            Scope loopScope;
+            beginScope(&loopScope);
+
+            stmt->declaration = foldStatement(stmt->declaration);
+            stmt->condition = foldExpression(stmt->condition);
+            stmt->increment = foldExpression(stmt->increment);
+            stmt->body = foldStatement(stmt->body);
+
+            endScope();
+            break;
+        }
+
+        case FOREACH_STATEMENT:
+        {
+            ForeachStmt* stmt = (ForeachStmt*)statement;
+
+            stmt->iterable = foldExpression(stmt->iterable);
+
+            Scope loopScope;
+            beginScope(&loopScope);
+
+            declare(stmt->name, false, NULL_VAL);
+            stmt->body = foldStatement(stmt->body);
+
+            endScope();
+            break;
+        }
+
+        case SWITCH_STATEMENT:
+        {
+            SwitchStmt* stmt = (SwitchStmt*)statement;
+
+            stmt->value = foldExpression(stmt->value);
+            foldExpressions(stmt->conditions);
+            foldStatements(stmt->caseBodies);
+            stmt->defaultBranch = foldStatement(stmt->defaultBranch);
+            break;
+        }
+
+        case VARIABLE_STATEMENT:
+        {
+            VariableStmt* stmt = (VariableStmt*)statement;
+
+            stmt->initializer = foldExpression(stmt->initializer);
+
+            if (!stmt->isConst)
+            {
+                declare(stmt->name, false, NULL_VAL);
+                break;
+            }
+
+            if (!isLiteral(stmt->initializer))
+            {
+                error("Constant '%s' must be initialized with a constant expression.", stmt->name->chars, line);
+                break;
+            }
+
+            declare(stmt->name, true, literalValue(stmt->initializer));
+            break;
+        }
+
+        case FUNCTION_STATEMENT:
+        {
+            FunctionStmt* stmt = (FunctionStmt*)statement;
+
+            declare(stmt->name, false, NULL_VAL);
+            foldFunction(stmt);
+            break;
+        }
+
+        case CLASS_STATEMENT:
+        {
+            ClassStmt* stmt = (ClassStmt*)statement;
+
+            declare(stmt->name, false, NULL_VAL);
+
+            for (uint i = 0; i < stmt->methods.count; i++)
+            {
+                foldFunction((FunctionStmt*)stmt->methods.values[i]);
+            }
+
+            break;
+        }
+
+        case RETURN_STATEMENT:
+        {
+            ReturnStmt* stmt = (ReturnStmt*)statement;
+
+            stmt->value = foldExpression(stmt->value);
+            break;
+        }
+
+        case TRY_STATEMENT:
+        {
+            TryStmt* stmt = (TryStmt*)statement;
+
+            stmt->body = foldStatement(stmt->body);
+
+            Scope handlerScope;
+            beginScope(&handlerScope);
+
+            if (stmt->errorName != NULL)
+            {
+                declare(stmt->errorName, false, NULL_VAL);
+            }
+
+            stmt->handler = foldStatement(stmt->handler);
+
+            endScope();
+            break;
+        }
+
+        case CONTINUE_STATEMENT:
+        case BREAK_STATEMENT:
+            break;
+    }
+
+    return statement;
+}
+
+// endregion
+
+bool foldConstants(Node* statements)
+{
+    hadError = false;
+
+    Scope scriptScope;
+    beginScope(&scriptScope);
+
+    declareAll(statements);
+    foldStatements(statements);
+
+    endScope();
+
+    return !hadError;
+}
@@ -0,0 +1,665 @@
+#include <string.h>
+
+#include "escape_analysis.h"
+#include "memory.h"
+#include "table.h"
+#include "vm.h"
+
+// A variable declared in a block or a function body owns its value when the value is created by the initializer,
+// as a list or an instance of a top-level class, and the variable is confined to:
+//   - being indexed, having its fields set and having fields read which aren't named like a method
+//     (reading a missing field binds a method, which refers to the instance),
+//   - the block declaring it, so it's never assigned, declared again or mentioned by a nested function.
+// The class can't have a parent and its 'init' has to be confined the same way with 'this'.
+
+// Declarations and assignments of every name in the script, a class declared once is always the same class
+static Table* declarations = NULL;
+static Node* topLevel = NULL;
+
+// Being checked, klass is NULL for lists
+static ObjString* variable = NULL;
+static ClassStmt* klass = NULL;
+
+static bool confinedStatement(Stmt* statement, bool nested);
+static bool confinedExpression(Expr* expression, bool nested);
+static void countStatement(Stmt* statement);
+
+// region Declarations
+
+static void countName(ObjString* name)
+{
+    Value count = NUMBER_VAL(0);
+    tableGet(declarations, name, &count);
+    tableSet(declarations, name, NUMBER_VAL(AS_NUMBER(count) + 1));
+}
+
+static uint declarationCount(ObjString* name)
+{
+    Value count;
+    return tableGet(declarations, name, &count) ? (uint)AS_NUMBER(count) : 0;
+}
+
+static void countExpressions(Node* expressions);
+
+static void countExpression(Expr* expression)
+{
+    if (expression == NULL) return;
+
+    switch (expression->type)
+    {
+        case ASSIGN_EXPRESSION:
+            countName(((AssignExpr*)expression)->name);
+            countExpression(((AssignExpr*)expression)->value);
+            break;
+
+        case BINARY_EXPRESSION:
+            countExpression(((BinaryExpr*)expression)->left);
+            countExpression(((BinaryExpr*)expression)->right);
+            break;
+
+        case LOGICAL_EXPRESSION:
+            countExpression(((LogicalExpr*)expression)->left);
+            countExpression(((LogicalExpr*)expression)->right);
+            break;
+
+        case UNARY_EXPRESSION:
+            countExpression(((UnaryExpr*)expression)->target);
+            break;
+
+        case TERNARY_EXPRESSION:
+            countExpression(((TernaryExpr*)expression)->condition);
+            countExpression(((TernaryExpr*)expression)->thenBranch);
+            countExpression(((TernaryExpr*)expression)->elseBranch);
+            break;
+
+        case CALL_EXPRESSION:
+            countExpression(((CallExpr*)expression)->callee);
+            countExpressions(((CallExpr*)expression)->args);
+            break;
+
+        case DOT_EXPRESSION:
+            countExpression(((DotExpr*)expression)->instance);
+            countExpression(((DotExpr*)expression)->value);
+            countExpressions(((DotExpr*)expression)->args);
+            break;
+
+        case SUBSCRIPT_EXPRESSION:
+            countExpression(((SubscriptExpr*)expression)->list);
+            countExpression(((SubscriptExpr*)expression)->index);
+            countExpression(((SubscriptExpr*)expression)->value);
+            break;
+
+        case LIST_EXPRESSION:
+            countExpressions(((ListExpr*)expression)->expressions);
+            break;
+
+        case INTERPOLATION_EXPRESSION:
+            countExpressions(((InterpolationExpr*)expression)->parts);
+            break;
+
+        case YIELD_EXPRESSION:
+            countExpression(((YieldExpr*)expression)->value);
+            break;
+
+        case RESUME_EXPRESSION:
+            countExpression(((ResumeExpr*)expression)->coroutine);
+            countExpression(((ResumeExpr*)expression)->value);
+            break;
+
+        case LITERAL_EXPRESSION:
+        case VAR_EXPRESSION:
+        case BASE_EXPRESSION:
+            break;
+    }
+}
+
+static void countExpressions(Node* expressions)
+{
+    for (Node* node = expressions; node != NULL; node = node->next)
+    {
+        countExpression(AS_EXPRESSION(node));
+    }
+}
+
+static void countStatements(Node* statements)
+{
+    for (Node* node = statements; node != NULL; node = node->next)
+    {
+        countStatement(AS_STATEMENT(node));
+    }
+}
+
+static void countFunction(FunctionStmt* stmt)
+{
+    countName(stmt->name);
+
+    for (uint i = 0; i < stmt->paramCount; i++)
+    {
+        countName(stmt->params[i]);
+    }
+
+    countStatements(stmt->body);
+}
+
+static void countStatement(Stmt* statement)
+{
+    if (statement == NULL) return;
+
+    switch (statement->type)
+    {
+        case EXPRESSION_STATEMENT:
+            countExpression(((ExpressionStmt*)statement)->expr);
+            break;
+
+        case BLOCK_STATEMENT:
+            countStatements(((BlockStmt*)statement)->statements);
+            break;
+
+        case IF_STATEMENT:
+            countExpression(((IfStmt*)statement)->condition);
+            countStatement(((IfStmt*)statement)->thenBranch);
+            countStatement(((IfStmt*)statement)->elseBranch);
+            break;
+
+        case WHILE_STATEMENT:
+            countExpression(((WhileStmt*)statement)->condition);
+            countStatement(((WhileStmt*)statement)->body);
+            break;
+
+        case FOR_STATEMENT:
+        {
+            ForStmt* stmt = (ForStmt*)statement;
+
+            countStatement(stmt->declaration);
+            countExpression(stmt->condition);
+            countExpression(stmt->increment);
+            countStatement(stmt->body);
+            break;
+        }
+
+        case FOREACH_STATEMENT:
+        {
+            ForeachStmt* stmt = (ForeachStmt*)statement;
+
+            countName(stmt->name);
+            countExpression(stmt->iterable);
+            countStatement(stmt->body);
+            break;
+        }
+
+        case SWITCH_STATEMENT:
+        {
+            SwitchStmt* stmt = (SwitchStmt*)statement;
+
+            countExpression(stmt->value);
+            countExpressions(stmt->conditions);
+            countStatements(stmt->caseBodies);
+            countStatement(stmt->defaultBranch);
+            break;
+        }
+
+        case VARIABLE_STATEMENT:
+            countName(((VariableStmt*)statement)->name);
+            countExpression(((VariableStmt*)statement)->initializer);
+            break;
+
+        case FUNCTION_STATEMENT:
+            countFunction((FunctionStmt*)statement);
+            break;
+
+        case CLASS_STATEMENT:
+        {
+            ClassStmt* stmt = (ClassStmt*)statement;
+
+            countName(stmt->name);
+            countExpression(stmt->parent);
+
+            for (uint i = 0; i < stmt->methods.count; i++)
+            {
+                FunctionStmt* method = (FunctionStmt*)stmt->methods.values[i];
+
+                // Method names aren't variables
+                for (uint j = 0; j < method->paramCount; j++)
+                {
+                    countName(method->params[j]);
+                }
+
+                countStatements(method->body);
+            }
+            break;
+        }
+
+        case RETURN_STATEMENT:
+            countExpression(((ReturnStmt*)statement)->value);
+            break;
+
+        case TRY_STATEMENT:
+        {
+            TryStmt* stmt = (TryStmt*)statement;
+
+            if (stmt->errorName != NULL) countName(stmt->errorName);
+
+            countStatement(stmt->body);
+            countStatement(stmt->handler);
+            break;
+        }
+
+        case CONTINUE_STATEMENT:
+        case BREAK_STATEMENT:
+            break;
+    }
+}
+
+// endregion
+
+// region Confinement
+
+static bool isVariable(Expr* expression)
+{
+    return expression->type == VAR_EXPRESSION && ((VarExpr*)expression)->name == variable;
+}
+
+static bool isMethod(ObjString* name)
+{
+    if (klass == NULL) return false;
+
+    for (uint i = 0; i < klass->methods.count; i++)
+    {
+        if (((FunctionStmt*)klass->methods.values[i])->name == name) return true;
+    }
+
+    return false;
+}
+
+static bool confinedExpressions(Node* expressions, bool nested)
+{
+    for (Node* node = expressions; node != NULL; node = node->next)
+    {
+        if (!confinedExpression(AS_EXPRESSION(node), nested)) return false;
+    }
+
+    return true;
+}
+
+static bool confinedStatements(Node* statements, bool nested)
+{
+    for (Node* node = statements; node != NULL; node = node->next)
+    {
+        if (!confinedStatement(AS_STATEMENT(node), nested)) return false;
+    }
+
+    return true;
+}
+
+// Functions are nested inside the scope, whenever they run the variable is out of sight
+static bool confinedFunction(FunctionStmt* stmt)
+{
+    if (stmt->name == variable) return false;
+
+    for (uint i = 0; i < stmt->paramCount; i++)
+    {
+        if (stmt->params[i] == variable) return false;
+    }
+
+    return confinedStatements(stmt->body, true);
+}
+
+static bool confinedExpression(Expr* expression, bool nested)
+{
+    if (expression == NULL) return true;
+
+    switch (expression->type)
+    {
+        case VAR_EXPRESSION:
+            return !isVariable(expression);
+
+        case ASSIGN_EXPRESSION:
+        {
+            AssignExpr* expr = (AssignExpr*)expression;
+            return expr->name != variable && confinedExpression(expr->value, nested);
+        }
+
+        case DOT_EXPRESSION:
+        {
+            DotExpr* expr = (DotExpr*)expression;
+
+            if (isVariable(expr->instance))
+            {
+                // Calling a method passes the instance as 'this'
+                if (nested || expr->isCall) return false;
+                if (expr->value == NULL && isMethod(expr->fieldName)) return false;
+
+                return confinedExpression(expr->value, nested);
+            }
+
+            return confinedExpression(expr->instance, nested) &&
+                   confinedExpressions(expr->args, nested) &&
+                   confinedExpression(expr->value, nested);
+        }
+
+        case SUBSCRIPT_EXPRESSION:
+        {
+            SubscriptExpr* expr = (SubscriptExpr*)expression;
+
+            if (isVariable(expr->list))
+            {
+                if (nested) return false;
+            }
+            else if (!confinedExpression(expr->list, nested))
+            {
+                return false;
+            }
+
+            return confinedExpression(expr->index, nested) && confinedExpression(expr->value, nested);
+        }
+
+        case BINARY_EXPRESSION:
+            return confinedExpression(((BinaryExpr*)expression)->left, nested) &&
+                   confinedExpression(((BinaryExpr*)expression)->right, nested);
+
+        case LOGICAL_EXPRESSION:
+            return confinedExpression(((LogicalExpr*)expression)->left, nested) &&
+                   confinedExpression(((LogicalExpr*)expression)->right, nested);
+
+        case UNARY_EXPRESSION:
+            return confinedExpression(((UnaryExpr*)expression)->target, nested);
+
+        case TERNARY_EXPRESSION:
+            return confinedExpression(((TernaryExpr*)expression)->condition, nested) &&
+                   confinedExpression(((TernaryExpr*)expression)->thenBranch, nested) &&
+                   confinedExpression(((TernaryExpr*)expression)->elseBranch, nested);
+
+        case CALL_EXPRESSION:
+            return confinedExpression(((CallExpr*)expression)->callee, nested) &&
+                   confinedExpressions(((CallExpr*)expression)->args, nested);
+
+        case LIST_EXPRESSION:
+            return confinedExpressions(((ListExpr*)expression)->expressions, nested);
+
+        case INTERPOLATION_EXPRESSION:
+            return confinedExpressions(((InterpolationExpr*)expression)->parts, nested);
+
+        case YIELD_EXPRESSION:
+            return confinedExpression(((YieldExpr*)expression)->value, nested);
+
+        case RESUME_EXPRESSION:
+            return confinedExpression(((ResumeExpr*)expression)->coroutine, nested) &&
+                   confinedExpression(((ResumeExpr*)expression)->value, nested);
+
+        case LITERAL_EXPRESSION:
+        case BASE_EXPRESSION:
+            return true;
+    }
+
+    return true;
+}
+
+static bool confinedStatement(Stmt* statement, bool nested)
+{
+    if (statement == NULL) return true;
+
+    switch (statement->type)
+    {
+        case EXPRESSION_STATEMENT:
+            return confinedExpression(((ExpressionStmt*)statement)->expr, nested);
+
+        case BLOCK_STATEMENT:
+            return confinedStatements(((BlockStmt*)statement)->statements, nested);
+
+        case IF_STATEMENT:
+            return confinedExpression(((IfStmt*)statement)->condition, nested) &&
+                   confinedStatement(((IfStmt*)statement)->thenBranch, nested) &&
+                   confinedStatement(((IfStmt*)statement)->elseBranch, nested);
+
+        case WHILE_STATEMENT:
+            return confinedExpression(((WhileStmt*)statement)->condition, nested) &&
+                   confinedStatement(((WhileStmt*)statement)->body, nested);
+
+        case FOR_STATEMENT:
+        {
+            ForStmt* stmt = (ForStmt*)statement;
+
+            return confinedStatement(stmt->declaration, nested) &&
+                   confinedExpression(stmt->condition, nested) &&
+                   confinedExpression(stmt->increment, nested) &&
+                   confinedStatement(stmt->body, nested);
+        }
+
+        case FOREACH_STATEMENT:
+        {
+            ForeachStmt* stmt = (ForeachStmt*)statement;
+
+            return stmt->name != variable &&
+                   confinedExpression(stmt->iterable, nested) &&
+                   confinedStatement(stmt->body, nested);
+        }
+
+        case SWITCH_STATEMENT:
+        {
+            SwitchStmt* stmt = (SwitchStmt*)statement;
+
+            return confinedExpression(stmt->value, nested) &&
+                   confinedExpressions(stmt->conditions, nested) &&
+                   confinedStatements(stmt->caseBodies, nested) &&
+                   confinedStatement(stmt->defaultBranch, nested);
+        }
+
+        case VARIABLE_STATEMENT:
+        {
+            VariableStmt* stmt = (VariableStmt*)statement;
+            return stmt->name != variable && confinedExpression(stmt->initializer, nested);
+        }
+
+        case FUNCTION_STATEMENT:
+            return confinedFunction((FunctionStmt*)statement);
+
+        case CLASS_STATEMENT:
+        {
+            ClassStmt* stmt = (ClassStmt*)statement;
+
+            if (stmt->name == variable || !confinedExpression(stmt->parent, nested)) return false;
+
+            for (uint i = 0; i < stmt->methods.count; i++)
+            {
+                if (!confinedFunction((FunctionStmt*)stmt->methods.values[i])) return false;
+            }
+
+            return true;
+        }
+
+        case RETURN_STATEMENT:
+            return confinedExpression(((ReturnStmt*)statement)->value, nested);
+
+        case TRY_STATEMENT:
+        {
+            TryStmt* stmt = (TryStmt*)statement;
+
+            return stmt->errorName != variable &&
+                   confinedStatement(stmt->body, nested) &&
+                   confinedStatement(stmt->handler, nested);
+        }
+
+        case CONTINUE_STATEMENT:
+        case BREAK_STATEMENT:
+            return true;
+    }
+
+    return true;
+}
+
+// endregion
+
+// region Owners
+
+static ClassStmt* findClass(ObjString* name)
+{
+    if (declarationCount(name) != 1) return NULL;
+
+    for (Node* node = topLevel; node != NULL; node = node->next)
+    {
+        Stmt* statement = AS_STATEMENT(node);
+
+        if (statement->type == CLASS_STATEMENT && ((ClassStmt*)statement)->name == name)
+        {
+            return (ClassStmt*)statement;
+        }
+    }
+
+    return NULL;
+}
+
+static bool confinedInitializer(ClassStmt* stmt)
+{
+    if (stmt->parent != NULL) return false;
+
+    for (uint i = 0; i < stmt->methods.count; i++)
+    {
+        FunctionStmt* method = (FunctionStmt*)stmt->methods.values[i];
+
+        if (method->name->length == 4 && memcmp(method->name->chars, "init", 4) == 0)
+        {
+            variable = vm.thisString;
+            klass = stmt;
+
+            return confinedStatements(method->body, false);
+        }
+    }
+
+    return true;
+}
+
+// Whether the initializer creates a list, or an instance of the class put in 'created'
+static bool createsValue(Expr* initializer, ClassStmt** created)
+{
+    *created = NULL;
+
+    if (initializer == NULL) return false;
+    if (initializer->type == LIST_EXPRESSION) return true;
+    if (initializer->type != CALL_EXPRESSION) return false;
+
+    Expr* callee = ((CallExpr*)initializer)->callee;
+    if (callee->type != VAR_EXPRESSION) return false;
+
+    *created = findClass(((VarExpr*)callee)->name);
+    return *created != NULL && confinedInitializer(*created);
+}
+
+static void findInStatement(Stmt* statement);
+
+// Only statements of a block or a function body have a scope which ends before the script does
+static void findInStatements(Node* statements, bool scoped)
+{
+    for (Node* node = statements; node != NULL; node = node->next)
+    {
+        Stmt* statement = AS_STATEMENT(node);
+        ClassStmt* created;
+
+        if (scoped && statement->type == VARIABLE_STATEMENT &&
+            createsValue(((VariableStmt*)statement)->initializer, &created))
+        {
+            VariableStmt* stmt = (VariableStmt*)statement;
+            bool confined = true;
+
+            variable = stmt->name;
+            klass = created;
+
+            // Functions declared before it can see it too
+            for (Node* other = statements; other != NULL && confined; other = other->next)
+            {
+                if (other != node) confined = confinedStatement(AS_STATEMENT(other), false);
+            }
+
+            stmt->ownedByScope = confined;
+        }
+
+        findInStatement(statement);
+    }
+}
+
+static void findInFunction(FunctionStmt* stmt)
+{
+    findInStatements(stmt->body, true);
+}
+
+static void findInStatement(Stmt* statement)
+{
+    if (statement == NULL) return;
+
+    switch (statement->type)
+    {
+        case BLOCK_STATEMENT:
+            findInStatements(((BlockStmt*)statement)->statements, true);
+            break;
+
+        case IF_STATEMENT:
+            findInStatement(((IfStmt*)statement)->thenBranch);
+            findInStatement(((IfStmt*)statement)->elseBranch);
+            break;
+
+        case WHILE_STATEMENT:
+            findInStatement(((WhileStmt*)statement)->body);
+            break;
+
+        case FOR_STATEMENT:
+            findInStatement(((ForStmt*)statement)->body);
+            break;
+
+        case FOREACH_STATEMENT:
+            findInStatement(((ForeachStmt*)statement)->body);
+            break;
+
+        case SWITCH_STATEMENT:
+        {
+            SwitchStmt* stmt = (SwitchStmt*)statement;
+
+            for (Node* node = stmt->caseBodies; node != NULL; node = node->next)
+            {
+                findInStatement(AS_STATEMENT(node));
+            }
+
+            findInStatement(stmt->defaultBranch);
+            break;
+        }
+
+        case FUNCTION_STATEMENT:
+            findInFunction((FunctionStmt*)statement);
+            break;
+
+        case CLASS_STATEMENT:
+        {
+            ClassStmt* stmt = (ClassStmt*)statement;
+
+            for (uint i = 0; i < stmt->methods.count; i++)
+            {
+                findInFunction((FunctionStmt*)stmt->methods.values[i]);
+            }
+            break;
+        }
+
+        case TRY_STATEMENT:
+            findInStatement(((TryStmt*)statement)->body);
+            findInStatement(((TryStmt*)statement)->handler);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// endregion
+
+void findOwnedValues(Node* statements)
+{
+    declarations = ALLOCATE_TABLE();
+    initTable(declarations);
+    topLevel = statements;
+
+    countStatements(statements);
+    findInStatements(statements, false);
+
+    freeTable(declarations);
+    declarations = NULL;
+    topLevel = NULL;
+    variable = NULL;
+    klass = NULL;
+}
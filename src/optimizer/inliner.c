@@ -0,0 +1,637 @@
+#include "inliner.h"
+#include "memory.h"
+#include "table.h"
+#include "garbage_collector.h"
+
+// Only bodies without calls, assignments or names other than the parameters are inlined. Evaluating them
+// can't change anything, so the only side effects left are the ones of the arguments.
+// Reading a variable is treated as free of side effects, such arguments may be read any number of times.
+// At most one argument may be anything else, only if the body evaluates it first and exactly once,
+// and if no variable is passed before it.
+//
+// The emitter guards every inlined call with a check that the name still refers to the candidate,
+// so a function or variable of the same name declared in an inner scope still gets called.
+
+bool inliningEnabled = true;
+
+static InlineCandidate* candidates = NULL;
+static uint count = 0;
+static uint capacity = 0;
+
+// Name -> index in candidates
+static Table* names = NULL;
+
+static void scanStatement(Stmt* statement);
+static void scanExpression(Expr* expression);
+
+// region Candidates
+
+static void removeCandidate(ObjString* name)
+{
+    Value index;
+    if (!tableGet(names, name, &index) || !IS_NUMBER(index)) return;
+
+    // Stays in the array, but can't be found anymore. The name is kept, so it is never added again.
+    candidates[(uint)AS_NUMBER(index)].declaration = NULL;
+    tableSet(names, name, NULL_VAL);
+}
+
+static bool isParameter(FunctionStmt* function, ObjString* name)
+{
+    for (uint i = 0; i < function->paramCount; i++)
+    {
+        // Names are interned
+        if (function->params[i] == name) return true;
+    }
+
+    return false;
+}
+
+// Returns the number of nodes, or INLINE_MAX_SIZE + 1 if the expression can't be inlined
+static uint inlinableSize(FunctionStmt* function, Expr* expression)
+{
+    switch (expression->type)
+    {
+        case LITERAL_EXPRESSION:
+            return 1;
+
+        case VAR_EXPRESSION:
+            return isParameter(function, ((VarExpr*)expression)->name) ? 1 : INLINE_MAX_SIZE + 1;
+
+        case BINARY_EXPRESSION:
+        {
+            BinaryExpr* expr = (BinaryExpr*)expression;
+            return 1 + inlinableSize(function, expr->left) + inlinableSize(function, expr->right);
+        }
+
+        case LOGICAL_EXPRESSION:
+        {
+            LogicalExpr* expr = (LogicalExpr*)expression;
+            return 1 + inlinableSize(function, expr->left) + inlinableSize(function, expr->right);
+        }
+
+        case UNARY_EXPRESSION:
+            return 1 + inlinableSize(function, ((UnaryExpr*)expression)->target);
+
+        case TERNARY_EXPRESSION:
+        {
+            TernaryExpr* expr = (TernaryExpr*)expression;
+            return 1 + inlinableSize(function, expr->condition) +
+                       inlinableSize(function, expr->thenBranch) +
+                       inlinableSize(function, expr->elseBranch);
+        }
+
+        case DOT_EXPRESSION:
+        {
+            DotExpr* expr = (DotExpr*)expression;
+            if (expr->isCall || expr->value != NULL) return INLINE_MAX_SIZE + 1;
+
+            return 1 + inlinableSize(function, expr->instance);
+        }
+
+        case SUBSCRIPT_EXPRESSION:
+        {
+            SubscriptExpr* expr = (SubscriptExpr*)expression;
+            if (expr->value != NULL) return INLINE_MAX_SIZE + 1;
+
+            return 1 + inlinableSize(function, expr->list) + inlinableSize(function, expr->index);
+        }
+
+        case LIST_EXPRESSION:
+        {
+            uint size = 1;
+
+            for (Node* node = ((ListExpr*)expression)->expressions; node != NULL; node = node->next)
+            {
+                size += inlinableSize(function, AS_EXPRESSION(node));
+            }
+
+            return size;
+        }
+
+        default:
+            return INLINE_MAX_SIZE + 1;
+    }
+}
+
+static Expr* returnedExpression(FunctionStmt* function)
+{
+    Node* body = function->body;
+    if (body == NULL || body->next != NULL) return NULL;
+
+    Stmt* statement = AS_STATEMENT(body);
+    if (statement == NULL || statement->type != RETURN_STATEMENT) return NULL;
+
+    return ((ReturnStmt*)statement)->value;
+}
+
+static void addCandidate(FunctionStmt* function)
+{
+    Expr* value = returnedExpression(function);
+    if (value == NULL || inlinableSize(function, value) > INLINE_MAX_SIZE) return;
+
+    if (capacity < count + 1)
+    {
+        uint oldCapacity = capacity;
+        capacity = GROW_CAPACITY(oldCapacity);
+        candidates = GROW_ARRAY(InlineCandidate, candidates, oldCapacity, capacity);
+    }
+
+    candidates[count].declaration = function;
+    candidates[count].function = NULL;
+    tableSet(names, function->name, NUMBER_VAL(count));
+
+    count++;
+}
+
+// endregion
+
+// region Escapes
+
+// Any use of a candidate's name which isn't a direct call means the function may be called from
+// somewhere we can't see, or that the name is expected to change
+
+static void scanExpressions(Node* expressions)
+{
+    for (Node* node = expressions; node != NULL; node = node->next)
+    {
+        scanExpression(AS_EXPRESSION(node));
+    }
+}
+
+static void scanExpression(Expr* expression)
+{
+    if (expression == NULL) return;
+
+    switch (expression->type)
+    {
+        case VAR_EXPRESSION:
+            removeCandidate(((VarExpr*)expression)->name);
+            break;
+
+        case ASSIGN_EXPRESSION:
+        {
+            AssignExpr* expr = (AssignExpr*)expression;
+
+            removeCandidate(expr->name);
+            scanExpression(expr->value);
+            break;
+        }
+
+        case CALL_EXPRESSION:
+        {
+            CallExpr* expr = (CallExpr*)expression;
+
+            if (expr->callee->type != VAR_EXPRESSION) scanExpression(expr->callee);
+            scanExpressions(expr->args);
+            break;
+        }
+
+        case BINARY_EXPRESSION:
+            scanExpression(((BinaryExpr*)expression)->left);
+            scanExpression(((BinaryExpr*)expression)->right);
+            break;
+
+        case LOGICAL_EXPRESSION:
+            scanExpression(((LogicalExpr*)expression)->left);
+            scanExpression(((LogicalExpr*)expression)->right);
+            break;
+
+        case UNARY_EXPRESSION:
+            scanExpression(((UnaryExpr*)expression)->target);
+            break;
+
+        case TERNARY_EXPRESSION:
+            scanExpression(((TernaryExpr*)expression)->condition);
+            scanExpression(((TernaryExpr*)expression)->thenBranch);
+            scanExpression(((TernaryExpr*)expression)->elseBranch);
+            break;
+
+        case DOT_EXPRESSION:
+            scanExpression(((DotExpr*)expression)->instance);
+            scanExpression(((DotExpr*)expression)->value);
+            scanExpressions(((DotExpr*)expression)->args);
+            break;
+
+        case SUBSCRIPT_EXPRESSION:
+            scanExpression(((SubscriptExpr*)expression)->list);
+            scanExpression(((SubscriptExpr*)expression)->index);
+            scanExpression(((SubscriptExpr*)expression)->value);
+            break;
+
+        case LIST_EXPRESSION:
+            scanExpressions(((ListExpr*)expression)->expressions);
+            break;
+
+        case INTERPOLATION_EXPRESSION:
+            scanExpressions(((InterpolationExpr*)expression)->parts);
+            break;
+
+        case YIELD_EXPRESSION:
+            scanExpression(((YieldExpr*)expression)->value);
+            break;
+
+        case RESUME_EXPRESSION:
+            scanExpression(((ResumeExpr*)expression)->coroutine);
+            scanExpression(((ResumeExpr*)expression)->value);
+            break;
+
+        case LITERAL_EXPRESSION:
+        case BASE_EXPRESSION:
+            break;
+    }
+}
+
+static void scanStatements(Node* statements)
+{
+    for (Node* node = statements; node != NULL; node = node->next)
+    {
+        scanStatement(AS_STATEMENT(node));
+    }
+}
+
+static void scanStatement(Stmt* statement)
+{
+    if (statement == NULL) return;
+
+    switch (statement->type)
+    {
+        case EXPRESSION_STATEMENT:
+            scanExpression(((ExpressionStmt*)statement)->expr);
+            break;
+
+        case BLOCK_STATEMENT:
+            scanStatements(((BlockStmt*)statement)->statements);
+            break;
+
+        case IF_STATEMENT:
+            scanExpression(((IfStmt*)statement)->condition);
+            scanStatement(((IfStmt*)statement)->thenBranch);
+            scanStatement(((IfStmt*)statement)->elseBranch);
+            break;
+
+        case WHILE_STATEMENT:
+            scanExpression(((WhileStmt*)statement)->condition);
+            scanStatement(((WhileStmt*)statement)->body);
+            break;
+
+        case FOR_STATEMENT:
+        {
+            ForStmt* stmt = (ForStmt*)statement;
+
+            scanStatement(stmt->declaration);
+            scanExpression(stmt->condition);
+            scanExpression(stmt->increment);
+            scanStatement(stmt->body);
+            break;
+        }
+
+        case FOREACH_STATEMENT:
+            scanExpression(((ForeachStmt*)statement)->iterable);
+            scanStatement(((ForeachStmt*)statement)->body);
+            break;
+
+        case SWITCH_STATEMENT:
+        {
+            SwitchStmt* stmt = (SwitchStmt*)statement;
+
+            scanExpression(stmt->value);
+            scanExpressions(stmt->conditions);
+            scanStatements(stmt->caseBodies);
+            scanStatement(stmt->defaultBranch);
+            break;
+        }
+
+        case VARIABLE_STATEMENT:
+            scanExpression(((VariableStmt*)statement)->initializer);
+            break;
+
+        case FUNCTION_STATEMENT:
+            scanStatements(((FunctionStmt*)statement)->body);
+            break;
+
+        case CLASS_STATEMENT:
+        {
+            ClassStmt* stmt = (ClassStmt*)statement;
+
+            scanExpression(stmt->parent);
+
+            for (uint i = 0; i < stmt->methods.count; i++)
+            {
+                scanStatement(stmt->methods.values[i]);
+            }
+            break;
+        }
+
+        case RETURN_STATEMENT:
+            scanExpression(((ReturnStmt*)statement)->value);
+            break;
+
+        case TRY_STATEMENT:
+            scanStatement(((TryStmt*)statement)->body);
+            scanStatement(((TryStmt*)statement)->handler);
+            break;
+
+        case CONTINUE_STATEMENT:
+        case BREAK_STATEMENT:
+            break;
+    }
+}
+
+// endregion
+
+// region Substitution
+
+typedef struct
+{
+    uint uses;
+
+    // Set if this parameter is the first thing the body evaluates
+    bool first;
+} ParameterUse;
+
+static void countUses(FunctionStmt* function, Expr* expression, ParameterUse* uses, bool* seenLeaf)
+{
+    switch (expression->type)
+    {
+        case LITERAL_EXPRESSION:
+            *seenLeaf = true;
+            break;
+
+        case VAR_EXPRESSION:
+        {
+            ObjString* name = ((VarExpr*)expression)->name;
+
+            for (uint i = 0; i < function->paramCount; i++)
+            {
+                if (function->params[i] != name) continue;
+
+                uses[i].uses++;
+                if (!*seenLeaf) uses[i].first = true;
+            }
+
+            *seenLeaf = true;
+            break;
+        }
+
+        // Same order the emitter compiles them in
+        case BINARY_EXPRESSION:
+            countUses(function, ((BinaryExpr*)expression)->left, uses, seenLeaf);
+            countUses(function, ((BinaryExpr*)expression)->right, uses, seenLeaf);
+            break;
+
+        case LOGICAL_EXPRESSION:
+            countUses(function, ((LogicalExpr*)expression)->left, uses, seenLeaf);
+            countUses(function, ((LogicalExpr*)expression)->right, uses, seenLeaf);
+            break;
+
+        case UNARY_EXPRESSION:
+            countUses(function, ((UnaryExpr*)expression)->target, uses, seenLeaf);
+            break;
+
+        case TERNARY_EXPRESSION:
+            countUses(function, ((TernaryExpr*)expression)->condition, uses, seenLeaf);
+            countUses(function, ((TernaryExpr*)expression)->thenBranch, uses, seenLeaf);
+            countUses(function, ((TernaryExpr*)expression)->elseBranch, uses, seenLeaf);
+            break;
+
+        case DOT_EXPRESSION:
+            countUses(function, ((DotExpr*)expression)->instance, uses, seenLeaf);
+            break;
+
+        case SUBSCRIPT_EXPRESSION:
+            countUses(function, ((SubscriptExpr*)expression)->list, uses, seenLeaf);
+            countUses(function, ((SubscriptExpr*)expression)->index, uses, seenLeaf);
+            break;
+
+        case LIST_EXPRESSION:
+            for (Node* node = ((ListExpr*)expression)->expressions; node != NULL; node = node->next)
+            {
+                countUses(function, AS_EXPRESSION(node), uses, seenLeaf);
+            }
+
+            // An empty list is built before anything else is evaluated
+            *seenLeaf = true;
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Copies keep the lines of the function's nodes, so runtime errors are reported where they are without inlining
+static Expr* substitute(FunctionStmt* function, Expr* expression, Expr** args)
+{
+    uint16_t line = expression->line;
+
+    switch (expression->type)
+    {
+        case LITERAL_EXPRESSION:
+            return (Expr*)newLiteralExpr(((LiteralExpr*)expression)->value, line);
+
+        case VAR_EXPRESSION:
+        {
+            ObjString* name = ((VarExpr*)expression)->name;
+
+            for (uint i = 0; i < function->paramCount; i++)
+            {
+                if (function->params[i] == name) return args[i];
+            }
+
+            return NULL; // Unreachable, candidates use only their parameters
+        }
+
+        case BINARY_EXPRESSION:
+        {
+            BinaryExpr* expr = (BinaryExpr*)expression;
+
+            BinaryExpr* copy = newBinaryExpr(substitute(function, expr->left, args), expr->op,
+                                             substitute(function, expr->right, args), line);
+
+            // Copies are made while emitting, only the parser's numbering is the same on every run
+            copy->site = expr->site;
+            return (Expr*)copy;
+        }
+
+        case LOGICAL_EXPRESSION:
+        {
+            LogicalExpr* expr = (LogicalExpr*)expression;
+
+            return (Expr*)newLogicalExpr(substitute(function, expr->left, args), expr->op,
+                                         substitute(function, expr->right, args), line);
+        }
+
+        case UNARY_EXPRESSION:
+        {
+            UnaryExpr* expr = (UnaryExpr*)expression;
+            return (Expr*)newUnaryExpr(substitute(function, expr->target, args), expr->op, line);
+        }
+
+        case TERNARY_EXPRESSION:
+        {
+            TernaryExpr* expr = (TernaryExpr*)expression;
+
+            return (Expr*)newTernaryExpr(substitute(function, expr->condition, args),
+                                         substitute(function, expr->thenBranch, args),
+                                         substitute(function, expr->elseBranch, args), line);
+        }
+
+        case DOT_EXPRESSION:
+        {
+            DotExpr* expr = (DotExpr*)expression;
+
+            DotExpr* copy = newDotExpr(substitute(function, expr->instance, args), expr->fieldName,
+                                       NULL, false, NULL, 0, line);
+
+            copy->site = expr->site;
+            return (Expr*)copy;
+        }
+
+        case SUBSCRIPT_EXPRESSION:
+        {
+            SubscriptExpr* expr = (SubscriptExpr*)expression;
+
+            return (Expr*)newSubscriptExpr(substitute(function, expr->list, args),
+                                           substitute(function, expr->index, args), NULL, line);
+        }
+
+        case LIST_EXPRESSION:
+        {
+            Node* expressions = NULL;
+
+            for (Node* node = ((ListExpr*)expression)->expressions; node != NULL; node = node->next)
+            {
+                listAdd(&expressions, NODE_EXPRESSION_VALUE(substitute(function, AS_EXPRESSION(node), args)));
+            }
+
+            return (Expr*)newListExpr(expressions, line);
+        }
+
+        default:
+            return NULL;
+    }
+}
+
+Expr* inlineCall(InlineCandidate* candidate, CallExpr* call)
+{
+    FunctionStmt* function = candidate->declaration;
+
+    // Let the VM report the wrong argument count
+    if (call->argCount != function->paramCount) return NULL;
+
+    Expr* body = returnedExpression(function);
+
+    ParameterUse uses[UINT8_COUNT];
+    Expr* args[UINT8_COUNT];
+
+    for (uint i = 0; i < function->paramCount; i++)
+    {
+        uses[i].uses = 0;
+        uses[i].first = false;
+    }
+
+    bool seenLeaf = false;
+    countUses(function, body, uses, &seenLeaf);
+
+    uint i = 0;
+    bool hasComplexArgument = false;
+    bool readsVariable = false;
+
+    for (Node* node = call->args; node != NULL; node = node->next, i++)
+    {
+        args[i] = AS_EXPRESSION(node);
+
+        if (args[i]->type == LITERAL_EXPRESSION) continue;
+
+        if (args[i]->type == VAR_EXPRESSION)
+        {
+            readsVariable = true;
+            continue;
+        }
+
+        // It's evaluated first, so it must be the first thing the body evaluates, and variables passed before
+        // it must not be read after it has run
+        if (hasComplexArgument || readsVariable || uses[i].uses != 1 || !uses[i].first) return NULL;
+        hasComplexArgument = true;
+    }
+
+    return substitute(function, body, args);
+}
+
+// endregion
+
+void findInlineCandidates(Node* statements)
+{
+    freeInlineCandidates();
+
+    names = ALLOCATE_TABLE();
+    initTable(names);
+
+    for (Node* node = statements; node != NULL; node = node->next)
+    {
+        Stmt* statement = AS_STATEMENT(node);
+        if (statement == NULL || statement->type != FUNCTION_STATEMENT) continue;
+
+        FunctionStmt* function = (FunctionStmt*)statement;
+
+        // Declaring it again is an error at runtime
+        Value previous;
+        if (tableGet(names, function->name, &previous))
+        {
+            removeCandidate(function->name);
+            continue;
+        }
+
+        addCandidate(function);
+    }
+
+    // Other top-level declarations of the same name
+    for (Node* node = statements; node != NULL; node = node->next)
+    {
+        Stmt* statement = AS_STATEMENT(node);
+        if (statement == NULL) continue;
+
+        if (statement->type == VARIABLE_STATEMENT) removeCandidate(((VariableStmt*)statement)->name);
+        if (statement->type == CLASS_STATEMENT) removeCandidate(((ClassStmt*)statement)->name);
+    }
+
+    scanStatements(statements);
+}
+
+uint inlineCandidateCount()
+{
+    return count;
+}
+
+InlineCandidate* getInlineCandidateAt(uint index)
+{
+    return candidates[index].declaration == NULL ? NULL : &candidates[index];
+}
+
+InlineCandidate* getInlineCandidate(ObjString* name)
+{
+    Value index;
+    if (names == NULL || !tableGet(names, name, &index) || !IS_NUMBER(index)) return NULL;
+
+    return &candidates[(uint)AS_NUMBER(index)];
+}
+
+void freeInlineCandidates()
+{
+    FREE_ARRAY(InlineCandidate, candidates, capacity);
+
+    candidates = NULL;
+    count = 0;
+    capacity = 0;
+
+    if (names != NULL) freeTable(names);
+    names = NULL;
+}
+
+void markInlineCandidates()
+{
+    for (uint i = 0; i < count; i++)
+    {
+        markObject((Obj*)candidates[i].function);
+    }
+}
@@ -0,0 +1,724 @@
+#include <math.h>
+
+#include "loop_invariants.h"
+#include "memory.h"
+#include "table.h"
+#include "core.h"
+
+// An expression is invariant in a loop when it's built with operators and pure natives (see NativePurity) from
+// literals, variables and fields the loop doesn't change. Names are compared, not variables:
+//   - a variable is unchanged when the loop never assigns or declares its name, and if the loop calls anything
+//     other than natives, or yields, when the name isn't assigned anywhere in the script,
+//   - a field is unchanged when the loop doesn't set a field of that name and calls nothing but natives,
+//   - the native is called, not something else of its name, when the script never declares or assigns the
+//     name of the function or its module, and never sets a field named like the function.
+// Lists passed to a pure native may change through anything else the loop calls, or by storing items.
+
+// What a script or a loop does to a name
+#define NAME_ASSIGNED  (1 << 0)
+#define NAME_DECLARED  (1 << 1) // Also as a parameter
+#define NAME_FIELD_SET (1 << 2)
+
+typedef struct
+{
+    Table* names;
+
+    // Calls something other than a native which leaves the script's values alone, or yields
+    bool runsCode;
+    bool storesItems;
+} Effects;
+
+typedef struct
+{
+    Effects effects;
+    uint8_t cacheCount;
+
+    // Range loop whose counter only the loop itself changes, its products may be stepped
+    ForStmt* range;
+} LoopState;
+
+static Effects script;
+
+// Innermost loop of the function being looked at, NULL outside of loops
+static LoopState* loop = NULL;
+
+static void scanStatement(Effects* effects, Stmt* statement);
+static void hoistStatement(Stmt* statement);
+static bool isInvariant(Expr* expression);
+
+// region Effects
+
+static int nameFlags(Table* names, ObjString* name)
+{
+    Value flags;
+    return tableGet(names, name, &flags) ? (int)AS_NUMBER(flags) : 0;
+}
+
+static void addNameFlags(Table* names, ObjString* name, int flags)
+{
+    tableSet(names, name, NUMBER_VAL(nameFlags(names, name) | flags));
+}
+
+static void initEffects(Effects* effects)
+{
+    effects->names = ALLOCATE_TABLE();
+    initTable(effects->names);
+
+    effects->runsCode = false;
+    effects->storesItems = false;
+}
+
+static void freeEffects(Effects* effects)
+{
+    freeTable(effects->names);
+    effects->names = NULL;
+}
+
+// Only natives called by their name, or by their module's name, are known
+static NativePurity callPurity(Expr* expression)
+{
+    if (expression->type == CALL_EXPRESSION)
+    {
+        Expr* callee = ((CallExpr*)expression)->callee;
+        if (callee->type != VAR_EXPRESSION) return NATIVE_IMPURE;
+
+        ObjString* name = ((VarExpr*)callee)->name;
+        if (nameFlags(script.names, name) & (NAME_ASSIGNED | NAME_DECLARED)) return NATIVE_IMPURE;
+
+        return nativePurity(NULL, name);
+    }
+
+    DotExpr* expr = (DotExpr*)expression;
+    if (expr->instance->type != VAR_EXPRESSION) return NATIVE_IMPURE;
+
+    ObjString* module = ((VarExpr*)expr->instance)->name;
+    if (nameFlags(script.names, module) & (NAME_ASSIGNED | NAME_DECLARED)) return NATIVE_IMPURE;
+    if (nameFlags(script.names, expr->fieldName) & NAME_FIELD_SET) return NATIVE_IMPURE;
+
+    return nativePurity(module, expr->fieldName);
+}
+
+static void scanExpression(Effects* effects, Expr* expression);
+
+static void scanExpressions(Effects* effects, Node* expressions)
+{
+    for (Node* node = expressions; node != NULL; node = node->next)
+    {
+        scanExpression(effects, AS_EXPRESSION(node));
+    }
+}
+
+static void scanExpression(Effects* effects, Expr* expression)
+{
+    if (expression == NULL) return;
+
+    switch (expression->type)
+    {
+        case ASSIGN_EXPRESSION:
+            addNameFlags(effects->names, ((AssignExpr*)expression)->name, NAME_ASSIGNED);
+            scanExpression(effects, ((AssignExpr*)expression)->value);
+            break;
+
+        case BINARY_EXPRESSION:
+            scanExpression(effects, ((BinaryExpr*)expression)->left);
+            scanExpression(effects, ((BinaryExpr*)expression)->right);
+            break;
+
+        case LOGICAL_EXPRESSION:
+            scanExpression(effects, ((LogicalExpr*)expression)->left);
+            scanExpression(effects, ((LogicalExpr*)expression)->right);
+            break;
+
+        case UNARY_EXPRESSION:
+            scanExpression(effects, ((UnaryExpr*)expression)->target);
+            break;
+
+        case TERNARY_EXPRESSION:
+            scanExpression(effects, ((TernaryExpr*)expression)->condition);
+            scanExpression(effects, ((TernaryExpr*)expression)->thenBranch);
+            scanExpression(effects, ((TernaryExpr*)expression)->elseBranch);
+            break;
+
+        case CALL_EXPRESSION:
+            if (callPurity(expression) == NATIVE_IMPURE) effects->runsCode = true;
+
+            scanExpression(effects, ((CallExpr*)expression)->callee);
+            scanExpressions(effects, ((CallExpr*)expression)->args);
+            break;
+
+        case DOT_EXPRESSION:
+        {
+            DotExpr* expr = (DotExpr*)expression;
+
+            if (expr->value != NULL) addNameFlags(effects->names, expr->fieldName, NAME_FIELD_SET);
+            if (expr->isCall && callPurity(expression) == NATIVE_IMPURE) effects->runsCode = true;
+
+            scanExpression(effects, expr->instance);
+            scanExpression(effects, expr->value);
+            scanExpressions(effects, expr->args);
+            break;
+        }
+
+        case SUBSCRIPT_EXPRESSION:
+            if (((SubscriptExpr*)expression)->value != NULL) effects->storesItems = true;
+
+            scanExpression(effects, ((SubscriptExpr*)expression)->list);
+            scanExpression(effects, ((SubscriptExpr*)expression)->index);
+            scanExpression(effects, ((SubscriptExpr*)expression)->value);
+            break;
+
+        case LIST_EXPRESSION:
+            scanExpressions(effects, ((ListExpr*)expression)->expressions);
+            break;
+
+        case INTERPOLATION_EXPRESSION:
+            scanExpressions(effects, ((InterpolationExpr*)expression)->parts);
+            break;
+
+        // Code outside of the loop runs until the coroutine is resumed
+        case YIELD_EXPRESSION:
+            effects->runsCode = true;
+            scanExpression(effects, ((YieldExpr*)expression)->value);
+            break;
+
+        case RESUME_EXPRESSION:
+            effects->runsCode = true;
+            scanExpression(effects, ((ResumeExpr*)expression)->coroutine);
+            scanExpression(effects, ((ResumeExpr*)expression)->value);
+            break;
+
+        case LITERAL_EXPRESSION:
+        case VAR_EXPRESSION:
+        case BASE_EXPRESSION:
+            break;
+    }
+}
+
+static void scanStatements(Effects* effects, Node* statements)
+{
+    for (Node* node = statements; node != NULL; node = node->next)
+    {
+        scanStatement(effects, AS_STATEMENT(node));
+    }
+}
+
+static void scanFunction(Effects* effects, FunctionStmt* stmt)
+{
+    for (uint i = 0; i < stmt->paramCount; i++)
+    {
+        addNameFlags(effects->names, stmt->params[i], NAME_DECLARED);
+    }
+
+    scanStatements(effects, stmt->body);
+}
+
+static void scanStatement(Effects* effects, Stmt* statement)
+{
+    if (statement == NULL) return;
+
+    switch (statement->type)
+    {
+        case EXPRESSION_STATEMENT:
+            scanExpression(effects, ((ExpressionStmt*)statement)->expr);
+            break;
+
+        case BLOCK_STATEMENT:
+            scanStatements(effects, ((BlockStmt*)statement)->statements);
+            break;
+
+        case IF_STATEMENT:
+            scanExpression(effects, ((IfStmt*)statement)->condition);
+            scanStatement(effects, ((IfStmt*)statement)->thenBranch);
+            scanStatement(effects, ((IfStmt*)statement)->elseBranch);
+            break;
+
+        case WHILE_STATEMENT:
+            scanExpression(effects, ((WhileStmt*)statement)->condition);
+            scanStatement(effects, ((WhileStmt*)statement)->body);
+            break;
+
+        // A range's increment isn't compiled, but it stands for the counter being set
+        case FOR_STATEMENT:
+        {
+            ForStmt* stmt = (ForStmt*)statement;
+
+            scanStatement(effects, stmt->declaration);
+            scanExpression(effects, stmt->condition);
+            scanExpression(effects, stmt->increment);
+            scanStatement(effects, stmt->body);
+            break;
+        }
+
+        case FOREACH_STATEMENT:
+        {
+            ForeachStmt* stmt = (ForeachStmt*)statement;
+
+            addNameFlags(effects->names, stmt->name, NAME_DECLARED);
+            scanExpression(effects, stmt->iterable);
+            scanStatement(effects, stmt->body);
+            break;
+        }
+
+        case SWITCH_STATEMENT:
+        {
+            SwitchStmt* stmt = (SwitchStmt*)statement;
+
+            scanExpression(effects, stmt->value);
+            scanExpressions(effects, stmt->conditions);
+            scanStatements(effects, stmt->caseBodies);
+            scanStatement(effects, stmt->defaultBranch);
+            break;
+        }
+
+        case VARIABLE_STATEMENT:
+            addNameFlags(effects->names, ((VariableStmt*)statement)->name, NAME_DECLARED);
+            scanExpression(effects, ((VariableStmt*)statement)->initializer);
+            break;
+
+        case FUNCTION_STATEMENT:
+            addNameFlags(effects->names, ((FunctionStmt*)statement)->name, NAME_DECLARED);
+            scanFunction(effects, (FunctionStmt*)statement);
+            break;
+
+        case CLASS_STATEMENT:
+        {
+            ClassStmt* stmt = (ClassStmt*)statement;
+
+            addNameFlags(effects->names, stmt->name, NAME_DECLARED);
+            scanExpression(effects, stmt->parent);
+
+            // Method names aren't variables
+            for (uint i = 0; i < stmt->methods.count; i++)
+            {
+                scanFunction(effects, (FunctionStmt*)stmt->methods.values[i]);
+            }
+            break;
+        }
+
+        case RETURN_STATEMENT:
+            scanExpression(effects, ((ReturnStmt*)statement)->value);
+            break;
+
+        case TRY_STATEMENT:
+        {
+            TryStmt* stmt = (TryStmt*)statement;
+
+            if (stmt->errorName != NULL) addNameFlags(effects->names, stmt->errorName, NAME_DECLARED);
+            scanStatement(effects, stmt->body);
+            scanStatement(effects, stmt->handler);
+            break;
+        }
+
+        case CONTINUE_STATEMENT:
+        case BREAK_STATEMENT:
+            break;
+    }
+}
+
+// endregion
+
+// region Invariants
+
+static bool isUnchanged(ObjString* name)
+{
+    if (nameFlags(loop->effects.names, name) & (NAME_ASSIGNED | NAME_DECLARED)) return false;
+
+    return !loop->effects.runsCode || !(nameFlags(script.names, name) & NAME_ASSIGNED);
+}
+
+static bool areInvariant(Node* expressions)
+{
+    for (Node* node = expressions; node != NULL; node = node->next)
+    {
+        if (!isInvariant(AS_EXPRESSION(node))) return false;
+    }
+
+    return true;
+}
+
+static bool isPureCall(Expr* expression, Node* args)
+{
+    if (callPurity(expression) != NATIVE_PURE || !areInvariant(args)) return false;
+
+    bool listsMayChange = loop->effects.runsCode || loop->effects.storesItems;
+
+    for (Node* node = args; node != NULL && listsMayChange; node = node->next)
+    {
+        if (AS_EXPRESSION(node)->inferredTypes & INFERRED_OTHER) return false;
+    }
+
+    return true;
+}
+
+static bool isInvariant(Expr* expression)
+{
+    switch (expression->type)
+    {
+        case LITERAL_EXPRESSION:
+            return true;
+
+        case VAR_EXPRESSION:
+            return isUnchanged(((VarExpr*)expression)->name);
+
+        case BINARY_EXPRESSION:
+            return isInvariant(((BinaryExpr*)expression)->left) && isInvariant(((BinaryExpr*)expression)->right);
+
+        case LOGICAL_EXPRESSION:
+            return isInvariant(((LogicalExpr*)expression)->left) && isInvariant(((LogicalExpr*)expression)->right);
+
+        case UNARY_EXPRESSION:
+            return isInvariant(((UnaryExpr*)expression)->target);
+
+        case TERNARY_EXPRESSION:
+        {
+            TernaryExpr* expr = (TernaryExpr*)expression;
+            return isInvariant(expr->condition) && isInvariant(expr->thenBranch) && isInvariant(expr->elseBranch);
+        }
+
+        case INTERPOLATION_EXPRESSION:
+            return areInvariant(((InterpolationExpr*)expression)->parts);
+
+        case CALL_EXPRESSION:
+            return isPureCall(expression, ((CallExpr*)expression)->args);
+
+        case DOT_EXPRESSION:
+        {
+            DotExpr* expr = (DotExpr*)expression;
+
+            if (expr->value != NULL) return false;
+            if (expr->isCall) return isInvariant(expr->instance) && isPureCall(expression, expr->args);
+
+            return !loop->effects.runsCode &&
+                   !(nameFlags(loop->effects.names, expr->fieldName) & NAME_FIELD_SET) &&
+                   isInvariant(expr->instance);
+        }
+
+        // Every evaluation of a list creates a new one
+        default:
+            return false;
+    }
+}
+
+static bool isInteger(Expr* expression)
+{
+    if (expression->type != LITERAL_EXPRESSION || !IS_NUMBER(((LiteralExpr*)expression)->value)) return false;
+
+    double number = AS_NUMBER(((LiteralExpr*)expression)->value);
+    return number == floor(number) && fabs(number) < MAX_EXACT_INTEGER;
+}
+
+// 'counter * step' or 'step * counter'. The counter only takes integers when it starts at one, so adding
+// the step to the product stays exact. A negative step could make it 0 where the product is -0.
+static bool isInduction(Expr* expression)
+{
+    if (loop->range == NULL || expression->type != BINARY_EXPRESSION) return false;
+
+    BinaryExpr* expr = (BinaryExpr*)expression;
+    if (expr->op != TOKEN_STAR) return false;
+
+    Expr* counter = expr->left->type == VAR_EXPRESSION ? expr->left : expr->right;
+    Expr* step = counter == expr->left ? expr->right : expr->left;
+
+    ObjString* name = ((VariableStmt*)loop->range->declaration)->name;
+
+    return counter->type == VAR_EXPRESSION && ((VarExpr*)counter)->name == name &&
+           isInteger(step) && AS_NUMBER(((LiteralExpr*)step)->value) > 0;
+}
+
+// Variables and literals are as fast to get as the slot
+static bool isWorthCaching(Expr* expression)
+{
+    return expression->type != LITERAL_EXPRESSION && expression->type != VAR_EXPRESSION;
+}
+
+// endregion
+
+// region Hoisting
+
+static void hoistExpression(Expr* expression);
+
+static void hoistExpressions(Node* expressions)
+{
+    for (Node* node = expressions; node != NULL; node = node->next)
+    {
+        hoistExpression(AS_EXPRESSION(node));
+    }
+}
+
+// Caches the largest invariant parts of the expression
+static void hoistExpression(Expr* expression)
+{
+    if (expression == NULL || loop == NULL || loop->cacheCount == MAX_LOOP_CACHES) return;
+
+    bool induction = isInduction(expression);
+
+    if (induction || (isWorthCaching(expression) && isInvariant(expression)))
+    {
+        expression->cacheSlot = ++loop->cacheCount;
+        if (induction) listAdd(&loop->range->inductions, NODE_EXPRESSION_VALUE(expression));
+        return;
+    }
+
+    switch (expression->type)
+    {
+        case BINARY_EXPRESSION:
+            hoistExpression(((BinaryExpr*)expression)->left);
+            hoistExpression(((BinaryExpr*)expression)->right);
+            break;
+
+        case LOGICAL_EXPRESSION:
+            hoistExpression(((LogicalExpr*)expression)->left);
+            hoistExpression(((LogicalExpr*)expression)->right);
+            break;
+
+        case UNARY_EXPRESSION:
+            hoistExpression(((UnaryExpr*)expression)->target);
+            break;
+
+        case TERNARY_EXPRESSION:
+            hoistExpression(((TernaryExpr*)expression)->condition);
+            hoistExpression(((TernaryExpr*)expression)->thenBranch);
+            hoistExpression(((TernaryExpr*)expression)->elseBranch);
+            break;
+
+        case ASSIGN_EXPRESSION:
+            hoistExpression(((AssignExpr*)expression)->value);
+            break;
+
+        case CALL_EXPRESSION:
+            hoistExpression(((CallExpr*)expression)->callee);
+            hoistExpressions(((CallExpr*)expression)->args);
+            break;
+
+        case DOT_EXPRESSION:
+            hoistExpression(((DotExpr*)expression)->instance);
+            hoistExpression(((DotExpr*)expression)->value);
+            hoistExpressions(((DotExpr*)expression)->args);
+            break;
+
+        case SUBSCRIPT_EXPRESSION:
+            hoistExpression(((SubscriptExpr*)expression)->list);
+            hoistExpression(((SubscriptExpr*)expression)->index);
+            hoistExpression(((SubscriptExpr*)expression)->value);
+            break;
+
+        case LIST_EXPRESSION:
+            hoistExpressions(((ListExpr*)expression)->expressions);
+            break;
+
+        case INTERPOLATION_EXPRESSION:
+            hoistExpressions(((InterpolationExpr*)expression)->parts);
+            break;
+
+        case YIELD_EXPRESSION:
+            hoistExpression(((YieldExpr*)expression)->value);
+            break;
+
+        case RESUME_EXPRESSION:
+            hoistExpression(((ResumeExpr*)expression)->coroutine);
+            hoistExpression(((ResumeExpr*)expression)->value);
+            break;
+
+        case LITERAL_EXPRESSION:
+        case VAR_EXPRESSION:
+        case BASE_EXPRESSION:
+            break;
+    }
+}
+
+static void hoistStatements(Node* statements)
+{
+    for (Node* node = statements; node != NULL; node = node->next)
+    {
+        hoistStatement(AS_STATEMENT(node));
+    }
+}
+
+// Loops of a function keep their slots in its own frame
+static void hoistFunction(FunctionStmt* stmt)
+{
+    LoopState* enclosing = loop;
+    loop = NULL;
+
+    hoistStatements(stmt->body);
+
+    loop = enclosing;
+}
+
+// The condition, the increment and the body are the loop's, what a range or foreach evaluates once isn't
+static void optimizeLoop(Stmt* statement)
+{
+    LoopState state;
+    initEffects(&state.effects);
+    state.cacheCount = 0;
+    state.range = NULL;
+
+    LoopState* enclosing = loop;
+    loop = &state;
+
+    switch (statement->type)
+    {
+        case WHILE_STATEMENT:
+        {
+            WhileStmt* stmt = (WhileStmt*)statement;
+
+            scanExpression(&state.effects, stmt->condition);
+            scanStatement(&state.effects, stmt->body);
+
+            hoistExpression(stmt->condition);
+            hoistStatement(stmt->body);
+
+            stmt->cacheCount = state.cacheCount;
+            break;
+        }
+
+        case FOR_STATEMENT:
+        {
+            ForStmt* stmt = (ForStmt*)statement;
+
+            scanStatement(&state.effects, stmt->body);
+
+            if (stmt->isRange)
+            {
+                VariableStmt* declaration = (VariableStmt*)stmt->declaration;
+                double start = isInteger(declaration->initializer) ?
+                               AS_NUMBER(((LiteralExpr*)declaration->initializer)->value) : NAN;
+
+                if (!isnan(start) && !signbit(start) && isUnchanged(declaration->name)) state.range = stmt;
+
+                // Set by every iteration
+                addNameFlags(state.effects.names, declaration->name, NAME_DECLARED);
+            }
+            else
+            {
+                scanExpression(&state.effects, stmt->condition);
+                scanExpression(&state.effects, stmt->increment);
+
+                hoistExpression(stmt->condition);
+                hoistExpression(stmt->increment);
+            }
+
+            hoistStatement(stmt->body);
+
+            stmt->cacheCount = state.cacheCount;
+            break;
+        }
+
+        case FOREACH_STATEMENT:
+        {
+            ForeachStmt* stmt = (ForeachStmt*)statement;
+
+            scanStatement(&state.effects, stmt->body);
+            addNameFlags(state.effects.names, stmt->name, NAME_DECLARED);
+
+            hoistStatement(stmt->body);
+
+            stmt->cacheCount = state.cacheCount;
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    loop = enclosing;
+    freeEffects(&state.effects);
+}
+
+static void hoistStatement(Stmt* statement)
+{
+    if (statement == NULL) return;
+
+    switch (statement->type)
+    {
+        case EXPRESSION_STATEMENT:
+            hoistExpression(((ExpressionStmt*)statement)->expr);
+            break;
+
+        case BLOCK_STATEMENT:
+            hoistStatements(((BlockStmt*)statement)->statements);
+            break;
+
+        case IF_STATEMENT:
+            hoistExpression(((IfStmt*)statement)->condition);
+            hoistStatement(((IfStmt*)statement)->thenBranch);
+            hoistStatement(((IfStmt*)statement)->elseBranch);
+            break;
+
+        case WHILE_STATEMENT:
+            optimizeLoop(statement);
+            break;
+
+        case FOR_STATEMENT:
+        {
+            ForStmt* stmt = (ForStmt*)statement;
+
+            hoistStatement(stmt->declaration);
+            if (stmt->isRange) hoistExpression(((BinaryExpr*)stmt->condition)->right);
+
+            optimizeLoop(statement);
+            break;
+        }
+
+        case FOREACH_STATEMENT:
+            hoistExpression(((ForeachStmt*)statement)->iterable);
+            optimizeLoop(statement);
+            break;
+
+        case SWITCH_STATEMENT:
+        {
+            SwitchStmt* stmt = (SwitchStmt*)statement;
+
+            hoistExpression(stmt->value);
+            hoistExpressions(stmt->conditions);
+            hoistStatements(stmt->caseBodies);
+            hoistStatement(stmt->defaultBranch);
+            break;
+        }
+
+        case VARIABLE_STATEMENT:
+            hoistExpression(((VariableStmt*)statement)->initializer);
+            break;
+
+        case RETURN_STATEMENT:
+            hoistExpression(((ReturnStmt*)statement)->value);
+            break;
+
+        case TRY_STATEMENT:
+            hoistStatement(((TryStmt*)statement)->body);
+            hoistStatement(((TryStmt*)statement)->handler);
+            break;
+
+        case FUNCTION_STATEMENT:
+            hoistFunction((FunctionStmt*)statement);
+            break;
+
+        case CLASS_STATEMENT:
+        {
+            ClassStmt* stmt = (ClassStmt*)statement;
+
+            for (uint i = 0; i < stmt->methods.count; i++)
+            {
+                hoistFunction((FunctionStmt*)stmt->methods.values[i]);
+            }
+            break;
+        }
+
+        case CONTINUE_STATEMENT:
+        case BREAK_STATEMENT:
+            break;
+    }
+}
+
+// endregion
+
+void findLoopInvariants(Node* statements)
+{
+    initEffects(&script);
+    scanStatements(&script, statements);
+
+    hoistStatements(statements);
+
+    freeEffects(&script);
+    loop = NULL;
+}
@@ -0,0 +1,300 @@
+#include "peephole.h"
+#include "memory.h"
+
+#define MAX_THREADED_JUMPS 16
+
+typedef struct
+{
+    uint offset;
+    uint8_t length;
+
+    bool isLeader; // Reached by a jump or an exception, so it can't be merged with what comes before it
+    bool removed;
+
+    uint target; // Only for jumps
+    uint newOffset;
+} Instruction;
+
+// region Jumps
+
+static bool isJump(uint8_t instruction)
+{
+    return instruction == OP_JUMP || instruction == OP_JUMP_IF_FALSE ||
+           instruction == OP_JUMP_IF_TRUE || instruction == OP_LOOP ||
+           instruction == OP_POP_JUMP_IF_FALSE || instruction == OP_POP_JUMP_IF_TRUE ||
+           instruction == OP_POP_LOOP_IF_TRUE || instruction == OP_FOREACH_NEXT ||
+           instruction == OP_FOR_RANGE || instruction == OP_GET_CACHED;
+}
+
+static bool isBackward(uint8_t instruction)
+{
+    return instruction == OP_LOOP || instruction == OP_POP_LOOP_IF_TRUE;
+}
+
+// The jump is in the last two bytes of the instruction, relative to its end
+static uint readTarget(Chunk* chunk, uint offset)
+{
+    uint end = offset + instructionLength(chunk->code[offset]);
+    uint16_t jump = (uint16_t)((chunk->code[end - 2] << 8) | chunk->code[end - 1]);
+
+    if (isBackward(chunk->code[offset]))
+    {
+        return end - jump;
+    }
+
+    return end + jump;
+}
+
+static void writeTarget(Chunk* chunk, uint offset, uint target)
+{
+    uint end = offset + instructionLength(chunk->code[offset]);
+    uint jump = isBackward(chunk->code[offset]) ? end - target : target - end;
+
+    chunk->code[end - 2] = (jump >> 8) & 0xff;
+    chunk->code[end - 1] = jump & 0xff;
+}
+
+// A jump landing on another jump goes straight to where that one would go.
+// Conditional jumps which don't pop, landing on another conditional jump, know how the value will be tested again.
+static void threadJumps(Chunk* chunk)
+{
+    for (uint offset = 0; offset < chunk->codeCount; offset += instructionLength(chunk->code[offset]))
+    {
+        uint8_t instruction = chunk->code[offset];
+        if (!isJump(instruction) || isBackward(instruction)) continue;
+
+        uint target = readTarget(chunk, offset);
+
+        for (int i = 0; i < MAX_THREADED_JUMPS && target < chunk->codeCount; i++)
+        {
+            uint8_t next = chunk->code[target];
+
+            bool testsAgain = instruction == OP_JUMP_IF_FALSE || instruction == OP_JUMP_IF_TRUE;
+
+            if (next == OP_JUMP || (testsAgain && next == instruction))
+            {
+                target = readTarget(chunk, target);
+            }
+            else if (testsAgain && (next == OP_JUMP_IF_FALSE || next == OP_JUMP_IF_TRUE))
+            {
+                // The opposite test, it won't jump
+                target += 3;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        if (target > offset && target - offset - 3 <= UINT16_MAX)
+        {
+            writeTarget(chunk, offset, target);
+        }
+    }
+}
+
+// endregion
+
+// region Removing
+
+static bool pushesWithoutEffect(uint8_t instruction)
+{
+    return instruction == OP_CONSTANT || instruction == OP_NULL ||
+           instruction == OP_TRUE || instruction == OP_FALSE || instruction == OP_GET_LOCAL ||
+           instruction == OP_DUP;
+}
+
+static bool endsBlock(uint8_t instruction)
+{
+    return instruction == OP_JUMP || instruction == OP_LOOP || instruction == OP_RETURN;
+}
+
+static uint findInstruction(Instruction* instructions, uint count, uint offset)
+{
+    uint low = 0;
+    uint high = count;
+
+    while (low < high)
+    {
+        uint middle = (low + high) / 2;
+
+        if (instructions[middle].offset < offset) low = middle + 1;
+        else high = middle;
+    }
+
+    return low;
+}
+
+static void markLeader(Instruction* instructions, uint count, uint offset)
+{
+    uint index = findInstruction(instructions, count, offset);
+    if (index < count) instructions[index].isLeader = true;
+}
+
+// Offsets of removed instructions move to the next instruction that is kept
+static uint newOffset(Instruction* instructions, uint count, uint offset, uint newCount)
+{
+    for (uint i = findInstruction(instructions, count, offset); i < count; i++)
+    {
+        if (!instructions[i].removed) return instructions[i].newOffset;
+    }
+
+    return newCount;
+}
+
+static void markRemoved(Chunk* chunk, Instruction* instructions, uint count)
+{
+    for (uint i = 0; i < count; i++)
+    {
+        Instruction* current = &instructions[i];
+        if (current->removed) continue;
+
+        uint8_t instruction = chunk->code[current->offset];
+
+        // Nothing falls through to the code after it, it stays only if something jumps there
+        if (endsBlock(instruction))
+        {
+            for (uint j = i + 1; j < count && !instructions[j].isLeader; j++)
+            {
+                instructions[j].removed = true;
+            }
+        }
+
+        if (instruction == OP_JUMP && current->target == current->offset + current->length)
+        {
+            current->removed = true;
+            continue;
+        }
+
+        if (i + 1 >= count || instructions[i + 1].isLeader || instructions[i + 1].removed) continue;
+
+        uint8_t next = chunk->code[instructions[i + 1].offset];
+
+        if ((pushesWithoutEffect(instruction) && next == OP_POP) ||
+            (instruction == OP_SCOPE_START && next == OP_SCOPE_END))
+        {
+            current->removed = true;
+            instructions[i + 1].removed = true;
+        }
+    }
+}
+
+// One round of removals, returns false if there was nothing to remove
+static bool removeInstructions(Chunk* chunk)
+{
+    uint count = 0;
+    for (uint offset = 0; offset < chunk->codeCount; offset += instructionLength(chunk->code[offset]))
+    {
+        count++;
+    }
+
+    Instruction* instructions = ALLOCATE(Instruction, count);
+
+    uint index = 0;
+    for (uint offset = 0; offset < chunk->codeCount; offset += instructionLength(chunk->code[offset]))
+    {
+        Instruction* current = &instructions[index++];
+
+        current->offset = offset;
+        current->length = instructionLength(chunk->code[offset]);
+        current->isLeader = false;
+        current->removed = false;
+        current->target = isJump(chunk->code[offset]) ? readTarget(chunk, offset) : 0;
+    }
+
+    for (uint i = 0; i < count; i++)
+    {
+        if (isJump(chunk->code[instructions[i].offset]))
+        {
+            markLeader(instructions, count, instructions[i].target);
+        }
+    }
+
+    for (uint i = 0; i < chunk->handlerCount; i++)
+    {
+        markLeader(instructions, count, chunk->handlers[i].handler);
+    }
+
+    for (uint i = 0; i < chunk->switchCount; i++)
+    {
+        SwitchTable* table = &chunk->switches[i];
+
+        for (uint j = 0; j < table->count; j++)
+        {
+            if (table->cases[j].target != NO_SWITCH_TARGET) markLeader(instructions, count, table->cases[j].target);
+        }
+    }
+
+    markRemoved(chunk, instructions, count);
+
+    uint newCount = 0;
+    for (uint i = 0; i < count; i++)
+    {
+        instructions[i].newOffset = newCount;
+        if (!instructions[i].removed) newCount += instructions[i].length;
+    }
+
+    if (newCount == chunk->codeCount)
+    {
+        FREE_ARRAY(Instruction, instructions, count);
+        return false;
+    }
+
+    // New offsets are never past old ones, so the code can be moved down in place
+    for (uint i = 0; i < count; i++)
+    {
+        Instruction* current = &instructions[i];
+        if (current->removed) continue;
+
+        for (uint byte = 0; byte < current->length; byte++)
+        {
+            chunk->code[current->newOffset + byte] = chunk->code[current->offset + byte];
+            chunk->lines[current->newOffset + byte] = chunk->lines[current->offset + byte];
+        }
+
+        if (isJump(chunk->code[current->newOffset]))
+        {
+            writeTarget(chunk, current->newOffset, newOffset(instructions, count, current->target, newCount));
+        }
+    }
+
+    for (uint i = 0; i < chunk->handlerCount; i++)
+    {
+        ExceptionHandler* handler = &chunk->handlers[i];
+
+        handler->start = newOffset(instructions, count, handler->start, newCount);
+        handler->end = newOffset(instructions, count, handler->end, newCount);
+        handler->handler = newOffset(instructions, count, handler->handler, newCount);
+    }
+
+    for (uint i = 0; i < chunk->switchCount; i++)
+    {
+        SwitchTable* table = &chunk->switches[i];
+
+        for (uint j = 0; j < table->count; j++)
+        {
+            SwitchCase* entry = &table->cases[j];
+            if (entry->target != NO_SWITCH_TARGET) entry->target = newOffset(instructions, count, entry->target, newCount);
+        }
+    }
+
+    chunk->codeCount = newCount;
+    chunk->lineCount = newCount;
+
+    FREE_ARRAY(Instruction, instructions, count);
+    return true;
+}
+
+// endregion
+
+uint optimizeChunk(Chunk* chunk)
+{
+    uint before = chunk->codeCount;
+
+    threadJumps(chunk);
+
+    // Removing code can leave new jumps to the next instruction or pairs that cancel out
+    while (removeInstructions(chunk));
+
+    return before - chunk->codeCount;
+}
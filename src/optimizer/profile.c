@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "profile.h"
+#include "type_inference.h"
+#include "garbage_collector.h"
+#include "memory.h"
+#include "chunk.h"
+#include "vm.h"
+
+// Profiles are text files, one line per kind of feedback a site has:
+//
+//   wally-profile <version> <hash of the source>
+//   types <site> <left> <right>
+//   branch <site> <truthy> <falsy>
+//   receiver <site> <uses> <class> <field>
+
+#define PROFILE_VERSION 1
+#define MAX_PROFILE_NAME 255
+
+bool profiling = false;
+
+typedef struct
+{
+    SiteFeedback* feedback;
+    uint capacity;
+} Sites;
+
+// Recorded by this run, and loaded for the emitter to use. Kept apart, so code compiled lazily
+// while profiling doesn't depend on what this run has seen so far.
+static Sites recorded = { NULL, 0 };
+static Sites loaded = { NULL, 0 };
+
+static SiteFeedback* feedbackAt(Sites* sites, uint site)
+{
+    if (site >= sites->capacity)
+    {
+        uint oldCapacity = sites->capacity;
+        uint newCapacity = GROW_CAPACITY(oldCapacity);
+        while (newCapacity <= site) newCapacity = GROW_CAPACITY(newCapacity);
+
+        // Growing can collect garbage, which marks the entries counted in capacity
+        sites->feedback = GROW_ARRAY(SiteFeedback, sites->feedback, oldCapacity, newCapacity);
+        memset(&sites->feedback[oldCapacity], 0, (newCapacity - oldCapacity) * sizeof(SiteFeedback));
+        sites->capacity = newCapacity;
+    }
+
+    return &sites->feedback[site];
+}
+
+static bool isEmpty(SiteFeedback* feedback)
+{
+    return feedback->leftTypes == 0 && feedback->rightTypes == 0 &&
+           feedback->truthy == 0 && feedback->falsy == 0 && feedback->receiver == NULL;
+}
+
+// region Recording
+
+static void recordReceiver(SiteFeedback* feedback, Value receiver, Value field)
+{
+    if (!IS_INSTANCE(receiver)) return;
+
+    ObjString* name = AS_INSTANCE(receiver)->klass->name;
+
+    if (feedback->receiver == NULL)
+    {
+        feedback->receiver = name;
+        feedback->field = AS_STRING(field);
+    }
+
+    if (feedback->receiver == name) feedback->uses++;
+}
+
+void recordFeedback(uint site, uint8_t* next)
+{
+    SiteFeedback* feedback = feedbackAt(&recorded, site);
+    Value* constants = vm.currentFunction->chunk.constants.values;
+
+    switch (*next)
+    {
+        case OP_POP_JUMP_IF_FALSE:
+        case OP_POP_JUMP_IF_TRUE:
+        {
+            Value condition = vm.stackTop[-1];
+
+            if (IS_NULL(condition) || (IS_BOOL(condition) && !AS_BOOL(condition))) feedback->falsy++;
+            else feedback->truthy++;
+
+            break;
+        }
+
+        case OP_INVOKE:
+            recordReceiver(feedback, vm.stackTop[-1 - next[2]], constants[next[1]]);
+            break;
+
+        case OP_GET_PROPERTY:
+            recordReceiver(feedback, vm.stackTop[-1], constants[next[1]]);
+            break;
+
+        // Arithmetic and comparisons
+        default:
+            feedback->leftTypes |= valueTypes(vm.stackTop[-2]);
+            feedback->rightTypes |= valueTypes(vm.stackTop[-1]);
+            break;
+    }
+}
+
+// endregion
+
+// region Using
+
+SiteFeedback* getSiteFeedback(uint site)
+{
+    if (site >= loaded.capacity || isEmpty(&loaded.feedback[site])) return NULL;
+    return &loaded.feedback[site];
+}
+
+uint methodUses(ObjString* className, ObjString* method)
+{
+    uint uses = 0;
+
+    for (uint i = 0; i < loaded.capacity; i++)
+    {
+        SiteFeedback* feedback = &loaded.feedback[i];
+
+        // Strings are interned
+        if (feedback->receiver == className && feedback->field == method) uses += feedback->uses;
+    }
+
+    return uses;
+}
+
+// endregion
+
+// region Files
+
+static uint32_t hashSource(const char* source)
+{
+    return hashString(source, strlen(source));
+}
+
+bool writeProfile(const char* path, const char* source)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL) return false;
+
+    fprintf(file, "wally-profile %d %u\n", PROFILE_VERSION, hashSource(source));
+
+    for (uint i = 0; i < recorded.capacity; i++)
+    {
+        SiteFeedback* feedback = &recorded.feedback[i];
+
+        if (feedback->leftTypes != 0 || feedback->rightTypes != 0)
+        {
+            fprintf(file, "types %u %u %u\n", i, feedback->leftTypes, feedback->rightTypes);
+        }
+
+        if (feedback->truthy != 0 || feedback->falsy != 0)
+        {
+            fprintf(file, "branch %u %u %u\n", i, feedback->truthy, feedback->falsy);
+        }
+
+        if (feedback->receiver != NULL)
+        {
+            fprintf(file, "receiver %u %u %s %s\n", i, feedback->uses,
+                    feedback->receiver->chars, feedback->field->chars);
+        }
+    }
+
+    return fclose(file) == 0;
+}
+
+static bool readLine(FILE* file, const char* kind)
+{
+    uint site;
+    if (fscanf(file, "%u", &site) != 1 || site > MAX_PROFILED_SITE) return false;
+
+    if (strcmp(kind, "types") == 0)
+    {
+        uint left, right;
+        if (fscanf(file, "%u %u", &left, &right) != 2) return false;
+
+        SiteFeedback* feedback = feedbackAt(&loaded, site);
+        feedback->leftTypes = (uint8_t)left;
+        feedback->rightTypes = (uint8_t)right;
+    }
+    else if (strcmp(kind, "branch") == 0)
+    {
+        SiteFeedback* feedback = feedbackAt(&loaded, site);
+        if (fscanf(file, "%u %u", &feedback->truthy, &feedback->falsy) != 2) return false;
+    }
+    else if (strcmp(kind, "receiver") == 0)
+    {
+        uint uses;
+        char className[MAX_PROFILE_NAME + 1];
+        char field[MAX_PROFILE_NAME + 1];
+
+        if (fscanf(file, "%u %255s %255s", &uses, className, field) != 3) return false;
+
+        SiteFeedback* feedback = feedbackAt(&loaded, site);
+
+        // Stored right away, so the first string is marked while the second one is allocated
+        feedback->uses = uses;
+        feedback->receiver = copyString(className, strlen(className));
+        feedback->field = copyString(field, strlen(field));
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool readProfile(const char* path, const char* source)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Could not open profile \"%s\".\n", path);
+        return false;
+    }
+
+    int version;
+    uint32_t hash;
+
+    if (fscanf(file, "wally-profile %d %u", &version, &hash) != 2 || version != PROFILE_VERSION)
+    {
+        fprintf(stderr, "\"%s\" is not a profile, it's ignored.\n", path);
+        fclose(file);
+        return false;
+    }
+
+    if (hash != hashSource(source))
+    {
+        fprintf(stderr, "Profile \"%s\" was recorded for a different script, it's ignored.\n", path);
+        fclose(file);
+        return false;
+    }
+
+    char kind[16];
+
+    while (fscanf(file, "%15s", kind) == 1)
+    {
+        if (!readLine(file, kind))
+        {
+            fprintf(stderr, "Profile \"%s\" is malformed, the rest of it is ignored.\n", path);
+            break;
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+// endregion
+
+static void markSites(Sites* sites)
+{
+    for (uint i = 0; i < sites->capacity; i++)
+    {
+        markObject((Obj*)sites->feedback[i].receiver);
+        markObject((Obj*)sites->feedback[i].field);
+    }
+}
+
+void markProfile()
+{
+    markSites(&recorded);
+    markSites(&loaded);
+}
+
+void freeProfile()
+{
+    FREE_ARRAY(SiteFeedback, recorded.feedback, recorded.capacity);
+    FREE_ARRAY(SiteFeedback, loaded.feedback, loaded.capacity);
+
+    recorded.feedback = NULL;
+    recorded.capacity = 0;
+    loaded.feedback = NULL;
+    loaded.capacity = 0;
+}
@@ -0,0 +1,502 @@
+#include "tree_shaking.h"
+#include "memory.h"
+#include "table.h"
+
+// Every reference in a script is a name, so a function or class is used when code which runs reads or assigns
+// its name, and a method when code which runs gets, sets or calls a field of its name. Scopes aren't told apart,
+// a name used anywhere keeps all the declarations of it.
+//
+// Declarations whose removal could hide a runtime error are kept, those are names declared twice in one
+// scope and classes inheriting from something which isn't a class the script declares.
+
+bool treeShakingEnabled = true;
+
+typedef struct
+{
+    Stmt* declaration;
+    bool isMethod;
+} Declaration;
+
+// Declarations inside code which runs, not known to be used yet
+static Declaration* pending = NULL;
+static uint pendingCount = 0;
+static uint pendingCapacity = 0;
+
+static Table* usedNames = NULL;
+static Table* usedMethods = NULL;
+
+// Of classes declared in code which runs
+static Table* classNames = NULL;
+
+static ObjString* initName = NULL;
+
+static void scanStatement(Stmt* statement);
+static void scanExpression(Expr* expression);
+
+// region Names
+
+static void useName(Table* names, ObjString* name)
+{
+    tableSet(names, name, TRUE_VAL);
+}
+
+static bool isUsed(Table* names, ObjString* name)
+{
+    Value value;
+    return tableGet(names, name, &value);
+}
+
+static bool isUsedMethod(ObjString* name)
+{
+    return isUsed(usedMethods, name) || name == initName;
+}
+
+static ObjString* declaredName(Stmt* statement)
+{
+    switch (statement->type)
+    {
+        case VARIABLE_STATEMENT: return ((VariableStmt*)statement)->name;
+        case FUNCTION_STATEMENT: return ((FunctionStmt*)statement)->name;
+        case CLASS_STATEMENT:    return ((ClassStmt*)statement)->name;
+
+        default:
+            return NULL;
+    }
+}
+
+static void addPending(Stmt* declaration, bool isMethod)
+{
+    if (pendingCapacity < pendingCount + 1)
+    {
+        uint oldCapacity = pendingCapacity;
+        pendingCapacity = GROW_CAPACITY(oldCapacity);
+        pending = GROW_ARRAY(Declaration, pending, oldCapacity, pendingCapacity);
+    }
+
+    pending[pendingCount].declaration = declaration;
+    pending[pendingCount].isMethod = isMethod;
+    pendingCount++;
+}
+
+// endregion
+
+// region Scanning
+
+// Functions and classes wait until something uses them, the rest of the statements run
+static void scanStatements(Node* statements)
+{
+    Table* declared = ALLOCATE_TABLE();
+    initTable(declared);
+
+    for (Node* node = statements; node != NULL; node = node->next)
+    {
+        Stmt* statement = AS_STATEMENT(node);
+
+        ObjString* name = declaredName(statement);
+        if (name != NULL)
+        {
+            // Declaring it again is an error at runtime
+            if (isUsed(declared, name)) useName(usedNames, name);
+            useName(declared, name);
+        }
+
+        switch (statement->type)
+        {
+            case FUNCTION_STATEMENT:
+                addPending(statement, false);
+                break;
+
+            case CLASS_STATEMENT:
+                useName(classNames, name);
+                addPending(statement, false);
+                break;
+
+            default:
+                scanStatement(statement);
+                break;
+        }
+    }
+
+    freeTable(declared);
+}
+
+static void scanExpressions(Node* expressions)
+{
+    for (Node* node = expressions; node != NULL; node = node->next)
+    {
+        scanExpression(AS_EXPRESSION(node));
+    }
+}
+
+static void scanExpression(Expr* expression)
+{
+    if (expression == NULL) return;
+
+    switch (expression->type)
+    {
+        case VAR_EXPRESSION:
+            useName(usedNames, ((VarExpr*)expression)->name);
+            break;
+
+        case ASSIGN_EXPRESSION:
+            useName(usedNames, ((AssignExpr*)expression)->name);
+            scanExpression(((AssignExpr*)expression)->value);
+            break;
+
+        case CALL_EXPRESSION:
+            scanExpression(((CallExpr*)expression)->callee);
+            scanExpressions(((CallExpr*)expression)->args);
+            break;
+
+        case DOT_EXPRESSION:
+        {
+            DotExpr* expr = (DotExpr*)expression;
+
+            useName(usedMethods, expr->fieldName);
+            scanExpression(expr->instance);
+            scanExpression(expr->value);
+            scanExpressions(expr->args);
+            break;
+        }
+
+        case BASE_EXPRESSION:
+            useName(usedMethods, ((BaseExpr*)expression)->methodName);
+            break;
+
+        case BINARY_EXPRESSION:
+            scanExpression(((BinaryExpr*)expression)->left);
+            scanExpression(((BinaryExpr*)expression)->right);
+            break;
+
+        case LOGICAL_EXPRESSION:
+            scanExpression(((LogicalExpr*)expression)->left);
+            scanExpression(((LogicalExpr*)expression)->right);
+            break;
+
+        case UNARY_EXPRESSION:
+            scanExpression(((UnaryExpr*)expression)->target);
+            break;
+
+        case TERNARY_EXPRESSION:
+            scanExpression(((TernaryExpr*)expression)->condition);
+            scanExpression(((TernaryExpr*)expression)->thenBranch);
+            scanExpression(((TernaryExpr*)expression)->elseBranch);
+            break;
+
+        case SUBSCRIPT_EXPRESSION:
+            scanExpression(((SubscriptExpr*)expression)->list);
+            scanExpression(((SubscriptExpr*)expression)->index);
+            scanExpression(((SubscriptExpr*)expression)->value);
+            break;
+
+        case LIST_EXPRESSION:
+            scanExpressions(((ListExpr*)expression)->expressions);
+            break;
+
+        case INTERPOLATION_EXPRESSION:
+            scanExpressions(((InterpolationExpr*)expression)->parts);
+            break;
+
+        case YIELD_EXPRESSION:
+            scanExpression(((YieldExpr*)expression)->value);
+            break;
+
+        case RESUME_EXPRESSION:
+            scanExpression(((ResumeExpr*)expression)->coroutine);
+            scanExpression(((ResumeExpr*)expression)->value);
+            break;
+
+        case LITERAL_EXPRESSION:
+            break;
+    }
+}
+
+static void scanStatement(Stmt* statement)
+{
+    if (statement == NULL) return;
+
+    switch (statement->type)
+    {
+        case EXPRESSION_STATEMENT:
+            scanExpression(((ExpressionStmt*)statement)->expr);
+            break;
+
+        case BLOCK_STATEMENT:
+            scanStatements(((BlockStmt*)statement)->statements);
+            break;
+
+        case IF_STATEMENT:
+            scanExpression(((IfStmt*)statement)->condition);
+            scanStatement(((IfStmt*)statement)->thenBranch);
+            scanStatement(((IfStmt*)statement)->elseBranch);
+            break;
+
+        case WHILE_STATEMENT:
+            scanExpression(((WhileStmt*)statement)->condition);
+            scanStatement(((WhileStmt*)statement)->body);
+            break;
+
+        case FOR_STATEMENT:
+        {
+            ForStmt* stmt = (ForStmt*)statement;
+
+            scanStatement(stmt->declaration);
+            scanExpression(stmt->condition);
+            scanExpression(stmt->increment);
+            scanStatement(stmt->body);
+            break;
+        }
+
+        case FOREACH_STATEMENT:
+            scanExpression(((ForeachStmt*)statement)->iterable);
+            scanStatement(((ForeachStmt*)statement)->body);
+            break;
+
+        case SWITCH_STATEMENT:
+        {
+            SwitchStmt* stmt = (SwitchStmt*)statement;
+
+            scanExpression(stmt->value);
+            scanExpressions(stmt->conditions);
+
+            for (Node* node = stmt->caseBodies; node != NULL; node = node->next)
+            {
+                scanStatement(AS_STATEMENT(node));
+            }
+
+            scanStatement(stmt->defaultBranch);
+            break;
+        }
+
+        case VARIABLE_STATEMENT:
+            scanExpression(((VariableStmt*)statement)->initializer);
+            break;
+
+        // Only reached as the single statement of a branch or a loop, where nothing else could use it
+        case FUNCTION_STATEMENT:
+        case CLASS_STATEMENT:
+            addPending(statement, false);
+            break;
+
+        case RETURN_STATEMENT:
+            scanExpression(((ReturnStmt*)statement)->value);
+            break;
+
+        case TRY_STATEMENT:
+            scanStatement(((TryStmt*)statement)->body);
+            scanStatement(((TryStmt*)statement)->handler);
+            break;
+
+        case CONTINUE_STATEMENT:
+        case BREAK_STATEMENT:
+            break;
+    }
+}
+
+// Scans the code of a pending declaration which turned out to be used
+static void useDeclaration(Stmt* declaration)
+{
+    if (declaration->type == FUNCTION_STATEMENT)
+    {
+        scanStatements(((FunctionStmt*)declaration)->body);
+        return;
+    }
+
+    ClassStmt* klass = (ClassStmt*)declaration;
+    scanExpression(klass->parent);
+
+    for (uint i = 0; i < klass->methods.count; i++)
+    {
+        addPending(klass->methods.values[i], true);
+    }
+}
+
+static bool isUsedDeclaration(Declaration* declaration)
+{
+    Stmt* statement = declaration->declaration;
+
+    if (declaration->isMethod) return isUsedMethod(((FunctionStmt*)statement)->name);
+    return isUsed(usedNames, declaredName(statement));
+}
+
+// Scanning a declaration can make others used, until nothing changes
+static void findUsedDeclarations()
+{
+    bool changed = true;
+
+    while (changed)
+    {
+        changed = false;
+
+        // Scanning adds more, so the array may move
+        for (uint i = 0; i < pendingCount; i++)
+        {
+            if (pending[i].declaration == NULL || !isUsedDeclaration(&pending[i])) continue;
+
+            Stmt* declaration = pending[i].declaration;
+            pending[i].declaration = NULL;
+
+            useDeclaration(declaration);
+            changed = true;
+        }
+
+        if (changed) continue;
+
+        // Inheriting is checked when the class is declared
+        for (uint i = 0; i < pendingCount; i++)
+        {
+            Stmt* declaration = pending[i].declaration;
+            if (declaration == NULL || declaration->type != CLASS_STATEMENT) continue;
+
+            Expr* parent = ((ClassStmt*)declaration)->parent;
+            if (parent == NULL) continue;
+
+            if (parent->type != VAR_EXPRESSION || !isUsed(classNames, ((VarExpr*)parent)->name))
+            {
+                useName(usedNames, ((ClassStmt*)declaration)->name);
+                changed = true;
+            }
+        }
+    }
+}
+
+// endregion
+
+// region Removal
+
+static uint removeFromStatement(Stmt* statement);
+
+static bool isUnused(Stmt* statement)
+{
+    if (statement->type != FUNCTION_STATEMENT && statement->type != CLASS_STATEMENT) return false;
+    return !isUsed(usedNames, declaredName(statement));
+}
+
+// The nodes are freed, the statements are left like the rest of the tree
+static uint removeFromStatements(Node** statements)
+{
+    uint removed = 0;
+    Node** link = statements;
+
+    while (*link != NULL)
+    {
+        Node* node = *link;
+
+        if (isUnused(AS_STATEMENT(node)))
+        {
+            *link = node->next;
+            FREE(Node, node);
+            removed++;
+            continue;
+        }
+
+        removed += removeFromStatement(AS_STATEMENT(node));
+        link = &node->next;
+    }
+
+    return removed;
+}
+
+static uint removeMethods(ClassStmt* klass)
+{
+    uint kept = 0;
+    uint removed = 0;
+
+    for (uint i = 0; i < klass->methods.count; i++)
+    {
+        FunctionStmt* method = (FunctionStmt*)klass->methods.values[i];
+
+        if (!isUsedMethod(method->name))
+        {
+            removed++;
+            continue;
+        }
+
+        removed += removeFromStatements(&method->body);
+        klass->methods.values[kept++] = (Stmt*)method;
+    }
+
+    klass->methods.count = kept;
+    return removed;
+}
+
+static uint removeFromStatement(Stmt* statement)
+{
+    if (statement == NULL) return 0;
+
+    switch (statement->type)
+    {
+        case BLOCK_STATEMENT:
+            return removeFromStatements(&((BlockStmt*)statement)->statements);
+
+        case IF_STATEMENT:
+            return removeFromStatement(((IfStmt*)statement)->thenBranch) +
+                   removeFromStatement(((IfStmt*)statement)->elseBranch);
+
+        case WHILE_STATEMENT:
+            return removeFromStatement(((WhileStmt*)statement)->body);
+
+        case FOR_STATEMENT:
+            return removeFromStatement(((ForStmt*)statement)->body);
+
+        case FOREACH_STATEMENT:
+            return removeFromStatement(((ForeachStmt*)statement)->body);
+
+        case TRY_STATEMENT:
+            return removeFromStatement(((TryStmt*)statement)->body) +
+                   removeFromStatement(((TryStmt*)statement)->handler);
+
+        // Bodies are paired with the conditions, only the statements inside them are removed
+        case SWITCH_STATEMENT:
+        {
+            SwitchStmt* stmt = (SwitchStmt*)statement;
+            uint removed = removeFromStatement(stmt->defaultBranch);
+
+            for (Node* node = stmt->caseBodies; node != NULL; node = node->next)
+            {
+                removed += removeFromStatement(AS_STATEMENT(node));
+            }
+
+            return removed;
+        }
+
+        case FUNCTION_STATEMENT:
+            return removeFromStatements(&((FunctionStmt*)statement)->body);
+
+        case CLASS_STATEMENT:
+            return removeMethods((ClassStmt*)statement);
+
+        default:
+            return 0;
+    }
+}
+
+// endregion
+
+uint removeUnusedDeclarations(Node** statements)
+{
+    usedNames = ALLOCATE_TABLE();
+    usedMethods = ALLOCATE_TABLE();
+    classNames = ALLOCATE_TABLE();
+    initTable(usedNames);
+    initTable(usedMethods);
+    initTable(classNames);
+
+    initName = copyString("init", 4);
+
+    scanStatements(*statements);
+    findUsedDeclarations();
+
+    uint removed = removeFromStatements(statements);
+
+    FREE_ARRAY(Declaration, pending, pendingCapacity);
+    pending = NULL;
+    pendingCount = 0;
+    pendingCapacity = 0;
+
+    freeTable(usedNames);
+    freeTable(usedMethods);
+    freeTable(classNames);
+
+    return removed;
+}
@@ -0,0 +1,1069 @@
+#include "type_inference.h"
+#include "memory.h"
+#include "table.h"
+
+// Variables are followed through the code of the function declaring them, joining the possible types where
+// branches meet and repeating loops until nothing changes. Only the declaring function's own code is followed,
+// so a variable assigned by a function nested in it is never narrowed. No other code can reach it by name.
+//
+// A name declared in a block refers to an outer variable until the declaration runs, so such variables are
+// marked as not declared yet and assignments to them go to the outer one.
+//
+// Anything can be thrown from almost anywhere, the handler of a 'try' starts with every state the body
+// had after an assignment.
+
+// Only in variable states, never in the types of an expression
+#define NOT_DECLARED (1 << 7)
+
+typedef struct
+{
+    ObjString* name;
+    uint8_t state;
+
+    // Assigned by a nested function, it's always INFERRED_ANY
+    bool tracked;
+
+    // Assignments followed so far, loops are followed more than once
+    uint assignments;
+} Variable;
+
+typedef struct
+{
+    uint count;
+    uint8_t* states;
+} State;
+
+// Join of the states at some points of the code, those points may not have been reached
+typedef struct
+{
+    bool reached;
+    State state;
+} Accumulator;
+
+typedef struct Loop
+{
+    Accumulator breaks;
+    Accumulator continues;
+
+    struct Loop* enclosing;
+} Loop;
+
+typedef struct Try
+{
+    Accumulator assignments;
+
+    struct Try* enclosing;
+} Try;
+
+typedef struct Function
+{
+    uint start; // First variable of this function
+
+    // Names assigned in nested functions
+    Table* assignedInside;
+
+    struct Function* enclosing;
+} Function;
+
+static Variable* variables = NULL;
+static uint variableCount = 0;
+static uint variableCapacity = 0;
+
+static Function* function = NULL;
+static Loop* loop = NULL;
+static Try* try = NULL;
+
+static void inferStatement(Stmt* statement);
+static uint8_t inferExpression(Expr* expression);
+static void collectStatement(Stmt* statement, bool nested);
+
+// region States
+
+static State saveState()
+{
+    State state;
+    state.count = variableCount - function->start;
+    state.states = ALLOCATE(uint8_t, state.count);
+
+    for (uint i = 0; i < state.count; i++)
+    {
+        state.states[i] = variables[function->start + i].state;
+    }
+
+    return state;
+}
+
+static void freeState(State state)
+{
+    FREE_ARRAY(uint8_t, state.states, state.count);
+}
+
+// Variables declared after the state was saved belong to blocks which have ended since
+static void restoreState(State state)
+{
+    for (uint i = 0; i < state.count && function->start + i < variableCount; i++)
+    {
+        variables[function->start + i].state = state.states[i];
+    }
+}
+
+static void joinWithState(State state)
+{
+    for (uint i = 0; i < state.count && function->start + i < variableCount; i++)
+    {
+        variables[function->start + i].state |= state.states[i];
+    }
+}
+
+static bool sameStates(State a, State b)
+{
+    if (a.count != b.count) return false;
+
+    for (uint i = 0; i < a.count; i++)
+    {
+        if (a.states[i] != b.states[i]) return false;
+    }
+
+    return true;
+}
+
+static void initAccumulator(Accumulator* accumulator)
+{
+    accumulator->reached = false;
+    accumulator->state.count = 0;
+    accumulator->state.states = NULL;
+}
+
+static void freeAccumulator(Accumulator* accumulator)
+{
+    if (accumulator->reached) freeState(accumulator->state);
+}
+
+static void accumulate(Accumulator* accumulator)
+{
+    if (!accumulator->reached)
+    {
+        accumulator->state = saveState();
+        accumulator->reached = true;
+        return;
+    }
+
+    State* state = &accumulator->state;
+
+    for (uint i = 0; i < state->count && function->start + i < variableCount; i++)
+    {
+        state->states[i] |= variables[function->start + i].state;
+    }
+}
+
+static void joinWithAccumulator(Accumulator* accumulator)
+{
+    if (accumulator->reached) joinWithState(accumulator->state);
+}
+
+// endregion
+
+// region Variables
+
+static void declareVariable(ObjString* name)
+{
+    if (variableCapacity < variableCount + 1)
+    {
+        uint oldCapacity = variableCapacity;
+        variableCapacity = GROW_CAPACITY(oldCapacity);
+        variables = GROW_ARRAY(Variable, variables, oldCapacity, variableCapacity);
+    }
+
+    Value unused;
+
+    Variable* variable = &variables[variableCount++];
+    variable->name = name;
+    variable->state = NOT_DECLARED;
+    variable->tracked = !tableGet(function->assignedInside, name, &unused);
+    variable->assignments = 0;
+}
+
+// Variables of the enclosing functions aren't visible, they are never narrowed
+static Variable* resolve(ObjString* name, uint below)
+{
+    for (uint i = below; i > function->start; i--)
+    {
+        // Names are interned
+        if (variables[i - 1].name == name) return &variables[i - 1];
+    }
+
+    return NULL;
+}
+
+static void noteAssignment()
+{
+    for (Try* current = try; current != NULL; current = current->enclosing)
+    {
+        accumulate(&current->assignments);
+    }
+}
+
+static void assignVariable(ObjString* name, uint8_t types, uint below, bool surely)
+{
+    Variable* variable = resolve(name, below);
+    if (variable == NULL) return;
+
+    uint index = (uint)(variable - variables);
+    if (!variable->tracked) types = INFERRED_ANY;
+
+    if (variable->state == NOT_DECLARED)
+    {
+        assignVariable(name, types, index, surely);
+        return;
+    }
+
+    variable->assignments++;
+
+    if (variable->state & NOT_DECLARED || !surely)
+    {
+        // Depending on the path taken, this one or the outer one is set
+        variable->state |= types;
+        assignVariable(name, types, index, false);
+    }
+    else
+    {
+        variable->state = types;
+    }
+}
+
+static void assign(ObjString* name, uint8_t types)
+{
+    assignVariable(name, types, variableCount, true);
+    noteAssignment();
+}
+
+// The declaration has been reached
+static void define(ObjString* name, uint8_t types)
+{
+    Variable* variable = resolve(name, variableCount);
+
+    // Declared somewhere declareAll() doesn't look, nothing is known about it
+    if (variable == NULL)
+    {
+        declareVariable(name);
+        variable = &variables[variableCount - 1];
+        variable->tracked = false;
+    }
+
+    variable->state = variable->tracked ? types : INFERRED_ANY;
+    variable->assignments++;
+    noteAssignment();
+}
+
+static uint8_t readVariable(ObjString* name)
+{
+    Variable* variable = resolve(name, variableCount);
+
+    if (variable == NULL || !variable->tracked || variable->state & NOT_DECLARED)
+    {
+        return INFERRED_ANY;
+    }
+
+    return variable->state;
+}
+
+// Statements compiled in the current scope, they can be inside branches which don't open their own
+static void declareIn(Stmt* statement)
+{
+    if (statement == NULL) return;
+
+    switch (statement->type)
+    {
+        case VARIABLE_STATEMENT:
+            declareVariable(((VariableStmt*)statement)->name);
+            break;
+
+        case FUNCTION_STATEMENT:
+            declareVariable(((FunctionStmt*)statement)->name);
+            break;
+
+        case CLASS_STATEMENT:
+            declareVariable(((ClassStmt*)statement)->name);
+            break;
+
+        case IF_STATEMENT:
+            declareIn(((IfStmt*)statement)->thenBranch);
+            declareIn(((IfStmt*)statement)->elseBranch);
+            break;
+
+        case WHILE_STATEMENT:
+            declareIn(((WhileStmt*)statement)->body);
+            break;
+
+        case SWITCH_STATEMENT:
+        {
+            SwitchStmt* stmt = (SwitchStmt*)statement;
+
+            for (Node* node = stmt->caseBodies; node != NULL; node = node->next)
+            {
+                declareIn(AS_STATEMENT(node));
+            }
+
+            declareIn(stmt->defaultBranch);
+            break;
+        }
+
+        case TRY_STATEMENT:
+            declareIn(((TryStmt*)statement)->body);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void declareAll(Node* statements)
+{
+    for (Node* node = statements; node != NULL; node = node->next)
+    {
+        declareIn(AS_STATEMENT(node));
+    }
+}
+
+// endregion
+
+// region Nested assignments
+
+static void collectExpressions(Node* expressions, bool nested);
+
+static void collectExpression(Expr* expression, bool nested)
+{
+    if (expression == NULL) return;
+
+    switch (expression->type)
+    {
+        case ASSIGN_EXPRESSION:
+        {
+            AssignExpr* expr = (AssignExpr*)expression;
+
+            if (nested) tableSet(function->assignedInside, expr->name, NULL_VAL);
+            collectExpression(expr->value, nested);
+            break;
+        }
+
+        case BINARY_EXPRESSION:
+            collectExpression(((BinaryExpr*)expression)->left, nested);
+            collectExpression(((BinaryExpr*)expression)->right, nested);
+            break;
+
+        case LOGICAL_EXPRESSION:
+            collectExpression(((LogicalExpr*)expression)->left, nested);
+            collectExpression(((LogicalExpr*)expression)->right, nested);
+            break;
+
+        case UNARY_EXPRESSION:
+            collectExpression(((UnaryExpr*)expression)->target, nested);
+            break;
+
+        case TERNARY_EXPRESSION:
+            collectExpression(((TernaryExpr*)expression)->condition, nested);
+            collectExpression(((TernaryExpr*)expression)->thenBranch, nested);
+            collectExpression(((TernaryExpr*)expression)->elseBranch, nested);
+            break;
+
+        case CALL_EXPRESSION:
+            collectExpression(((CallExpr*)expression)->callee, nested);
+            collectExpressions(((CallExpr*)expression)->args, nested);
+            break;
+
+        case DOT_EXPRESSION:
+            collectExpression(((DotExpr*)expression)->instance, nested);
+            collectExpression(((DotExpr*)expression)->value, nested);
+            collectExpressions(((DotExpr*)expression)->args, nested);
+            break;
+
+        case SUBSCRIPT_EXPRESSION:
+            collectExpression(((SubscriptExpr*)expression)->list, nested);
+            collectExpression(((SubscriptExpr*)expression)->index, nested);
+            collectExpression(((SubscriptExpr*)expression)->value, nested);
+            break;
+
+        case LIST_EXPRESSION:
+            collectExpressions(((ListExpr*)expression)->expressions, nested);
+            break;
+
+        case INTERPOLATION_EXPRESSION:
+            collectExpressions(((InterpolationExpr*)expression)->parts, nested);
+            break;
+
+        case YIELD_EXPRESSION:
+            collectExpression(((YieldExpr*)expression)->value, nested);
+            break;
+
+        case RESUME_EXPRESSION:
+            collectExpression(((ResumeExpr*)expression)->coroutine, nested);
+            collectExpression(((ResumeExpr*)expression)->value, nested);
+            break;
+
+        case LITERAL_EXPRESSION:
+        case VAR_EXPRESSION:
+        case BASE_EXPRESSION:
+            break;
+    }
+}
+
+static void collectExpressions(Node* expressions, bool nested)
+{
+    for (Node* node = expressions; node != NULL; node = node->next)
+    {
+        collectExpression(AS_EXPRESSION(node), nested);
+    }
+}
+
+static void collectStatements(Node* statements, bool nested)
+{
+    for (Node* node = statements; node != NULL; node = node->next)
+    {
+        collectStatement(AS_STATEMENT(node), nested);
+    }
+}
+
+static void collectStatement(Stmt* statement, bool nested)
+{
+    if (statement == NULL) return;
+
+    switch (statement->type)
+    {
+        case EXPRESSION_STATEMENT:
+            collectExpression(((ExpressionStmt*)statement)->expr, nested);
+            break;
+
+        case BLOCK_STATEMENT:
+            collectStatements(((BlockStmt*)statement)->statements, nested);
+            break;
+
+        case IF_STATEMENT:
+            collectExpression(((IfStmt*)statement)->condition, nested);
+            collectStatement(((IfStmt*)statement)->thenBranch, nested);
+            collectStatement(((IfStmt*)statement)->elseBranch, nested);
+            break;
+
+        case WHILE_STATEMENT:
+            collectExpression(((WhileStmt*)statement)->condition, nested);
+            collectStatement(((WhileStmt*)statement)->body, nested);
+            break;
+
+        case FOR_STATEMENT:
+        {
+            ForStmt* stmt = (ForStmt*)statement;
+
+            collectStatement(stmt->declaration, nested);
+            collectExpression(stmt->condition, nested);
+            collectExpression(stmt->increment, nested);
+            collectStatement(stmt->body, nested);
+            break;
+        }
+
+        case FOREACH_STATEMENT:
+            collectExpression(((ForeachStmt*)statement)->iterable, nested);
+            collectStatement(((ForeachStmt*)statement)->body, nested);
+            break;
+
+        case SWITCH_STATEMENT:
+        {
+            SwitchStmt* stmt = (SwitchStmt*)statement;
+
+            collectExpression(stmt->value, nested);
+            collectExpressions(stmt->conditions, nested);
+            collectStatements(stmt->caseBodies, nested);
+            collectStatement(stmt->defaultBranch, nested);
+            break;
+        }
+
+        case VARIABLE_STATEMENT:
+            collectExpression(((VariableStmt*)statement)->initializer, nested);
+            break;
+
+        case FUNCTION_STATEMENT:
+            collectStatements(((FunctionStmt*)statement)->body, true);
+            break;
+
+        case CLASS_STATEMENT:
+        {
+            ClassStmt* stmt = (ClassStmt*)statement;
+
+            collectExpression(stmt->parent, nested);
+
+            for (uint i = 0; i < stmt->methods.count; i++)
+            {
+                collectStatement(stmt->methods.values[i], true);
+            }
+            break;
+        }
+
+        case RETURN_STATEMENT:
+            collectExpression(((ReturnStmt*)statement)->value, nested);
+            break;
+
+        case TRY_STATEMENT:
+            collectStatement(((TryStmt*)statement)->body, nested);
+            collectStatement(((TryStmt*)statement)->handler, nested);
+            break;
+
+        case CONTINUE_STATEMENT:
+        case BREAK_STATEMENT:
+            break;
+    }
+}
+
+// endregion
+
+// region Expressions
+
+uint8_t valueTypes(Value value)
+{
+    if (IS_NUMBER(value)) return INFERRED_NUMBER;
+    if (IS_BOOL(value))   return INFERRED_BOOL;
+    if (IS_NULL(value))   return INFERRED_NULL;
+    if (IS_STRING(value)) return INFERRED_STRING;
+
+    return INFERRED_OTHER;
+}
+
+static void inferExpressions(Node* expressions)
+{
+    for (Node* node = expressions; node != NULL; node = node->next)
+    {
+        inferExpression(AS_EXPRESSION(node));
+    }
+}
+
+// Same order the emitter compiles them in
+static uint8_t inferExpression(Expr* expression)
+{
+    if (expression == NULL) return INFERRED_NULL;
+
+    uint8_t types = INFERRED_ANY;
+
+    switch (expression->type)
+    {
+        case LITERAL_EXPRESSION:
+            types = valueTypes(((LiteralExpr*)expression)->value);
+            break;
+
+        case VAR_EXPRESSION:
+            types = readVariable(((VarExpr*)expression)->name);
+            break;
+
+        case ASSIGN_EXPRESSION:
+        {
+            AssignExpr* expr = (AssignExpr*)expression;
+            assign(expr->name, inferExpression(expr->value));
+            break;
+        }
+
+        case BINARY_EXPRESSION:
+        {
+            BinaryExpr* expr = (BinaryExpr*)expression;
+
+            uint8_t left = inferExpression(expr->left);
+            uint8_t right = inferExpression(expr->right);
+
+            switch (expr->op)
+            {
+                case TOKEN_PLUS:
+                    if (left == INFERRED_NUMBER && right == INFERRED_NUMBER) types = INFERRED_NUMBER;
+                    else if (left == INFERRED_STRING || right == INFERRED_STRING) types = INFERRED_STRING;
+                    else types = INFERRED_NUMBER | INFERRED_STRING;
+                    break;
+
+                // Anything else is an error
+                case TOKEN_MINUS:
+                case TOKEN_MINUS_E:
+                case TOKEN_STAR:
+                case TOKEN_SLASH:
+                case TOKEN_PERCENT:
+                case TOKEN_TILDE_SLASH:
+                case TOKEN_AMPERSAND:
+                case TOKEN_PIPE:
+                case TOKEN_CARET:
+                case TOKEN_LESS_LESS:
+                case TOKEN_GREATER_GREATER:
+                    types = INFERRED_NUMBER;
+                    break;
+
+                default:
+                    types = INFERRED_BOOL;
+                    break;
+            }
+
+            break;
+        }
+
+        case UNARY_EXPRESSION:
+        {
+            UnaryExpr* expr = (UnaryExpr*)expression;
+
+            inferExpression(expr->target);
+            types = expr->op == TOKEN_BANG ? INFERRED_BOOL : INFERRED_NUMBER;
+            break;
+        }
+
+        case LOGICAL_EXPRESSION:
+        {
+            LogicalExpr* expr = (LogicalExpr*)expression;
+
+            types = inferExpression(expr->left);
+
+            // The right side may be skipped
+            State skipped = saveState();
+            types |= inferExpression(expr->right);
+
+            joinWithState(skipped);
+            freeState(skipped);
+            break;
+        }
+
+        case TERNARY_EXPRESSION:
+        {
+            TernaryExpr* expr = (TernaryExpr*)expression;
+
+            // Every part is evaluated
+            inferExpression(expr->condition);
+            types = inferExpression(expr->thenBranch);
+            types |= inferExpression(expr->elseBranch);
+            break;
+        }
+
+        case CALL_EXPRESSION:
+        {
+            CallExpr* expr = (CallExpr*)expression;
+
+            inferExpressions(expr->args);
+            inferExpression(expr->callee);
+            break;
+        }
+
+        case DOT_EXPRESSION:
+        {
+            DotExpr* expr = (DotExpr*)expression;
+
+            inferExpression(expr->instance);
+            inferExpressions(expr->args);
+            inferExpression(expr->value);
+            break;
+        }
+
+        case SUBSCRIPT_EXPRESSION:
+        {
+            SubscriptExpr* expr = (SubscriptExpr*)expression;
+
+            inferExpression(expr->list);
+            inferExpression(expr->index);
+            inferExpression(expr->value);
+            break;
+        }
+
+        case LIST_EXPRESSION:
+            inferExpressions(((ListExpr*)expression)->expressions);
+            types = INFERRED_OTHER;
+            break;
+
+        case INTERPOLATION_EXPRESSION:
+            inferExpressions(((InterpolationExpr*)expression)->parts);
+            types = INFERRED_STRING;
+            break;
+
+        case YIELD_EXPRESSION:
+            inferExpression(((YieldExpr*)expression)->value);
+            break;
+
+        case RESUME_EXPRESSION:
+            inferExpression(((ResumeExpr*)expression)->coroutine);
+            inferExpression(((ResumeExpr*)expression)->value);
+            break;
+
+        case BASE_EXPRESSION:
+            break;
+    }
+
+    expression->inferredTypes = types;
+    return types;
+}
+
+// endregion
+
+// region Statements
+
+static void inferStatements(Node* statements)
+{
+    for (Node* node = statements; node != NULL; node = node->next)
+    {
+        inferStatement(AS_STATEMENT(node));
+    }
+}
+
+static void inferFunction(FunctionStmt* stmt)
+{
+    Function context;
+    context.start = variableCount;
+    context.assignedInside = ALLOCATE_TABLE();
+    context.enclosing = function;
+    initTable(context.assignedInside);
+
+    function = &context;
+    collectStatements(stmt->body, false);
+
+    // Breaks and handlers of the enclosing function are out of reach
+    Loop* enclosingLoop = loop;
+    Try* enclosingTry = try;
+    loop = NULL;
+    try = NULL;
+
+    for (uint i = 0; i < stmt->paramCount; i++)
+    {
+        declareVariable(stmt->params[i]);
+        variables[variableCount - 1].state = INFERRED_ANY;
+    }
+
+    declareAll(stmt->body);
+    inferStatements(stmt->body);
+
+    variableCount = context.start;
+    freeTable(context.assignedInside);
+
+    function = context.enclosing;
+    loop = enclosingLoop;
+    try = enclosingTry;
+}
+
+// Repeated until the state at the start of an iteration stops changing
+// Returns how many times the loop was followed
+static uint inferLoop(Expr* condition, Stmt* body, Expr* increment)
+{
+    uint passes = 0;
+
+    Loop context;
+    context.enclosing = loop;
+    loop = &context;
+
+    State start = saveState();
+
+    for (;;)
+    {
+        restoreState(start);
+        initAccumulator(&context.breaks);
+        initAccumulator(&context.continues);
+        passes++;
+
+        inferExpression(condition);
+        State exit = saveState();
+
+        inferStatement(body);
+        joinWithAccumulator(&context.continues);
+        inferExpression(increment);
+
+        joinWithState(start);
+        State next = saveState();
+
+        bool stable = sameStates(start, next);
+        freeState(start);
+        start = next;
+
+        if (stable)
+        {
+            restoreState(exit);
+            joinWithAccumulator(&context.breaks);
+        }
+
+        freeState(exit);
+        freeAccumulator(&context.breaks);
+        freeAccumulator(&context.continues);
+
+        if (stable) break;
+    }
+
+    freeState(start);
+    loop = context.enclosing;
+
+    return passes;
+}
+
+static bool isVariableNamed(Expr* expression, ObjString* name)
+{
+    // Names are interned
+    return expression->type == VAR_EXPRESSION && ((VarExpr*)expression)->name == name;
+}
+
+// 'for (var i = start; i < limit; i++)' with a literal or a variable as the limit
+static bool countsUp(ForStmt* stmt)
+{
+    if (stmt->declaration == NULL || stmt->declaration->type != VARIABLE_STATEMENT) return false;
+
+    VariableStmt* declaration = (VariableStmt*)stmt->declaration;
+    ObjString* name = declaration->name;
+    if (declaration->isConst || declaration->initializer == NULL) return false;
+
+    if (stmt->condition == NULL || stmt->condition->type != BINARY_EXPRESSION) return false;
+
+    BinaryExpr* condition = (BinaryExpr*)stmt->condition;
+    if (condition->op != TOKEN_LESS || !isVariableNamed(condition->left, name)) return false;
+    if (condition->right->type != LITERAL_EXPRESSION && condition->right->type != VAR_EXPRESSION) return false;
+    if (isVariableNamed(condition->right, name)) return false;
+
+    if (stmt->increment == NULL || stmt->increment->type != ASSIGN_EXPRESSION) return false;
+
+    AssignExpr* increment = (AssignExpr*)stmt->increment;
+    if (increment->name != name || increment->value->type != BINARY_EXPRESSION) return false;
+
+    BinaryExpr* sum = (BinaryExpr*)increment->value;
+    if (sum->op != TOKEN_PLUS || !isVariableNamed(sum->left, name)) return false;
+    if (sum->right->type != LITERAL_EXPRESSION) return false;
+
+    Value step = ((LiteralExpr*)sum->right)->value;
+    return IS_NUMBER(step) && AS_NUMBER(step) == 1;
+}
+
+// The loop counts like 'for (i in start..limit)' if only the increment assigns the counter and nothing assigns
+// the limit. Other functions can't assign either variable, else it wouldn't be tracked. Bounds which aren't
+// numbers fail the first comparison either way.
+static void inferCountingLoop(ForStmt* stmt)
+{
+    BinaryExpr* condition = (BinaryExpr*)stmt->condition;
+
+    uint counter = (uint)(resolve(((VariableStmt*)stmt->declaration)->name, variableCount) - variables);
+    uint counterAssignments = variables[counter].assignments;
+
+    // Declared outside the loop, it keeps its index while the loop declares more variables
+    Variable* limitVariable = NULL;
+    if (condition->right->type == VAR_EXPRESSION)
+    {
+        limitVariable = resolve(((VarExpr*)condition->right)->name, variableCount);
+        if (limitVariable == NULL || !limitVariable->tracked) limitVariable = NULL;
+    }
+
+    uint limit = limitVariable == NULL ? 0 : (uint)(limitVariable - variables);
+    uint limitAssignments = limitVariable == NULL ? 0 : limitVariable->assignments;
+
+    // The increment is followed once per pass
+    uint passes = inferLoop(stmt->condition, stmt->body, stmt->increment);
+
+    bool invariantLimit = condition->right->type == LITERAL_EXPRESSION ||
+                          (limitVariable != NULL && variables[limit].assignments == limitAssignments);
+
+    stmt->isRange = invariantLimit && variables[counter].tracked &&
+                    variables[counter].assignments - counterAssignments == passes;
+}
+
+static void inferStatement(Stmt* statement)
+{
+    if (statement == NULL) return;
+
+    switch (statement->type)
+    {
+        case EXPRESSION_STATEMENT:
+            inferExpression(((ExpressionStmt*)statement)->expr);
+            break;
+
+        case BLOCK_STATEMENT:
+        {
+            BlockStmt* stmt = (BlockStmt*)statement;
+            uint scopeStart = variableCount;
+
+            declareAll(stmt->statements);
+            inferStatements(stmt->statements);
+
+            variableCount = scopeStart;
+            break;
+        }
+
+        case IF_STATEMENT:
+        {
+            IfStmt* stmt = (IfStmt*)statement;
+
+            inferExpression(stmt->condition);
+            State skipped = saveState();
+
+            inferStatement(stmt->thenBranch);
+            State taken = saveState();
+
+            restoreState(skipped);
+            inferStatement(stmt->elseBranch);
+            joinWithState(taken);
+
+            freeState(skipped);
+            freeState(taken);
+            break;
+        }
+
+        case WHILE_STATEMENT:
+        {
+            WhileStmt* stmt = (WhileStmt*)statement;
+
+            inferLoop(stmt->condition, stmt->body, NULL);
+            break;
+        }
+
+        case FOR_STATEMENT:
+        {
+            ForStmt* stmt = (ForStmt*)statement;
+            uint scopeStart = variableCount;
+
+            declareIn(stmt->declaration);
+            inferStatement(stmt->declaration);
+
+            if (stmt->isRange || !countsUp(stmt))
+            {
+                inferLoop(stmt->condition, stmt->body, stmt->increment);
+            }
+            else
+            {
+                inferCountingLoop(stmt);
+            }
+
+            variableCount = scopeStart;
+            break;
+        }
+
+        case FOREACH_STATEMENT:
+        {
+            ForeachStmt* stmt = (ForeachStmt*)statement;
+            uint scopeStart = variableCount;
+
+            inferExpression(stmt->iterable);
+
+            // Items can be anything
+            declareVariable(stmt->name);
+            define(stmt->name, INFERRED_ANY);
+            inferLoop(NULL, stmt->body, NULL);
+
+            variableCount = scopeStart;
+            break;
+        }
+
+        case SWITCH_STATEMENT:
+        {
+            SwitchStmt* stmt = (SwitchStmt*)statement;
+
+            inferExpression(stmt->value);
+            inferExpressions(stmt->conditions);
+
+            // Any of the bodies may run or not
+            for (Node* node = stmt->caseBodies; node != NULL; node = node->next)
+            {
+                State skipped = saveState();
+
+                inferStatement(AS_STATEMENT(node));
+
+                joinWithState(skipped);
+                freeState(skipped);
+            }
+
+            State skipped = saveState();
+
+            inferStatement(stmt->defaultBranch);
+
+            joinWithState(skipped);
+            freeState(skipped);
+            break;
+        }
+
+        case VARIABLE_STATEMENT:
+        {
+            VariableStmt* stmt = (VariableStmt*)statement;
+            define(stmt->name, inferExpression(stmt->initializer));
+            break;
+        }
+
+        case FUNCTION_STATEMENT:
+        {
+            FunctionStmt* stmt = (FunctionStmt*)statement;
+
+            define(stmt->name, INFERRED_OTHER);
+            inferFunction(stmt);
+            break;
+        }
+
+        case CLASS_STATEMENT:
+        {
+            ClassStmt* stmt = (ClassStmt*)statement;
+
+            for (uint i = 0; i < stmt->methods.count; i++)
+            {
+                inferFunction((FunctionStmt*)stmt->methods.values[i]);
+            }
+
+            inferExpression(stmt->parent);
+            define(stmt->name, INFERRED_OTHER);
+            break;
+        }
+
+        case RETURN_STATEMENT:
+            inferExpression(((ReturnStmt*)statement)->value);
+            break;
+
+        case TRY_STATEMENT:
+        {
+            TryStmt* stmt = (TryStmt*)statement;
+
+            Try context;
+            context.enclosing = try;
+            initAccumulator(&context.assignments);
+            accumulate(&context.assignments);
+
+            try = &context;
+            inferStatement(stmt->body);
+            try = context.enclosing;
+
+            State finished = saveState();
+
+            joinWithAccumulator(&context.assignments);
+            freeAccumulator(&context.assignments);
+
+            uint scopeStart = variableCount;
+
+            if (stmt->errorName != NULL)
+            {
+                declareVariable(stmt->errorName);
+                define(stmt->errorName, INFERRED_ANY);
+            }
+
+            inferStatement(stmt->handler);
+            variableCount = scopeStart;
+
+            joinWithState(finished);
+            freeState(finished);
+            break;
+        }
+
+        case BREAK_STATEMENT:
+            if (loop != NULL) accumulate(&loop->breaks);
+            break;
+
+        case CONTINUE_STATEMENT:
+            if (loop != NULL) accumulate(&loop->continues);
+            break;
+    }
+}
+
+// endregion
+
+void inferTypes(Node* statements)
+{
+    Function script;
+    script.start = 0;
+    script.assignedInside = ALLOCATE_TABLE();
+    script.enclosing = NULL;
+    initTable(script.assignedInside);
+
+    function = &script;
+    loop = NULL;
+    try = NULL;
+
+    collectStatements(statements, false);
+    declareAll(statements);
+    inferStatements(statements);
+
+    freeTable(script.assignedInside);
+    FREE_ARRAY(Variable, variables, variableCapacity);
+
+    variables = NULL;
+    variableCount = 0;
+    variableCapacity = 0;
+    function = NULL;
+}
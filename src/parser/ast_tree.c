@@ -6,6 +6,9 @@
 
 DEFINE_ARRAY_FUNCTIONS(Statements, statements, Stmt*)
 
+// The same script always gets the same numbers
+static uint siteCount = 0;
+
 static Expr* newExpression(size_t size, ExprType type, bool pop, uint16_t line)
 {
     Expr* object = reallocate(NULL, 0, size);
@@ -13,6 +16,8 @@ static Expr* newExpression(size_t size, ExprType type, bool pop, uint16_t line)
     object->type = type;
     object->line = line;
     object->pop = pop;
+    object->inferredTypes = INFERRED_ANY;
+    object->cacheSlot = 0;
 
     return object;
 }
@@ -119,6 +124,37 @@ void freeExpression(Expr* expr)
             break;
         }
 
+        case YIELD_EXPRESSION:
+        {
+            YieldExpr* expression = (YieldExpr*) expr;
+
+            if(expression->value != NULL) freeExpression(expression->value);
+
+            FREE(YieldExpr, expr);
+            break;
+        }
+
+        case RESUME_EXPRESSION:
+        {
+            ResumeExpr* expression = (ResumeExpr*) expr;
+
+            freeExpression(expression->coroutine);
+            if(expression->value != NULL) freeExpression(expression->value);
+
+            FREE(ResumeExpr, expr);
+            break;
+        }
+
+        case INTERPOLATION_EXPRESSION:
+        {
+            InterpolationExpr* expression = (InterpolationExpr*) expr;
+
+            freeList(expression->parts);
+
+            FREE(InterpolationExpr, expr);
+            break;
+        }
+
         case TERNARY_EXPRESSION:
         {
             TernaryExpr* expression = (TernaryExpr*) expr;
@@ -231,6 +267,18 @@ void freeStatement(Stmt* stmt)
             }
 
             freeStatement(statement->body);
+            freeList(statement->inductions);
+            break;
+        }
+
+        case FOREACH_STATEMENT:
+        {
+            ForeachStmt* statement = (ForeachStmt*) stmt;
+
+            freeExpression(statement->iterable);
+            freeStatement(statement->body);
+
+            FREE(ForeachStmt, stmt);
             break;
         }
 
@@ -277,6 +325,7 @@ void freeStatement(Stmt* stmt)
         {
             SwitchStmt* statement = (SwitchStmt*) stmt;
 
+            freeExpression(statement->value);
             freeList(statement->caseBodies);
             freeList(statement->conditions);
 
@@ -286,6 +335,17 @@ void freeStatement(Stmt* stmt)
             break;
         }
 
+        case TRY_STATEMENT:
+        {
+            TryStmt* statement = (TryStmt*) stmt;
+
+            freeStatement(statement->body);
+            freeStatement(statement->handler);
+
+            FREE(TryStmt, stmt);
+            break;
+        }
+
     }
 }
 
@@ -322,6 +382,17 @@ ClassStmt* newClassStmt(ObjString* name, Expr* parent, Statements methods, uint1
     return stmt;
 }
 
+TryStmt* newTryStmt(Stmt* body, ObjString* errorName, Stmt* handler, uint16_t line)
+{
+    TryStmt* stmt = (TryStmt*) ALLOCATE_STATEMENT(TryStmt, TRY_STATEMENT, line);
+
+    stmt->body = body;
+    stmt->errorName = errorName;
+    stmt->handler = handler;
+
+    return stmt;
+}
+
 FunctionStmt* newFunctionStmt(ObjString* name, Node* body, ObjString** params, uint16_t paramCount, uint16_t line)
 {
     FunctionStmt* stmt = (FunctionStmt*) ALLOCATE_STATEMENT(FunctionStmt, FUNCTION_STATEMENT, line);
@@ -334,20 +405,24 @@ FunctionStmt* newFunctionStmt(ObjString* name, Node* body, ObjString** params, u
     return stmt;
 }
 
-VariableStmt* newVariableStmt(ObjString* name, Expr* initializer, uint16_t line)
+VariableStmt* newVariableStmt(ObjString* name, Expr* initializer, bool isConst, uint16_t line)
 {
     VariableStmt* stmt = (VariableStmt*) ALLOCATE_STATEMENT(VariableStmt, VARIABLE_STATEMENT, line);
 
     stmt->name = name;
     stmt->initializer = initializer;
+    stmt->isConst = isConst;
+    stmt->ownedByScope = false;
 
     return stmt;
 }
 
-SwitchStmt* newSwitchStmt(Node* caseConditions, Node* caseBodies, Stmt* defaultBranch, uint16_t line)
+SwitchStmt* newSwitchStmt(Expr* value, Node* caseConditions, Node* caseBodies, Stmt* defaultBranch, uint16_t line)
 {
     SwitchStmt* stmt = (SwitchStmt*) ALLOCATE_STATEMENT(SwitchStmt, SWITCH_STATEMENT, line);
 
+    stmt->value = value;
+
     stmt->defaultBranch = defaultBranch;
 
     stmt->caseBodies = caseBodies;
@@ -362,6 +437,7 @@ WhileStmt* newWhileStmt(Expr* condition, Stmt* body, uint16_t line)
 
     stmt->condition = condition;
     stmt->body = body;
+    stmt->cacheCount = 0;
 
     return stmt;
 }
@@ -374,6 +450,22 @@ ForStmt* newForStmt(Stmt* declaration, Expr* condition, Expr* increment, Stmt* b
     stmt->increment = increment;
     stmt->condition = condition;
     stmt->body = body;
+    stmt->isRange = false;
+    stmt->isRangeSyntax = false;
+    stmt->cacheCount = 0;
+    stmt->inductions = NULL;
+
+    return stmt;
+}
+
+ForeachStmt* newForeachStmt(ObjString* name, Expr* iterable, Stmt* body, uint16_t line)
+{
+    ForeachStmt* stmt = (ForeachStmt*) ALLOCATE_STATEMENT(ForeachStmt, FOREACH_STATEMENT, line);
+
+    stmt->name = name;
+    stmt->iterable = iterable;
+    stmt->body = body;
+    stmt->cacheCount = 0;
 
     return stmt;
 }
@@ -385,6 +477,7 @@ IfStmt* newIfStmt(Expr* condition, Stmt* thenBranch, Stmt* elseBranch, uint16_t
     stmt->condition = condition;
     stmt->thenBranch = thenBranch;
     stmt->elseBranch = elseBranch;
+    stmt->site = siteCount++;
 
     return stmt;
 }
@@ -444,6 +537,7 @@ DotExpr* newDotExpr(Expr* instance, ObjString* fieldName, Expr* value,
     expr->args = args;
     expr->argCount = argCount;
     expr->isCall = isCall;
+    expr->site = siteCount++;
 
     return expr;
 }
@@ -476,6 +570,25 @@ BaseExpr* newBaseExpr(ObjString* methodName, uint16_t line)
     return expr;
 }
 
+YieldExpr* newYieldExpr(Expr* value, uint16_t line)
+{
+    YieldExpr* expr = (YieldExpr*) ALLOCATE_EXPRESSION(YieldExpr, YIELD_EXPRESSION, true, line);
+
+    expr->value = value;
+
+    return expr;
+}
+
+ResumeExpr* newResumeExpr(Expr* coroutine, Expr* value, uint16_t line)
+{
+    ResumeExpr* expr = (ResumeExpr*) ALLOCATE_EXPRESSION(ResumeExpr, RESUME_EXPRESSION, true, line);
+
+    expr->coroutine = coroutine;
+    expr->value = value;
+
+    return expr;
+}
+
 TernaryExpr* newTernaryExpr(Expr* condition, Expr* thenBranch, Expr* elseBranch, uint16_t line)
 {
     TernaryExpr* expr = (TernaryExpr*) ALLOCATE_EXPRESSION(TernaryExpr, TERNARY_EXPRESSION, true, line);
@@ -505,6 +618,7 @@ BinaryExpr* newBinaryExpr(Expr* left, TokenType op, Expr* right, uint16_t line)
     expr->left = left;
     expr->op = op;
     expr->right = right;
+    expr->site = siteCount++;
 
     return expr;
 }
@@ -516,6 +630,14 @@ ListExpr* newListExpr(Node* expressions, uint16_t line)
     return expr;
 }
 
+InterpolationExpr* newInterpolationExpr(Node* parts, uint8_t partCount, uint16_t line)
+{
+    InterpolationExpr* expr = (InterpolationExpr*) ALLOCATE_EXPRESSION(InterpolationExpr, INTERPOLATION_EXPRESSION, true, line);
+    expr->parts = parts;
+    expr->partCount = partCount;
+    return expr;
+}
+
 SubscriptExpr* newSubscriptExpr(Expr* indexedValue, Expr* index, Expr* valueToStore, uint16_t line)
 {
     bool pop = valueToStore == NULL ? true : false;
@@ -536,3 +658,89 @@ LiteralExpr* newLiteralExpr(Value value, uint16_t line)
 }
 
 // endregion
+
+// region Compound assignments
+
+static bool isArithmetic(TokenType op)
+{
+    switch (op)
+    {
+        case TOKEN_PLUS:
+        case TOKEN_MINUS:
+        case TOKEN_MINUS_E:
+        case TOKEN_STAR:
+        case TOKEN_SLASH:
+        case TOKEN_PERCENT:
+        case TOKEN_TILDE_SLASH:
+        case TOKEN_AMPERSAND:
+        case TOKEN_PIPE:
+        case TOKEN_CARET:
+        case TOKEN_LESS_LESS:
+        case TOKEN_GREATER_GREATER:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Evaluating it can't assign anything, so it may run before the target is read
+static bool isUnchanging(Expr* expression)
+{
+    switch (expression->type)
+    {
+        case LITERAL_EXPRESSION:
+        case VAR_EXPRESSION:
+            return true;
+
+        case BINARY_EXPRESSION:
+            return isUnchanging(((BinaryExpr*)expression)->left) && isUnchanging(((BinaryExpr*)expression)->right);
+
+        case UNARY_EXPRESSION:
+            return isUnchanging(((UnaryExpr*)expression)->target);
+
+        default:
+            return false;
+    }
+}
+
+static BinaryExpr* compoundValue(Expr* value)
+{
+    if (value == NULL || value->type != BINARY_EXPRESSION || value->cacheSlot != 0) return NULL;
+
+    BinaryExpr* binary = (BinaryExpr*)value;
+    if (!isArithmetic(binary->op) || binary->left->cacheSlot != 0 || !isUnchanging(binary->right)) return NULL;
+
+    return binary;
+}
+
+BinaryExpr* variableUpdate(AssignExpr* assignment)
+{
+    BinaryExpr* binary = compoundValue(assignment->value);
+    if (binary == NULL || binary->left->type != VAR_EXPRESSION) return NULL;
+
+    return ((VarExpr*)binary->left)->name == assignment->name ? binary : NULL;
+}
+
+BinaryExpr* propertyCompound(DotExpr* setter)
+{
+    Expr* value = setter->value;
+    if (setter->isCall || value == NULL || value->type != BINARY_EXPRESSION || value->cacheSlot != 0) return NULL;
+
+    BinaryExpr* binary = (BinaryExpr*)value;
+    if (binary->left->type != DOT_EXPRESSION || binary->left->cacheSlot != 0) return NULL;
+
+    DotExpr* getter = (DotExpr*)binary->left;
+    bool sameField = !getter->isCall && getter->value == NULL && getter->fieldName == setter->fieldName;
+
+    return sameField && getter->instance == setter->instance ? binary : NULL;
+}
+
+BinaryExpr* propertyUpdate(DotExpr* setter)
+{
+    BinaryExpr* binary = propertyCompound(setter);
+
+    return binary != NULL && compoundValue(setter->value) != NULL ? binary : NULL;
+}
+
+// endregion
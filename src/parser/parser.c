@@ -118,6 +118,13 @@ static TokenType matchMultiple(int tokenCount, ...)
     return 0;
 }
 
+// Operator of 'x op= y' after its '=', 0 for a plain assignment
+static TokenType matchCompoundOperator()
+{
+    return matchMultiple(11, TOKEN_PLUS, TOKEN_MINUS_E, TOKEN_STAR, TOKEN_SLASH, TOKEN_PERCENT, TOKEN_TILDE_SLASH,
+                         TOKEN_AMPERSAND, TOKEN_PIPE, TOKEN_CARET, TOKEN_LESS_LESS, TOKEN_GREATER_GREATER);
+}
+
 static bool identifiersEqual(Token* a, Token* b)
 {
     if (a->length != b->length) return false;
@@ -137,10 +144,13 @@ static void synchronize()
             case TOKEN_CLASS:
             case TOKEN_FUNCTION:
             case TOKEN_VAR:
+            case TOKEN_CONST:
             case TOKEN_FOR:
+            case TOKEN_FOREACH:
             case TOKEN_IF:
             case TOKEN_WHILE:
             case TOKEN_RETURN:
+            case TOKEN_TRY:
                 return;
 
             default: ; // Nothing.
@@ -296,7 +306,7 @@ static ObjString* parseVariableName(const char* errorMessage)
 {
     consume(TOKEN_IDENTIFIER, errorMessage);
 
-    return copyString(parser.previous.start,parser.previous.length);
+    return keepString(copyString(parser.previous.start,parser.previous.length));
 }
 
 static Expr* dot(Expr* previous, bool canAssign)
@@ -312,7 +322,7 @@ static Expr* dot(Expr* previous, bool canAssign)
     if (match(TOKEN_EQUAL) && canAssign)
     {
         // Syntax sugar like += -=
-        TokenType op = matchMultiple(4, TOKEN_PLUS, TOKEN_MINUS_E, TOKEN_STAR, TOKEN_SLASH);
+        TokenType op = matchCompoundOperator();
 
         if(op == 0)
         {
@@ -359,13 +369,13 @@ static Expr* ternary(Expr* previous, __attribute__((unused)) bool canAssign)
 
 static Expr* variable(bool canAssign)
 {
-    ObjString* name = copyString(parser.previous.start,parser.previous.length);
+    ObjString* name = keepString(copyString(parser.previous.start,parser.previous.length));
 
     //if(match(TOKEN_DOT)) return dot();
 
     if(match(TOKEN_EQUAL) && canAssign)
     {
-        TokenType op = matchMultiple(4, TOKEN_PLUS, TOKEN_MINUS_E, TOKEN_STAR, TOKEN_SLASH);
+        TokenType op = matchCompoundOperator();
 
         if(op == 0)
         {
@@ -402,6 +412,33 @@ static Expr* base(__attribute__((unused)) bool canAssign)
     return (Expr*)newBaseExpr(methodName, parser.line);
 }
 
+static Expr* yield(__attribute__((unused)) bool canAssign)
+{
+    Expr* value = NULL;
+
+    if(!check(TOKEN_SEMICOLON) && !check(TOKEN_RIGHT_PAREN) && !check(TOKEN_COMMA) && !check(TOKEN_RIGHT_BRACKET))
+    {
+        value = expression();
+    }
+
+    return (Expr*)newYieldExpr(value, parser.line);
+}
+
+static Expr* resume(__attribute__((unused)) bool canAssign)
+{
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after 'resume'.");
+    Expr* coroutine = expression();
+
+    Expr* value = NULL;
+    if(match(TOKEN_COMMA))
+    {
+        value = expression();
+    }
+
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after resumed coroutine.");
+    return (Expr*)newResumeExpr(coroutine, value, parser.line);
+}
+
 static Expr* literal(__attribute__((unused)) bool canAssign)
 {
     switch (parser.previous.type)
@@ -490,7 +527,24 @@ static Expr* string(__attribute__((unused)) bool canAssign)
 
     escapeSequences(str, str);
 
-    Value string = OBJ_VAL(copyString(str, parser.previous.length - 2));
+    Value string = OBJ_VAL(keepString(copyString(str, parser.previous.length - 2)));
+    push(string);
+    Expr* rv = (Expr*)newLiteralExpr(string, parser.line);
+    pop();
+
+    return rv;
+}
+
+static Expr* stringPart(const char* start, uint length)
+{
+    char str[length + 1];
+
+    memcpy(str, start, length);
+    str[length] = 0;
+
+    escapeSequences(str, str);
+
+    Value string = OBJ_VAL(keepString(copyString(str, strlen(str))));
     push(string);
     Expr* rv = (Expr*)newLiteralExpr(string, parser.line);
     pop();
@@ -498,9 +552,85 @@ static Expr* string(__attribute__((unused)) bool canAssign)
     return rv;
 }
 
+// The rest of the string is scanned on its own up to the '}' closing the expression, so strings inside the
+// expression are skipped like anywhere else. Moves current past the '}', then the scanner continues after the string.
+static Expr* interpolatedExpression(const char** current, const char* end, uint16_t line)
+{
+    uint length = end - *current;
+    char source[length + 1];
+
+    memcpy(source, *current, length);
+    source[length] = 0;
+
+    Scanner outerScanner = scanner;
+    Token outerCurrent = parser.current;
+    Token outerPrevious = parser.previous;
+
+    initScanner(source);
+    scanner.line = line;
+    advance();
+
+    Expr* expr = expression();
+
+    if (check(TOKEN_RIGHT_BRACE))
+    {
+        *current += parser.current.start - source + 1;
+    }
+    else
+    {
+        errorAtCurrent("Expect '}' after interpolated expression.");
+        *current = end;
+    }
+
+    scanner = outerScanner;
+    parser.current = outerCurrent;
+    parser.previous = outerPrevious;
+
+    return expr;
+}
+
+// $"Hello {name}!" - a brace is written as \{
 static Expr* interpolatedString(__attribute__((unused)) bool canAssign)
 {
-    return NULL;
+    consume(TOKEN_STRING, "Expect string after '$'.");
+
+    Token string = parser.previous;
+    const char* current = string.start + 1;
+    const char* end = string.start + string.length - 1;
+
+    Node* parts = NULL;
+    uint partCount = 0;
+
+    while (current < end)
+    {
+        const char* start = current;
+
+        if (*current == '{')
+        {
+            current++;
+            listAdd(&parts, NODE_EXPRESSION_VALUE(interpolatedExpression(&current, end, string.line)));
+        }
+        else
+        {
+            while (current < end && *current != '{')
+            {
+                if (*current == '\\' && current + 1 < end) current++;
+                current++;
+            }
+
+            listAdd(&parts, NODE_EXPRESSION_VALUE(stringPart(start, current - start)));
+        }
+
+        partCount++;
+    }
+
+    if (partCount > UINT8_MAX)
+    {
+        error("Can't have more than 255 parts in an interpolated string.");
+        return NULL;
+    }
+
+    return (Expr*)newInterpolationExpr(parts, partCount, parser.line);
 }
 
 static Expr* unary(__attribute__((unused)) bool canAssign)
@@ -524,7 +654,7 @@ static Expr* grouping(__attribute__((unused)) bool canAssign)
 // region STATEMENTS
 static Stmt* declaration();
 static Stmt* statement();
-static Stmt* varDeclaration();
+static Stmt* finishVarDeclaration(ObjString* name);
 
 static Stmt* expressionStatement()
 {
@@ -604,6 +734,32 @@ static Expr* list(__attribute__((unused)) bool canAssign)
     return (Expr*)newListExpr(list, parser.line);
 }
 
+// 'for (i in start..end)' is a 'for (var i = start; i < end; i++)' which evaluates the bounds once
+static Stmt* rangeStatement(ObjString* name, uint16_t line)
+{
+    Expr* start = expression();
+    consume(TOKEN_DOT_DOT, "Expect '..' between range bounds.");
+    Expr* end = expression();
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after range.");
+
+    Stmt* declaration = (Stmt*)newVariableStmt(name, start, false, line);
+    Expr* condition = (Expr*)newBinaryExpr((Expr*)newVarExpr(name, line), TOKEN_LESS, end, line);
+    Expr* increment = (Expr*)newAssignExpr(name, (Expr*)newBinaryExpr(
+                                                   (Expr*)newVarExpr(name, line),
+                                                   TOKEN_PLUS,
+                                                   (Expr*)newLiteralExpr(NUMBER_VAL(1), line),
+                                                   line),
+                                           line);
+
+    Stmt* body = statement();
+
+    ForStmt* stmt = newForStmt(declaration, condition, increment, body, parser.line);
+    stmt->isRange = true;
+    stmt->isRangeSyntax = true;
+
+    return (Stmt*)stmt;
+}
+
 static Stmt* forStatement()
 {
     consume(TOKEN_LEFT_PAREN, "Expect '(' after 'for'.");
@@ -616,11 +772,23 @@ static Stmt* forStatement()
     }
     else if (match(TOKEN_VAR))
     {
-        declaration = varDeclaration();
+        ObjString* name = parseVariableName("Expect variable name after 'var'.");
+        if (match(TOKEN_IN)) return rangeStatement(name, parser.line);
+
+        declaration = finishVarDeclaration(name);
     }
     else
     {
-        declaration = expressionStatement();
+        Expr* expr = expression();
+
+        // 'var' may be left out in a range
+        if (expr->type == VAR_EXPRESSION && match(TOKEN_IN))
+        {
+            return rangeStatement(((VarExpr*)expr)->name, parser.line);
+        }
+
+        consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
+        declaration = (Stmt*)newExpressionStmt(expr, parser.line);
     }
 
     Expr* condition = NULL;
@@ -656,6 +824,22 @@ static Stmt* continueStatement()
     return (Stmt*)newContinueStmt(parser.line);
 }
 
+static Stmt* foreachStatement()
+{
+    consume(TOKEN_LEFT_PAREN, "Expect '(' after 'foreach'.");
+    consume(TOKEN_VAR, "Expect 'var' before the loop variable.");
+
+    ObjString* name = parseVariableName("Expect loop variable name.");
+
+    consume(TOKEN_IN, "Expect 'in' after loop variable.");
+    Expr* iterable = expression();
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after the iterated value.");
+
+    Stmt* body = statement();
+
+    return (Stmt*)newForeachStmt(name, iterable, body, parser.line);
+}
+
 static Stmt* whileStatement()
 {
     consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
@@ -733,7 +917,28 @@ static Stmt* switchStatement()
 
     consume(TOKEN_RIGHT_BRACE, "Expect '}' at the end of switch statement.");
 
-    return (Stmt*)newSwitchStmt(caseConditions, caseBodies, defaultCase, parser.line);
+    return (Stmt*)newSwitchStmt(value, caseConditions, caseBodies, defaultCase, parser.line);
+}
+
+static Stmt* tryStatement()
+{
+    consume(TOKEN_LEFT_BRACE, "Expect '{' after 'try'.");
+    Stmt* body = block();
+
+    consume(TOKEN_CATCH, "Expect 'catch' after try block.");
+
+    // The error message can be bound to a name, 'catch (error) { ... }', or ignored, 'catch { ... }'
+    ObjString* errorName = NULL;
+    if (match(TOKEN_LEFT_PAREN))
+    {
+        errorName = parseVariableName("Expect error name after '('.");
+        consume(TOKEN_RIGHT_PAREN, "Expect ')' after error name.");
+    }
+
+    consume(TOKEN_LEFT_BRACE, "Expect '{' before catch block.");
+    Stmt* handler = block();
+
+    return (Stmt*)newTryStmt(body, errorName, handler, parser.line);
 }
 
 /*
@@ -784,11 +989,13 @@ static Stmt* statement()
     if (match(TOKEN_IF))              return ifStatement();
     else if (match(TOKEN_WHILE))      return whileStatement();
     else if (match(TOKEN_FOR))        return forStatement();
+    else if (match(TOKEN_FOREACH))    return foreachStatement();
     else if (match(TOKEN_LEFT_BRACE)) return block();
     else if (match(TOKEN_BREAK))      return breakStatement();
     else if (match(TOKEN_CONTINUE))   return continueStatement();
     else if (match(TOKEN_SWITCH))     return switchStatement();
     else if (match(TOKEN_RETURN))     return returnStatement();
+    else if (match(TOKEN_TRY))        return tryStatement();
     else return expressionStatement();
 
 }
@@ -872,11 +1079,9 @@ static Stmt* classDeclaration()
     return (Stmt*)newClassStmt(name, parent, *methods, parser.line);
 }
 
-static Stmt* varDeclaration()
+// The name has been parsed
+static Stmt* finishVarDeclaration(ObjString* name)
 {
-    // Get name
-    ObjString* name = parseVariableName("Expect variable name after 'var'.");
-
     // Get initializer
     Expr* initializer;
     if (match(TOKEN_EQUAL))
@@ -891,7 +1096,27 @@ static Stmt* varDeclaration()
 
     consume(TOKEN_SEMICOLON, "Expect ';' after variable declaration.");
 
-    return (Stmt*)newVariableStmt(name, initializer, parser.line);
+    return (Stmt*)newVariableStmt(name, initializer, false, parser.line);
+}
+
+static Stmt* varDeclaration()
+{
+    // Get name
+    ObjString* name = parseVariableName("Expect variable name after 'var'.");
+
+    return finishVarDeclaration(name);
+}
+
+static Stmt* constDeclaration()
+{
+    ObjString* name = parseVariableName("Expect constant name after 'const'.");
+
+    consume(TOKEN_EQUAL, "Expect '=' after constant name.");
+    Expr* initializer = expression();
+
+    consume(TOKEN_SEMICOLON, "Expect ';' after constant declaration.");
+
+    return (Stmt*)newVariableStmt(name, initializer, true, parser.line);
 }
 
 static Stmt* declaration()
@@ -899,6 +1124,7 @@ static Stmt* declaration()
     Stmt* stmt;
 
     if (match(TOKEN_VAR))           stmt = varDeclaration();
+    else if (match(TOKEN_CONST))    stmt = constDeclaration();
     else if (match(TOKEN_FUNCTION)) stmt = functionDeclaration(false);
     else if (match(TOKEN_CLASS))    stmt = classDeclaration();
     else
@@ -964,6 +1190,14 @@ ParseRule rules[] =
         [TOKEN_SEMICOLON]     = {NULL,                 NULL,      PREC_NONE},
         [TOKEN_SLASH]         = {NULL,                 binary,    PREC_FACTOR},
         [TOKEN_STAR]          = {NULL,                 binary,    PREC_FACTOR},
+        [TOKEN_PERCENT]       = {NULL,                 binary,    PREC_FACTOR},
+        [TOKEN_TILDE_SLASH]   = {NULL,                 binary,    PREC_FACTOR},
+        [TOKEN_AMPERSAND]     = {NULL,                 binary,    PREC_BIT_AND},
+        [TOKEN_PIPE]          = {NULL,                 binary,    PREC_BIT_OR},
+        [TOKEN_CARET]         = {NULL,                 binary,    PREC_BIT_XOR},
+        [TOKEN_LESS_LESS]     = {NULL,                 binary,    PREC_SHIFT},
+        [TOKEN_GREATER_GREATER] = {NULL,               binary,    PREC_SHIFT},
+        [TOKEN_TILDE]         = {unary,                NULL,      PREC_NONE},
         [TOKEN_BANG]          = {unary,                NULL,      PREC_NONE},
         [TOKEN_BANG_EQUAL]    = {NULL,                 binary,    PREC_EQUALITY},
         [TOKEN_EQUAL]         = {NULL,                 binary,    PREC_COMPARISON},
@@ -983,6 +1217,9 @@ ParseRule rules[] =
         [TOKEN_COLON]         = {NULL,                 NULL,      PREC_NONE},
         [TOKEN_FALSE]         = {literal,              NULL,      PREC_NONE},
         [TOKEN_FOR]           = {NULL,                 NULL,      PREC_NONE},
+        [TOKEN_FOREACH]       = {NULL,                 NULL,      PREC_NONE},
+        [TOKEN_IN]            = {NULL,                 NULL,      PREC_NONE},
+        [TOKEN_DOT_DOT]       = {NULL,                 NULL,      PREC_NONE},
         [TOKEN_FUNCTION]      = {NULL,                 NULL,      PREC_NONE},
         [TOKEN_IF]            = {NULL,                 NULL,      PREC_NONE},
         [TOKEN_NULL]          = {literal,              NULL,      PREC_NONE},
@@ -991,6 +1228,8 @@ ParseRule rules[] =
         [TOKEN_DOT]           = {variable,             dot,       PREC_CALL},
         [TOKEN_THIS]          = {this_,                NULL,      PREC_NONE},
         [TOKEN_BASE]          = {base,                 NULL,      PREC_NONE},
+        [TOKEN_YIELD]         = {yield,                NULL,      PREC_NONE},
+        [TOKEN_RESUME]        = {resume,               NULL,      PREC_NONE},
         [TOKEN_TRUE]          = {literal,              NULL,      PREC_NONE},
         [TOKEN_VAR]           = {NULL,                 NULL,      PREC_NONE},
         [TOKEN_PLUS_PLUS]     = {NULL,                 increment, PREC_INCR_DECR},
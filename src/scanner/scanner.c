@@ -8,6 +8,7 @@ void initScanner(const char* source)
     scanner.current = source;
     scanner.line = 1;
     scanner.returnNext = TOKEN_NONE;
+    scanner.afterDollar = false;
 }
 
 static Token makeToken(TokenType type)
@@ -141,25 +142,48 @@ static Token number()
     return makeToken(TOKEN_NUMBER);
 }
 
-static Token string()
+// Moves through the closing quote of a string whose opening quote was consumed, false if there's none.
+// The expressions between the braces of an interpolated string can have strings of their own.
+static bool skipString(bool interpolated)
 {
-    while (peek() != '"' && !isAtEnd())
+    int depth = 0;
+
+    while (!isAtEnd())
     {
-        if (peek() == '\n') scanner.line++;
-        if (peek() == '\\')
+        char c = advance();
+
+        if (c == '\n')
         {
-            if(peekNext() == '"')
-            {
-               advance();
-            }
+            scanner.line++;
+        }
+        else if (depth == 0 && c == '\\')
+        {
+            if (peek() == '"' || (interpolated && peek() == '{')) advance();
+        }
+        else if (interpolated && c == '{')
+        {
+            depth++;
+        }
+        else if (depth > 0 && c == '}')
+        {
+            depth--;
+        }
+        else if (c == '"')
+        {
+            if (depth == 0) return true;
+
+            // Nested interpolated strings are right after their '$'
+            if (!skipString(scanner.current[-2] == '$')) return false;
         }
-        advance();
     }
 
-    if (isAtEnd()) return errorToken("Unterminated string.");
+    return false;
+}
+
+static Token string(bool interpolated)
+{
+    if (!skipString(interpolated)) return errorToken("Unterminated string.");
 
-    // Advance through the closing quote.
-    advance();
     return makeToken(TOKEN_STRING);
 }
 
@@ -180,11 +204,24 @@ static TokenType identifierType()
     switch (scanner.start[0])
     {
         case 'e': return checkKeyword(1, 3, "lse", TOKEN_ELSE);
-        case 'i': return checkKeyword(1, 1, "f", TOKEN_IF);
+        case 'i':
+        {
+            if (scanner.current - scanner.start == 2 && scanner.start[1] == 'n') return TOKEN_IN;
+            return checkKeyword(1, 1, "f", TOKEN_IF);
+        }
         case 'n': return checkKeyword(1, 3, "ull", TOKEN_NULL);
-        case 'r': return checkKeyword(1, 5, "eturn", TOKEN_RETURN);
+        case 'r':
+        {
+            if (scanner.current - scanner.start > 2 && scanner.start[2] == 's')
+            {
+                return checkKeyword(1, 5, "esume", TOKEN_RESUME);
+            }
+
+            return checkKeyword(1, 5, "eturn", TOKEN_RETURN);
+        }
         case 'v': return checkKeyword(1, 2, "ar", TOKEN_VAR);
         case 'w': return checkKeyword(1, 4, "hile", TOKEN_WHILE);
+        case 'y': return checkKeyword(1, 4, "ield", TOKEN_YIELD);
 
         case 'd': return checkKeyword(1, 6, "efault", TOKEN_DEFAULT);
         case 's': return checkKeyword(1, 5, "witch", TOKEN_SWITCH);
@@ -207,9 +244,25 @@ static TokenType identifierType()
             {
                 switch (scanner.start[1])
                 {
-                    case 'o': return checkKeyword(2, 6, "ntinue", TOKEN_CONTINUE);
+                    case 'o':
+                    {
+                        if (scanner.current - scanner.start == 5)
+                        {
+                            return checkKeyword(2, 3, "nst", TOKEN_CONST);
+                        }
+
+                        return checkKeyword(2, 6, "ntinue", TOKEN_CONTINUE);
+                    }
                     case 'l': return checkKeyword(2, 3, "ass", TOKEN_CLASS);
-                    case 'a': return checkKeyword(2, 2, "se", TOKEN_CASE);
+                    case 'a':
+                    {
+                        if (scanner.current - scanner.start > 2 && scanner.start[2] == 't')
+                        {
+                            return checkKeyword(3, 2, "ch", TOKEN_CATCH);
+                        }
+
+                        return checkKeyword(2, 2, "se", TOKEN_CASE);
+                    }
                 }
             }
             break;
@@ -222,7 +275,14 @@ static TokenType identifierType()
                     case 'a':
                         return checkKeyword(2, 3, "lse", TOKEN_FALSE);
                     case 'o':
+                    {
+                        if (scanner.current - scanner.start == 7)
+                        {
+                            return checkKeyword(2, 5, "reach", TOKEN_FOREACH);
+                        }
+
                         return checkKeyword(2, 1, "r", TOKEN_FOR);
+                    }
                     case 'u':
                         return checkKeyword(2, 6, "nction", TOKEN_FUNCTION);
                 }
@@ -237,7 +297,14 @@ static TokenType identifierType()
                     case 'h':
                         return checkKeyword(2, 2, "is", TOKEN_THIS);
                     case 'r':
+                    {
+                        if (scanner.current - scanner.start == 3)
+                        {
+                            return checkKeyword(2, 1, "y", TOKEN_TRY);
+                        }
+
                         return checkKeyword(2, 2, "ue", TOKEN_TRUE);
+                    }
                 }
             }
             break;
@@ -254,6 +321,19 @@ static Token identifier()
     return makeToken(identifierType());
 }
 
+uint countTokens(const char* source)
+{
+    initScanner(source);
+    uint count = 0;
+
+    while (scanToken().type != TOKEN_EOF)
+    {
+        count++;
+    }
+
+    return count;
+}
+
 Token scanToken()
 {
     if(scanner.returnNext != TOKEN_NONE)
@@ -264,6 +344,9 @@ Token scanToken()
         return makeToken(type);
     }
 
+    bool afterDollar = scanner.afterDollar;
+    scanner.afterDollar = false;
+
     skipWhitespace();
     scanner.start = scanner.current;
 
@@ -293,8 +376,10 @@ Token scanToken()
         case ',':
             return makeToken(TOKEN_COMMA);
         case '.':
-            return makeToken(TOKEN_DOT);
+            return makeToken(
+                    match('.') ? TOKEN_DOT_DOT : TOKEN_DOT);
         case '$':
+            scanner.afterDollar = true;
             return makeToken(TOKEN_DOLLAR);
         case '?':
             return makeToken(TOKEN_QUESTION_MARK);
@@ -339,26 +424,59 @@ Token scanToken()
             }
             else return makeToken(TOKEN_STAR);
 
+        case '%':
+            if (match('='))
+            {
+                scanner.returnNext = TOKEN_PERCENT;
+                return makeToken(TOKEN_EQUAL);
+            }
+            else return makeToken(TOKEN_PERCENT);
+
+        case '^':
+            if (match('='))
+            {
+                scanner.returnNext = TOKEN_CARET;
+                return makeToken(TOKEN_EQUAL);
+            }
+            else return makeToken(TOKEN_CARET);
+
+        // '//' starts a comment, integer division is '~/'
+        case '~':
+            if (match('/'))
+            {
+                if (match('='))
+                {
+                    scanner.returnNext = TOKEN_TILDE_SLASH;
+                    return makeToken(TOKEN_EQUAL);
+                }
+
+                return makeToken(TOKEN_TILDE_SLASH);
+            }
+            else return makeToken(TOKEN_TILDE);
+
         case '&':
-            if(match('&'))
+            if (match('&'))
             {
                 return makeToken(TOKEN_AND);
             }
-            else
+            else if (match('='))
             {
-                return errorToken("Expected '&' after '&'.");
+                scanner.returnNext = TOKEN_AMPERSAND;
+                return makeToken(TOKEN_EQUAL);
             }
+            else return makeToken(TOKEN_AMPERSAND);
 
         case '|':
-            if(match('|'))
+            if (match('|'))
             {
                 return makeToken(TOKEN_OR);
             }
-            else
+            else if (match('='))
             {
-                return errorToken("Expected '|' after '|'.");
+                scanner.returnNext = TOKEN_PIPE;
+                return makeToken(TOKEN_EQUAL);
             }
-
+            else return makeToken(TOKEN_PIPE);
 
         case '!':
             return makeToken(
@@ -367,13 +485,33 @@ Token scanToken()
             return makeToken(
                     match('=') ? TOKEN_EQUAL_EQUAL : TOKEN_EQUAL);
         case '<':
+            if (match('<'))
+            {
+                if (match('='))
+                {
+                    scanner.returnNext = TOKEN_LESS_LESS;
+                    return makeToken(TOKEN_EQUAL);
+                }
+
+                return makeToken(TOKEN_LESS_LESS);
+            }
             return makeToken(
                     match('=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
         case '>':
+            if (match('>'))
+            {
+                if (match('='))
+                {
+                    scanner.returnNext = TOKEN_GREATER_GREATER;
+                    return makeToken(TOKEN_EQUAL);
+                }
+
+                return makeToken(TOKEN_GREATER_GREATER);
+            }
             return makeToken(
                     match('=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
 
-        case '"': return string();
+        case '"': return string(afterDollar);
 
         default:
             printf("Reached unreachable.");
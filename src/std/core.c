@@ -17,6 +17,7 @@ ObjString* classStringConst;
 ObjString* listStringConst;
 ObjString* instanceStringConst;
 ObjString* stringStringConst;
+ObjString* coroutineStringConst;
 
 NATIVE_FUNCTION(print)
 {
@@ -49,6 +50,38 @@ NATIVE_FUNCTION(include)
     return NULL_VAL;
 }
 
+NATIVE_FUNCTION(coroutine)
+{
+    if(argCount != 1 || !IS_FUNCTION(args[0]))
+    {
+        nativeError(line, "coroutine", "Expected a function.");
+        return NULL_VAL;
+    }
+
+    ObjFunction* function = AS_FUNCTION(args[0]);
+
+    // The first resume passes at most one value
+    if(function->arity > 1)
+    {
+        nativeError(line, "coroutine", "Coroutine functions take at most 1 argument, '%s' takes %d.",
+                    function->name->chars, function->arity);
+        return NULL_VAL;
+    }
+
+    return OBJ_VAL(newCoroutine(function));
+}
+
+NATIVE_FUNCTION(isDone)
+{
+    if(argCount != 1 || !IS_COROUTINE(args[0]))
+    {
+        nativeError(line, "isDone", "Expected a coroutine.");
+        return NULL_VAL;
+    }
+
+    return BOOL_VAL(AS_COROUTINE(args[0])->state == COROUTINE_DONE);
+}
+
 NATIVE_FUNCTION(type)
 {
     Value value = args[0];
@@ -85,6 +118,10 @@ NATIVE_FUNCTION(type)
     {
         return OBJ_VAL((Obj*)functionStringConst);
     }
+    else if (IS_COROUTINE(value))
+    {
+        return OBJ_VAL((Obj*)coroutineStringConst);
+    }
     else
     {
         printf("Unreachable reached");
@@ -93,11 +130,37 @@ NATIVE_FUNCTION(type)
 
 }
 
+// Every call to coroutine() creates a new one and isDone() reads one which changes, so neither is pure
+static const NativeDefinition coreNatives[] = {
+    {"print",     printNative,     NATIVE_EFFECTS},
+    {"type",      typeNative,      NATIVE_PURE},
+    {"include",   includeNative,   NATIVE_IMPURE},
+    {"coroutine", coroutineNative, NATIVE_EFFECTS},
+    {"isDone",    isDoneNative,    NATIVE_EFFECTS},
+    {NULL}
+};
+
+static const NativeDefinition* moduleNatives(ObjString* moduleName)
+{
+    if (moduleName == NULL) return coreNatives;
+
+    if (charsEqual(moduleName->chars, "math", moduleName->length, 4))   return mathNatives;
+    if (charsEqual(moduleName->chars, "os", moduleName->length, 2))     return osNatives;
+    if (charsEqual(moduleName->chars, "random", moduleName->length, 6)) return randomNatives;
+    if (charsEqual(moduleName->chars, "list", moduleName->length, 4))   return listNatives;
+
+    return NULL;
+}
+
+NativePurity nativePurity(ObjString* moduleName, ObjString* name)
+{
+    const NativeDefinition* natives = moduleNatives(moduleName);
+    return natives != NULL ? findNativePurity(natives, name) : NATIVE_IMPURE;
+}
+
 void defineCore(Table* table)
 {
-    defineNativeFunction(table, "print", printNative);
-    defineNativeFunction(table, "type", typeNative);
-    defineNativeFunction(table, "include",includeNative);
+    defineNativeFunctions(table, coreNatives);
 
     boolStringConst = copyString("bool", 4);
     nullStringConst = copyString("null", 4);
@@ -107,4 +170,5 @@ void defineCore(Table* table)
     listStringConst = copyString("list", 4);
     instanceStringConst = copyString("instance", 8);
     stringStringConst = copyString("string", 5);
+    coroutineStringConst = copyString("coroutine", 9);
 }
@@ -1,7 +1,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 
-#include "object.h"
+#include "native_utils.h"
 #include "vm.h"
 
 void nativeError(uint16_t line, const char* fooName, const char* format, ...)
@@ -41,3 +41,21 @@ void defineNativeFunction(Table* table, const char* name, NativeFn function)
     );
 }
 
+
+void defineNativeFunctions(Table* table, const NativeDefinition* natives)
+{
+    for (const NativeDefinition* native = natives; native->name != NULL; native++)
+    {
+        defineNativeFunction(table, native->name, native->function);
+    }
+}
+
+NativePurity findNativePurity(const NativeDefinition* natives, ObjString* name)
+{
+    for (const NativeDefinition* native = natives; native->name != NULL; native++)
+    {
+        if (charsEqual((char*)native->name, name->chars, (int)strlen(native->name), name->length)) return native->purity;
+    }
+
+    return NATIVE_IMPURE;
+}
@@ -48,18 +48,19 @@ NATIVE_FUNCTION(count)
     return NUMBER_VAL(AS_LIST(args[0])->count);
 }
 
+// Counting only reads the list, the rest change it
+const NativeDefinition listNatives[] = {
+    {"join",   joinNative,   NATIVE_IMPURE},
+    {"remove", removeNative, NATIVE_IMPURE},
+    {"count",  countNative,  NATIVE_PURE},
+    {"append", appendNative, NATIVE_IMPURE},
+    {NULL}
+};
+
 void defineList(Table* table)
 {
     ObjClass* list = newClass(copyString("list", 4));
-
-    #define DEFINE_LIST_METHOD(name, method) defineNativeFunction(list->methods, name, method)
-
-    DEFINE_LIST_METHOD("join",   joinNative);
-    DEFINE_LIST_METHOD("remove", removeNative);
-    DEFINE_LIST_METHOD("count",  countNative);
-    DEFINE_LIST_METHOD("append", appendNative);
-
-    #undef DEFINE_LIST_METHOD
+    defineNativeFunctions(list->methods, listNatives);
 
     ObjInstance* instance = newInstance(list);
 
@@ -111,34 +111,32 @@ NATIVE_FUNCTION(round)
     return NUMBER_VAL(round(AS_NUMBER(args[0])));
 }
 
+const NativeDefinition mathNatives[] = {
+    {"abs",              absNative,              NATIVE_PURE},
+    {"round",            roundNative,            NATIVE_PURE},
+    {"sqrt",             sqrtNative,             NATIVE_PURE},
+    {"tan",              tanNative,              NATIVE_PURE},
+    {"cos",              cosNative,              NATIVE_PURE},
+    {"sin",              sinNative,              NATIVE_PURE},
+    {"min",              minNative,              NATIVE_PURE},
+    {"max",              maxNative,              NATIVE_PURE},
+    {"mod",              modNative,              NATIVE_PURE},
+    {"exp",              expNative,              NATIVE_PURE},
+    {"degreesToRadians", degreesToRadiansNative, NATIVE_PURE},
+    {"radiansToDegrees", radiansToDegreesNative, NATIVE_PURE},
+    {"floor",            floorNative,            NATIVE_PURE},
+    {"ceil",             ceilNative,             NATIVE_PURE},
+    {"atan2",            atan2Native,            NATIVE_PURE},
+    {"atan",             atanNative,             NATIVE_PURE},
+    {"asin",             asinNative,             NATIVE_PURE},
+    {"acos",             acosNative,             NATIVE_PURE},
+    {NULL}
+};
+
 void defineMath(Table* table)
 {
     ObjClass* math = newClass(copyString("math", 4));
-
-    #define DEFINE_MATH_METHOD(name, method) defineNativeFunction(math->methods, name, method)
-
-    DEFINE_MATH_METHOD("abs",   absNative);
-    DEFINE_MATH_METHOD("round", roundNative);
-    DEFINE_MATH_METHOD("sqrt",  sqrtNative);
-    DEFINE_MATH_METHOD("tan",   tanNative);
-    DEFINE_MATH_METHOD("cos",   cosNative);
-    DEFINE_MATH_METHOD("sin",   sinNative);
-    DEFINE_MATH_METHOD("min",   minNative);
-    DEFINE_MATH_METHOD("max",   maxNative);
-    DEFINE_MATH_METHOD("mod",   modNative);
-    DEFINE_MATH_METHOD("exp",   expNative);
-    DEFINE_MATH_METHOD("degreesToRadians",   degreesToRadiansNative);
-    DEFINE_MATH_METHOD("radiansToDegrees",   radiansToDegreesNative);
-    DEFINE_MATH_METHOD("floor", floorNative);
-    DEFINE_MATH_METHOD("ceil",  ceilNative);
-    DEFINE_MATH_METHOD("atan2", atan2Native);
-    DEFINE_MATH_METHOD("atan",  atanNative);
-    DEFINE_MATH_METHOD("asin",  asinNative);
-    DEFINE_MATH_METHOD("acos",  acosNative);
-    DEFINE_MATH_METHOD("atan2", atan2Native);
-    DEFINE_MATH_METHOD("atan2", atan2Native);
-
-    #undef DEFINE_MATH_METHOD
+    defineNativeFunctions(math->methods, mathNatives);
 
     ObjInstance* instance = newInstance(math);
     tableDefineEntry(instance->fields, copyString("pi", 2),
@@ -236,26 +236,35 @@ NATIVE_FUNCTION(getDate)
     return OBJ_VAL(copyString(str, strlen(str)));
 }
 
+NATIVE_FUNCTION(clock)
+{
+    CHECK_ARG_COUNT("clock", 0);
+
+    return NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
+}
+
+// Files, input and the clock are outside of the script
+const NativeDefinition osNatives[] = {
+    {"getDate",         getDateNative,         NATIVE_EFFECTS},
+    {"clock",           clockNative,           NATIVE_EFFECTS},
+    {"inputYesNo",      inputYesNoNative,      NATIVE_EFFECTS},
+    {"inputString",     inputStringNative,     NATIVE_EFFECTS},
+    {"fileExists",      fileExistsNative,      NATIVE_EFFECTS},
+    {"directoryExists", directoryExistsNative, NATIVE_EFFECTS},
+    {"directoryRemove", directoryRemoveNative, NATIVE_EFFECTS},
+    {"directoryCreate", directoryCreateNative, NATIVE_EFFECTS},
+    {"fileRemove",      fileRemoveNative,      NATIVE_EFFECTS},
+    {"fileCreate",      fileCreateNative,      NATIVE_EFFECTS},
+    {"fileWrite",       fileWriteNative,       NATIVE_EFFECTS},
+    {"fileRead",        fileReadNative,        NATIVE_EFFECTS},
+    {"exit",            exitNative,            NATIVE_EFFECTS},
+    {NULL}
+};
+
 void defineOS(Table* table)
 {
     ObjClass* os = newClass(copyString("os", 2));
-
-    #define DEFINE_OS_METHOD(name, method) defineNativeFunction(os->methods, name, method)
-
-    DEFINE_OS_METHOD("getDate",         getDateNative);
-    DEFINE_OS_METHOD("inputYesNo",      inputYesNoNative);
-    DEFINE_OS_METHOD("inputString",     inputStringNative);
-    DEFINE_OS_METHOD("fileExists",      fileExistsNative);
-    DEFINE_OS_METHOD("directoryExists", directoryExistsNative);
-    DEFINE_OS_METHOD("directoryRemove", directoryRemoveNative);
-    DEFINE_OS_METHOD("directoryCreate", directoryCreateNative);
-    DEFINE_OS_METHOD("fileRemove",      fileRemoveNative);
-    DEFINE_OS_METHOD("fileCreate",      fileCreateNative);
-    DEFINE_OS_METHOD("fileWrite",       fileWriteNative);
-    DEFINE_OS_METHOD("fileRead",        fileReadNative);
-    DEFINE_OS_METHOD("exit",            exitNative);
-
-    #undef DEFINE_OS_METHOD
+    defineNativeFunctions(os->methods, osNatives);
 
     char pathSeparator;
 
@@ -56,19 +56,20 @@ NATIVE_FUNCTION(between)
     return NUMBER_VAL(min + (rand() / div));
 }
 
+// The random state isn't a value of the script, but every call changes it
+const NativeDefinition randomNatives[] = {
+    {"between",        betweenNative,        NATIVE_EFFECTS},
+    {"integerBetween", integerBetweenNative, NATIVE_EFFECTS},
+    {"integer",        integerNative,        NATIVE_EFFECTS},
+    {"bool",           boolNative,           NATIVE_EFFECTS},
+    {"init",           initNative,           NATIVE_EFFECTS},
+    {NULL}
+};
+
 void defineRandom(Table* table)
 {
     ObjClass* random = newClass(copyString("random", 6));
-
-    #define DEFINE_RANDOM_METHOD(name, method) defineNativeFunction(random->methods, name, method)
-
-    DEFINE_RANDOM_METHOD("between", betweenNative);
-    DEFINE_RANDOM_METHOD("integerBetween", integerBetweenNative);
-    DEFINE_RANDOM_METHOD("integer", integerNative);
-    DEFINE_RANDOM_METHOD("bool", boolNative);
-    DEFINE_RANDOM_METHOD("init", initNative);
-
-    #undef DEFINE_MATH_METHOD
+    defineNativeFunctions(random->methods, randomNatives);
 
     tableDefineEntry(
             table,
@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <math.h>
 
 #include "common.h"
 #include "vm.h"
@@ -8,8 +10,11 @@
 #include "object.h"
 #include "memory.h"
 #include "emitter.h"
+#include "inliner.h"
+#include "profile.h"
 #include "garbage_collector.h"
 #include "core.h"
+#include "phase_timer.h"
 
 VM vm;
 
@@ -17,22 +22,38 @@ VM vm;
 
 static void resetStack()
 {
+    vm.stack = vm.mainStack;
+    vm.frames = vm.mainFrames;
+    vm.frameMax = FRAMES_MAX;
+    vm.currentCoroutine = NULL;
+
     // This is the equivalent of: vm.stackTop = &vm.stack[0]
     vm.stackTop = vm.stack;
+    vm.frameCount = 0;
 }
 
+// Only records the error, whoever raised it stops and lets the VM look for a handler
 void runtimeError(uint16_t line, const char* format, ...)
 {
     va_list args;
     va_start(args, format);
-    fprintf(stderr, "[line %d] Runtime Error : ", line);
-    vfprintf(stderr, format, args);
+    vsnprintf(vm.errorMessage, ERROR_MESSAGE_MAX, format, args);
     va_end(args);
-    fputs("\n", stderr);
 
+    vm.errorLine = line;
+}
+
+void reportRuntimeError()
+{
+    fprintf(stderr, "[line %d] Runtime Error : %s\n", vm.errorLine, vm.errorMessage);
     resetStack();
 }
 
+const char* rangeBoundsError(bool isRangeSyntax)
+{
+    return isRangeSyntax ? "Range bounds must be numbers." : "Both operands must be numbers.";
+}
+
 // endregion
 
 // region VM Utils
@@ -97,6 +118,55 @@ static void concatenate()
     push(OBJ_VAL(result));
 }
 
+// Applies the arithmetic opcode of OP_UPDATE_VARIABLE or OP_UPDATE_PROPERTY to the current value and the operand
+// on top of the stack, the result replaces the operand
+static bool applyUpdate(uint8_t op, Value current, uint16_t line)
+{
+    Value operand = peek(0);
+
+    if (IS_NUMBER(current) && IS_NUMBER(operand))
+    {
+        double a = AS_NUMBER(current);
+        double b = AS_NUMBER(operand);
+        double result;
+
+        switch (op)
+        {
+            case OP_ADD:         result = a + b;                   break;
+            case OP_SUBTRACT:    result = a - b;                   break;
+            case OP_MULTIPLY:    result = a * b;                   break;
+            case OP_DIVIDE:      result = a / b;                   break;
+            case OP_MODULO:      result = numberModulo(a, b);      break;
+            case OP_INT_DIVIDE:  result = numberIntDivide(a, b);   break;
+            case OP_BIT_AND:     result = numberBitAnd(a, b);      break;
+            case OP_BIT_OR:      result = numberBitOr(a, b);       break;
+            case OP_BIT_XOR:     result = numberBitXor(a, b);      break;
+            case OP_SHIFT_LEFT:  result = numberShiftLeft(a, b);   break;
+            case OP_SHIFT_RIGHT: result = numberShiftRight(a, b);  break;
+
+            default:
+                runtimeError(line, "Unknown operator in compound assignment.");
+                return false;
+        }
+
+        vm.stackTop[-1] = NUMBER_VAL(result);
+        return true;
+    }
+
+    if (op == OP_ADD && (IS_STRING(current) || IS_STRING(operand)))
+    {
+        vm.stackTop[-1] = current;
+        push(operand);
+        concatenate();
+        return true;
+    }
+
+    runtimeError(line, op == OP_ADD ? "Operands must be either two numbers or two strings." :
+                                      "Both operands must be numbers.");
+    return false;
+}
+
+// Arguments are expected on top of the stack, the function's body pops them with OP_DEFINE_ARGUMENT
 static bool call(ObjFunction* function, ObjInstance* thisValue, uint16_t argCount, uint16_t line)
 {
     if(argCount != function->arity)
@@ -105,21 +175,239 @@ static bool call(ObjFunction* function, ObjInstance* thisValue, uint16_t argCoun
         return false;
     }
 
+    if(vm.frameCount == vm.frameMax)
+    {
+        runtimeError(line, "Stack overflow.");
+        return false;
+    }
+
+    if(function->declaration != NULL && !compileLazily(function))
+    {
+        runtimeError(line, "Couldn't compile function '%s'.", function->name->chars);
+        return false;
+    }
+
+    CallFrame* frame = &vm.frames[vm.frameCount++];
+    frame->function = function;
+    frame->slots = vm.stackTop - argCount;
+    frame->returnIp = vm.ip;
+    frame->returnEnvironment = vm.currentEnvironment;
+
     vm.ip = function->chunk.code;
-    vm.currentEnvironment = newEnvironment(); // todo found the culprit
+    vm.currentFunction = function;
 
     // Define 'this' to be replaced by instance in methods
     if(thisValue != NULL)
     {
+        // Until it's defined the instance might not be reachable from anywhere
+        push(OBJ_VAL(thisValue));
+        vm.currentEnvironment = newEnvironment();
         environmentDefine(vm.currentEnvironment, vm.thisString, OBJ_VAL(thisValue), line);
+        pop();
+    }
+    else
+    {
+        vm.currentEnvironment = newEnvironment();
     }
 
     vm.currentEnvironment->enclosing = function->closure;
-    vm.currentFunction = function;
+    frame->environment = vm.currentEnvironment;
+
+    return true;
+}
+
+// Frees every environment opened inside the frame's function, leaving 'depth' of them open
+static void closeScopes(CallFrame* frame, uint8_t depth)
+{
+    uint opened = 0;
+
+    for(Environment* env = vm.currentEnvironment; env != frame->environment; env = env->enclosing)
+    {
+        opened++;
+    }
+
+    while(opened > depth)
+    {
+        Environment* old = vm.currentEnvironment;
+
+        vm.currentEnvironment = vm.currentEnvironment->enclosing;
+        freeEnvironment(old);
+        opened--;
+    }
+}
+
+static void returnFromFrame(Value result)
+{
+    CallFrame* frame = &vm.frames[vm.frameCount - 1];
+
+    closeScopes(frame, 0);
+
+    vm.currentEnvironment = frame->returnEnvironment;
+    freeEnvironment(frame->environment);
+
+    vm.stackTop = frame->slots;
+    push(result);
+
+    vm.ip = frame->returnIp;
+
+    vm.frameCount--;
+    vm.currentFunction = vm.frames[vm.frameCount - 1].function;
+}
+
+// region Coroutines
+
+// Exchanges the VM's registers with the ones saved in the coroutine. The same swap suspends
+// whoever is running and continues the other side, so switching never allocates.
+static void swapRegisters(ObjCoroutine* coroutine)
+{
+    #define SWAP(type, a, b) { type temp = a; a = b; b = temp; }
+
+    SWAP(Value*, vm.stack, coroutine->savedStack)
+    SWAP(Value*, vm.stackTop, coroutine->savedStackTop)
+    SWAP(CallFrame*, vm.frames, coroutine->savedFrames)
+    SWAP(int, vm.frameCount, coroutine->savedFrameCount)
+    SWAP(int, vm.frameMax, coroutine->savedFrameMax)
+    SWAP(uint8_t*, vm.ip, coroutine->savedIp)
+    SWAP(Environment*, vm.currentEnvironment, coroutine->savedEnvironment)
+    SWAP(ObjFunction*, vm.currentFunction, coroutine->savedFunction)
+
+    #undef SWAP
+}
+
+// 'value' becomes the argument of the first resume and the result of 'yield' in the later ones
+static bool resumeCoroutine(Value callee, Value value, uint16_t line)
+{
+    if(!IS_COROUTINE(callee))
+    {
+        runtimeError(line, "Can only resume coroutines.");
+        return false;
+    }
+
+    ObjCoroutine* coroutine = AS_COROUTINE(callee);
+
+    if(coroutine->state == COROUTINE_DONE)
+    {
+        runtimeError(line, "Cannot resume a finished coroutine.");
+        return false;
+    }
+
+    if(coroutine->state == COROUTINE_RUNNING)
+    {
+        runtimeError(line, "Cannot resume a running coroutine.");
+        return false;
+    }
+
+    bool start = coroutine->state == COROUTINE_CREATED;
+
+    swapRegisters(coroutine);
+    coroutine->resumer = vm.currentCoroutine;
+    coroutine->state = COROUTINE_RUNNING;
+    vm.currentCoroutine = coroutine;
+
+    if(!start)
+    {
+        push(value);
+        return true;
+    }
+
+    ObjFunction* function = coroutine->function;
+
+    if(function->arity == 1)
+    {
+        push(value);
+    }
 
+    return call(function, NULL, function->arity, line);
+}
+
+static bool yieldCoroutine(Value value, uint16_t line)
+{
+    ObjCoroutine* coroutine = vm.currentCoroutine;
+
+    if(coroutine == NULL)
+    {
+        runtimeError(line, "Can only yield inside a coroutine.");
+        return false;
+    }
+
+    swapRegisters(coroutine);
+    vm.currentCoroutine = coroutine->resumer;
+    coroutine->resumer = NULL;
+    coroutine->state = COROUTINE_SUSPENDED;
+
+    push(value);
     return true;
 }
 
+// Ends the coroutine once its bottom frame is left, by returning or by an uncaught error
+static void finishCoroutine()
+{
+    ObjCoroutine* coroutine = vm.currentCoroutine;
+    CallFrame* frame = &vm.frames[0];
+
+    closeScopes(frame, 0);
+    freeEnvironment(frame->environment);
+
+    vm.currentEnvironment = NULL;
+    vm.currentFunction = NULL;
+    vm.ip = NULL;
+    vm.stackTop = vm.stack;
+    vm.frameCount = 0;
+
+    swapRegisters(coroutine);
+    vm.currentCoroutine = coroutine->resumer;
+    coroutine->resumer = NULL;
+    coroutine->state = COROUTINE_DONE;
+}
+
+// endregion
+
+// Looks up the exception tables, from the failed instruction outwards through its callers.
+// This is the only place they are read, so code inside 'try' runs exactly like code outside of it.
+static bool catchError()
+{
+    while(vm.frameCount > 0)
+    {
+        CallFrame* frame = &vm.frames[vm.frameCount - 1];
+        Chunk* chunk = &frame->function->chunk;
+
+        // ip has already moved past the opcode of the failed instruction (or the call in callers)
+        uint offset = (uint)(vm.ip - chunk->code - 1);
+
+        for(uint i = 0; i < chunk->handlerCount; i++)
+        {
+            ExceptionHandler* handler = &chunk->handlers[i];
+
+            if(offset >= handler->start && offset < handler->end)
+            {
+                closeScopes(frame, handler->scopeDepth);
+
+                // 'try' is a statement, only the loops and switches around it keep values on the stack
+                vm.stackTop = frame->slots + handler->stackDepth;
+                push(OBJ_VAL(copyString(vm.errorMessage, strlen(vm.errorMessage))));
+
+                vm.ip = chunk->code + handler->handler;
+                return true;
+            }
+        }
+
+        if(vm.frameCount == 1)
+        {
+            // The script's environment is freed with the VM
+            if(vm.currentCoroutine == NULL) break;
+
+            // Errors leave coroutines through whoever resumed them
+            finishCoroutine();
+            continue;
+        }
+
+        returnFromFrame(NULL_VAL);
+    }
+
+    reportRuntimeError();
+    return false;
+}
+
 static void callNative(Value callee, uint16_t line, uint8_t argCount)
 {
     NativeFn native = AS_NATIVE(callee);
@@ -137,42 +425,33 @@ static bool callValue(Value callee, uint8_t argCount, uint16_t line)
             case OBJ_BOUND_METHOD:
             {
                 ObjBoundMethod* bound = AS_BOUND_METHOD(callee);
-
-                bound->method->calledFromFunction = vm.currentFunction;
-                bound->method->calledFromIp = vm.ip;
-                bound->method->calledFromEnvironment = vm.currentEnvironment;
-
                 return call(bound->method, bound->instance, argCount, line);
             }
 
             case OBJ_FUNCTION:
             {
-                ObjFunction* function = AS_FUNCTION(callee);
-
-                function->calledFromFunction = vm.currentFunction;
-                function->calledFromIp = vm.ip;
-                function->calledFromEnvironment = vm.currentEnvironment;
-
-                return call(function, NULL, argCount, line);
+                return call(AS_FUNCTION(callee), NULL, argCount, line);
             }
 
             case OBJ_CLASS:
             {
                 ObjClass* klass = AS_CLASS(callee);
-                push(OBJ_VAL(newInstance(klass)));
+                ObjInstance* instance = newInstance(klass);
 
                 Value initializer;
                 if (tableGet(klass->methods, vm.initString,&initializer))
                 {
-                    ObjFunction* init = AS_FUNCTION(initializer);
-
-                    init->calledFromFunction = vm.currentFunction;
-                    init->calledFromIp = vm.ip;
-                    init->calledFromEnvironment = vm.currentEnvironment;
+                    // The initializer's OP_RETURN leaves the instance as the result
+                    return call(AS_FUNCTION(initializer), instance, argCount, line);
+                }
 
-                    return call(AS_FUNCTION(initializer), AS_INSTANCE(peek(0)),  argCount, line);
+                if (argCount != 0)
+                {
+                    runtimeError(line, "Expected 0 arguments but got %d.", argCount);
+                    return false;
                 }
 
+                push(OBJ_VAL(instance));
                 return true;
             }
 
@@ -222,13 +501,13 @@ static bool invokeFromClass(ObjInstance* instance, ObjString* name, uint8_t argC
         return true;
     }
 
-    ObjFunction* callee = AS_FUNCTION(method);
-
-    callee->calledFromFunction = vm.currentFunction;
-    callee->calledFromIp = vm.ip;
-    callee->calledFromEnvironment = vm.currentEnvironment;
+    // The receiver is reachable through 'this' from now on, so it's dropped and the arguments
+    // end up where a plain call would put them
+    Value* args = vm.stackTop - argCount;
+    memmove(args - 1, args, sizeof(Value) * argCount);
+    vm.stackTop--;
 
-    return call(callee, instance, argCount, line);
+    return call(AS_FUNCTION(method), instance, argCount, line);
 }
 
 static bool invoke(ObjString* name, int argCount, uint16_t line)
@@ -249,7 +528,31 @@ static bool invoke(ObjString* name, int argCount, uint16_t line)
 
 // region Run
 
-static int run()
+static void traceInstruction()
+{
+    if (vm.traceFunction != NULL)
+    {
+        const char* name = vm.currentFunction->name == NULL ? "script" : vm.currentFunction->name->chars;
+        if (strcmp(name, vm.traceFunction) != 0) return;
+    }
+
+    disassembleInstruction(&vm.currentFunction->chunk,
+    (int)(vm.ip - vm.currentFunction->chunk.code));
+
+    // Print the whole stack
+    printf("        |  ");
+    for (Value* slot = vm.stack; slot < vm.stackTop; slot++)
+    {
+        printf("[ ");
+        printValue(*slot);
+        printf(" ]");
+    }
+    putchar('\n');
+}
+
+// Always inlined with a constant 'trace', so run() and runTraced() get their own copy of the loop
+// and the one used normally doesn't check anything.
+static inline __attribute__((always_inline)) int execute(const bool trace)
 {
     uint16_t line;
 
@@ -259,40 +562,64 @@ static int run()
         (vm.ip += 2, (uint16_t)((vm.ip[-2] << 8) | vm.ip[-1]))
 
     #define READ_CONSTANT() (vm.currentFunction->chunk.constants.values[READ_BYTE()])
+    // Not wrapped in do-while, 'continue' in THROW() has to reach the dispatch loop
     #define BINARY_OP(valueType, op) \
-        do { \
+        { \
             if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) \
             { \
                 runtimeError(line, "Both operands must be numbers."); \
-                return INTERPRET_RUNTIME_ERROR; \
+                THROW(); \
             } \
             \
             double b = AS_NUMBER(pop()); \
             double a = AS_NUMBER(pop()); \
             push(valueType(a op b)); \
-        } while (false)
+        }
+
+    // Operators of value.h like numberModulo, which take numbers and return one
+    #define NUMBER_FUNCTION_OP(function) \
+        { \
+            if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) \
+            { \
+                runtimeError(line, "Both operands must be numbers."); \
+                THROW(); \
+            } \
+            \
+            double b = AS_NUMBER(pop()); \
+            double a = AS_NUMBER(pop()); \
+            push(NUMBER_VAL(function(a, b))); \
+        }
+
+    // Both operands are known to be numbers
+    #define NUMBER_OP(valueType, op) \
+        { \
+            double b = AS_NUMBER(pop()); \
+            double a = AS_NUMBER(pop()); \
+            push(valueType(a op b)); \
+        }
+
+    // Pops the switched on value, no matching case falls through to the next instruction
+    #define SWITCH_OP(findTarget) \
+        { \
+            SwitchTable* table = &vm.currentFunction->chunk.switches[READ_SHORT()]; \
+            uint target = findTarget(table, pop()); \
+            if (target != NO_SWITCH_TARGET) vm.ip = vm.currentFunction->chunk.code + target; \
+        }
 
     #define READ_STRING() AS_STRING(READ_CONSTANT())
 
+    // Continues at the handler if there is one, otherwise stops the script
+    #define THROW() \
+        { \
+            if (!catchError()) return INTERPRET_RUNTIME_ERROR; \
+            continue; \
+        }
+
     for (;;)
     {
         line = vm.currentFunction->chunk.lines[(int)(vm.ip - vm.currentFunction->chunk.code)];
 
-        #ifdef DEBUG_TRACE_EXECUTION
-        disassembleInstruction(&vm.currentFunction->chunk,
-        (int)(vm.ip - vm.currentFunction->chunk.code));
-
-        // Print the whole stack
-        printf("        |  ");
-        for (Value* slot = vm.stack; slot < vm.stackTop; slot++)
-        {
-            printf("[ ");
-            printValue(*slot);
-            printf(" ]");
-        }
-        putchar('\n');
-
-        #endif
+        if (trace) traceInstruction();
 
         switch (READ_BYTE())
         {
@@ -309,6 +636,7 @@ static int run()
             case OP_FALSE:  push(BOOL_VAL(false)); break;
 
             case OP_POP: pop(); break;
+            case OP_DUP: push(peek(0)); break;
 
             case OP_EQUAL:
             {
@@ -318,6 +646,13 @@ static int run()
                 break;
             }
 
+            case OP_PROFILE:
+            {
+                uint site = READ_SHORT();
+                recordFeedback(site, vm.ip);
+                break;
+            }
+
             case OP_SWITCH_EQUAL:
             {
                 Value b = pop();
@@ -344,7 +679,7 @@ static int run()
                 if (!IS_NUMBER(peek(0)))
                 {
                     runtimeError(line, "Operand must be a number.");
-                    return INTERPRET_RUNTIME_ERROR;
+                    THROW();
                 }
                 push(NUMBER_VAL(-AS_NUMBER(pop())));
                 break;
@@ -355,6 +690,16 @@ static int run()
                 break;
             }
 
+            case OP_ADD_LIKELY_NUMBERS:
+                if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1)))
+                {
+                    double b = AS_NUMBER(pop());
+                    double a = AS_NUMBER(pop());
+                    push(NUMBER_VAL(a + b));
+                    break;
+                }
+
+                // Falls through to the generic addition
             case OP_ADD:
             {
                 if (IS_STRING(peek(0)) || IS_STRING(peek(1)))
@@ -370,7 +715,7 @@ static int run()
                 else
                 {
                     runtimeError(line, "Operands must be either two numbers or two strings.");
-                    return INTERPRET_RUNTIME_ERROR;
+                    THROW();
                 }
                 break;
             }
@@ -379,12 +724,51 @@ static int run()
             case OP_MULTIPLY: BINARY_OP(NUMBER_VAL, *); break;
             case OP_DIVIDE:   BINARY_OP(NUMBER_VAL, /); break;
 
+            case OP_MODULO:      NUMBER_FUNCTION_OP(numberModulo);     break;
+            case OP_INT_DIVIDE:  NUMBER_FUNCTION_OP(numberIntDivide);  break;
+            case OP_BIT_AND:     NUMBER_FUNCTION_OP(numberBitAnd);     break;
+            case OP_BIT_OR:      NUMBER_FUNCTION_OP(numberBitOr);      break;
+            case OP_BIT_XOR:     NUMBER_FUNCTION_OP(numberBitXor);     break;
+            case OP_SHIFT_LEFT:  NUMBER_FUNCTION_OP(numberShiftLeft);  break;
+            case OP_SHIFT_RIGHT: NUMBER_FUNCTION_OP(numberShiftRight); break;
+
+            case OP_BIT_NOT:
+                if (!IS_NUMBER(peek(0)))
+                {
+                    runtimeError(line, "Operand must be a number.");
+                    THROW();
+                }
+                push(NUMBER_VAL(numberBitNot(AS_NUMBER(pop()))));
+                break;
+
+            case OP_NEGATE_NUMBER: push(NUMBER_VAL(-AS_NUMBER(pop()))); break;
+
+            case OP_ADD_NUMBERS:      NUMBER_OP(NUMBER_VAL, +); break;
+            case OP_SUBTRACT_NUMBERS: NUMBER_OP(NUMBER_VAL, -); break;
+            case OP_MULTIPLY_NUMBERS: NUMBER_OP(NUMBER_VAL, *); break;
+            case OP_DIVIDE_NUMBERS:   NUMBER_OP(NUMBER_VAL, /); break;
+
+            case OP_GREATER_NUMBERS:       NUMBER_OP(BOOL_VAL, >);  break;
+            case OP_GREATER_EQUAL_NUMBERS: NUMBER_OP(BOOL_VAL, >=); break;
+            case OP_LESS_NUMBERS:          NUMBER_OP(BOOL_VAL, <);  break;
+            case OP_LESS_EQUAL_NUMBERS:    NUMBER_OP(BOOL_VAL, <=); break;
+
+            // At least one of the operands is a string
+            case OP_CONCATENATE: concatenate(); break;
+
             case OP_DEFINE_VARIABLE:
             {
-                Value initializer = pop();
+                // Stays on the stack, storing it can grow the table and collect garbage
+                Value initializer = peek(0);
                 ObjString* name = READ_STRING();
 
-                environmentDefine(vm.currentEnvironment, name, initializer, line);
+                bool defined = environmentDefine(vm.currentEnvironment, name, initializer, line);
+                pop();
+
+                if(!defined)
+                {
+                    THROW();
+                }
 
                 break;
             }
@@ -392,11 +776,14 @@ static int run()
             case OP_DEFINE_ARGUMENT:
             {
                 ObjString* name = READ_STRING();
-                Value initializer = pop();
+                Value initializer = peek(0);
 
-                if(!environmentDefine(vm.currentEnvironment, name, initializer, line))
+                bool defined = environmentDefine(vm.currentEnvironment, name, initializer, line);
+                pop();
+
+                if(!defined)
                 {
-                    return INTERPRET_RUNTIME_ERROR;
+                    THROW();
                 }
 
                 break;
@@ -412,7 +799,7 @@ static int run()
                     if(!environmentGet(vm.nativeEnvironment, name, &value))
                     {
                         runtimeError(line, "Tried to get value of '%s', but it doesn't exist.", name->chars);
-                        return INTERPRET_RUNTIME_ERROR;
+                        THROW();
                     }
                 }
 
@@ -422,14 +809,43 @@ static int run()
 
             case OP_SET_VARIABLE:
             {
-                Value value = pop();
+                Value value = peek(0);
                 ObjString* name = READ_STRING();
 
-                if (!environmentSet(vm.currentEnvironment, name, value, line))
+                bool set = environmentSet(vm.currentEnvironment, name, value, line);
+                pop();
+
+                if (!set)
+                {
+                    THROW();
+                }
+
+                break;
+            }
+
+            // Looks the variable up once, instead of for OP_GET_VARIABLE and again for OP_SET_VARIABLE
+            case OP_UPDATE_VARIABLE:
+            {
+                ObjString* name = READ_STRING();
+                uint8_t op = READ_BYTE();
+                Value* variable = environmentGetSlot(vm.currentEnvironment, name);
+
+                if (variable == NULL)
                 {
-                    return INTERPRET_RUNTIME_ERROR;
+                    runtimeError(line, "Tried to get value of '%s', but it doesn't exist.", name->chars);
+                    THROW();
                 }
 
+                // Concatenating can collect garbage, which never resizes the variable's table
+                if (!applyUpdate(op, *variable, line)) THROW();
+
+                if (IS_FUNCTION(*variable))
+                {
+                    runtimeError(line, "Changing value of functions is illegal.");
+                    THROW();
+                }
+
+                *variable = pop();
                 break;
             }
 
@@ -439,7 +855,10 @@ static int run()
                 vm.currentClosure = vm.currentEnvironment;
                 function->closure = vm.currentClosure;
 
-                environmentDefine(vm.currentEnvironment, function->name, OBJ_VAL(function), line);
+                if(!environmentDefine(vm.currentEnvironment, function->name, OBJ_VAL(function), line))
+                {
+                    THROW();
+                }
 
                 break;
             }
@@ -448,7 +867,11 @@ static int run()
             {
                 ObjClass* klass = AS_CLASS(peek(0));
 
-                environmentDefine(vm.currentEnvironment, klass->name, OBJ_VAL(klass), line);
+                if(!environmentDefine(vm.currentEnvironment, klass->name, OBJ_VAL(klass), line))
+                {
+                    THROW();
+                }
+
                 break;
             }
 
@@ -459,7 +882,7 @@ static int run()
 
                 if (!invoke(method, argCount, line))
                 {
-                    return INTERPRET_RUNTIME_ERROR;
+                    THROW();
                 }
 
                 break;
@@ -472,30 +895,29 @@ static int run()
                 if(charsEqual(name->chars, "init", name->length, 4))
                 {
                     runtimeError(line, "Cannot call base initializer.");
-                    return INTERPRET_RUNTIME_ERROR;
+                    THROW();
                 }
 
-                Value instanceV = peek(0);
+                Value instanceV;
 
-                if(!IS_INSTANCE(instanceV))
+                if(!environmentGet(vm.currentEnvironment, vm.thisString, &instanceV) || !IS_INSTANCE(instanceV))
                 {
                     runtimeError(line, "Cannot use 'base' outside of a method.");
-                    return INTERPRET_RUNTIME_ERROR;
+                    THROW();
                 }
 
                 ObjInstance* instance = AS_INSTANCE(instanceV);
                 ObjClass* base = (ObjClass*) instance->klass->parent;
-                push(OBJ_VAL(base)); // Just to feed the pops and returns
 
                 if(base == NULL)
                 {
                     runtimeError(line, "Cannot use 'base' in a class that does not inherit from another.");
-                    return INTERPRET_RUNTIME_ERROR;
+                    THROW();
                 }
 
                 if (!bindMethod(base, instance, name, line))
                 {
-                    return INTERPRET_RUNTIME_ERROR;
+                    THROW();
                 }
                 break;
             }
@@ -505,7 +927,7 @@ static int run()
                 if (!IS_INSTANCE(peek(0)))
                 {
                     runtimeError(line, "Only instances have properties.");
-                    return INTERPRET_RUNTIME_ERROR;
+                    THROW();
                 }
 
                 ObjInstance* instance = AS_INSTANCE(peek(0));
@@ -517,7 +939,7 @@ static int run()
                 {
                     if (!bindMethod(instance->klass, instance, name, line))
                     {
-                        return INTERPRET_RUNTIME_ERROR;
+                        THROW();
                     }
                     break;
                 }
@@ -537,7 +959,7 @@ static int run()
                 if (!IS_INSTANCE(instanceVal))
                 {
                     runtimeError(line, "Only instances have fields.");
-                    return INTERPRET_RUNTIME_ERROR;
+                    THROW();
                 }
 
                 ObjInstance* instance = AS_INSTANCE(instanceVal);
@@ -547,6 +969,35 @@ static int run()
                 break;
             }
 
+            case OP_UPDATE_PROPERTY:
+            {
+                ObjString* name = READ_STRING();
+                uint8_t op = READ_BYTE();
+
+                if (!IS_INSTANCE(peek(1)))
+                {
+                    runtimeError(line, "Only instances have properties.");
+                    THROW();
+                }
+
+                Value* field = tableGetSlot(AS_INSTANCE(peek(1))->fields, name);
+
+                if (field == NULL)
+                {
+                    runtimeError(line, "Undefined property '%s'.", name->chars);
+                    THROW();
+                }
+
+                if (!applyUpdate(op, *field, line)) THROW();
+
+                *field = peek(0);
+
+                // The value takes the instance's place
+                vm.stackTop[-2] = vm.stackTop[-1];
+                pop();
+                break;
+            }
+
             case OP_SCOPE_START:
             {
                 Environment* enclosing = vm.currentEnvironment;
@@ -556,6 +1007,11 @@ static int run()
                 break;
             }
 
+            // The value on top of the stack was just created, only the variable defined next will refer to it
+            case OP_SCOPE_OWN:
+                if (IS_OBJ(peek(0))) environmentOwn(vm.currentEnvironment, AS_OBJ(peek(0)));
+                break;
+
             case OP_SCOPE_END:
             {
                 Environment* old = vm.currentEnvironment;
@@ -593,30 +1049,149 @@ static int run()
                 break;
             }
 
-            case OP_TERNARY:
+            case OP_POP_JUMP_IF_FALSE:
             {
-                Value elseBranch = pop();
-                Value thenBranch = pop();
-                Value condition = pop();
+                uint16_t offset = READ_SHORT();
+                if (isFalsey(pop())) vm.ip += offset;
+                break;
+            }
 
-                if(isFalsey(condition))
+            case OP_POP_JUMP_IF_TRUE:
+            {
+                uint16_t offset = READ_SHORT();
+                if (!isFalsey(pop())) vm.ip += offset;
+                break;
+            }
+
+            case OP_POP_LOOP_IF_TRUE:
+            {
+                uint16_t offset = READ_SHORT();
+                if (!isFalsey(pop())) vm.ip -= offset;
+                break;
+            }
+
+            // The iterated value and the index of the next item are on the stack
+            case OP_FOREACH_NEXT:
+            {
+                uint16_t offset = READ_SHORT();
+                Value iterated = peek(1);
+                uint index = (uint)AS_NUMBER(peek(0));
+
+                if (IS_LIST(iterated))
+                {
+                    ObjWList* list = AS_LIST(iterated);
+
+                    if (index >= list->count)
+                    {
+                        vm.ip += offset;
+                        break;
+                    }
+
+                    vm.stackTop[-1] = NUMBER_VAL(index + 1);
+                    push(list->items[index]);
+                }
+                else if (IS_STRING(iterated))
                 {
-                    push(elseBranch);
+                    ObjString* string = AS_STRING(iterated);
+
+                    if (index >= string->length)
+                    {
+                        vm.ip += offset;
+                        break;
+                    }
+
+                    vm.stackTop[-1] = NUMBER_VAL(index + 1);
+                    push(OBJ_VAL(getIndexString(string, index)));
                 }
                 else
                 {
-                    push(thenBranch);
+                    runtimeError(line, "Only lists and strings can be iterated over.");
+                    THROW();
+                }
+
+                break;
+            }
+
+            // The next value of the counter and the limit are on the stack
+            case OP_FOR_RANGE:
+            {
+                bool isRangeSyntax = READ_BYTE();
+                uint16_t offset = READ_SHORT();
+                Value counter = peek(1);
+                Value limit = peek(0);
+
+                if (!IS_NUMBER(counter) || !IS_NUMBER(limit))
+                {
+                    runtimeError(line, rangeBoundsError(isRangeSyntax));
+                    THROW();
+                }
+
+                if (!(AS_NUMBER(counter) < AS_NUMBER(limit)))
+                {
+                    vm.ip += offset;
+                    break;
                 }
 
+                vm.stackTop[-2] = NUMBER_VAL(AS_NUMBER(counter) + 1);
+                push(counter);
                 break;
             }
 
+            // A loop's slot is null until the code computing its value, which follows, runs once
+            case OP_GET_CACHED:
+            {
+                Value cached = vm.frames[vm.frameCount - 1].slots[READ_BYTE()];
+                uint16_t offset = READ_SHORT();
+
+                if (!IS_NULL(cached))
+                {
+                    push(cached);
+                    vm.ip += offset;
+                }
+
+                break;
+            }
+
+            case OP_SET_CACHED:
+            {
+                vm.frames[vm.frameCount - 1].slots[READ_BYTE()] = peek(0);
+                break;
+            }
+
+            // Keeps the product of a range's counter in step with the counter
+            case OP_STEP_CACHED:
+            {
+                Value* slot = &vm.frames[vm.frameCount - 1].slots[READ_BYTE()];
+                Value step = READ_CONSTANT();
+
+                if (IS_NULL(*slot)) break;
+
+                double next = AS_NUMBER(*slot) + AS_NUMBER(step);
+                *slot = fabs(next) < MAX_EXACT_INTEGER ? NUMBER_VAL(next) : NULL_VAL;
+                break;
+            }
+
+            case OP_GET_LOCAL:
+                push(vm.frames[vm.frameCount - 1].slots[READ_BYTE()]);
+                break;
+
+            case OP_SET_LOCAL:
+                vm.frames[vm.frameCount - 1].slots[READ_BYTE()] = pop();
+                break;
+
+            case OP_JUMP_TABLE:    SWITCH_OP(jumpTableTarget);    break;
+            case OP_SWITCH_STRING: SWITCH_OP(stringSwitchTarget); break;
+            case OP_SWITCH_SEARCH: SWITCH_OP(searchSwitchTarget); break;
+
             case OP_CALL:
             {
                 Value callee = pop();
                 uint8_t argCount = READ_BYTE();
 
-                callValue(callee, argCount, line);
+                if (!callValue(callee, argCount, line))
+                {
+                    THROW();
+                }
 
                 break;
             }
@@ -629,7 +1204,7 @@ static int run()
                 if (!IS_CLASS(base))
                 {
                     runtimeError(line, "Superclass must be a class.");
-                    return INTERPRET_RUNTIME_ERROR;
+                    THROW();
                 }
 
                 // Just for convenience.
@@ -647,6 +1222,23 @@ static int run()
                 defineMethod();
                 break;
 
+            case OP_BUILD_STRING:
+            {
+                uint8_t count = READ_BYTE();
+
+                // The parts stay on the stack until the string is interned
+                ObjString* string = joinValues(vm.stackTop - count, count);
+                if (string == NULL)
+                {
+                    runtimeError(line, "Only strings, numbers, booleans, null and functions can be interpolated.");
+                    THROW();
+                }
+
+                vm.stackTop -= count;
+                push(OBJ_VAL(string));
+                break;
+            }
+
             case OP_BUILD_LIST:
             {
                 ObjWList* list = newWList();
@@ -680,7 +1272,7 @@ static int run()
                 if(!IS_NUMBER(indexVal))
                 {
                     runtimeError(line, "Index must be a number.");
-                    return INTERPRET_RUNTIME_ERROR;
+                    THROW();
                 }
 
                 uint index = AS_NUMBER(indexVal);
@@ -694,7 +1286,7 @@ static int run()
                     if(!isValidWListIndex(list, index))
                     {
                         runtimeError(line, "'%d' is not a valid index of the indexed list.", index);
-                        return INTERPRET_RUNTIME_ERROR;
+                        THROW();
                     }
 
                     storeWList(AS_LIST(indexedValue), storedValue, index);
@@ -704,7 +1296,7 @@ static int run()
                     if(!IS_STRING(storedValue))
                     {
                         runtimeError(line, "String index can only store other strings.", index);
-                        return INTERPRET_RUNTIME_ERROR;
+                        THROW();
                     }
 
                     ObjString* string = AS_STRING(indexedValue);
@@ -713,13 +1305,13 @@ static int run()
                     if(!isValidStringIndex(string, index))
                     {
                         runtimeError(line, "'%d' is not a valid index of '%s'.", index, string->chars);
-                        return INTERPRET_RUNTIME_ERROR;
+                        THROW();
                     }
 
                     if(strlen(c) > 1)
                     {
                         runtimeError(line, "Cannot replace a string index with a string longer than 1 ('%s').", c);
-                        return INTERPRET_RUNTIME_ERROR;
+                        THROW();
                     }
 
                     replaceIndexString(string, index, *c);
@@ -727,7 +1319,7 @@ static int run()
                 else
                 {
                     runtimeError(line, "Cannot index this value type.");
-                    return INTERPRET_RUNTIME_ERROR;
+                    THROW();
                 }
 
                 break;
@@ -741,7 +1333,7 @@ static int run()
                 if(!IS_NUMBER(indexVal))
                 {
                     runtimeError(line, "Index must be a number.");
-                    return INTERPRET_RUNTIME_ERROR;
+                    THROW();
                 }
 
                 uint index = AS_NUMBER(indexVal);
@@ -753,7 +1345,7 @@ static int run()
                     if(!isValidWListIndex(list, index))
                     {
                         runtimeError(line, "'%d' is not a valid index of the indexed list.", index);
-                        return INTERPRET_RUNTIME_ERROR;
+                        THROW();
                     }
 
                     push(getIndexWList(list, index));
@@ -765,7 +1357,7 @@ static int run()
                     if(!isValidStringIndex(string, index))
                     {
                         runtimeError(line, "'%d' is not a valid index of '%s'.", index, string->chars);
-                        return INTERPRET_RUNTIME_ERROR;
+                        THROW();
                     }
 
                     push(OBJ_VAL(getIndexString(string, index)));
@@ -773,56 +1365,102 @@ static int run()
                 else
                 {
                     runtimeError(line, "Cannot index this value type.");
-                    return INTERPRET_RUNTIME_ERROR;
+                    THROW();
                 }
 
                 break;
             }
 
-            case OP_RETURN:
+            case OP_RESUME:
             {
+                Value value = pop();
+                Value coroutine = pop();
+
+                if(!resumeCoroutine(coroutine, value, line))
+                {
+                    THROW();
+                }
 
-                ObjFunction* oldFunction = vm.currentFunction;
+                break;
+            }
 
-                if(oldFunction->calledFromFunction == NULL)
+            case OP_YIELD:
+            {
+                if(!yieldCoroutine(pop(), line))
+                {
+                    THROW();
+                }
+
+                break;
+            }
+
+            case OP_RETURN:
+            {
+                if(vm.frameCount == 1 && vm.currentCoroutine == NULL)
                 {
-                    // printVariables(vm.currentEnvironment);
-                    // collectGarbage();
                     return INTERPRET_OK;
                 }
 
-                if(oldFunction->type == TYPE_METHOD)
+                Value result;
+
+                // Initializers don't push anything, they always return the instance
+                if(vm.currentFunction->type == TYPE_INITIALIZER)
                 {
-                    pop(); // Instance.
+                    tableGet(vm.frames[vm.frameCount - 1].environment->values, vm.thisString, &result);
+                }
+                else
+                {
+                    result = pop();
                 }
 
-                vm.currentFunction = oldFunction->calledFromFunction;
-                vm.ip = oldFunction->calledFromIp;
-                freeEnvironment(vm.currentEnvironment);
-                vm.currentEnvironment = oldFunction->calledFromEnvironment;
+                if(vm.frameCount == 1)
+                {
+                    finishCoroutine();
+                    push(result);
+                    break;
+                }
 
+                returnFromFrame(result);
                 break;
             }
         }
     }
 
+    #undef THROW
     #undef READ_SHORT
     #undef READ_STRING
     #undef BINARY_OP
+    #undef NUMBER_FUNCTION_OP
+    #undef NUMBER_OP
+    #undef SWITCH_OP
     #undef READ_CONSTANT
     #undef READ_BYTE
     #undef READ_BYTE_NO_INCREMENT
 }
 
+static int run()
+{
+    return execute(false);
+}
+
+static int runTraced()
+{
+    return execute(true);
+}
+
 // endregion
 
 // region Main
 
 void initVM()
 {
+    beginPhase("init", false);
+
     resetStack();
     vm.strings = ALLOCATE_TABLE();
     initTable(vm.strings);
+    vm.sourceStrings = ALLOCATE_TABLE();
+    initTable(vm.sourceStrings);
     vm.nativeEnvironment = newEnvironment();
     vm.currentClosure = vm.currentEnvironment;
 
@@ -833,6 +1471,13 @@ void initVM()
     vm.bytesAllocated = 0;
     vm.nextGC = 1024 * 1024;
 
+    #ifdef DEBUG_TRACE_EXECUTION
+    vm.trace = true;
+    #else
+    vm.trace = false;
+    #endif
+    vm.traceFunction = NULL;
+
     // NULLs are needed to make sure the garbage collector doesn't free them
     vm.initString = NULL;
     vm.initString = copyString("init", 4);
@@ -842,16 +1487,25 @@ void initVM()
     defineCore(vm.nativeEnvironment->values);
 
     vm.objects = NULL;
+
+    endPhase();
 }
 
 void freeVM()
 {
+    // Everything is freed below, collecting during that would touch freed environments
+    gcStarted = false;
+
     vm.initString = NULL;
     vm.thisString = NULL;
 
     freeEnvironmentsRecursively(vm.currentEnvironment);
     freeEnvironment(vm.nativeEnvironment);
+    freeEnvironmentPool();
     freeTable(vm.strings);
+    freeTable(vm.sourceStrings);
+    freeInlineCandidates();
+    freeProfile();
     freeObjects();
 }
 
@@ -863,18 +1517,43 @@ int interpret(const char* source)
         return INTERPRET_OK;
     }
 
+    // The parser scans as it goes, this pass shows the scanner's share and counts the tokens
+    if (timePhases)
+    {
+        beginPhase("scan", true);
+        uint tokens = countTokens(source);
+        endPhase();
+
+        setPhaseSource(scanner.line, tokens);
+    }
+
+    beginPhase("parse", true);
     Node* statements = compile(source);
+    endPhase();
+
     if (statements == NULL) return INTERPRET_COMPILE_ERROR;
 
+    beginPhase("emit", false);
     ObjFunction* function = emit(statements);
+    endPhase();
+
     if (function == NULL) return INTERPRET_COMPILE_ERROR;
 
     function->closure = NULL;
 
+    // The script's frame is always the bottom one
+    vm.frameCount = 0;
     call(function, NULL, 0, 0);
 
     gcStarted = true;
-    return run();
+
+    int (*dispatch)() = vm.trace ? runTraced : run;
+
+    beginPhase("run", false);
+    int result = dispatch();
+    endPhase();
+
+    return result;
 }
 
 // endregion
\ No newline at end of file
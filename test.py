@@ -8,6 +8,7 @@ from os import listdir
 from os.path import abspath, basename, dirname, isdir, isfile, join, realpath, relpath, splitext
 import re
 from subprocess import Popen, PIPE
+import os
 import sys
 
 # Runs the tests.
@@ -17,8 +18,8 @@ OUTPUT_EXPECT = re.compile(r'// Expect: ?(.*)')
 ERROR_EXPECT = re.compile(r'// (Error.*)')
 ERROR_LINE_EXPECT = re.compile(r'// \[((java|c) )?line (\d+)\] (Error.*)')
 RUNTIME_ERROR_EXPECT = re.compile(r'// Expected Runtime Error: (.+)')
-SYNTAX_ERROR_RE = re.compile(r'\[.*line (\d+)\] (Error.+)')
-STACK_TRACE_RE = re.compile(r'\[line (\d+)\]')
+SYNTAX_ERROR_RE = re.compile(r'\[.*line (\d+)\] (?:Parse |Emitter )?(Error.+)')
+RUNTIME_ERROR_RE = re.compile(r'\[line (\d+)\] Runtime Error : (.+)')
 NONTEST_RE = re.compile(r'// Ignore')
 
 passed = 0
@@ -29,10 +30,28 @@ expectations = 0
 interpreter = None
 filter_path = None
 
+# With --aot every test is translated to C with '--emit-c' and compiled against the library build.
+aot = False
+
+# With --jobs N the interpreter compiles top-level functions on N threads.
+jobs = None
+
+# These are passed on to the interpreter, so the tests can be run with an optimization turned off.
+OPTIONS = ['--no-inline', '--no-ir', '--no-tree-shaking']
+options = []
+AOT_LIBRARY = 'build/library-release/libWally.a'
+AOT_INCLUDES = ['include', 'include/data_structs', 'include/misc', 'include/debug', 'include/memory',
+                'include/scanner', 'include/parser', 'include/vm', 'include/emitter', 'include/std',
+                'include/preprocessor', 'include/aot']
+
 INTERPRETERS = {}
 C_SUITES = []
 
 
+def interpreter_options():
+    return options + (['--jobs', jobs] if jobs else [])
+
+
 class Interpreter:
     def __init__(self, name, language, args, tests):
         self.name = name
@@ -60,6 +79,7 @@ class Test:
         self.runtime_error_message = None
         self.exit_code = 0
         self.failures = []
+        self.skipped = False
 
 
     def parse(self):
@@ -143,11 +163,52 @@ class Test:
         else:
             args = ["./build/release/Wally", self.path]
 
+        args[1:1] = interpreter_options()
+
+        if aot:
+            args = self.compile_to_c(args[0])
+            if args is None: return
+
         proc = Popen(args, stdin=PIPE, stdout=PIPE, stderr=PIPE)
 
         out, err = proc.communicate()
         self.validate(proc.returncode, out, err)
 
+        if aot: os.remove(args[0])
+
+
+    def compile_to_c(self, wally):
+        source = splitext(self.path)[0] + '.aot.c'
+        binary = splitext(self.path)[0] + '.aot'
+
+        with open(source, 'w') as file:
+            proc = Popen([wally] + interpreter_options() + ['--emit-c', self.path], stdout=file, stderr=PIPE)
+            _, err = proc.communicate()
+
+        if proc.returncode != 0:
+            os.remove(source)
+
+            # Features the translator doesn't support are skipped, other errors have to match the interpreter.
+            if b'Emit C Error' in err:
+                self.skipped = True
+            else:
+                self.validate(proc.returncode, b'', err)
+            return None
+
+        args = ['cc', '-O2', source, '-o', binary, join(REPO_DIR, AOT_LIBRARY), '-lm', '-lpthread']
+        args.extend(['-I' + join(REPO_DIR, include) for include in AOT_INCLUDES])
+
+        proc = Popen(args, stdout=PIPE, stderr=PIPE)
+        _, err = proc.communicate()
+        os.remove(source)
+
+        if proc.returncode != 0:
+            self.fail('Failed to compile generated C:')
+            self.failures += err.decode("utf-8").split('\n')
+            return None
+
+        return [binary]
+
 
     def validate(self, exit_code, out, err):
         if self.compile_errors and self.runtime_error_message:
@@ -184,28 +245,19 @@ class Test:
         while SYNTAX_ERROR_RE.search(error_lines[line]):
             line += 1
 
-        if error_lines[line] != self.runtime_error_message:
+        # The error is reported as '[line N] Runtime Error : message'
+        match = RUNTIME_ERROR_RE.match(error_lines[line])
+
+        if not match or match.group(2) != self.runtime_error_message:
             self.fail('Expected runtime error "{0}" and got:',
                       self.runtime_error_message)
             self.fail(error_lines[line])
+            return
 
-        # Make sure the stack trace has the right line. Skip over any lines that
-        # come from builtin libraries.
-        match = False
-        stack_lines = error_lines[line + 1:]
-        for stack_line in stack_lines:
-            match = STACK_TRACE_RE.search(stack_line)
-            if match: break
-
-        if not match:
-            self.fail('Expected stack trace and got:')
-            for stack_line in stack_lines:
-                self.fail(stack_line)
-        else:
-            stack_line = int(match.group(1))
-            if stack_line != self.runtime_error_line:
-                self.fail('Expected runtime error on line {0} but was on line {1}.',
-                          self.runtime_error_line, stack_line)
+        error_line = int(match.group(1))
+        if error_line != self.runtime_error_line:
+            self.fail('Expected runtime error on line {0} but was on line {1}.',
+                      self.runtime_error_line, error_line)
 
 
     def validate_compile_errors(self, error_lines):
@@ -354,7 +406,9 @@ def run_script(path):
     test.run()
 
     # Display the results.
-    if len(test.failures) == 0:
+    if test.skipped:
+        num_skipped += 1
+    elif len(test.failures) == 0:
         passed += 1
     else:
         failed += 1
@@ -408,4 +462,10 @@ def run_suites(names):
         sys.exit(1)
 
 if __name__ == '__main__':
+    aot = '--aot' in sys.argv
+
+    if '--jobs' in sys.argv:
+        jobs = sys.argv[sys.argv.index('--jobs') + 1]
+
+    options = [option for option in OPTIONS if option in sys.argv]
     run_suites(C_SUITES)
\ No newline at end of file
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+
+# Measures how fast the compiler gets through large generated scripts, so regressions of the parser and the
+# emitter show up. Every script is run with '--time-phases', which reports lines and tokens per second.
+
+from __future__ import print_function
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+WALLY = './build/release-mingw/Wally.exe' if sys.platform == 'win32' else './build/release/Wally'
+NUM_TRIALS = 5
+
+# Number of groups in each script, a group is about 500 lines
+SIZES = [10, 40, 100]
+
+PHASE_RE = re.compile(r'^(\S+)\s+(\d+\.\d+)\s+\d+\s+\d+(?:\s+(\d+)\s+(\d+))?$', re.MULTILINE)
+FUNCTIONS_PER_GROUP = 10
+CLASSES_PER_GROUP = 2
+
+
+def function_source(name, seed):
+    return """    function {0}(n, text)
+    {{
+        var total = {1};
+        var parts = [];
+
+        for (var i = 0; i < n; i++)
+        {{
+            if (i % 3 == 0)
+            {{
+                total += i * {1} - (total ~/ 7);
+            }}
+            else if (i % 3 == 1)
+            {{
+                total -= i & 5;
+            }}
+            else
+            {{
+                total = total > 1000 ? total ~/ 2 : total * 2 + 1;
+            }}
+
+            parts = [total, i, text];
+        }}
+
+        var j = 0;
+        while (j < n)
+        {{
+            j++;
+
+            switch (j)
+            {{
+                case 1: total += 1;
+                case 2: total += 2;
+                default: total += 3;
+            }}
+        }}
+
+        foreach (var part in parts)
+        {{
+            total += part == text ? 1 : 0;
+        }}
+
+        return $"{{text}}:{{total}}";
+    }}
+""".format(name, seed)
+
+
+def class_source(name, seed):
+    return """    class {0}
+    {{
+        init(value)
+        {{
+            this.value = value;
+            this.count = {1};
+        }}
+
+        step(by)
+        {{
+            this.value += by;
+            this.count++;
+            return this.value * 2 + this.count;
+        }}
+
+        describe()
+        {{
+            var result = "";
+
+            for (var i = 0; i < 3; i++)
+            {{
+                result = result + this.step(i) + ",";
+            }}
+
+            return result;
+        }}
+    }}
+""".format(name, seed)
+
+
+# Top-level declarations are constants of the script, so the code is split into groups which each have their own
+def generate(groups):
+    lines = []
+
+    for group in range(groups):
+        lines.append('function group{0}()\n{{\n    var total = "";\n'.format(group))
+
+        for i in range(FUNCTIONS_PER_GROUP):
+            lines.append(function_source('f{0}'.format(i), group + i))
+
+        for i in range(CLASSES_PER_GROUP):
+            lines.append(class_source('C{0}'.format(i), group * i))
+
+        for i in range(FUNCTIONS_PER_GROUP):
+            lines.append('    total = total + f{0}(4, "g{1}");\n'.format(i, group))
+
+        for i in range(CLASSES_PER_GROUP):
+            lines.append('    total = total + C{0}({1}).describe();\n'.format(i, group))
+
+        lines.append('    return total;\n}\n\n')
+
+    for group in range(groups):
+        lines.append('group{0}();\n'.format(group))
+
+    return ''.join(lines)
+
+
+def run_trial(path, extra_args):
+    args = [WALLY, '--time-phases'] + extra_args + [path]
+    proc = subprocess.Popen(args, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True)
+    _, err = proc.communicate()
+
+    if proc.returncode != 0:
+        print(err)
+        return None
+
+    phases = {}
+
+    for match in PHASE_RE.finditer(err):
+        phases[match.group(1)] = float(match.group(2)) / 1000
+
+        # The ratio of the parse phase's two rates gives back how many tokens the script has
+        if match.group(1) == 'parse':
+            phases['tokens per line'] = float(match.group(4)) / float(match.group(3))
+
+    return phases
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure the compiler's throughput over generated scripts")
+    parser.add_argument('--jobs', help='Pass --jobs to the interpreter')
+    parser.add_argument('--keep', action='store_true', help='Keep the generated scripts')
+    args = parser.parse_args()
+
+    extra_args = ['--jobs', args.jobs] if args.jobs else []
+    directory = tempfile.mkdtemp()
+
+    print('{0:>8s} {1:>10s} {2:>14s} {3:>14s} {4:>14s} {5:>14s}'.format(
+        'lines', 'tokens', 'parse lines/s', 'parse tokens/s', 'emit lines/s', 'emit tokens/s'))
+
+    for groups in SIZES:
+        source = generate(groups)
+        path = os.path.join(directory, 'throughput_{0}.wally'.format(groups))
+
+        with open(path, 'w') as file:
+            file.write(source)
+
+        lines = source.count('\n') + 1
+        tokens = 0
+        parse = None
+        emit = None
+
+        for _ in range(NUM_TRIALS):
+            phases = run_trial(path, extra_args)
+            if phases is None: sys.exit(1)
+
+            # Bodies the VM compiles on their first call count as emitted too
+            emitted = phases.get('emit', 0) + phases.get('lazy-emit', 0)
+            tokens = int(round(lines * phases['tokens per line']))
+
+            parse = phases['parse'] if parse is None else min(parse, phases['parse'])
+            emit = emitted if emit is None else min(emit, emitted)
+
+        print('{0:8d} {1:10d} {2:14.0f} {3:14.0f} {4:14.0f} {5:14.0f}'.format(
+            lines, tokens, lines / parse, tokens / parse, lines / emit, tokens / emit))
+
+        if not args.keep: os.remove(path)
+
+    if not args.keep: os.rmdir(directory)
+
+
+main()